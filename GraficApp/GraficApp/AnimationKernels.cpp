@@ -0,0 +1,274 @@
+#include "AnimationKernels.h"
+#include "ImageKernels.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define ANIMATION_KERNELS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#else
+#define ANIMATION_KERNELS_X86 0
+#endif
+
+void InstanceAnimation::Resize(size_t count) {
+    x.resize(count, 0.0f);
+    y.resize(count, 0.0f);
+    z.resize(count, 0.0f);
+    speed.resize(count, 0.0f);
+    prevAngle.resize(count, 0.0f);
+    angle.resize(count, 0.0f);
+}
+
+void StepAnimation(InstanceAnimation& animation, float step) {
+    const float TwoPi = 6.283185307f;
+    for (size_t i = 0; i < animation.GetCount(); i++) {
+        animation.prevAngle[i] = animation.angle[i];
+        animation.angle[i] += animation.speed[i] * step;
+        if (animation.angle[i] > TwoPi) {
+            animation.angle[i] -= TwoPi;
+            animation.prevAngle[i] -= TwoPi;
+        }
+    }
+}
+
+namespace {
+    // Cephes sinf/cosf: reduction by pi/4 in three parts, then a minimax polynomial per octant.
+    // The AVX2 version below performs the same operations in the same order.
+    const float FourOverPi = 1.27323954473516f;
+    const float PiOver4Part1 = 0.78515625f;
+    const float PiOver4Part2 = 2.4187564849853515625e-4f;
+    const float PiOver4Part3 = 3.77489497744594108e-8f;
+    const float Cos0 = 2.443315711809948e-5f;
+    const float Cos1 = -1.388731625493765e-3f;
+    const float Cos2 = 4.166664568298827e-2f;
+    const float Sin0 = -1.9515295891e-4f;
+    const float Sin1 = 8.3321608736e-3f;
+    const float Sin2 = -1.6666654611e-1f;
+
+    void SinCosScalar(float angle, float& sine, float& cosine) {
+        uint32_t bits;
+        memcpy(&bits, &angle, sizeof(bits));
+        uint32_t sinSign = bits & 0x80000000u;
+        float x = fabsf(angle);
+
+        int octant = ((int)(x * FourOverPi) + 1) & ~1;
+        float y = (float)octant;
+        x = ((x - y * PiOver4Part1) - y * PiOver4Part2) - y * PiOver4Part3;
+
+        sinSign ^= (uint32_t)(octant & 4) << 29;
+        uint32_t cosSign = (uint32_t)(~(octant - 2) & 4) << 29;
+        bool sinPolynomial = (octant & 2) == 0;
+
+        float z = x * x;
+        float c = ((Cos0 * z + Cos1) * z + Cos2) * z * z - 0.5f * z + 1.0f;
+        float s = ((Sin0 * z + Sin1) * z + Sin2) * z * x + x;
+
+        float sinValue = sinPolynomial ? s : c;
+        float cosValue = sinPolynomial ? c : s;
+        memcpy(&bits, &sinValue, sizeof(bits));
+        bits ^= sinSign;
+        memcpy(&sine, &bits, sizeof(bits));
+        memcpy(&bits, &cosValue, sizeof(bits));
+        bits ^= cosSign;
+        memcpy(&cosine, &bits, sizeof(bits));
+    }
+
+    int32_t ToSnorm16(float value) {
+        return (int32_t)nearbyintf(value * 32767.0f);
+    }
+
+    void AnimateScalar(const InstanceAnimation& animation, size_t begin, size_t end, float alpha,
+        float* matrices, PackedInstance* packed) {
+        for (size_t i = begin; i < end; i++) {
+            float angle = animation.prevAngle[i] + (animation.angle[i] - animation.prevAngle[i]) * alpha;
+            float halfSin, halfCos;
+            SinCosScalar(angle * 0.5f, halfSin, halfCos);
+
+            if (matrices != nullptr) {
+                // Double angle identities, one sincos serves both outputs
+                float s = 2.0f * halfSin * halfCos;
+                float c = 1.0f - 2.0f * halfSin * halfSin;
+                float* m = matrices + i * 16;
+                m[0] = c;    m[1] = 0.0f; m[2] = -s;   m[3] = 0.0f;
+                m[4] = 0.0f; m[5] = 1.0f; m[6] = 0.0f; m[7] = 0.0f;
+                m[8] = s;    m[9] = 0.0f; m[10] = c;   m[11] = 0.0f;
+                m[12] = animation.x[i];
+                m[13] = animation.y[i];
+                m[14] = animation.z[i];
+                m[15] = 1.0f;
+            }
+            if (packed != nullptr) {
+                // Quaternion (0, sin(a / 2), 0, cos(a / 2)) with w >= 0 like PackInstance
+                if (halfCos < 0.0f) {
+                    halfSin = -halfSin;
+                    halfCos = -halfCos;
+                }
+                PackedInstance& instance = packed[i];
+                instance.position[0] = animation.x[i];
+                instance.position[1] = animation.y[i];
+                instance.position[2] = animation.z[i];
+                instance.scale = 1.0f;
+                instance.rotation[0] = (uint32_t)ToSnorm16(halfSin) << 16;
+                instance.rotation[1] = (uint32_t)ToSnorm16(halfCos) << 16;
+            }
+        }
+    }
+
+#if ANIMATION_KERNELS_X86
+    AVX2_TARGET void SinCosAVX2(__m256 angle, __m256& sine, __m256& cosine) {
+        const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32((int)0x80000000));
+        __m256 sinSign = _mm256_and_ps(angle, signMask);
+        __m256 x = _mm256_andnot_ps(signMask, angle);
+
+        __m256i octant = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(FourOverPi)));
+        octant = _mm256_and_si256(_mm256_add_epi32(octant, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+        __m256 y = _mm256_cvtepi32_ps(octant);
+        x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(PiOver4Part1)));
+        x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(PiOver4Part2)));
+        x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(PiOver4Part3)));
+
+        const __m256i four = _mm256_set1_epi32(4);
+        sinSign = _mm256_xor_ps(sinSign, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(octant, four), 29)));
+        __m256i cosBits = _mm256_andnot_si256(_mm256_sub_epi32(octant, _mm256_set1_epi32(2)), four);
+        __m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(cosBits, 29));
+        __m256 sinPolynomial = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(octant, _mm256_set1_epi32(2)), _mm256_setzero_si256()));
+
+        __m256 z = _mm256_mul_ps(x, x);
+        __m256 c = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(Cos0), z), _mm256_set1_ps(Cos1));
+        c = _mm256_add_ps(_mm256_mul_ps(c, z), _mm256_set1_ps(Cos2));
+        c = _mm256_mul_ps(_mm256_mul_ps(c, z), z);
+        c = _mm256_add_ps(_mm256_sub_ps(c, _mm256_mul_ps(_mm256_set1_ps(0.5f), z)), _mm256_set1_ps(1.0f));
+        __m256 s = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(Sin0), z), _mm256_set1_ps(Sin1));
+        s = _mm256_add_ps(_mm256_mul_ps(s, z), _mm256_set1_ps(Sin2));
+        s = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(s, z), x), x);
+
+        sine = _mm256_xor_ps(_mm256_blendv_ps(c, s, sinPolynomial), sinSign);
+        cosine = _mm256_xor_ps(_mm256_blendv_ps(s, c, sinPolynomial), cosSign);
+    }
+
+    // Returns how many values were done, the rest is left to the scalar path
+    AVX2_TARGET size_t SinCosAVX2(const float* angles, float* sines, float* cosines, size_t count) {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256 s, c;
+            SinCosAVX2(_mm256_loadu_ps(angles + i), s, c);
+            _mm256_storeu_ps(sines + i, s);
+            _mm256_storeu_ps(cosines + i, c);
+        }
+        return i;
+    }
+
+    AVX2_TARGET void StoreRows(float* m, __m128 row0, __m128 row2, __m128 row3) {
+        _mm_storeu_ps(m, row0);
+        _mm_storeu_ps(m + 4, _mm_setr_ps(0.0f, 1.0f, 0.0f, 0.0f));
+        _mm_storeu_ps(m + 8, row2);
+        _mm_storeu_ps(m + 12, row3);
+    }
+
+    AVX2_TARGET void AnimateAVX2(const InstanceAnimation& animation, size_t begin, size_t end, float alpha,
+        float* matrices, PackedInstance* packed) {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 two = _mm256_set1_ps(2.0f);
+        const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32((int)0x80000000));
+        const __m256 snormScale = _mm256_set1_ps(32767.0f);
+
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+            __m256 prevAngle = _mm256_loadu_ps(&animation.prevAngle[i]);
+            __m256 angle = _mm256_loadu_ps(&animation.angle[i]);
+            angle = _mm256_add_ps(prevAngle, _mm256_mul_ps(_mm256_sub_ps(angle, prevAngle), _mm256_set1_ps(alpha)));
+            __m256 halfSin, halfCos;
+            SinCosAVX2(_mm256_mul_ps(angle, _mm256_set1_ps(0.5f)), halfSin, halfCos);
+
+            __m256 x = _mm256_loadu_ps(&animation.x[i]);
+            __m256 y = _mm256_loadu_ps(&animation.y[i]);
+            __m256 z = _mm256_loadu_ps(&animation.z[i]);
+            // (x, y, z, 1) per instance, instances 0-3 in the low halves and 4-7 in the high ones
+            __m256 xz0 = _mm256_unpacklo_ps(x, z), xz1 = _mm256_unpackhi_ps(x, z);
+            __m256 y10 = _mm256_unpacklo_ps(y, one), y11 = _mm256_unpackhi_ps(y, one);
+            __m256 t[4] = {
+                _mm256_unpacklo_ps(xz0, y10), _mm256_unpackhi_ps(xz0, y10),
+                _mm256_unpacklo_ps(xz1, y11), _mm256_unpackhi_ps(xz1, y11)
+            };
+
+            if (matrices != nullptr) {
+                __m256 s = _mm256_mul_ps(_mm256_mul_ps(two, halfSin), halfCos);
+                __m256 c = _mm256_sub_ps(one, _mm256_mul_ps(_mm256_mul_ps(two, halfSin), halfSin));
+                __m256 minusS = _mm256_xor_ps(s, signMask);
+                // Rows (c, 0, -s, 0) and (s, 0, c, 0)
+                __m256 cs0 = _mm256_unpacklo_ps(c, minusS), cs1 = _mm256_unpackhi_ps(c, minusS);
+                __m256 sc0 = _mm256_unpacklo_ps(s, c), sc1 = _mm256_unpackhi_ps(s, c);
+                __m256 r0[4] = {
+                    _mm256_unpacklo_ps(cs0, zero), _mm256_unpackhi_ps(cs0, zero),
+                    _mm256_unpacklo_ps(cs1, zero), _mm256_unpackhi_ps(cs1, zero)
+                };
+                __m256 r2[4] = {
+                    _mm256_unpacklo_ps(sc0, zero), _mm256_unpackhi_ps(sc0, zero),
+                    _mm256_unpacklo_ps(sc1, zero), _mm256_unpackhi_ps(sc1, zero)
+                };
+                float* m = matrices + i * 16;
+                for (int k = 0; k < 4; k++) {
+                    StoreRows(m + k * 16, _mm256_castps256_ps128(r0[k]), _mm256_castps256_ps128(r2[k]), _mm256_castps256_ps128(t[k]));
+                    StoreRows(m + (k + 4) * 16, _mm256_extractf128_ps(r0[k], 1), _mm256_extractf128_ps(r2[k], 1), _mm256_extractf128_ps(t[k], 1));
+                }
+            }
+            if (packed != nullptr) {
+                __m256 flip = _mm256_and_ps(halfCos, signMask);
+                halfSin = _mm256_xor_ps(halfSin, flip);
+                halfCos = _mm256_xor_ps(halfCos, flip);
+                alignas(32) uint32_t rotation0[8], rotation1[8];
+                _mm256_store_si256((__m256i*)rotation0, _mm256_slli_epi32(_mm256_cvtps_epi32(_mm256_mul_ps(halfSin, snormScale)), 16));
+                _mm256_store_si256((__m256i*)rotation1, _mm256_slli_epi32(_mm256_cvtps_epi32(_mm256_mul_ps(halfCos, snormScale)), 16));
+                // position and scale are the (x, y, z, 1) vectors
+                for (int k = 0; k < 4; k++) {
+                    _mm_storeu_ps(packed[i + k].position, _mm256_castps256_ps128(t[k]));
+                    _mm_storeu_ps(packed[i + k + 4].position, _mm256_extractf128_ps(t[k], 1));
+                }
+                for (int k = 0; k < 8; k++) {
+                    packed[i + k].rotation[0] = rotation0[k];
+                    packed[i + k].rotation[1] = rotation1[k];
+                }
+            }
+        }
+        AnimateScalar(animation, i, end, alpha, matrices, packed);
+    }
+#endif
+
+    bool UseAVX2() {
+#if ANIMATION_KERNELS_X86
+        return GetImageKernelPath() == ImageKernelPath::AVX2;
+#else
+        return false;
+#endif
+    }
+}
+
+void SinCos(const float* angles, float* sines, float* cosines, size_t count) {
+    size_t i = 0;
+#if ANIMATION_KERNELS_X86
+    if (UseAVX2()) {
+        i = SinCosAVX2(angles, sines, cosines, count);
+    }
+#endif
+    for (; i < count; i++) {
+        SinCosScalar(angles[i], sines[i], cosines[i]);
+    }
+}
+
+void AnimateInstances(const InstanceAnimation& animation, size_t first, size_t count, float alpha,
+    float* matrices, PackedInstance* packed) {
+#if ANIMATION_KERNELS_X86
+    if (UseAVX2()) {
+        AnimateAVX2(animation, first, first + count, alpha, matrices, packed);
+        return;
+    }
+#endif
+    AnimateScalar(animation, first, first + count, alpha, matrices, packed);
+}
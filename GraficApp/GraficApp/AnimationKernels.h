@@ -0,0 +1,34 @@
+#pragma once
+
+#include "InstancePacking.h"
+
+#include <cstddef>
+#include <vector>
+
+// State of instances spinning about the Y axis, one array per field so eight instances
+// load with one instruction. The rendered angle is prevAngle + (angle - prevAngle) * alpha.
+struct InstanceAnimation {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> speed;
+    std::vector<float> prevAngle;
+    std::vector<float> angle;
+
+    void Resize(size_t count);
+    size_t GetCount() const { return angle.size(); };
+};
+
+// One fixed simulation step for every instance. prevAngle keeps the angle before the step and
+// both wrap together at 2 pi, so the interpolation between them never spans the wrap
+void StepAnimation(InstanceAnimation& animation, float step);
+
+// sin and cos of eight angles with the same polynomials in both paths
+void SinCos(const float* angles, float* sines, float* cosines, size_t count);
+
+// Writes the rotation-translation matrix of every instance in [first, first + count) without
+// a matrix multiply: row-major, for row vectors like XMMATRIX, 16 floats per instance.
+// packed gets position, scale and rotation in the GPU layout, material and texture ids are
+// left alone. Either output may be null. Uses AVX2 under the same switch as the image kernels.
+void AnimateInstances(const InstanceAnimation& animation, size_t first, size_t count, float alpha,
+    float* matrices, PackedInstance* packed);
@@ -0,0 +1,19 @@
+#include "BenchmarkLog.h"
+
+#include <fstream>
+
+bool BenchmarkLog::SaveCSV(const std::string& fileName) const {
+    std::ofstream file(fileName, std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file << "frame,time,cpu_ms,frame_ms,visible,draws,record_ms,execute_ms,contexts\n";
+    for (const BenchmarkFrame& frame : frames_) {
+        file << frame.frame << ',' << frame.time << ',' << frame.cpuMs << ',' << frame.frameMs << ','
+            << frame.visible << ',' << frame.draws << ',' << frame.recordMs << ',' << frame.executeMs << ','
+            << frame.contexts << '\n';
+    }
+
+    return file.good();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct BenchmarkFrame {
+    uint32_t frame;
+    float time;
+    double cpuMs;   // UpdateScene start to the last submitted draw
+    double frameMs; // between consecutive frames, includes Present
+    uint32_t visible;
+    uint32_t draws;
+    double recordMs;   // opaque pass recording, ParallelCommandRecorder::GetRecordMs
+    double executeMs;  // command list execution, 0 on the immediate context
+    uint32_t contexts; // deferred contexts used, 0 for the immediate context
+};
+
+// Collects per-frame rows in memory and writes them as CSV once the run is over
+class BenchmarkLog {
+public:
+    BenchmarkLog() = default;
+
+    void Reserve(size_t frameCount) { frames_.reserve(frameCount); };
+    void AddFrame(const BenchmarkFrame& frame) { frames_.push_back(frame); };
+    void Clear() { frames_.clear(); };
+
+    bool SaveCSV(const std::string& fileName) const;
+
+    size_t GetFrameCount() const { return frames_.size(); };
+
+    ~BenchmarkLog() = default;
+private:
+    std::vector<BenchmarkFrame> frames_;
+};
@@ -0,0 +1,916 @@
+#include "BlockCompression.h"
+#include "DdsHeader.h"
+#include "ImageKernels.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BLOCK_COMPRESSION_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#else
+#define BLOCK_COMPRESSION_X86 0
+#endif
+
+namespace {
+    // 16 pixel rows per task like ImageKernels
+    const uint32_t BlockRowsPerTask = 4;
+
+    bool UseAVX2() {
+        return GetImageKernelPath() == ImageKernelPath::AVX2;
+    }
+
+    // Pixels are handled as little-endian uint32 RGBA, red in the low byte
+    uint32_t PackPixel(uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+        return r | (g << 8) | (b << 16) | (a << 24);
+    }
+
+    void Expand565(uint32_t color, int rgb[3]) {
+        int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    uint32_t ReadUInt16(const uint8_t* data) {
+        return data[0] | ((uint32_t)data[1] << 8);
+    }
+
+    uint32_t ReadUInt32(const uint8_t* data) {
+        return data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+    }
+
+    // Three index bits per pixel in bytes 2..7 of a BC4 block
+    uint64_t ReadValueIndices(const uint8_t* block) {
+        uint64_t indices = 0;
+        for (int i = 5; i >= 0; i--) {
+            indices = (indices << 8) | block[2 + i];
+        }
+        return indices;
+    }
+
+    // BC1 color block; BC2 and BC3 always use four colors whatever the endpoint order
+    void GetColorPalette(const uint8_t* block, bool fourColors, uint32_t palette[4]) {
+        uint32_t c0 = ReadUInt16(block), c1 = ReadUInt16(block + 2);
+        int a[3], b[3];
+        Expand565(c0, a);
+        Expand565(c1, b);
+        palette[0] = PackPixel(a[0], a[1], a[2], 255);
+        palette[1] = PackPixel(b[0], b[1], b[2], 255);
+        if (fourColors || c0 > c1) {
+            palette[2] = PackPixel((2 * a[0] + b[0] + 1) / 3, (2 * a[1] + b[1] + 1) / 3, (2 * a[2] + b[2] + 1) / 3, 255);
+            palette[3] = PackPixel((a[0] + 2 * b[0] + 1) / 3, (a[1] + 2 * b[1] + 1) / 3, (a[2] + 2 * b[2] + 1) / 3, 255);
+        }
+        else {
+            palette[2] = PackPixel((a[0] + b[0] + 1) / 2, (a[1] + b[1] + 1) / 2, (a[2] + b[2] + 1) / 2, 255);
+            palette[3] = 0;
+        }
+    }
+
+    // BC4 block, also the alpha of BC3
+    void GetValuePalette(const uint8_t* block, uint8_t palette[8]) {
+        int e0 = block[0], e1 = block[1];
+        palette[0] = (uint8_t)e0;
+        palette[1] = (uint8_t)e1;
+        if (e0 > e1) {
+            for (int i = 1; i < 7; i++) {
+                palette[i + 1] = (uint8_t)(((7 - i) * e0 + i * e1 + 3) / 7);
+            }
+        }
+        else {
+            for (int i = 1; i < 5; i++) {
+                palette[i + 1] = (uint8_t)(((5 - i) * e0 + i * e1 + 2) / 5);
+            }
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    void LookupColorsScalar(const uint32_t palette[4], uint32_t indices, uint32_t* pixels) {
+        for (int i = 0; i < 16; i++) {
+            pixels[i] = palette[(indices >> (2 * i)) & 3];
+        }
+    }
+
+    // Replaces one channel of every pixel
+    void LookupValuesScalar(const uint8_t palette[8], uint64_t indices, int channel, uint32_t* pixels) {
+        uint32_t shift = channel * 8;
+        for (int i = 0; i < 16; i++) {
+            uint32_t value = palette[(indices >> (3 * i)) & 7];
+            pixels[i] = (pixels[i] & ~(0xFFu << shift)) | (value << shift);
+        }
+    }
+
+    // r * dir[0] + g * dir[1] + b * dir[2] of every pixel
+    void ProjectScalar(const uint32_t* pixels, const int dir[3], int dots[16]) {
+        for (int i = 0; i < 16; i++) {
+            uint32_t p = pixels[i];
+            dots[i] = (int)(p & 0xFF) * dir[0] + (int)((p >> 8) & 0xFF) * dir[1] + (int)((p >> 16) & 0xFF) * dir[2];
+        }
+    }
+
+#if BLOCK_COMPRESSION_X86
+    // The palette is one 16 byte register, each pixel shuffles in its four bytes
+    AVX2_TARGET void LookupColorsAVX2(const uint32_t palette[4], uint32_t indices, uint32_t* pixels) {
+        __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)palette));
+        __m256i shifts = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+        __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12,
+            0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12);
+        __m256i bytes = _mm256_set1_epi32(0x03020100);
+        for (int half = 0; half < 2; half++) {
+            __m256i index = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32((int)(indices >> (16 * half))), shifts),
+                _mm256_set1_epi32(3));
+            __m256i mask = _mm256_add_epi8(_mm256_shuffle_epi8(_mm256_slli_epi32(index, 2), spread), bytes);
+            _mm256_storeu_si256((__m256i*)(pixels + 8 * half), _mm256_shuffle_epi8(table, mask));
+        }
+    }
+
+    AVX2_TARGET void LookupValuesAVX2(const uint8_t palette[8], uint64_t indices, int channel, uint32_t* pixels) {
+        __m256i table = _mm256_broadcastsi128_si256(_mm_loadl_epi64((const __m128i*)palette));
+        __m256i shifts = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+        __m128i shift = _mm_cvtsi32_si128(channel * 8);
+        __m256i keep = _mm256_set1_epi32((int)~(0xFFu << (channel * 8)));
+        for (int half = 0; half < 2; half++) {
+            __m256i index = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32((int)(indices >> (24 * half))), shifts),
+                _mm256_set1_epi32(7));
+            // Upper index bytes are zero and pick palette[0], masked off
+            __m256i values = _mm256_and_si256(_mm256_shuffle_epi8(table, index), _mm256_set1_epi32(0xFF));
+            __m256i* row = (__m256i*)(pixels + 8 * half);
+            __m256i merged = _mm256_or_si256(_mm256_and_si256(_mm256_loadu_si256(row), keep), _mm256_sll_epi32(values, shift));
+            _mm256_storeu_si256(row, merged);
+        }
+    }
+
+    // Red and blue share a 16 bit pair for one madd, green takes another
+    AVX2_TARGET void ProjectAVX2(const uint32_t* pixels, const int dir[3], int dots[16]) {
+        __m256i redBlue = _mm256_set1_epi32((int)(((uint32_t)dir[0] & 0xFFFF) | ((uint32_t)dir[2] << 16)));
+        __m256i green = _mm256_set1_epi32(dir[1] & 0xFFFF);
+        __m256i lowBytes = _mm256_set1_epi32(0x00FF00FF);
+        for (int half = 0; half < 2; half++) {
+            __m256i p = _mm256_loadu_si256((const __m256i*)(pixels + 8 * half));
+            __m256i rb = _mm256_madd_epi16(_mm256_and_si256(p, lowBytes), redBlue);
+            __m256i g = _mm256_madd_epi16(_mm256_and_si256(_mm256_srli_epi32(p, 8), _mm256_set1_epi32(0xFF)), green);
+            _mm256_storeu_si256((__m256i*)(dots + 8 * half), _mm256_add_epi32(rb, g));
+        }
+    }
+#else
+    void LookupColorsAVX2(const uint32_t palette[4], uint32_t indices, uint32_t* pixels) { LookupColorsScalar(palette, indices, pixels); }
+    void LookupValuesAVX2(const uint8_t palette[8], uint64_t indices, int channel, uint32_t* pixels) { LookupValuesScalar(palette, indices, channel, pixels); }
+    void ProjectAVX2(const uint32_t* pixels, const int dir[3], int dots[16]) { ProjectScalar(pixels, dir, dots); }
+#endif
+
+    void LookupColors(const uint32_t palette[4], uint32_t indices, uint32_t* pixels, bool avx2) {
+        avx2 ? LookupColorsAVX2(palette, indices, pixels) : LookupColorsScalar(palette, indices, pixels);
+    }
+
+    void LookupValues(const uint8_t* block, int channel, uint32_t* pixels, bool avx2) {
+        uint8_t palette[8];
+        GetValuePalette(block, palette);
+        uint64_t indices = ReadValueIndices(block);
+        avx2 ? LookupValuesAVX2(palette, indices, channel, pixels) : LookupValuesScalar(palette, indices, channel, pixels);
+    }
+
+    void Project(const uint32_t* pixels, const int dir[3], int dots[16], bool avx2) {
+        avx2 ? ProjectAVX2(pixels, dir, dots) : ProjectScalar(pixels, dir, dots);
+    }
+
+    // BC7 modes: subsets, partition bits, rotation bits, index selection bits, color bits,
+    // alpha bits, P-bits per endpoint, P-bits shared by a subset, index bits, second index bits
+    struct BC7Mode {
+        uint8_t subsets;
+        uint8_t partitionBits;
+        uint8_t rotationBits;
+        uint8_t selectionBits;
+        uint8_t colorBits;
+        uint8_t alphaBits;
+        uint8_t endpointPBits;
+        uint8_t sharedPBits;
+        uint8_t indexBits;
+        uint8_t secondIndexBits;
+    };
+
+    const BC7Mode BC7Modes[8] = {
+        { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+        { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+        { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+        { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+        { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+        { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+        { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+        { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 }
+    };
+
+    // Bit i is the subset of pixel i
+    constexpr uint16_t BC7Partitions2[64] = {
+        0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+        0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+        0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+        0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+        0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+        0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+        0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+        0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22
+    };
+
+    // Subset of each pixel
+    constexpr uint8_t BC7Partitions3[64][16] = {
+        { 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 1, 2, 2, 2, 2 },
+        { 0, 0, 0, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 2, 1 },
+        { 0, 0, 0, 0, 2, 0, 0, 1, 2, 2, 1, 1, 2, 2, 1, 1 },
+        { 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 1, 0, 1, 1, 1 },
+        { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2 },
+        { 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 2, 2 },
+        { 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1 },
+        { 0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1 },
+        { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2 },
+        { 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2 },
+        { 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2 },
+        { 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2 },
+        { 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2 },
+        { 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2 },
+        { 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2, 1, 2, 2, 2 },
+        { 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0, 2, 2, 2, 0 },
+        { 0, 0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2 },
+        { 0, 1, 1, 1, 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0 },
+        { 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2 },
+        { 0, 0, 2, 2, 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1 },
+        { 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2, 0, 2, 2, 2 },
+        { 0, 0, 0, 1, 0, 0, 0, 1, 2, 2, 2, 1, 2, 2, 2, 1 },
+        { 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2 },
+        { 0, 0, 0, 0, 1, 1, 0, 0, 2, 2, 1, 0, 2, 2, 1, 0 },
+        { 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1, 0, 0, 0, 0 },
+        { 0, 0, 1, 2, 0, 0, 1, 2, 1, 1, 2, 2, 2, 2, 2, 2 },
+        { 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1, 0, 1, 1, 0 },
+        { 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1 },
+        { 0, 0, 2, 2, 1, 1, 0, 2, 1, 1, 0, 2, 0, 0, 2, 2 },
+        { 0, 1, 1, 0, 0, 1, 1, 0, 2, 0, 0, 2, 2, 2, 2, 2 },
+        { 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1 },
+        { 0, 0, 0, 0, 2, 0, 0, 0, 2, 2, 1, 1, 2, 2, 2, 1 },
+        { 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 2, 2, 2 },
+        { 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 2, 0, 0, 1, 1 },
+        { 0, 0, 1, 1, 0, 0, 1, 2, 0, 0, 2, 2, 0, 2, 2, 2 },
+        { 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0 },
+        { 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0 },
+        { 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0 },
+        { 0, 1, 2, 0, 2, 0, 1, 2, 1, 2, 0, 1, 0, 1, 2, 0 },
+        { 0, 0, 1, 1, 2, 2, 0, 0, 1, 1, 2, 2, 0, 0, 1, 1 },
+        { 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0, 1, 1 },
+        { 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2 },
+        { 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1 },
+        { 0, 0, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2, 1, 1, 2, 2 },
+        { 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 1, 1 },
+        { 0, 2, 2, 0, 1, 2, 2, 1, 0, 2, 2, 0, 1, 2, 2, 1 },
+        { 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 0, 1, 0, 1 },
+        { 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1 },
+        { 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2 },
+        { 0, 2, 2, 2, 0, 1, 1, 1, 0, 2, 2, 2, 0, 1, 1, 1 },
+        { 0, 0, 0, 2, 1, 1, 1, 2, 0, 0, 0, 2, 1, 1, 1, 2 },
+        { 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2 },
+        { 0, 2, 2, 2, 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2 },
+        { 0, 0, 0, 2, 1, 1, 1, 2, 1, 1, 1, 2, 0, 0, 0, 2 },
+        { 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2 },
+        { 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2 },
+        { 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2, 2, 2, 2, 2 },
+        { 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2 },
+        { 0, 0, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2 },
+        { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2 },
+        { 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 1 },
+        { 0, 2, 2, 2, 1, 2, 2, 2, 0, 2, 2, 2, 1, 2, 2, 2 },
+        { 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2 },
+        { 0, 1, 1, 1, 2, 0, 1, 1, 2, 2, 0, 1, 2, 2, 2, 0 }
+    };
+
+    // Pixel of the second subset whose index is one bit shorter
+    constexpr uint8_t BC7Anchors2[64] = {
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+        15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+        15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+        6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15
+    };
+
+    constexpr uint8_t BC7Anchors3Second[64] = {
+        3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+        3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+        8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+        3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3
+    };
+
+    constexpr uint8_t BC7Anchors3Third[64] = {
+        15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+        15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+        15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+        15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8
+    };
+
+    // Anchors have to lie in their subsets, partitions start in subset 0
+    constexpr bool CheckBC7Partitions() {
+        for (int p = 0; p < 64; p++) {
+            if ((BC7Partitions2[p] & 1) != 0 || ((BC7Partitions2[p] >> BC7Anchors2[p]) & 1) != 1 ||
+                BC7Partitions3[p][0] != 0 || BC7Partitions3[p][BC7Anchors3Second[p]] != 1 ||
+                BC7Partitions3[p][BC7Anchors3Third[p]] != 2) {
+                return false;
+            }
+        }
+        return true;
+    }
+    static_assert(CheckBC7Partitions(), "BC7 partition and anchor tables disagree");
+
+    const uint8_t BC7Weights2[4] = { 0, 21, 43, 64 };
+    const uint8_t BC7Weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+    const uint8_t BC7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    const uint8_t* GetBC7Weights(int bits) {
+        return bits == 2 ? BC7Weights2 : (bits == 3 ? BC7Weights3 : BC7Weights4);
+    }
+
+    // 128 bits read from the lowest bit up
+    class BlockBitReader {
+    public:
+        explicit BlockBitReader(const uint8_t* block) {
+            memcpy(&low_, block, 8);
+            memcpy(&high_, block + 8, 8);
+        }
+
+        uint32_t Read(uint32_t count) {
+            uint64_t value = position_ < 64 ? low_ >> position_ : high_ >> (position_ - 64);
+            if (position_ < 64 && position_ + count > 64) {
+                value |= high_ << (64 - position_);
+            }
+            position_ += count;
+            return (uint32_t)(value & ((1ull << count) - 1));
+        }
+    private:
+        uint64_t low_;
+        uint64_t high_;
+        uint32_t position_ = 0;
+    };
+
+    uint32_t ExpandBits(uint32_t value, uint32_t bits) {
+        value <<= 8 - bits;
+        return value | (value >> bits);
+    }
+
+    void DecodeBC7(const uint8_t* block, uint32_t* pixels) {
+        int mode = 0;
+        while (mode < 8 && (block[0] & (1 << mode)) == 0) {
+            mode++;
+        }
+        // Reserved mode, D3D decodes it to zeros
+        if (mode == 8) {
+            memset(pixels, 0, 16 * sizeof(uint32_t));
+            return;
+        }
+        const BC7Mode& info = BC7Modes[mode];
+        BlockBitReader reader(block);
+        reader.Read(mode + 1);
+        uint32_t partition = reader.Read(info.partitionBits);
+        uint32_t rotation = reader.Read(info.rotationBits);
+        uint32_t selection = reader.Read(info.selectionBits);
+
+        // [subset][endpoint][channel]
+        uint32_t endpoints[3][2][4] = {};
+        for (int c = 0; c < 3; c++) {
+            for (int s = 0; s < info.subsets; s++) {
+                endpoints[s][0][c] = reader.Read(info.colorBits);
+                endpoints[s][1][c] = reader.Read(info.colorBits);
+            }
+        }
+        for (int s = 0; s < info.subsets && info.alphaBits > 0; s++) {
+            endpoints[s][0][3] = reader.Read(info.alphaBits);
+            endpoints[s][1][3] = reader.Read(info.alphaBits);
+        }
+
+        uint32_t pBits[3][2] = {};
+        for (int s = 0; s < info.subsets; s++) {
+            if (info.endpointPBits) {
+                pBits[s][0] = reader.Read(1);
+                pBits[s][1] = reader.Read(1);
+            }
+            else if (info.sharedPBits) {
+                pBits[s][0] = pBits[s][1] = reader.Read(1);
+            }
+        }
+        uint32_t pBitCount = info.endpointPBits + info.sharedPBits;
+        for (int s = 0; s < info.subsets; s++) {
+            for (int e = 0; e < 2; e++) {
+                for (int c = 0; c < 4; c++) {
+                    uint32_t bits = c < 3 ? info.colorBits : info.alphaBits;
+                    if (bits == 0) {
+                        endpoints[s][e][c] = 255;
+                        continue;
+                    }
+                    uint32_t value = endpoints[s][e][c];
+                    if (pBitCount > 0) {
+                        value = (value << 1) | pBits[s][e];
+                        bits++;
+                    }
+                    endpoints[s][e][c] = ExpandBits(value, bits);
+                }
+            }
+        }
+
+        uint32_t subsetOf[16];
+        for (int i = 0; i < 16; i++) {
+            subsetOf[i] = info.subsets == 1 ? 0 : (info.subsets == 2 ? (BC7Partitions2[partition] >> i) & 1 :
+                BC7Partitions3[partition][i]);
+        }
+        auto isAnchor = [&](int i) {
+            if (i == 0) {
+                return true;
+            }
+            if (info.subsets == 2) {
+                return i == BC7Anchors2[partition];
+            }
+            return info.subsets == 3 && (i == BC7Anchors3Second[partition] || i == BC7Anchors3Third[partition]);
+        };
+        uint32_t indices[16], secondIndices[16] = {};
+        for (int i = 0; i < 16; i++) {
+            indices[i] = reader.Read(info.indexBits - (isAnchor(i) ? 1 : 0));
+        }
+        for (int i = 0; i < 16 && info.secondIndexBits > 0; i++) {
+            secondIndices[i] = reader.Read(info.secondIndexBits - (i == 0 ? 1 : 0));
+        }
+
+        // Mode 4 selection swaps which index set drives color and which alpha
+        int colorBits = info.indexBits, alphaBits = info.secondIndexBits > 0 ? info.secondIndexBits : info.indexBits;
+        if (selection) {
+            colorBits = info.secondIndexBits;
+            alphaBits = info.indexBits;
+        }
+        const uint8_t* colorWeights = GetBC7Weights(colorBits);
+        const uint8_t* alphaWeights = GetBC7Weights(alphaBits);
+        for (int i = 0; i < 16; i++) {
+            const uint32_t(*e)[4] = endpoints[subsetOf[i]];
+            uint32_t colorIndex = indices[i], alphaIndex = info.secondIndexBits > 0 ? secondIndices[i] : indices[i];
+            if (selection) {
+                colorIndex = secondIndices[i];
+                alphaIndex = indices[i];
+            }
+            uint32_t channels[4];
+            for (int c = 0; c < 4; c++) {
+                uint32_t w = c < 3 ? colorWeights[colorIndex] : alphaWeights[alphaIndex];
+                channels[c] = ((64 - w) * e[0][c] + w * e[1][c] + 32) >> 6;
+            }
+            if (rotation > 0) {
+                uint32_t swap = channels[3];
+                channels[3] = channels[rotation - 1];
+                channels[rotation - 1] = swap;
+            }
+            pixels[i] = PackPixel(channels[0], channels[1], channels[2], channels[3]);
+        }
+    }
+
+    void DecodeBlockPixels(uint32_t format, const uint8_t* block, uint32_t* pixels, bool avx2) {
+        uint32_t palette[4];
+        switch (format) {
+        case DdsFormatBC1:
+        case DdsFormatBC1Srgb:
+            GetColorPalette(block, false, palette);
+            LookupColors(palette, ReadUInt32(block + 4), pixels, avx2);
+            break;
+        case DdsFormatBC2:
+        case DdsFormatBC2Srgb:
+            GetColorPalette(block + 8, true, palette);
+            LookupColors(palette, ReadUInt32(block + 12), pixels, avx2);
+            for (int i = 0; i < 16; i++) {
+                uint32_t alpha = (block[i / 2] >> (4 * (i & 1))) & 15;
+                pixels[i] = (pixels[i] & 0x00FFFFFF) | ((alpha * 17) << 24);
+            }
+            break;
+        case DdsFormatBC3:
+        case DdsFormatBC3Srgb:
+            GetColorPalette(block + 8, true, palette);
+            LookupColors(palette, ReadUInt32(block + 12), pixels, avx2);
+            LookupValues(block, 3, pixels, avx2);
+            break;
+        case DdsFormatBC4:
+            for (int i = 0; i < 16; i++) {
+                pixels[i] = 0xFF000000;
+            }
+            LookupValues(block, 0, pixels, avx2);
+            break;
+        case DdsFormatBC5:
+            for (int i = 0; i < 16; i++) {
+                pixels[i] = 0xFF000000;
+            }
+            LookupValues(block, 0, pixels, avx2);
+            LookupValues(block + 8, 1, pixels, avx2);
+            break;
+        case DdsFormatBC7:
+        case DdsFormatBC7Srgb:
+            DecodeBC7(block, pixels);
+            break;
+        default:
+            memset(pixels, 0, 16 * sizeof(uint32_t));
+            break;
+        }
+    }
+
+    int Channel(uint32_t pixel, int c) {
+        return (int)((pixel >> (8 * c)) & 0xFF);
+    }
+
+    int Quantize(float value, int maxCode) {
+        int code = (int)(value * maxCode / 255.0f + 0.5f);
+        return code < 0 ? 0 : (code > maxCode ? maxCode : code);
+    }
+
+    uint32_t To565(const float rgb[3]) {
+        return (Quantize(rgb[0], 31) << 11) | (Quantize(rgb[1], 63) << 5) | Quantize(rgb[2], 31);
+    }
+
+    // Nearest palette entry along the endpoint axis: four color order 0, 2, 3, 1, three color
+    // order 0, 2, 1 with 3 for transparent pixels. Returns the squared error of opaque pixels.
+    int ColorIndices(const uint32_t* pixels, const bool* transparent, uint32_t c0, uint32_t c1, bool fourColors,
+        uint32_t& indices, bool avx2) {
+        uint8_t block[4] = { (uint8_t)c0, (uint8_t)(c0 >> 8), (uint8_t)c1, (uint8_t)(c1 >> 8) };
+        uint32_t palette[4];
+        GetColorPalette(block, fourColors, palette);
+
+        int dir[3];
+        for (int c = 0; c < 3; c++) {
+            dir[c] = Channel(palette[0], c) - Channel(palette[1], c);
+        }
+        int dots[16];
+        Project(pixels, dir, dots, avx2);
+        int stops[4];
+        for (int i = 0; i < 4; i++) {
+            stops[i] = Channel(palette[i], 0) * dir[0] + Channel(palette[i], 1) * dir[1] + Channel(palette[i], 2) * dir[2];
+        }
+
+        indices = 0;
+        int error = 0;
+        for (int i = 0; i < 16; i++) {
+            uint32_t index;
+            if (transparent[i]) {
+                index = 3;
+            }
+            else if (fourColors) {
+                int d = 2 * dots[i];
+                index = d < stops[1] + stops[3] ? 1 : (d < stops[3] + stops[2] ? 3 : (d < stops[2] + stops[0] ? 2 : 0));
+            }
+            else {
+                int d = 2 * dots[i];
+                index = d < stops[1] + stops[2] ? 1 : (d < stops[2] + stops[0] ? 2 : 0);
+            }
+            indices |= index << (2 * i);
+            for (int c = 0; c < 3 && !transparent[i]; c++) {
+                int delta = Channel(pixels[i], c) - Channel(palette[index], c);
+                error += delta * delta;
+            }
+        }
+        return error;
+    }
+
+    // Ends of the principal axis through the opaque pixels, pulled in by 1/16 of the range
+    bool FindColorEndpoints(const uint32_t* pixels, const bool* transparent, float e0[3], float e1[3]) {
+        float mean[3] = {};
+        int count = 0;
+        for (int i = 0; i < 16; i++) {
+            if (transparent[i]) {
+                continue;
+            }
+            count++;
+            for (int c = 0; c < 3; c++) {
+                mean[c] += (float)Channel(pixels[i], c);
+            }
+        }
+        if (count == 0) {
+            return false;
+        }
+        float cov[6] = {};
+        for (int c = 0; c < 3; c++) {
+            mean[c] /= count;
+        }
+        for (int i = 0; i < 16; i++) {
+            if (transparent[i]) {
+                continue;
+            }
+            float d[3] = { Channel(pixels[i], 0) - mean[0], Channel(pixels[i], 1) - mean[1], Channel(pixels[i], 2) - mean[2] };
+            cov[0] += d[0] * d[0];
+            cov[1] += d[0] * d[1];
+            cov[2] += d[0] * d[2];
+            cov[3] += d[1] * d[1];
+            cov[4] += d[1] * d[2];
+            cov[5] += d[2] * d[2];
+        }
+
+        // Power iteration from the covariance column of the widest channel, the bounding box
+        // diagonal would miss axes like red rising while blue falls
+        int widest = cov[0] >= cov[3] && cov[0] >= cov[5] ? 0 : (cov[3] >= cov[5] ? 1 : 2);
+        const int column[3][3] = { { 0, 1, 2 }, { 1, 3, 4 }, { 2, 4, 5 } };
+        float axis[3] = { cov[column[widest][0]], cov[column[widest][1]], cov[column[widest][2]] };
+        for (int iteration = 0; iteration < 4; iteration++) {
+            float next[3] = {
+                cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]
+            };
+            float length = fabsf(next[0]) > fabsf(next[1]) ? fabsf(next[0]) : fabsf(next[1]);
+            length = fabsf(next[2]) > length ? fabsf(next[2]) : length;
+            if (length < 1e-6f) {
+                break;
+            }
+            for (int c = 0; c < 3; c++) {
+                axis[c] = next[c] / length;
+            }
+        }
+
+        float low = 1e30f, high = -1e30f;
+        for (int i = 0; i < 16; i++) {
+            if (transparent[i]) {
+                continue;
+            }
+            float t = 0.0f;
+            for (int c = 0; c < 3; c++) {
+                t += (Channel(pixels[i], c) - mean[c]) * axis[c];
+            }
+            if (t < low) {
+                low = t;
+                for (int c = 0; c < 3; c++) {
+                    e1[c] = (float)Channel(pixels[i], c);
+                }
+            }
+            if (t > high) {
+                high = t;
+                for (int c = 0; c < 3; c++) {
+                    e0[c] = (float)Channel(pixels[i], c);
+                }
+            }
+        }
+        for (int c = 0; c < 3; c++) {
+            float inset = (e0[c] - e1[c]) / 16.0f;
+            e0[c] -= inset;
+            e1[c] += inset;
+        }
+        return true;
+    }
+
+    // Least squares endpoints for fixed four color indices
+    bool RefineColorEndpoints(const uint32_t* pixels, uint32_t indices, float e0[3], float e1[3]) {
+        static const float Weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f, ap[3] = {}, bp[3] = {};
+        for (int i = 0; i < 16; i++) {
+            float w = Weights[(indices >> (2 * i)) & 3];
+            aa += w * w;
+            ab += w * (1.0f - w);
+            bb += (1.0f - w) * (1.0f - w);
+            for (int c = 0; c < 3; c++) {
+                ap[c] += w * Channel(pixels[i], c);
+                bp[c] += (1.0f - w) * Channel(pixels[i], c);
+            }
+        }
+        float det = aa * bb - ab * ab;
+        if (fabsf(det) < 1e-6f) {
+            return false;
+        }
+        for (int c = 0; c < 3; c++) {
+            e0[c] = (ap[c] * bb - bp[c] * ab) / det;
+            e1[c] = (bp[c] * aa - ap[c] * ab) / det;
+        }
+        return true;
+    }
+
+    void WriteColorBlock(uint32_t c0, uint32_t c1, uint32_t indices, uint8_t* block) {
+        block[0] = (uint8_t)c0;
+        block[1] = (uint8_t)(c0 >> 8);
+        block[2] = (uint8_t)c1;
+        block[3] = (uint8_t)(c1 >> 8);
+        for (int i = 0; i < 4; i++) {
+            block[4 + i] = (uint8_t)(indices >> (8 * i));
+        }
+    }
+
+    // Endpoints for four colors need c0 > c1, swapping them swaps indices 0-1 and 2-3
+    void EncodeFourColors(const uint32_t* pixels, const bool* transparent, const float e0[3], const float e1[3],
+        uint32_t& bestC0, uint32_t& bestC1, uint32_t& bestIndices, int& bestError, bool avx2) {
+        uint32_t c0 = To565(e0), c1 = To565(e1);
+        if (c0 < c1) {
+            uint32_t swap = c0;
+            c0 = c1;
+            c1 = swap;
+        }
+        uint32_t indices = 0;
+        int error = ColorIndices(pixels, transparent, c0, c1, true, indices, avx2);
+        // Equal endpoints decode in three color mode, index 0 is the same color in both
+        if (c0 == c1) {
+            indices = 0;
+        }
+        if (error < bestError) {
+            bestError = error;
+            bestC0 = c0;
+            bestC1 = c1;
+            bestIndices = indices;
+        }
+    }
+
+    void EncodeColorBlock(const uint32_t* pixels, bool punchThrough, uint8_t* block, bool avx2) {
+        bool transparent[16];
+        bool anyTransparent = false;
+        for (int i = 0; i < 16; i++) {
+            transparent[i] = punchThrough && (pixels[i] >> 24) < 128;
+            anyTransparent = anyTransparent || transparent[i];
+        }
+        float e0[3], e1[3];
+        if (!FindColorEndpoints(pixels, transparent, e0, e1)) {
+            WriteColorBlock(0, 0, 0xFFFFFFFF, block);
+            return;
+        }
+
+        if (anyTransparent) {
+            // Three colors with transparent black need c0 <= c1
+            uint32_t c0 = To565(e0), c1 = To565(e1);
+            if (c0 > c1) {
+                uint32_t swap = c0;
+                c0 = c1;
+                c1 = swap;
+            }
+            uint32_t indices;
+            ColorIndices(pixels, transparent, c0, c1, false, indices, avx2);
+            WriteColorBlock(c0, c1, indices, block);
+            return;
+        }
+
+        uint32_t c0 = 0, c1 = 0, indices = 0;
+        int error = 0x7FFFFFFF;
+        EncodeFourColors(pixels, transparent, e0, e1, c0, c1, indices, error, avx2);
+        if (c0 != c1 && RefineColorEndpoints(pixels, indices, e0, e1)) {
+            EncodeFourColors(pixels, transparent, e0, e1, c0, c1, indices, error, avx2);
+        }
+        WriteColorBlock(c0, c1, indices, block);
+    }
+
+    // Eight value mode between the extremes, each value rounded to the nearest step
+    void EncodeValueBlock(const uint32_t* pixels, int channel, uint8_t* block) {
+        int values[16], low = 255, high = 0;
+        for (int i = 0; i < 16; i++) {
+            values[i] = Channel(pixels[i], channel);
+            low = values[i] < low ? values[i] : low;
+            high = values[i] > high ? values[i] : high;
+        }
+        block[0] = (uint8_t)high;
+        block[1] = (uint8_t)low;
+        uint64_t indices = 0;
+        int range = high - low;
+        for (int i = 0; i < 16 && range > 0; i++) {
+            int level = ((values[i] - low) * 14 + range) / (2 * range);
+            uint64_t index = level == 7 ? 0 : (level == 0 ? 1 : 8 - level);
+            indices |= index << (3 * i);
+        }
+        for (int i = 0; i < 6; i++) {
+            block[2 + i] = (uint8_t)(indices >> (8 * i));
+        }
+    }
+
+    void EncodeBlockPixels(uint32_t format, const uint32_t* pixels, uint8_t* block, bool avx2) {
+        switch (format) {
+        case DdsFormatBC1:
+        case DdsFormatBC1Srgb:
+            EncodeColorBlock(pixels, true, block, avx2);
+            break;
+        case DdsFormatBC3:
+        case DdsFormatBC3Srgb:
+            EncodeValueBlock(pixels, 3, block);
+            EncodeColorBlock(pixels, false, block + 8, avx2);
+            break;
+        case DdsFormatBC5:
+            EncodeValueBlock(pixels, 0, block);
+            EncodeValueBlock(pixels, 1, block + 8);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void ParallelBlockRows(uint32_t blocksY, const std::function<void(uint32_t)>& task) {
+        size_t count = (blocksY + BlockRowsPerTask - 1) / BlockRowsPerTask;
+        ThreadPool::GetInstance().ParallelFor(count, [&](size_t i) {
+            uint32_t y0 = (uint32_t)i * BlockRowsPerTask;
+            uint32_t y1 = y0 + BlockRowsPerTask < blocksY ? y0 + BlockRowsPerTask : blocksY;
+            for (uint32_t y = y0; y < y1; y++) {
+                task(y);
+            }
+        });
+    }
+}
+
+bool IsBlockDecodeSupported(uint32_t format) {
+    switch (format) {
+    case DdsFormatBC1:
+    case DdsFormatBC1Srgb:
+    case DdsFormatBC2:
+    case DdsFormatBC2Srgb:
+    case DdsFormatBC3:
+    case DdsFormatBC3Srgb:
+    case DdsFormatBC4:
+    case DdsFormatBC5:
+    case DdsFormatBC7:
+    case DdsFormatBC7Srgb:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool IsBlockEncodeSupported(uint32_t format) {
+    switch (format) {
+    case DdsFormatBC1:
+    case DdsFormatBC1Srgb:
+    case DdsFormatBC3:
+    case DdsFormatBC3Srgb:
+    case DdsFormatBC5:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void DecodeBlock(uint32_t format, const uint8_t* block, uint8_t* pixels) {
+    uint32_t decoded[16];
+    DecodeBlockPixels(format, block, decoded, UseAVX2());
+    memcpy(pixels, decoded, sizeof(decoded));
+}
+
+void EncodeBlock(uint32_t format, const uint8_t* pixels, uint8_t* block) {
+    uint32_t source[16];
+    memcpy(source, pixels, sizeof(source));
+    EncodeBlockPixels(format, source, block, UseAVX2());
+}
+
+bool DecodeImage(uint32_t format, const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* pixels) {
+    if (!IsBlockDecodeSupported(format) || width == 0 || height == 0) {
+        return false;
+    }
+    bool avx2 = UseAVX2();
+    uint32_t blocksX = (width + 3) / 4;
+    uint32_t blockBytes = GetDdsBlockBytes(format);
+    ParallelBlockRows((height + 3) / 4, [&](uint32_t by) {
+        uint32_t decoded[16];
+        for (uint32_t bx = 0; bx < blocksX; bx++) {
+            DecodeBlockPixels(format, blocks + ((size_t)by * blocksX + bx) * blockBytes, decoded, avx2);
+            uint32_t columns = width - bx * 4 < 4 ? width - bx * 4 : 4;
+            for (uint32_t y = 0; y < 4 && by * 4 + y < height; y++) {
+                memcpy(pixels + ((size_t)(by * 4 + y) * width + bx * 4) * 4, decoded + y * 4, columns * 4);
+            }
+        }
+    });
+    return true;
+}
+
+bool EncodeImage(uint32_t format, const uint8_t* pixels, uint32_t width, uint32_t height, uint8_t* blocks) {
+    if (!IsBlockEncodeSupported(format) || width == 0 || height == 0) {
+        return false;
+    }
+    bool avx2 = UseAVX2();
+    uint32_t blocksX = (width + 3) / 4;
+    uint32_t blockBytes = GetDdsBlockBytes(format);
+    ParallelBlockRows((height + 3) / 4, [&](uint32_t by) {
+        uint32_t source[16];
+        for (uint32_t bx = 0; bx < blocksX; bx++) {
+            for (uint32_t i = 0; i < 16; i++) {
+                uint32_t x = bx * 4 + (i & 3), y = by * 4 + i / 4;
+                x = x < width ? x : width - 1;
+                y = y < height ? y : height - 1;
+                memcpy(&source[i], pixels + ((size_t)y * width + x) * 4, 4);
+            }
+            EncodeBlockPixels(format, source, blocks + ((size_t)by * blocksX + bx) * blockBytes, avx2);
+        }
+    });
+    return true;
+}
+
+bool DecodeDdsImage(const uint8_t* file, size_t size, uint32_t slice, uint32_t mip, std::vector<uint8_t>& pixels,
+    uint32_t& width, uint32_t& height) {
+    DdsInfo info;
+    if (!ParseDdsHeader(file, size, size, info) || slice >= info.arraySize * info.faces || mip >= info.mipCount) {
+        return false;
+    }
+    width = GetDdsMipWidth(info, mip);
+    height = GetDdsMipHeight(info, mip);
+    pixels.resize((size_t)width * height * 4);
+    const uint8_t* data = file + GetDdsMipOffset(info, slice, mip);
+
+    switch (info.format) {
+    case DdsFormatRGBA8:
+    case DdsFormatRGBA8Srgb:
+        memcpy(pixels.data(), data, pixels.size());
+        return true;
+    case DdsFormatBGRA8:
+    case DdsFormatBGRA8Srgb:
+        for (size_t i = 0; i < pixels.size(); i += 4) {
+            pixels[i] = data[i + 2];
+            pixels[i + 1] = data[i + 1];
+            pixels[i + 2] = data[i];
+            pixels[i + 3] = data[i + 3];
+        }
+        return true;
+    default:
+        return DecodeImage(info.format, data, width, height, pixels.data());
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// CPU codecs for block compressed DDS content: textures for the software rasterizer,
+// thumbnails and offline compression. Pixels are tightly packed RGBA8 rows, blocks are
+// stored row by row as in a DDS mip, rows of blocks are split across ThreadPool. Palette
+// lookups and the encoder's projections have an AVX2 path that gives the same bytes as the
+// scalar one and is chosen by SetImageKernelPath; BC7 is scalar, its cost is the bit parsing.
+// Formats are DdsFormat values, sRGB variants are handled as the raw bytes.
+
+bool IsBlockDecodeSupported(uint32_t format);
+bool IsBlockEncodeSupported(uint32_t format);
+
+// One 4x4 block to 16 pixels in row order. BC4 and BC5 give (r, 0, 0, 255) and (r, g, 0, 255)
+// like D3D, the BC5 encoder ignores blue and alpha
+void DecodeBlock(uint32_t format, const uint8_t* block, uint8_t* pixels);
+// BC1 switches to the three color mode with transparent black when some alpha is below 128
+void EncodeBlock(uint32_t format, const uint8_t* pixels, uint8_t* block);
+
+// Sizes that are not multiples of 4 are cropped on decode and padded with the edge pixels on encode
+bool DecodeImage(uint32_t format, const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* pixels);
+bool EncodeImage(uint32_t format, const uint8_t* pixels, uint32_t width, uint32_t height, uint8_t* blocks);
+
+// One mip of one slice of a DDS file in memory, BC or 8 bit RGBA/BGRA
+bool DecodeDdsImage(const uint8_t* file, size_t size, uint32_t slice, uint32_t mip, std::vector<uint8_t>& pixels,
+    uint32_t& width, uint32_t& height);
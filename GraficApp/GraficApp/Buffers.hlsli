@@ -3,10 +3,19 @@
 #include "Constant.h"
 #include "LightCalc.hlsli"
 
+// Mirror of PackedInstance in InstancePacking.h
 struct GeomBuffer {
-    float4x4 worldMatrix;
-    float4x4 norm;
-    float4 shineSpeedTexIdNM;
+    float3 position;
+    float scale;
+    uint2 rotation;  // quaternion xyzw as snorm16, x and z in the low halves
+    uint material;   // shininess as half in the low 16 bits
+    uint textureIds; // textureRemap index in the low 16 bits, bit 16 enables the normal map
+};
+
+// Mirror of TextureRemap in TexturePacking.h, where a material texture sits in the packed array
+struct TextureRemap {
+    float4 scaleOffset;
+    uint4 slice;
 };
 
 cbuffer GeomBufferInst : register (b0) {
@@ -16,4 +25,32 @@ cbuffer GeomBufferInst : register (b0) {
 cbuffer SceneConstantBuffer : register (b1) {
     float4x4 viewProjectionMatrix;
     int4 indexBuffer[MAX_CUBE];
-};
\ No newline at end of file
+};
+
+cbuffer TextureRemapBuffer : register (b4) {
+    TextureRemap textureRemap[MAX_TEXTURE_REMAP];
+};
+
+// First instance of the drawn range, SV_InstanceID restarts at 0 for every draw
+cbuffer DrawRangeBuffer : register (b3) {
+    int4 firstInstance;
+};
+
+float4 UnpackRotation(uint2 packed) {
+    int4 q = int4(int(packed.x << 16), int(packed.x), int(packed.y << 16), int(packed.y)) >> 16;
+    return normalize(max(q / 32767.0, -1.0));
+}
+
+// q * v * q^-1 for a unit quaternion
+float3 RotateVector(float4 q, float3 v) {
+    float3 t = 2.0 * cross(q.xyz, v);
+    return v + q.w * t + cross(q.xyz, t);
+}
+
+float GetShininess(GeomBuffer instance) {
+    return f16tof32(instance.material);
+}
+
+TextureRemap GetTextureRemap(GeomBuffer instance) {
+    return textureRemap[instance.textureIds & 0xFFFF];
+}
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "CameraPath.h"
+
+#include <fstream>
+#include <sstream>
+
+using namespace DirectX;
+
+bool CameraPath::Load(const std::string& fileName, const std::string& name) {
+    std::ifstream file(fileName);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::vector<CameraKey> keys;
+    bool inPath = false;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream stream(line);
+        std::string token;
+        if (!(stream >> token) || token[0] == '#') {
+            continue;
+        }
+
+        if (token == "path") {
+            std::string pathName;
+            stream >> pathName;
+            if (inPath) {
+                break;
+            }
+            inPath = pathName == name;
+        }
+        else if (token == "key" && inPath) {
+            CameraKey key;
+            float yaw, pitch, roll;
+            if (!(stream >> key.time >> key.position.x >> key.position.y >> key.position.z >> yaw >> pitch >> roll)) {
+                return false;
+            }
+            if (!keys.empty() && key.time < keys.back().time) {
+                return false;
+            }
+            XMStoreFloat4(&key.orientation, XMQuaternionRotationRollPitchYaw(
+                XMConvertToRadians(pitch), XMConvertToRadians(yaw), XMConvertToRadians(roll)));
+            keys.push_back(key);
+        }
+    }
+
+    if (keys.empty()) {
+        return false;
+    }
+
+    keys_ = keys;
+    name_ = name;
+    return true;
+}
+
+void CameraPath::Evaluate(float time, XMFLOAT3& position, XMFLOAT4& orientation) const {
+    if (keys_.empty()) {
+        position = XMFLOAT3(0.0f, 0.0f, 0.0f);
+        orientation = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+        return;
+    }
+    if (time <= keys_.front().time || keys_.size() == 1) {
+        position = keys_.front().position;
+        orientation = keys_.front().orientation;
+        return;
+    }
+    if (time >= keys_.back().time) {
+        position = keys_.back().position;
+        orientation = keys_.back().orientation;
+        return;
+    }
+
+    size_t i = 1;
+    while (keys_[i].time <= time) {
+        i++;
+    }
+    size_t i1 = i - 1;
+    size_t i2 = i;
+    // End segments reuse the boundary key as the missing neighbour
+    size_t i0 = i1 > 0 ? i1 - 1 : i1;
+    size_t i3 = i2 + 1 < keys_.size() ? i2 + 1 : i2;
+
+    float span = keys_[i2].time - keys_[i1].time;
+    float s = span > 0.0f ? (time - keys_[i1].time) / span : 0.0f;
+
+    XMVECTOR p = XMVectorCatmullRom(XMLoadFloat3(&keys_[i0].position), XMLoadFloat3(&keys_[i1].position),
+        XMLoadFloat3(&keys_[i2].position), XMLoadFloat3(&keys_[i3].position), s);
+    XMVECTOR q = XMQuaternionSlerp(XMLoadFloat4(&keys_[i1].orientation), XMLoadFloat4(&keys_[i2].orientation), s);
+
+    XMStoreFloat3(&position, p);
+    XMStoreFloat4(&orientation, XMQuaternionNormalize(q));
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+// Keyframed camera path: Catmull-Rom through the positions, slerp between the orientations.
+//
+// Text format, one path per "path" block:
+//   # comment
+//   path <name>
+//   key <time> <x> <y> <z> <yaw> <pitch> <roll>
+// Angles are in degrees with the XMQuaternionRotationRollPitchYaw convention,
+// yaw 0 looks along +z, yaw 90 along +x.
+struct CameraKey {
+    float time;
+    DirectX::XMFLOAT3 position;
+    DirectX::XMFLOAT4 orientation;
+};
+
+class CameraPath {
+public:
+    CameraPath() = default;
+
+    // Loads the path with the given name from a path file, keys must be sorted by time
+    bool Load(const std::string& fileName, const std::string& name);
+    void SetKeys(const std::vector<CameraKey>& keys) { keys_ = keys; };
+
+    void Evaluate(float time, DirectX::XMFLOAT3& position, DirectX::XMFLOAT4& orientation) const;
+
+    bool IsEmpty() const { return keys_.empty(); };
+    float GetDuration() const { return keys_.empty() ? 0.0f : keys_.back().time; };
+    const std::string& GetName() const { return name_; };
+
+    ~CameraPath() = default;
+private:
+    std::vector<CameraKey> keys_;
+    std::string name_;
+};
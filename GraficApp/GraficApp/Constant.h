@@ -3,4 +3,5 @@
 #define SCREEN_NEAR 0.01f
 #define SCREEN_FAR 100.0f
 #define MAX_CUBE 30
-#define MAX_LIGHT 60
\ No newline at end of file
+#define MAX_LIGHT 60
+#define MAX_TEXTURE_REMAP 64
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include "D3D11CommandContexts.h"
+
+HRESULT D3D11CommandContexts::Init(ID3D11Device* pDevice, ID3D11DeviceContext* pImmediateContext, int contextCount) {
+    Release();
+    pImmediateContext_ = pImmediateContext;
+
+    D3D11_FEATURE_DATA_THREADING threading = {};
+    HRESULT result = pDevice->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading));
+    driverCommandLists_ = SUCCEEDED(result) && threading.DriverCommandLists;
+    if (!driverCommandLists_) {
+        return S_OK;
+    }
+
+    contextCount = contextCount < MaxContexts ? contextCount : MaxContexts;
+    for (int i = 0; i < contextCount && SUCCEEDED(result); i++) {
+        ID3D11DeviceContext* pContext = NULL;
+        result = pDevice->CreateDeferredContext(0, &pContext);
+        if (SUCCEEDED(result)) {
+            deferredContexts_.push_back(pContext);
+        }
+    }
+    commandLists_.resize(deferredContexts_.size(), NULL);
+
+    if (FAILED(result)) {
+        Release();
+    }
+    return result;
+}
+
+void D3D11CommandContexts::Release() {
+    for (ID3D11CommandList*& pCommandList : commandLists_) {
+        SAFE_RELEASE(pCommandList);
+    }
+    for (ID3D11DeviceContext*& pContext : deferredContexts_) {
+        SAFE_RELEASE(pContext);
+    }
+    commandLists_.clear();
+    deferredContexts_.clear();
+    pImmediateContext_ = NULL;
+}
+
+int D3D11CommandContexts::GetContextCount() const {
+    return IsDeferred() ? (int)deferredContexts_.size() : 1;
+}
+
+bool D3D11CommandContexts::Record(int context, const DrawRange& range) {
+    if (!IsDeferred()) {
+        draw_(pImmediateContext_, context, range);
+        return true;
+    }
+
+    ID3D11DeviceContext* pContext = deferredContexts_[context];
+    draw_(pContext, context, range);
+    SAFE_RELEASE(commandLists_[context]);
+    return SUCCEEDED(pContext->FinishCommandList(FALSE, &commandLists_[context]));
+}
+
+void D3D11CommandContexts::Execute(int context) {
+    if (!IsDeferred() || commandLists_[context] == NULL) {
+        return;
+    }
+
+    // Keeps the immediate state, later passes rely on what the opaque pass bound
+    pImmediateContext_->ExecuteCommandList(commandLists_[context], TRUE);
+    SAFE_RELEASE(commandLists_[context]);
+}
+
+D3D11CommandContexts::~D3D11CommandContexts() {
+    Release();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "framework.h"
+#include "ParallelCommandRecorder.h"
+
+#include <functional>
+#include <vector>
+
+// Deferred contexts that record into command lists. Without native driver command lists
+// the runtime emulates them on one thread, so the ranges are drawn on the immediate
+// context instead and GetContextCount() is 1.
+class D3D11CommandContexts : public ICommandContextSet {
+public:
+    static constexpr int MaxContexts = 8;
+
+    // Draws a range on the given context, must bind all the state it needs
+    using DrawFunction = std::function<void(ID3D11DeviceContext* pContext, int context, const DrawRange& range)>;
+
+    D3D11CommandContexts() = default;
+
+    D3D11CommandContexts(const D3D11CommandContexts&) = delete;
+    D3D11CommandContexts(D3D11CommandContexts&&) = delete;
+
+    HRESULT Init(ID3D11Device* pDevice, ID3D11DeviceContext* pImmediateContext, int contextCount);
+    void Release();
+
+    void SetDrawFunction(const DrawFunction& draw) { draw_ = draw; };
+    // false falls back to the immediate context even if deferred contexts exist
+    void SetDeferred(bool deferred) { deferred_ = deferred; };
+    bool IsDeferred() const { return deferred_ && !deferredContexts_.empty(); };
+    bool HasDriverCommandLists() const { return driverCommandLists_; };
+
+    int GetContextCount() const override;
+    bool Record(int context, const DrawRange& range) override;
+    void Execute(int context) override;
+
+    ~D3D11CommandContexts();
+private:
+    ID3D11DeviceContext* pImmediateContext_ = NULL;
+    std::vector<ID3D11DeviceContext*> deferredContexts_;
+    std::vector<ID3D11CommandList*> commandLists_;
+    DrawFunction draw_;
+    bool deferred_ = true;
+    bool driverCommandLists_ = false;
+};
@@ -0,0 +1,48 @@
+#include "D3D11FrameGraph.h"
+
+void D3D11FrameGraphBackend::BeginFrame(ID3D11DeviceContext* pDeviceContext) {
+    pDeviceContext_ = pDeviceContext;
+    handles_.clear();
+    imported_.clear();
+}
+
+void D3D11FrameGraphBackend::SetImported(int resource, const D3D11RenderTarget& target) {
+    if (resource >= (int)imported_.size()) {
+        imported_.resize(resource + 1);
+    }
+    imported_[resource] = target;
+}
+
+D3D11RenderTarget D3D11FrameGraphBackend::GetTarget(const FrameGraph& graph, int resource) const {
+    int physical = graph.GetPhysical(resource);
+    if (physical < 0) {
+        return resource < (int)imported_.size() ? imported_[resource] : D3D11RenderTarget();
+    }
+    if (physical >= (int)handles_.size() || handles_[physical] < 0) {
+        return D3D11RenderTarget();
+    }
+    return *static_cast<D3D11RenderTarget*>(pool_.GetResource(handles_[physical]));
+}
+
+bool D3D11FrameGraphBackend::Acquire(int physical, const RenderTargetDesc& desc) {
+    if (physical >= (int)handles_.size()) {
+        handles_.resize(physical + 1, -1);
+    }
+    handles_[physical] = pool_.Acquire(desc);
+    return handles_[physical] >= 0;
+}
+
+void D3D11FrameGraphBackend::Release(int physical) {
+    pool_.Release(handles_[physical]);
+    handles_[physical] = -1;
+}
+
+void D3D11FrameGraphBackend::Barrier(const FrameGraphBarrier& barrier) {
+    if (barrier.type == FrameGraphBarrierType::UnbindShaderResources) {
+        ID3D11ShaderResourceView* nullsrv[ShaderResourceSlots] = {};
+        pDeviceContext_->PSSetShaderResources(0, ShaderResourceSlots, nullsrv);
+    }
+    else {
+        pDeviceContext_->OMSetRenderTargets(0, nullptr, nullptr);
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "framework.h"
+#include "FrameGraph.h"
+#include "D3D11RenderTarget.h"
+
+#include <vector>
+
+// Physical frame graph resources are RenderTargetPool entries, imported ones are set by
+// the renderer every frame. Barriers clear the pixel shader slots or the output merger.
+class D3D11FrameGraphBackend : public IFrameGraphBackend {
+public:
+    static constexpr UINT ShaderResourceSlots = 8;
+
+    D3D11FrameGraphBackend(RenderTargetPool& pool) : pool_(pool) {};
+
+    D3D11FrameGraphBackend(const D3D11FrameGraphBackend&) = delete;
+    D3D11FrameGraphBackend(D3D11FrameGraphBackend&&) = delete;
+
+    // Forgets the previous frame, pool handles are freed by RenderTargetPool::BeginFrame
+    void BeginFrame(ID3D11DeviceContext* pDeviceContext);
+    void SetImported(int resource, const D3D11RenderTarget& target);
+    // Views of a resource of the compiled graph, valid while its pass runs
+    D3D11RenderTarget GetTarget(const FrameGraph& graph, int resource) const;
+
+    bool Acquire(int physical, const RenderTargetDesc& desc) override;
+    void Release(int physical) override;
+    void Barrier(const FrameGraphBarrier& barrier) override;
+
+    ~D3D11FrameGraphBackend() = default;
+private:
+    RenderTargetPool& pool_;
+    ID3D11DeviceContext* pDeviceContext_ = NULL;
+    std::vector<int> handles_;
+    std::vector<D3D11RenderTarget> imported_;
+};
@@ -0,0 +1,82 @@
+#include "D3D11QuerySource.h"
+
+HRESULT D3D11QuerySource::Init(ID3D11Device* pDevice, ID3D11DeviceContext* pDeviceContext, int slotCount, int timestampCount) {
+    Release();
+
+    pDeviceContext_ = pDeviceContext;
+    timestampCount_ = timestampCount;
+    disjointQueries_.assign(slotCount, NULL);
+    timestampQueries_.assign(slotCount * timestampCount, NULL);
+
+    HRESULT result = S_OK;
+    D3D11_QUERY_DESC desc = {};
+    desc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+    for (size_t i = 0; i < disjointQueries_.size() && SUCCEEDED(result); i++) {
+        result = pDevice->CreateQuery(&desc, &disjointQueries_[i]);
+    }
+
+    desc.Query = D3D11_QUERY_TIMESTAMP;
+    for (size_t i = 0; i < timestampQueries_.size() && SUCCEEDED(result); i++) {
+        result = pDevice->CreateQuery(&desc, &timestampQueries_[i]);
+    }
+
+    if (FAILED(result)) {
+        Release();
+    }
+
+    return result;
+}
+
+void D3D11QuerySource::Release() {
+    for (auto& query : disjointQueries_) {
+        SAFE_RELEASE(query);
+    }
+    for (auto& query : timestampQueries_) {
+        SAFE_RELEASE(query);
+    }
+    disjointQueries_.clear();
+    timestampQueries_.clear();
+    pDeviceContext_ = NULL;
+}
+
+void D3D11QuerySource::Begin(int slot) {
+    pDeviceContext_->Begin(disjointQueries_[slot]);
+}
+
+void D3D11QuerySource::Timestamp(int slot, int index) {
+    pDeviceContext_->End(timestampQueries_[slot * timestampCount_ + index]);
+}
+
+void D3D11QuerySource::End(int slot) {
+    pDeviceContext_->End(disjointQueries_[slot]);
+}
+
+QueryStatus D3D11QuerySource::Read(int slot, uint32_t timestampMask, uint64_t* timestamps, uint64_t& frequency) {
+    // DONOTFLUSH keeps GetData from submitting the command buffer early
+    D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+    if (pDeviceContext_->GetData(disjointQueries_[slot], &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) {
+        return QueryStatus::NotReady;
+    }
+
+    for (int i = 0; i < timestampCount_; i++) {
+        if ((timestampMask & (1u << i)) == 0) {
+            continue;
+        }
+        UINT64 value = 0;
+        if (pDeviceContext_->GetData(timestampQueries_[slot * timestampCount_ + i], &value, sizeof(value), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) {
+            return QueryStatus::NotReady;
+        }
+        timestamps[i] = value;
+    }
+
+    if (disjoint.Disjoint) {
+        return QueryStatus::Disjoint;
+    }
+
+    frequency = disjoint.Frequency;
+    return QueryStatus::Ready;
+}
+
+D3D11QuerySource::~D3D11QuerySource() {
+    Release();
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "framework.h"
+#include "QueryRing.h"
+
+#include <vector>
+
+// IQuerySource over D3D11 timestamp and timestamp-disjoint queries
+class D3D11QuerySource : public IQuerySource {
+public:
+    D3D11QuerySource() = default;
+
+    D3D11QuerySource(const D3D11QuerySource&) = delete;
+    D3D11QuerySource(D3D11QuerySource&&) = delete;
+
+    HRESULT Init(ID3D11Device* pDevice, ID3D11DeviceContext* pDeviceContext, int slotCount, int timestampCount);
+    void Release();
+
+    void Begin(int slot) override;
+    void Timestamp(int slot, int index) override;
+    void End(int slot) override;
+    QueryStatus Read(int slot, uint32_t timestampMask, uint64_t* timestamps, uint64_t& frequency) override;
+
+    ~D3D11QuerySource();
+private:
+    ID3D11DeviceContext* pDeviceContext_ = NULL;
+    std::vector<ID3D11Query*> disjointQueries_;
+    std::vector<ID3D11Query*> timestampQueries_;
+    int timestampCount_ = 0;
+};
@@ -0,0 +1,45 @@
+#include "D3D11RenderTarget.h"
+
+void* D3D11RenderTargetAllocator::Create(const RenderTargetDesc& desc) {
+    if (pDevice_ == NULL) {
+        return NULL;
+    }
+
+    D3D11_TEXTURE2D_DESC textureDesc = {};
+    textureDesc.Width = desc.width;
+    textureDesc.Height = desc.height;
+    textureDesc.MipLevels = 1;
+    textureDesc.ArraySize = 1;
+    textureDesc.Format = (DXGI_FORMAT)desc.format;
+    textureDesc.SampleDesc.Count = desc.samples;
+    textureDesc.SampleDesc.Quality = 0;
+    textureDesc.Usage = D3D11_USAGE_DEFAULT;
+    textureDesc.BindFlags = desc.bindFlags;
+
+    D3D11RenderTarget* target = new D3D11RenderTarget;
+    HRESULT result = pDevice_->CreateTexture2D(&textureDesc, NULL, &target->pTexture);
+    if (SUCCEEDED(result) && (desc.bindFlags & D3D11_BIND_RENDER_TARGET)) {
+        result = pDevice_->CreateRenderTargetView(target->pTexture, NULL, &target->pRenderTargetView);
+    }
+    if (SUCCEEDED(result) && (desc.bindFlags & D3D11_BIND_SHADER_RESOURCE)) {
+        result = pDevice_->CreateShaderResourceView(target->pTexture, NULL, &target->pShaderResourceView);
+    }
+    if (SUCCEEDED(result) && (desc.bindFlags & D3D11_BIND_DEPTH_STENCIL)) {
+        result = pDevice_->CreateDepthStencilView(target->pTexture, NULL, &target->pDepthStencilView);
+    }
+
+    if (FAILED(result)) {
+        Destroy(target);
+        return NULL;
+    }
+    return target;
+}
+
+void D3D11RenderTargetAllocator::Destroy(void* resource) {
+    D3D11RenderTarget* target = static_cast<D3D11RenderTarget*>(resource);
+    SAFE_RELEASE(target->pRenderTargetView);
+    SAFE_RELEASE(target->pShaderResourceView);
+    SAFE_RELEASE(target->pDepthStencilView);
+    SAFE_RELEASE(target->pTexture);
+    delete target;
+}
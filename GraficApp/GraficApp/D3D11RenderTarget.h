@@ -0,0 +1,34 @@
+#pragma once
+
+#include "framework.h"
+#include "RenderTargetPool.h"
+
+// Resource behind a pooled target, views exist for the requested bind flags only
+struct D3D11RenderTarget {
+    ID3D11Texture2D* pTexture = NULL;
+    ID3D11RenderTargetView* pRenderTargetView = NULL;
+    ID3D11ShaderResourceView* pShaderResourceView = NULL;
+    ID3D11DepthStencilView* pDepthStencilView = NULL;
+};
+
+inline RenderTargetDesc MakeRenderTargetDesc(UINT width, UINT height, DXGI_FORMAT format, UINT bindFlags, UINT samples = 1) {
+    RenderTargetDesc desc = { width, height, (uint32_t)format, bindFlags, samples };
+    return desc;
+}
+
+class D3D11RenderTargetAllocator : public IRenderTargetAllocator {
+public:
+    D3D11RenderTargetAllocator() = default;
+
+    D3D11RenderTargetAllocator(const D3D11RenderTargetAllocator&) = delete;
+    D3D11RenderTargetAllocator(D3D11RenderTargetAllocator&&) = delete;
+
+    void Init(ID3D11Device* pDevice) { pDevice_ = pDevice; };
+
+    void* Create(const RenderTargetDesc& desc) override;
+    void Destroy(void* resource) override;
+
+    ~D3D11RenderTargetAllocator() = default;
+private:
+    ID3D11Device* pDevice_ = NULL;
+};
@@ -0,0 +1,42 @@
+#include "D3D11ShaderCompiler.h"
+#include "D3DInclude.h"
+
+void* D3D11ShaderCompiler::Compile(const ShaderSource& source, const std::vector<const char*>& macros) {
+    if (pDevice_ == NULL) {
+        return NULL;
+    }
+
+    std::vector<D3D_SHADER_MACRO> defines;
+    for (const char* macro : macros) {
+        defines.push_back({ macro, "1" });
+    }
+    defines.push_back({ NULL, NULL });
+
+    ID3D10Blob* pixelShaderBuffer = nullptr;
+    ID3D10Blob* errorBuffer = nullptr;
+    int flags = 0;
+#ifdef _DEBUG
+    flags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+    // The compiler and the device are free threaded, the include handler is per call
+    D3DInclude includeObj;
+    std::wstring file(source.file.begin(), source.file.end());
+    ID3D11PixelShader* pPixelShader = NULL;
+    HRESULT result = D3DCompileFromFile(file.c_str(), defines.data(), &includeObj, source.entry.c_str(), source.target.c_str(),
+        flags, 0, &pixelShaderBuffer, &errorBuffer);
+    if (SUCCEEDED(result)) {
+        result = pDevice_->CreatePixelShader(pixelShaderBuffer->GetBufferPointer(), pixelShaderBuffer->GetBufferSize(), NULL, &pPixelShader);
+    }
+    else if (errorBuffer != nullptr) {
+        OutputDebugStringA((const char*)errorBuffer->GetBufferPointer());
+    }
+    SAFE_RELEASE(pixelShaderBuffer);
+    SAFE_RELEASE(errorBuffer);
+
+    return SUCCEEDED(result) ? pPixelShader : NULL;
+}
+
+void D3D11ShaderCompiler::Destroy(void* shader) {
+    ID3D11PixelShader* pPixelShader = static_cast<ID3D11PixelShader*>(shader);
+    SAFE_RELEASE(pPixelShader);
+}
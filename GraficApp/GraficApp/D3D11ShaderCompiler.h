@@ -0,0 +1,24 @@
+#pragma once
+
+#include "framework.h"
+#include "ShaderPermutations.h"
+
+// Compiles pixel shader variants for ShaderPermutations from the .hlsl files next to the
+// executable. Vertex shaders are not permuted, the renderer keeps their bytecode for the
+// input layouts. Compilation errors go to the debugger output.
+class D3D11ShaderCompiler : public IShaderCompiler {
+public:
+    D3D11ShaderCompiler() = default;
+
+    D3D11ShaderCompiler(const D3D11ShaderCompiler&) = delete;
+    D3D11ShaderCompiler(D3D11ShaderCompiler&&) = delete;
+
+    void Init(ID3D11Device* pDevice) { pDevice_ = pDevice; };
+
+    void* Compile(const ShaderSource& source, const std::vector<const char*>& macros) override;
+    void Destroy(void* shader) override;
+
+    ~D3D11ShaderCompiler() = default;
+private:
+    ID3D11Device* pDevice_ = NULL;
+};
@@ -0,0 +1,175 @@
+#include "D3D11TextureCache.h"
+
+#include <fstream>
+
+bool D3D11TextureLoader::ReadSources(const std::vector<std::wstring>& files, std::vector<DdsInfo>& sources) {
+    sources.clear();
+    for (const std::wstring& name : files) {
+        std::ifstream file(name, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) {
+            return false;
+        }
+        uint64_t fileSize = (uint64_t)file.tellg();
+        uint8_t header[DdsMaxHeaderSize] = {};
+        size_t headerSize = fileSize < DdsMaxHeaderSize ? (size_t)fileSize : DdsMaxHeaderSize;
+        file.seekg(0);
+        if (!file.read((char*)header, headerSize)) {
+            return false;
+        }
+
+        DdsInfo source;
+        if (!ParseDdsHeader(header, headerSize, fileSize, source) || source.arraySize * source.faces != 1) {
+            return false;
+        }
+        sources.push_back(source);
+    }
+    return !sources.empty();
+}
+
+int D3D11TextureLoader::Add(const std::vector<std::wstring>& files, bool asArray, DdsInfo& info) {
+    if (files.size() > 1 && !asArray) {
+        return -1;
+    }
+
+    Texture texture = { files, {}, {}, asArray, false, {} };
+    if (!ReadSources(files, texture.sources)) {
+        return -1;
+    }
+    const DdsInfo& first = texture.sources[0];
+    for (const DdsInfo& source : texture.sources) {
+        if (source.width != first.width || source.height != first.height || source.mipCount != first.mipCount ||
+            source.format != first.format) {
+            return -1;
+        }
+    }
+
+    texture.info = first;
+    texture.info.arraySize = (uint32_t)files.size();
+    texture.info.dataOffset = 0;
+    info = texture.info;
+    textures_.push_back(texture);
+    return (int)textures_.size() - 1;
+}
+
+int D3D11TextureLoader::AddPacked(const std::vector<std::wstring>& files, const TexturePackSettings& settings,
+    TexturePackLayout& layout, DdsInfo& info) {
+    Texture texture = { files, {}, {}, true, true, {} };
+    if (!ReadSources(files, texture.sources) || !PackTextures(texture.sources, settings, texture.layout)) {
+        return -1;
+    }
+
+    texture.info = texture.layout.page;
+    layout = texture.layout;
+    info = texture.info;
+    textures_.push_back(texture);
+    return (int)textures_.size() - 1;
+}
+
+bool D3D11TextureLoader::ReadSlices(const Texture& texture, uint32_t firstMip, std::vector<uint8_t>& data) {
+    // Mips from firstMip down are stored together at the end of each file
+    uint64_t sliceBytes = GetDdsSliceBytes(texture.info, firstMip);
+    data.resize((size_t)(sliceBytes * texture.files.size()));
+    for (size_t slice = 0; slice < texture.files.size(); slice++) {
+        std::ifstream file(texture.files[slice], std::ios::binary);
+        file.seekg((std::streamoff)GetDdsMipOffset(texture.sources[slice], 0, firstMip));
+        if (!file.read((char*)data.data() + slice * sliceBytes, (std::streamsize)sliceBytes)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool D3D11TextureLoader::ReadPacked(const Texture& texture, uint32_t firstMip, std::vector<uint8_t>& data) {
+    const DdsInfo& info = texture.info;
+    uint64_t sliceBytes = GetDdsSliceBytes(info, firstMip);
+    // Space between atlas rects stays black
+    data.assign((size_t)(sliceBytes * info.arraySize), 0);
+
+    std::vector<uint8_t> mips;
+    for (size_t i = 0; i < texture.files.size(); i++) {
+        // Sources may have more mips than the page keeps
+        const DdsInfo& source = texture.sources[i];
+        uint64_t offset = GetDdsMipOffset(source, 0, firstMip);
+        mips.resize((size_t)(GetDdsSliceBytes(source, firstMip) - GetDdsSliceBytes(source, info.mipCount)));
+        std::ifstream file(texture.files[i], std::ios::binary);
+        file.seekg((std::streamoff)offset);
+        if (!file.read((char*)mips.data(), (std::streamsize)mips.size())) {
+            return false;
+        }
+
+        uint8_t* slice = data.data() + texture.layout.rects[i].slice * sliceBytes;
+        for (uint32_t mip = firstMip; mip < info.mipCount; mip++) {
+            BlitPackedTexture(texture.layout, (int)i, source, mip, mips.data() + (GetDdsMipOffset(source, 0, mip) - offset),
+                slice + (sliceBytes - GetDdsSliceBytes(info, mip)));
+        }
+    }
+    return true;
+}
+
+void* D3D11TextureLoader::Load(int texture, uint32_t firstMip) {
+    if (pDevice_ == NULL) {
+        return NULL;
+    }
+    const Texture& entry = textures_[texture];
+    const DdsInfo& info = entry.info;
+    uint32_t mipCount = info.mipCount - firstMip;
+    // The top level of a block compressed texture has to be whole blocks
+    if (GetDdsBlockBytes(info.format) != 0 && (GetDdsMipWidth(info, firstMip) % 4 != 0 || GetDdsMipHeight(info, firstMip) % 4 != 0)) {
+        return NULL;
+    }
+
+    std::vector<uint8_t> data;
+    if (!(entry.packed ? ReadPacked(entry, firstMip, data) : ReadSlices(entry, firstMip, data))) {
+        return NULL;
+    }
+    std::vector<D3D11_SUBRESOURCE_DATA> subresources;
+    const uint8_t* mipData = data.data();
+    for (uint32_t slice = 0; slice < info.arraySize; slice++) {
+        for (uint32_t mip = firstMip; mip < info.mipCount; mip++) {
+            D3D11_SUBRESOURCE_DATA subresource = { mipData, GetDdsRowPitch(info, mip), (UINT)GetDdsMipBytes(info, mip) };
+            subresources.push_back(subresource);
+            mipData += GetDdsMipBytes(info, mip);
+        }
+    }
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width = GetDdsMipWidth(info, firstMip);
+    desc.Height = GetDdsMipHeight(info, firstMip);
+    desc.MipLevels = mipCount;
+    desc.ArraySize = info.arraySize;
+    desc.Format = (DXGI_FORMAT)info.format;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_IMMUTABLE;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    ID3D11Texture2D* pTexture = NULL;
+    HRESULT result = pDevice_->CreateTexture2D(&desc, subresources.data(), &pTexture);
+
+    ID3D11ShaderResourceView* pView = NULL;
+    if (SUCCEEDED(result)) {
+        D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+        viewDesc.Format = desc.Format;
+        if (entry.asArray) {
+            viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+            viewDesc.Texture2DArray.MostDetailedMip = 0;
+            viewDesc.Texture2DArray.MipLevels = mipCount;
+            viewDesc.Texture2DArray.FirstArraySlice = 0;
+            viewDesc.Texture2DArray.ArraySize = desc.ArraySize;
+        }
+        else {
+            viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+            viewDesc.Texture2D.MostDetailedMip = 0;
+            viewDesc.Texture2D.MipLevels = mipCount;
+        }
+        result = pDevice_->CreateShaderResourceView(pTexture, &viewDesc, &pView);
+    }
+    // The view keeps the texture alive
+    SAFE_RELEASE(pTexture);
+
+    return SUCCEEDED(result) ? pView : NULL;
+}
+
+void D3D11TextureLoader::Destroy(void* resource) {
+    ID3D11ShaderResourceView* pView = static_cast<ID3D11ShaderResourceView*>(resource);
+    SAFE_RELEASE(pView);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "framework.h"
+#include "TextureCache.h"
+#include "TexturePacking.h"
+
+#include <string>
+#include <vector>
+
+// Creates textures for TextureCache straight from DDS files, reading only the requested mips.
+// Resources are shader resource views; several files of the same size and format make one
+// Texture2DArray.
+class D3D11TextureLoader : public ITextureLoader {
+public:
+    D3D11TextureLoader() = default;
+
+    D3D11TextureLoader(const D3D11TextureLoader&) = delete;
+    D3D11TextureLoader(D3D11TextureLoader&&) = delete;
+
+    void Init(ID3D11Device* pDevice) { pDevice_ = pDevice; };
+
+    // Reads the headers, info describes the whole texture for TextureCache::Register;
+    // the index matches the one Register returns when textures are added in the same order.
+    // -1 if a file is missing, damaged or does not match the first one.
+    int Add(const std::vector<std::wstring>& files, bool asArray, DdsInfo& info);
+    // Same format textures of any size packed into one Texture2DArray, slices are put
+    // together from the files at every load; layout has the remap table for the shader
+    int AddPacked(const std::vector<std::wstring>& files, const TexturePackSettings& settings,
+        TexturePackLayout& layout, DdsInfo& info);
+
+    void* Load(int texture, uint32_t firstMip) override;
+    void Destroy(void* resource) override;
+
+    ~D3D11TextureLoader() = default;
+private:
+    struct Texture {
+        std::vector<std::wstring> files;
+        std::vector<DdsInfo> sources; // of each file, headers may differ in size
+        DdsInfo info;                 // of the created texture
+        bool asArray;
+        bool packed;
+        TexturePackLayout layout;
+    };
+
+    bool ReadSources(const std::vector<std::wstring>& files, std::vector<DdsInfo>& sources);
+    // Mips firstMip and below of every slice, one slice after another
+    bool ReadSlices(const Texture& texture, uint32_t firstMip, std::vector<uint8_t>& data);
+    bool ReadPacked(const Texture& texture, uint32_t firstMip, std::vector<uint8_t>& data);
+
+    ID3D11Device* pDevice_ = NULL;
+    std::vector<Texture> textures_;
+};
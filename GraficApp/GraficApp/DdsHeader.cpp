@@ -0,0 +1,313 @@
+#include "DdsHeader.h"
+
+#include <cstring>
+
+namespace {
+    const uint32_t Magic = 0x20534444; // "DDS "
+    const uint32_t HeaderSize = 124;
+    const uint32_t PixelFormatSize = 32;
+    const uint32_t Dx10HeaderSize = 20;
+
+    const uint32_t FlagCaps = 0x1;
+    const uint32_t FlagHeight = 0x2;
+    const uint32_t FlagWidth = 0x4;
+    const uint32_t FlagPixelFormat = 0x1000;
+    const uint32_t FlagMipCount = 0x20000;
+    const uint32_t FlagLinearSize = 0x80000;
+    const uint32_t FlagDepth = 0x800000;
+
+    const uint32_t PixelFlagAlpha = 0x1;
+    const uint32_t PixelFlagFourCC = 0x4;
+    const uint32_t PixelFlagRGB = 0x40;
+
+    const uint32_t CapsComplex = 0x8;
+    const uint32_t CapsTexture = 0x1000;
+    const uint32_t CapsMipmap = 0x400000;
+    const uint32_t Caps2Cubemap = 0x200;
+    const uint32_t Caps2AllFaces = 0xFC00;
+    const uint32_t Caps2Volume = 0x200000;
+
+    const uint32_t Dx10Texture2D = 3;
+    const uint32_t Dx10MiscCube = 0x4;
+
+    constexpr uint32_t FourCC(char a, char b, char c, char d) {
+        return (uint32_t)(uint8_t)a | ((uint32_t)(uint8_t)b << 8) | ((uint32_t)(uint8_t)c << 16) | ((uint32_t)(uint8_t)d << 24);
+    }
+
+    struct LegacyFormat {
+        uint32_t fourCC;
+        uint32_t format;
+    };
+
+    // The first entry for a format is the one BuildDdsHeader writes
+    const LegacyFormat LegacyFormats[] = {
+        { FourCC('D', 'X', 'T', '1'), DdsFormatBC1 },
+        { FourCC('D', 'X', 'T', '3'), DdsFormatBC2 },
+        { FourCC('D', 'X', 'T', '2'), DdsFormatBC2 },
+        { FourCC('D', 'X', 'T', '5'), DdsFormatBC3 },
+        { FourCC('D', 'X', 'T', '4'), DdsFormatBC3 },
+        { FourCC('A', 'T', 'I', '1'), DdsFormatBC4 },
+        { FourCC('B', 'C', '4', 'U'), DdsFormatBC4 },
+        { FourCC('A', 'T', 'I', '2'), DdsFormatBC5 },
+        { FourCC('B', 'C', '5', 'U'), DdsFormatBC5 },
+        // D3DFMT values stored as FourCC
+        { 113, DdsFormatRGBA16Float },
+        { 116, DdsFormatRGBA32Float }
+    };
+
+    uint32_t GetU32(const uint8_t* data) {
+        return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+    }
+
+    void PutU32(uint8_t* data, uint32_t value) {
+        data[0] = (uint8_t)value;
+        data[1] = (uint8_t)(value >> 8);
+        data[2] = (uint8_t)(value >> 16);
+        data[3] = (uint8_t)(value >> 24);
+    }
+
+    uint32_t MaxMipCount(uint32_t width, uint32_t height) {
+        uint32_t size = width > height ? width : height, count = 1;
+        while (size > 1) {
+            size >>= 1;
+            count++;
+        }
+        return count;
+    }
+}
+
+uint32_t GetDdsBlockBytes(uint32_t format) {
+    switch (format) {
+    case DdsFormatBC1:
+    case DdsFormatBC1Srgb:
+    case DdsFormatBC4:
+    case DdsFormatBC4Snorm:
+        return 8;
+    case DdsFormatBC2:
+    case DdsFormatBC2Srgb:
+    case DdsFormatBC3:
+    case DdsFormatBC3Srgb:
+    case DdsFormatBC5:
+    case DdsFormatBC5Snorm:
+    case DdsFormatBC6HUf16:
+    case DdsFormatBC6HSf16:
+    case DdsFormatBC7:
+    case DdsFormatBC7Srgb:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+uint32_t GetDdsPixelBytes(uint32_t format) {
+    switch (format) {
+    case DdsFormatRGBA8:
+    case DdsFormatRGBA8Srgb:
+    case DdsFormatBGRA8:
+    case DdsFormatBGRA8Srgb:
+        return 4;
+    case DdsFormatRGBA16Float:
+        return 8;
+    case DdsFormatRGBA32Float:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+bool ParseDdsHeader(const uint8_t* data, size_t size, uint64_t fileSize, DdsInfo& info) {
+    info = {};
+    if (data == nullptr || size < 4 + HeaderSize || GetU32(data) != Magic) {
+        return false;
+    }
+
+    const uint8_t* header = data + 4;
+    const uint8_t* pixelFormat = header + 72;
+    uint32_t flags = GetU32(header + 4);
+    uint32_t height = GetU32(header + 8);
+    uint32_t width = GetU32(header + 12);
+    uint32_t depth = GetU32(header + 20);
+    uint32_t mipCount = GetU32(header + 24);
+    uint32_t pixelFlags = GetU32(pixelFormat + 4);
+    uint32_t fourCC = GetU32(pixelFormat + 8);
+    uint32_t caps2 = GetU32(header + 108);
+    if (GetU32(header) != HeaderSize || GetU32(pixelFormat) != PixelFormatSize) {
+        return false;
+    }
+    if ((caps2 & Caps2Volume) != 0 || ((flags & FlagDepth) != 0 && depth > 1)) {
+        return false;
+    }
+
+    info.width = width;
+    info.height = height;
+    info.mipCount = (flags & FlagMipCount) != 0 && mipCount > 0 ? mipCount : 1;
+    info.arraySize = 1;
+    info.faces = 1;
+    info.dataOffset = 4 + HeaderSize;
+
+    if ((pixelFlags & PixelFlagFourCC) != 0 && fourCC == FourCC('D', 'X', '1', '0')) {
+        if (size < 4 + HeaderSize + Dx10HeaderSize) {
+            return false;
+        }
+        const uint8_t* extension = header + HeaderSize;
+        info.format = GetU32(extension);
+        uint32_t dimension = GetU32(extension + 4);
+        uint32_t misc = GetU32(extension + 8);
+        info.arraySize = GetU32(extension + 12);
+        info.faces = (misc & Dx10MiscCube) != 0 ? 6 : 1;
+        info.dataOffset += Dx10HeaderSize;
+        if (dimension != Dx10Texture2D) {
+            return false;
+        }
+    }
+    else {
+        if ((pixelFlags & PixelFlagFourCC) != 0) {
+            for (const LegacyFormat& legacy : LegacyFormats) {
+                if (legacy.fourCC == fourCC) {
+                    info.format = legacy.format;
+                    break;
+                }
+            }
+        }
+        else if ((pixelFlags & PixelFlagRGB) != 0 && GetU32(pixelFormat + 12) == 32) {
+            uint32_t red = GetU32(pixelFormat + 16), green = GetU32(pixelFormat + 20), blue = GetU32(pixelFormat + 24);
+            if (red == 0x000000FF && green == 0x0000FF00 && blue == 0x00FF0000) {
+                info.format = DdsFormatRGBA8;
+            }
+            else if (red == 0x00FF0000 && green == 0x0000FF00 && blue == 0x000000FF) {
+                info.format = DdsFormatBGRA8;
+            }
+        }
+        // Legacy cube maps list their faces, partial ones are not supported
+        if ((caps2 & Caps2Cubemap) != 0) {
+            if ((caps2 & Caps2AllFaces) != Caps2AllFaces) {
+                return false;
+            }
+            info.faces = 6;
+        }
+    }
+
+    if (GetDdsBlockBytes(info.format) == 0 && GetDdsPixelBytes(info.format) == 0) {
+        return false;
+    }
+    if (width == 0 || height == 0 || width > DdsMaxDimension || height > DdsMaxDimension ||
+        info.mipCount > MaxMipCount(width, height) || info.arraySize == 0 || info.arraySize > DdsMaxArraySize ||
+        (info.faces == 6 && width != height) || GetDdsMipBytes(info, 0) > DdsMaxMipBytes) {
+        return false;
+    }
+
+    // Sizes stay far below 2^64: 16384^2 * 16 bytes * 4/3 * 2048 * 6
+    return fileSize == 0 || info.dataOffset + GetDdsTextureBytes(info, 0) <= fileSize;
+}
+
+bool ValidateDdsFile(const uint8_t* data, size_t size, DdsInfo& info) {
+    if (!ParseDdsHeader(data, size, size, info)) {
+        return false;
+    }
+
+    uint64_t end = info.dataOffset;
+    for (uint32_t slice = 0; slice < info.arraySize * info.faces; slice++) {
+        for (uint32_t mip = 0; mip < info.mipCount; mip++) {
+            uint64_t offset = GetDdsMipOffset(info, slice, mip);
+            uint64_t bytes = GetDdsMipBytes(info, mip);
+            if (offset != end || offset > size || bytes == 0 || bytes > size - offset) {
+                return false;
+            }
+            end = offset + bytes;
+        }
+    }
+    return true;
+}
+
+bool BuildDdsHeader(const DdsInfo& info, std::vector<uint8_t>& header) {
+    uint32_t blockBytes = GetDdsBlockBytes(info.format);
+    if (blockBytes == 0 && GetDdsPixelBytes(info.format) == 0) {
+        return false;
+    }
+
+    uint32_t fourCC = 0;
+    for (const LegacyFormat& legacy : LegacyFormats) {
+        if (legacy.format == info.format) {
+            fourCC = legacy.fourCC;
+            break;
+        }
+    }
+    bool rgb = info.format == DdsFormatRGBA8 || info.format == DdsFormatBGRA8;
+    bool dx10 = (fourCC == 0 && !rgb) || info.arraySize > 1;
+
+    header.assign(4 + HeaderSize + (dx10 ? Dx10HeaderSize : 0), 0);
+    uint8_t* h = header.data() + 4;
+    uint8_t* pixelFormat = h + 72;
+    PutU32(header.data(), Magic);
+    PutU32(h, HeaderSize);
+    PutU32(h + 4, FlagCaps | FlagHeight | FlagWidth | FlagPixelFormat | (info.mipCount > 1 ? FlagMipCount : 0) | FlagLinearSize);
+    PutU32(h + 8, info.height);
+    PutU32(h + 12, info.width);
+    PutU32(h + 16, (uint32_t)GetDdsMipBytes(info, 0));
+    PutU32(h + 24, info.mipCount);
+    PutU32(pixelFormat, PixelFormatSize);
+    PutU32(h + 104, CapsTexture | (info.mipCount > 1 ? CapsMipmap | CapsComplex : 0) | (info.faces == 6 ? CapsComplex : 0));
+    PutU32(h + 108, info.faces == 6 ? Caps2Cubemap | Caps2AllFaces : 0);
+
+    if (dx10) {
+        PutU32(pixelFormat + 4, PixelFlagFourCC);
+        PutU32(pixelFormat + 8, FourCC('D', 'X', '1', '0'));
+        uint8_t* extension = h + HeaderSize;
+        PutU32(extension, info.format);
+        PutU32(extension + 4, Dx10Texture2D);
+        PutU32(extension + 8, info.faces == 6 ? Dx10MiscCube : 0);
+        PutU32(extension + 12, info.arraySize);
+    }
+    else if (rgb) {
+        bool bgra = info.format == DdsFormatBGRA8;
+        PutU32(pixelFormat + 4, PixelFlagRGB | PixelFlagAlpha);
+        PutU32(pixelFormat + 12, 32);
+        PutU32(pixelFormat + 16, bgra ? 0x00FF0000 : 0x000000FF);
+        PutU32(pixelFormat + 20, 0x0000FF00);
+        PutU32(pixelFormat + 24, bgra ? 0x000000FF : 0x00FF0000);
+        PutU32(pixelFormat + 28, 0xFF000000);
+    }
+    else {
+        PutU32(pixelFormat + 4, PixelFlagFourCC);
+        PutU32(pixelFormat + 8, fourCC);
+    }
+    return true;
+}
+
+uint32_t GetDdsMipWidth(const DdsInfo& info, uint32_t mip) {
+    uint32_t width = info.width >> mip;
+    return width > 0 ? width : 1;
+}
+
+uint32_t GetDdsMipHeight(const DdsInfo& info, uint32_t mip) {
+    uint32_t height = info.height >> mip;
+    return height > 0 ? height : 1;
+}
+
+uint32_t GetDdsRowPitch(const DdsInfo& info, uint32_t mip) {
+    uint32_t blockBytes = GetDdsBlockBytes(info.format);
+    uint32_t width = GetDdsMipWidth(info, mip);
+    return blockBytes > 0 ? (width + 3) / 4 * blockBytes : width * GetDdsPixelBytes(info.format);
+}
+
+uint64_t GetDdsMipBytes(const DdsInfo& info, uint32_t mip) {
+    uint32_t height = GetDdsMipHeight(info, mip);
+    uint32_t rows = GetDdsBlockBytes(info.format) > 0 ? (height + 3) / 4 : height;
+    return (uint64_t)GetDdsRowPitch(info, mip) * rows;
+}
+
+uint64_t GetDdsSliceBytes(const DdsInfo& info, uint32_t firstMip) {
+    uint64_t bytes = 0;
+    for (uint32_t mip = firstMip; mip < info.mipCount; mip++) {
+        bytes += GetDdsMipBytes(info, mip);
+    }
+    return bytes;
+}
+
+uint64_t GetDdsTextureBytes(const DdsInfo& info, uint32_t firstMip) {
+    return GetDdsSliceBytes(info, firstMip) * info.arraySize * info.faces;
+}
+
+uint64_t GetDdsMipOffset(const DdsInfo& info, uint32_t slice, uint32_t mip) {
+    return info.dataOffset + GetDdsSliceBytes(info, 0) * slice + (GetDdsSliceBytes(info, 0) - GetDdsSliceBytes(info, mip));
+}
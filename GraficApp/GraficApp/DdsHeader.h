@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// DXGI_FORMAT values the DDS code understands, numeric so the header does not need dxgi
+enum DdsFormat : uint32_t {
+    DdsFormatUnknown = 0,
+    DdsFormatRGBA32Float = 2,
+    DdsFormatRGBA16Float = 10,
+    DdsFormatRGBA8 = 28,
+    DdsFormatRGBA8Srgb = 29,
+    DdsFormatBC1 = 71,
+    DdsFormatBC1Srgb = 72,
+    DdsFormatBC2 = 74,
+    DdsFormatBC2Srgb = 75,
+    DdsFormatBC3 = 77,
+    DdsFormatBC3Srgb = 78,
+    DdsFormatBC4 = 80,
+    DdsFormatBC4Snorm = 81,
+    DdsFormatBC5 = 83,
+    DdsFormatBC5Snorm = 84,
+    DdsFormatBGRA8 = 87,
+    DdsFormatBGRA8Srgb = 91,
+    DdsFormatBC6HUf16 = 95,
+    DdsFormatBC6HSf16 = 96,
+    DdsFormatBC7 = 98,
+    DdsFormatBC7Srgb = 99
+};
+
+// 2D textures, arrays and cube maps; volumes are rejected. Slices are stored one after
+// another, each with its whole mip chain, faces of a cube map count as slices.
+struct DdsInfo {
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipCount;
+    uint32_t arraySize;
+    uint32_t faces;      // 6 for cube maps
+    uint32_t format;     // DdsFormat
+    uint32_t dataOffset; // magic, header and the DX10 extension when present
+};
+
+// Largest dimension D3D11 allows for 2D textures
+const uint32_t DdsMaxDimension = 16384;
+const uint32_t DdsMaxArraySize = 2048;
+const size_t DdsMaxHeaderSize = 4 + 124 + 20;
+// Pitches of D3D11_SUBRESOURCE_DATA are 32 bit, a 16384x16384 RGBA32F level does not fit
+const uint64_t DdsMaxMipBytes = 0xFFFFFFFF;
+
+// Reads and checks the header; fileSize is the whole file and has to hold every mip of
+// every slice, 0 checks the header alone
+bool ParseDdsHeader(const uint8_t* data, size_t size, uint64_t fileSize, DdsInfo& info);
+// ParseDdsHeader over a whole file in memory and the walk a loader does over it: every mip of
+// every slice right after the previous one and inside the file
+bool ValidateDdsFile(const uint8_t* data, size_t size, DdsInfo& info);
+// Legacy header for formats with a FourCC or RGB masks, DX10 extension otherwise
+bool BuildDdsHeader(const DdsInfo& info, std::vector<uint8_t>& header);
+
+// 8 or 16 bytes per 4x4 block for BC formats, 0 otherwise
+uint32_t GetDdsBlockBytes(uint32_t format);
+// Bytes per pixel for uncompressed formats, 0 for BC and unknown formats
+uint32_t GetDdsPixelBytes(uint32_t format);
+
+uint32_t GetDdsMipWidth(const DdsInfo& info, uint32_t mip);
+uint32_t GetDdsMipHeight(const DdsInfo& info, uint32_t mip);
+// Bytes of one row of pixels or of 4x4 blocks
+uint32_t GetDdsRowPitch(const DdsInfo& info, uint32_t mip);
+uint64_t GetDdsMipBytes(const DdsInfo& info, uint32_t mip);
+// Mips firstMip and below of one slice
+uint64_t GetDdsSliceBytes(const DdsInfo& info, uint32_t firstMip);
+// Mips firstMip and below of every slice, what a texture without its top mips takes
+uint64_t GetDdsTextureBytes(const DdsInfo& info, uint32_t firstMip);
+uint64_t GetDdsMipOffset(const DdsInfo& info, uint32_t slice, uint32_t mip);
@@ -0,0 +1,127 @@
+#include "DdsValidation.h"
+#include "BlockCompression.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+namespace {
+    // *.dds also finds longer extensions through their 8.3 names on Windows
+    bool HasDdsExtension(const char* name) {
+        size_t length = strlen(name);
+        return length > 4 && name[length - 4] == '.' && tolower((unsigned char)name[length - 3]) == 'd' &&
+            tolower((unsigned char)name[length - 2]) == 'd' && tolower((unsigned char)name[length - 1]) == 's';
+    }
+}
+
+const char* GetDdsFileStatusName(DdsFileStatus status) {
+    switch (status) {
+    case DdsFileStatus::Valid:
+        return "valid";
+    case DdsFileStatus::Unreadable:
+        return "unreadable";
+    case DdsFileStatus::BadHeader:
+        return "bad header";
+    default:
+        return "bad layout";
+    }
+}
+
+bool ListDdsFiles(const std::string& directory, std::vector<std::string>& files) {
+    files.clear();
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((directory + "\\*.dds").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE) {
+        return GetLastError() == ERROR_FILE_NOT_FOUND;
+    }
+    do {
+        if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 && HasDdsExtension(data.cFileName)) {
+            files.push_back(directory + "/" + data.cFileName);
+        }
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (dir == nullptr) {
+        return false;
+    }
+    while (dirent* entry = readdir(dir)) {
+        if (HasDdsExtension(entry->d_name)) {
+            files.push_back(directory + "/" + entry->d_name);
+        }
+    }
+    closedir(dir);
+#endif
+    std::sort(files.begin(), files.end());
+    return true;
+}
+
+bool ValidateDdsFiles(const std::vector<std::string>& files, std::vector<DdsFileCheck>& checks) {
+    checks.assign(files.size(), DdsFileCheck{ DdsFileStatus::Unreadable, 0, {} });
+    // Only the header pages of a mapped file are read, the mips stay on disk
+    ThreadPool::GetInstance().ParallelFor(files.size(), [&](size_t i) {
+        DdsFileCheck& check = checks[i];
+        MappedFile file;
+        if (!file.Open(files[i])) {
+            return;
+        }
+        check.size = file.GetSize();
+        if (!ParseDdsHeader(file.GetData(), file.GetSize(), 0, check.info)) {
+            check.status = DdsFileStatus::BadHeader;
+        }
+        else {
+            check.status = ValidateDdsFile(file.GetData(), file.GetSize(), check.info) ? DdsFileStatus::Valid : DdsFileStatus::BadLayout;
+        }
+    });
+
+    for (const DdsFileCheck& check : checks) {
+        if (check.status != DdsFileStatus::Valid) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RunDdsDirectoryCheck(const std::string& directory, const std::string& fileName) {
+    std::ofstream file(fileName, std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> files;
+    std::vector<DdsFileCheck> checks;
+    bool listed = ListDdsFiles(directory, files);
+    bool valid = ValidateDdsFiles(files, checks);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    file << "file,status,size_kb,width,height,mips,slices,format\n";
+    int invalid = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        const DdsFileCheck& check = checks[i];
+        file << files[i] << ',' << GetDdsFileStatusName(check.status) << ',' << check.size / 1024;
+        if (check.status == DdsFileStatus::Valid) {
+            file << ',' << check.info.width << ',' << check.info.height << ',' << check.info.mipCount << ','
+                << check.info.arraySize * check.info.faces << ',' << check.info.format;
+        }
+        else {
+            file << ",,,,,";
+            invalid++;
+        }
+        file << '\n';
+    }
+    file << (listed ? "checked" : "directory not readable") << ',' << files.size() << " files," << ms << " ms,"
+        << ThreadPool::GetInstance().GetThreadCount() << " threads," << invalid << " invalid,,,\n";
+    return file.good() && listed && valid;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "DdsHeader.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Checks asset directories before they are loaded. Files are mapped and validated with
+// ValidateDdsFile on ThreadPool, nothing here needs a device.
+enum class DdsFileStatus {
+    Valid,
+    Unreadable, // missing, empty or cannot be mapped
+    BadHeader,
+    BadLayout   // the header parses but the mips do not fit the file
+};
+
+struct DdsFileCheck {
+    DdsFileStatus status;
+    uint64_t size;
+    DdsInfo info;
+};
+
+const char* GetDdsFileStatusName(DdsFileStatus status);
+
+// Paths of the .dds files in a directory, not recursive, sorted; false if it cannot be read
+bool ListDdsFiles(const std::string& directory, std::vector<std::string>& files);
+// One check per file in the same order, true if every file is valid
+bool ValidateDdsFiles(const std::vector<std::string>& files, std::vector<DdsFileCheck>& checks);
+
+// Validates a directory, writes file,status,size_kb,width,height,mips,slices,format rows and
+// a timing row; returns false if a file is not valid or the directory cannot be read
+bool RunDdsDirectoryCheck(const std::string& directory, const std::string& fileName);
@@ -0,0 +1,27 @@
+#include "FixedStepTimer.h"
+
+void FixedStepTimer::Reset(double step, int maxSteps) {
+    step_ = step > 0.0 ? step : 1.0 / 60.0;
+    maxSteps_ = maxSteps > 0 ? maxSteps : 1;
+    accumulator_ = 0.0;
+    stepIndex_ = 0;
+}
+
+int FixedStepTimer::Advance(double elapsedSeconds) {
+    if (elapsedSeconds > 0.0) {
+        accumulator_ += elapsedSeconds;
+    }
+
+    int steps = 0;
+    while (accumulator_ >= step_ && steps < maxSteps_) {
+        accumulator_ -= step_;
+        steps++;
+    }
+    // After a long stall drop the backlog instead of trying to catch up
+    if (accumulator_ >= step_) {
+        accumulator_ = 0.0;
+    }
+
+    stepIndex_ += steps;
+    return steps;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+// Accumulator for a fixed-rate simulation. The caller feeds real elapsed time once per
+// rendered frame, runs the returned number of steps, and blends the last two simulated
+// states with GetAlpha(). Results depend only on the number of steps, not on the frame rate.
+class FixedStepTimer {
+public:
+    explicit FixedStepTimer(double step = 1.0 / 60.0, int maxSteps = 8) {
+        Reset(step, maxSteps);
+    };
+
+    void Reset(double step, int maxSteps = 8);
+
+    // Returns the number of simulation steps to run for this frame
+    int Advance(double elapsedSeconds);
+
+    double GetStep() const { return step_; };
+    uint64_t GetStepIndex() const { return stepIndex_; };
+    // Time of the latest simulated state
+    double GetTime() const { return stepIndex_ * step_; };
+    // Blend factor between the previous and the latest state, in [0, 1)
+    double GetAlpha() const { return accumulator_ / step_; };
+private:
+    double step_ = 1.0 / 60.0;
+    double accumulator_ = 0.0;
+    uint64_t stepIndex_ = 0;
+    int maxSteps_ = 8;
+};
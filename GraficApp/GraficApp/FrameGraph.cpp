@@ -0,0 +1,207 @@
+#include "FrameGraph.h"
+
+#include <algorithm>
+
+void FrameGraph::Reset() {
+    resources_.clear();
+    passes_.clear();
+    physical_.clear();
+    compiled_.clear();
+}
+
+int FrameGraph::ImportResource(const std::string& name) {
+    Resource resource = { name, {}, true, -1, -1, -1 };
+    resources_.push_back(resource);
+    return (int)resources_.size() - 1;
+}
+
+int FrameGraph::CreateResource(const std::string& name, const RenderTargetDesc& desc) {
+    Resource resource = { name, desc, false, -1, -1, -1 };
+    resources_.push_back(resource);
+    return (int)resources_.size() - 1;
+}
+
+int FrameGraph::AddPass(const std::string& name, const std::function<void()>& execute) {
+    Pass pass;
+    pass.name = name;
+    pass.execute = execute;
+    passes_.push_back(pass);
+    return (int)passes_.size() - 1;
+}
+
+void FrameGraph::Read(int pass, int resource) {
+    passes_[pass].reads.push_back(resource);
+}
+
+void FrameGraph::Write(int pass, int resource) {
+    passes_[pass].writes.push_back(resource);
+}
+
+int FrameGraph::GetTransientCount() const {
+    int count = 0;
+    for (const Resource& resource : resources_) {
+        count += resource.physical >= 0 ? 1 : 0;
+    }
+    return count;
+}
+
+bool FrameGraph::Compile() {
+    compiled_.clear();
+    physical_.clear();
+    for (Resource& resource : resources_) {
+        resource.physical = -1;
+        resource.firstUse = -1;
+        resource.lastUse = -1;
+    }
+
+    // Culling: walking backwards, a pass is live if it writes something a later live pass
+    // uses or an imported resource. Writes keep the contents, so earlier writers stay live too.
+    std::vector<bool> needed(resources_.size());
+    for (size_t i = 0; i < resources_.size(); i++) {
+        needed[i] = resources_[i].imported;
+    }
+    std::vector<bool> live(passes_.size(), false);
+    for (int p = (int)passes_.size() - 1; p >= 0; p--) {
+        const Pass& pass = passes_[p];
+        for (int resource : pass.writes) {
+            live[p] = live[p] || needed[resource];
+        }
+        if (!live[p]) {
+            continue;
+        }
+        for (int resource : pass.reads) {
+            needed[resource] = true;
+        }
+        for (int resource : pass.writes) {
+            needed[resource] = true;
+        }
+    }
+
+    // Lifetimes in compiled pass indices
+    std::vector<bool> written(resources_.size(), false);
+    for (int p = 0; p < (int)passes_.size(); p++) {
+        if (!live[p]) {
+            continue;
+        }
+        int index = (int)compiled_.size();
+        const Pass& pass = passes_[p];
+        for (int resource : pass.reads) {
+            if (!resources_[resource].imported && !written[resource]) {
+                compiled_.clear();
+                return false;
+            }
+        }
+        for (int resource : pass.writes) {
+            written[resource] = true;
+        }
+        for (const std::vector<int>* list : { &pass.reads, &pass.writes }) {
+            for (int resource : *list) {
+                Resource& r = resources_[resource];
+                if (r.firstUse < 0) {
+                    r.firstUse = index;
+                }
+                r.lastUse = index;
+            }
+        }
+
+        FrameGraphCompiledPass compiledPass;
+        compiledPass.pass = p;
+        compiled_.push_back(compiledPass);
+    }
+
+    // Aliasing: in order of first use, reuse a physical resource with the same descriptor
+    // whose previous owner is already dead
+    std::vector<int> order;
+    for (int i = 0; i < (int)resources_.size(); i++) {
+        if (!resources_[i].imported && resources_[i].firstUse >= 0) {
+            order.push_back(i);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+        return resources_[a].firstUse < resources_[b].firstUse;
+    });
+
+    std::vector<int> physicalFirstUse;
+    for (int index : order) {
+        Resource& resource = resources_[index];
+        for (int i = 0; i < (int)physical_.size() && resource.physical < 0; i++) {
+            if (physical_[i].lastUse < resource.firstUse && physical_[i].desc == resource.desc) {
+                resource.physical = i;
+            }
+        }
+        if (resource.physical < 0) {
+            resource.physical = (int)physical_.size();
+            physical_.push_back({ resource.desc, -1 });
+            physicalFirstUse.push_back(resource.firstUse);
+        }
+        physical_[resource.physical].lastUse = resource.lastUse;
+    }
+    // A physical resource is held from its first owner's first use to its last owner's last use
+    for (int i = 0; i < (int)physical_.size(); i++) {
+        compiled_[physicalFirstUse[i]].acquire.push_back(i);
+        compiled_[physical_[i].lastUse].release.push_back(i);
+    }
+
+    // Hazards are tracked per storage, so two aliased resources count as one
+    int physicalCount = (int)physical_.size();
+    auto storageOf = [&](int resource) {
+        int physical = resources_[resource].physical;
+        return physical >= 0 ? physical : physicalCount + resource;
+    };
+    std::vector<bool> boundRead(physicalCount + resources_.size(), false);
+    std::vector<bool> boundTarget(physicalCount + resources_.size(), false);
+    for (FrameGraphCompiledPass& compiledPass : compiled_) {
+        const Pass& pass = passes_[compiledPass.pass];
+        for (int resource : pass.writes) {
+            if (boundRead[storageOf(resource)]) {
+                // The backend unbinds every shader resource slot
+                compiledPass.barriers.push_back({ FrameGraphBarrierType::UnbindShaderResources, resource });
+                std::fill(boundRead.begin(), boundRead.end(), false);
+                break;
+            }
+        }
+        for (int resource : pass.reads) {
+            if (boundTarget[storageOf(resource)]) {
+                compiledPass.barriers.push_back({ FrameGraphBarrierType::UnbindRenderTargets, resource });
+                std::fill(boundTarget.begin(), boundTarget.end(), false);
+                break;
+            }
+        }
+
+        for (int resource : pass.reads) {
+            boundRead[storageOf(resource)] = true;
+        }
+        // Binding new targets replaces the old ones
+        if (!pass.writes.empty()) {
+            std::fill(boundTarget.begin(), boundTarget.end(), false);
+        }
+        for (int resource : pass.writes) {
+            boundTarget[storageOf(resource)] = true;
+        }
+    }
+
+    return true;
+}
+
+bool FrameGraph::Execute(IFrameGraphBackend& backend) {
+    for (const FrameGraphCompiledPass& compiledPass : compiled_) {
+        for (int physical : compiledPass.acquire) {
+            if (!backend.Acquire(physical, physical_[physical].desc)) {
+                return false;
+            }
+        }
+        for (const FrameGraphBarrier& barrier : compiledPass.barriers) {
+            backend.Barrier(barrier);
+        }
+
+        const Pass& pass = passes_[compiledPass.pass];
+        if (pass.execute) {
+            pass.execute();
+        }
+
+        for (int physical : compiledPass.release) {
+            backend.Release(physical);
+        }
+    }
+    return true;
+}
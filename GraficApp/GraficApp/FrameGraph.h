@@ -0,0 +1,100 @@
+#pragma once
+
+#include "RenderTargetPool.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+enum class FrameGraphBarrierType {
+    UnbindShaderResources, // the resource is about to be written while still bound for reading
+    UnbindRenderTargets    // the resource is about to be read while still bound as a target
+};
+
+struct FrameGraphBarrier {
+    FrameGraphBarrierType type;
+    int resource;
+};
+
+// Backend for FrameGraph::Execute. Physical resources are the storage behind transient
+// resources after aliasing; D3D11FrameGraphBackend takes them from a RenderTargetPool.
+class IFrameGraphBackend {
+public:
+    virtual bool Acquire(int physical, const RenderTargetDesc& desc) = 0;
+    virtual void Release(int physical) = 0;
+    virtual void Barrier(const FrameGraphBarrier& barrier) = 0;
+
+    virtual ~IFrameGraphBackend() = default;
+};
+
+struct FrameGraphCompiledPass {
+    int pass;
+    std::vector<int> acquire; // physical resources first used by this pass
+    std::vector<int> release; // physical resources last used by this pass
+    std::vector<FrameGraphBarrier> barriers;
+};
+
+// Passes are added in execution order and declare the resources they read (shader resource)
+// and write (render target or depth). A write keeps the previous contents, so it depends on
+// the previous writer. Compile() culls passes that do not contribute to an imported resource,
+// computes lifetimes of transient resources, lets transients with the same descriptor and
+// disjoint lifetimes share a physical resource and inserts the unbinds D3D11 needs between
+// passes. The graph is rebuilt every frame; Reset() keeps the allocations.
+class FrameGraph {
+public:
+    FrameGraph() = default;
+
+    FrameGraph(const FrameGraph&) = delete;
+    FrameGraph(FrameGraph&&) = delete;
+
+    void Reset();
+
+    // External resource such as the back buffer, never culled or aliased
+    int ImportResource(const std::string& name);
+    int CreateResource(const std::string& name, const RenderTargetDesc& desc);
+    int AddPass(const std::string& name, const std::function<void()>& execute);
+    void Read(int pass, int resource);
+    void Write(int pass, int resource);
+
+    // false if a live pass reads a transient resource that nothing wrote before
+    bool Compile();
+    // Runs the compiled passes, false if the backend could not provide a resource
+    bool Execute(IFrameGraphBackend& backend);
+
+    // -1 for imported and culled resources
+    int GetPhysical(int resource) const { return resources_[resource].physical; };
+    const std::vector<FrameGraphCompiledPass>& GetCompiledPasses() const { return compiled_; };
+    const std::string& GetPassName(int pass) const { return passes_[pass].name; };
+    int GetPassCount() const { return (int)passes_.size(); };
+    int GetCulledCount() const { return (int)(passes_.size() - compiled_.size()); };
+    int GetTransientCount() const;
+    int GetPhysicalCount() const { return (int)physical_.size(); };
+
+    ~FrameGraph() = default;
+private:
+    struct Resource {
+        std::string name;
+        RenderTargetDesc desc;
+        bool imported;
+        int physical;
+        int firstUse;
+        int lastUse;
+    };
+
+    struct Pass {
+        std::string name;
+        std::function<void()> execute;
+        std::vector<int> reads;
+        std::vector<int> writes;
+    };
+
+    struct Physical {
+        RenderTargetDesc desc;
+        int lastUse;
+    };
+
+    std::vector<Resource> resources_;
+    std::vector<Pass> passes_;
+    std::vector<Physical> physical_;
+    std::vector<FrameGraphCompiledPass> compiled_;
+};
@@ -0,0 +1,90 @@
+#include "FramePacer.h"
+
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+double SteadyClock::Now() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+void SteadyClock::SleepFor(double seconds) {
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+}
+
+void FramePacer::SetTargetFps(double fps) {
+    period_ = fps > 0.0 ? 1.0 / fps : 0.0;
+    nextDeadline_ = -1.0;
+}
+
+void FramePacer::Wait() {
+    if (period_ <= 0.0) {
+        return;
+    }
+
+    double now = clock_.Now();
+    // First frame or missed by more than a whole period: restart the schedule instead of bursting
+    if (nextDeadline_ < 0.0 || now - nextDeadline_ > period_) {
+        nextDeadline_ = now;
+    }
+
+    double remaining = nextDeadline_ - now;
+    while (remaining > 0.0) {
+        if (remaining > spinThreshold_) {
+            clock_.SleepFor(remaining - spinThreshold_);
+        }
+        now = clock_.Now();
+        remaining = nextDeadline_ - now;
+    }
+
+    nextDeadline_ += period_;
+}
+
+void FramePacer::MarkInput() {
+    inputTime_ = clock_.Now();
+}
+
+void FramePacer::MarkPresent() {
+    double now = clock_.Now();
+    if (lastPresent_ >= 0.0) {
+        intervals_[head_] = now - lastPresent_;
+        latencies_[head_] = inputTime_ >= 0.0 ? now - inputTime_ : 0.0;
+        head_ = (head_ + 1) % HistorySize;
+        if (count_ < HistorySize) {
+            count_++;
+        }
+    }
+    lastPresent_ = now;
+}
+
+FrameStats FramePacer::GetStats() const {
+    FrameStats stats;
+    if (count_ == 0) {
+        return stats;
+    }
+
+    double sum = 0.0, latency = 0.0;
+    double minValue = intervals_[0], maxValue = intervals_[0];
+    for (int i = 0; i < count_; i++) {
+        sum += intervals_[i];
+        latency += latencies_[i];
+        minValue = intervals_[i] < minValue ? intervals_[i] : minValue;
+        maxValue = intervals_[i] > maxValue ? intervals_[i] : maxValue;
+    }
+    double mean = sum / count_;
+
+    double variance = 0.0;
+    for (int i = 0; i < count_; i++) {
+        variance += (intervals_[i] - mean) * (intervals_[i] - mean);
+    }
+    variance /= count_;
+
+    stats.frames = (uint32_t)count_;
+    stats.averageMs = mean * 1000.0;
+    stats.deviationMs = std::sqrt(variance) * 1000.0;
+    stats.minMs = minValue * 1000.0;
+    stats.maxMs = maxValue * 1000.0;
+    stats.latencyMs = latency / count_ * 1000.0;
+    return stats;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+
+// Time source used by FramePacer, a simulated clock can be substituted to test pacing off-line
+class IClock {
+public:
+    virtual double Now() = 0; // seconds
+    virtual void SleepFor(double seconds) = 0;
+
+    virtual ~IClock() = default;
+};
+
+class SteadyClock : public IClock {
+public:
+    double Now() override;
+    void SleepFor(double seconds) override;
+};
+
+enum class PacingMode {
+    Unlimited,
+    VSync,
+    TargetFps
+};
+
+struct FrameStats {
+    uint32_t frames = 0;
+    double averageMs = 0.0;
+    double deviationMs = 0.0;
+    double minMs = 0.0;
+    double maxMs = 0.0;
+    double latencyMs = 0.0; // input sampling to the return from Present
+};
+
+// Frame limiter with a hybrid wait: the OS sleep covers most of the interval and the
+// last spinThreshold seconds are spun, because Sleep() overshoots by up to a timer tick.
+class FramePacer {
+public:
+    static constexpr int HistorySize = 128;
+
+    explicit FramePacer(IClock& clock) : clock_(clock) {};
+
+    FramePacer(const FramePacer&) = delete;
+    FramePacer(FramePacer&&) = delete;
+
+    // 0 disables the limiter
+    void SetTargetFps(double fps);
+    void SetSpinThreshold(double seconds) { spinThreshold_ = seconds; };
+    double GetTargetFps() const { return period_ > 0.0 ? 1.0 / period_ : 0.0; };
+
+    // Blocks until the next frame slot
+    void Wait();
+    void MarkInput();
+    void MarkPresent();
+
+    FrameStats GetStats() const;
+
+    ~FramePacer() = default;
+private:
+    IClock& clock_;
+    double period_ = 0.0;
+    double spinThreshold_ = 0.002;
+    double nextDeadline_ = -1.0;
+
+    double inputTime_ = -1.0;
+    double lastPresent_ = -1.0;
+    double intervals_[HistorySize] = {};
+    double latencies_[HistorySize] = {};
+    int count_ = 0;
+    int head_ = 0;
+};
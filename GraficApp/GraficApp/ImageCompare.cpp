@@ -0,0 +1,90 @@
+#include "ImageCompare.h"
+#include "ImageKernels.h"
+
+#include <climits>
+#include <fstream>
+
+namespace {
+    uint32_t ReadUInt32(const uint8_t* data) {
+        return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+    }
+
+    uint16_t ReadUInt16(const uint8_t* data) {
+        return (uint16_t)(data[0] | (data[1] << 8));
+    }
+}
+
+bool LoadBMP(const std::string& fileName, std::vector<uint8_t>& pixels, int& width, int& height) {
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    uint8_t header[54];
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != 'B' || header[1] != 'M') {
+        return false;
+    }
+    uint32_t dataOffset = ReadUInt32(header + 10);
+    int32_t fileWidth = (int32_t)ReadUInt32(header + 18);
+    int32_t fileHeight = (int32_t)ReadUInt32(header + 22);
+    uint16_t bitCount = ReadUInt16(header + 28);
+    uint32_t compression = ReadUInt32(header + 30);
+    // INT_MIN has no positive height
+    if (fileWidth <= 0 || fileHeight == 0 || fileHeight == INT_MIN || (bitCount != 24 && bitCount != 32) || compression != 0) {
+        return false;
+    }
+
+    // Negative height means top-down rows
+    bool topDown = fileHeight < 0;
+    width = fileWidth;
+    height = topDown ? -fileHeight : fileHeight;
+    if (width > BmpMaxDimension || height > BmpMaxDimension) {
+        return false;
+    }
+    int bytesPerPixel = bitCount / 8;
+    size_t rowSize = ((size_t)width * bytesPerPixel + 3) & ~(size_t)3;
+
+    // The pixel data must be in the file before it is allocated
+    file.seekg(0, std::ios::end);
+    uint64_t fileSize = (uint64_t)file.tellg();
+    if (!file || (uint64_t)dataOffset + (uint64_t)rowSize * height > fileSize) {
+        return false;
+    }
+
+    std::vector<uint8_t> data(rowSize * height);
+    file.seekg(dataOffset);
+    if (!file.read(reinterpret_cast<char*>(data.data()), data.size())) {
+        return false;
+    }
+
+    pixels.resize((size_t)width * height * 4);
+    for (int y = 0; y < height; y++) {
+        const uint8_t* src = data.data() + rowSize * (topDown ? y : height - 1 - y);
+        uint8_t* dst = pixels.data() + (size_t)y * width * 4;
+        for (int x = 0; x < width; x++) {
+            dst[x * 4 + 0] = src[x * bytesPerPixel + 0];
+            dst[x * 4 + 1] = src[x * bytesPerPixel + 1];
+            dst[x * 4 + 2] = src[x * bytesPerPixel + 2];
+            dst[x * 4 + 3] = bytesPerPixel == 4 ? src[x * 4 + 3] : 255;
+        }
+    }
+
+    return true;
+}
+
+bool CompareImages(const std::string& fileA, const std::string& fileB, ImageCompareResult& result) {
+    std::vector<uint8_t> a, b;
+    int widthA, heightA, widthB, heightB;
+    if (!LoadBMP(fileA, a, widthA, heightA) || !LoadBMP(fileB, b, widthB, heightB)) {
+        return false;
+    }
+    if (widthA != widthB || heightA != heightB) {
+        return false;
+    }
+
+    result.width = widthA;
+    result.height = heightA;
+    result.psnr = ComputePSNR(a.data(), b.data(), widthA, heightA);
+    result.ssim = ComputeSSIM(a.data(), b.data(), widthA, heightA);
+    return true;
+}
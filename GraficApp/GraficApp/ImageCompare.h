@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ImageCompareResult {
+    int width = 0;
+    int height = 0;
+    double psnr = 0.0; // dB, +infinity for identical images
+    double ssim = 0.0;
+};
+
+// Larger images are rejected before anything is allocated, same limit as DdsMaxDimension
+const int BmpMaxDimension = 16384;
+
+// Reads uncompressed 24 and 32 bit BMP files (as written by SoftwareRasterizer::SaveBMP)
+// into top-down BGRA8 pixels. Fails if the header claims more pixel data than the file holds
+bool LoadBMP(const std::string& fileName, std::vector<uint8_t>& pixels, int& width, int& height);
+
+// Fails if a file can not be read or the sizes differ
+bool CompareImages(const std::string& fileA, const std::string& fileB, ImageCompareResult& result);
@@ -0,0 +1,375 @@
+#include "ImageKernels.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define IMAGE_KERNELS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#else
+#define IMAGE_KERNELS_X86 0
+#endif
+
+namespace {
+    // Enough rows per task to hide the ParallelFor overhead, 135 tasks for a 4K frame
+    const int RowsPerTask = 16;
+    const int SSIMBlock = 8;
+
+    ImageKernelPath& ActivePath() {
+        static ImageKernelPath path = IsAVX2Supported() ? ImageKernelPath::AVX2 : ImageKernelPath::Scalar;
+        return path;
+    }
+
+    bool UseAVX2() {
+        return ActivePath() == ImageKernelPath::AVX2;
+    }
+
+    void ParallelRows(int height, const std::function<void(int, int)>& task) {
+        size_t count = (size_t)((height + RowsPerTask - 1) / RowsPerTask);
+        ThreadPool::GetInstance().ParallelFor(count, [&](size_t i) {
+            int y0 = (int)i * RowsPerTask;
+            int y1 = y0 + RowsPerTask < height ? y0 + RowsPerTask : height;
+            task(y0, y1);
+        });
+    }
+
+    uint8_t ToUNorm8(float value) {
+        value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+        return (uint8_t)(value * 255.0f + 0.5f);
+    }
+
+    // Per channel sums over one SSIM block, kept in integers so both paths match exactly
+    struct BlockSums {
+        int32_t a[4];
+        int32_t b[4];
+        int32_t aa[4];
+        int32_t bb[4];
+        int32_t ab[4];
+    };
+
+    double BlockSSIM(const BlockSums& sums, int pixelCount) {
+        const double C1 = (0.01 * 255.0) * (0.01 * 255.0);
+        const double C2 = (0.03 * 255.0) * (0.03 * 255.0);
+        const double n = pixelCount;
+
+        double ssim = 0.0;
+        for (int c = 0; c < 3; c++) {
+            double muA = sums.a[c] / n;
+            double muB = sums.b[c] / n;
+            double varA = sums.aa[c] / n - muA * muA;
+            double varB = sums.bb[c] / n - muB * muB;
+            double cov = sums.ab[c] / n - muA * muB;
+            ssim += ((2.0 * muA * muB + C1) * (2.0 * cov + C2)) / ((muA * muA + muB * muB + C1) * (varA + varB + C2));
+        }
+        return ssim / 3.0;
+    }
+
+    void InvertRowScalar(float* row, int width) {
+        for (int x = 0; x < width; x++) {
+            float* p = row + x * 4;
+            p[0] = 1.0f - p[0];
+            p[1] = 1.0f - p[1];
+            p[2] = 1.0f - p[2];
+            p[3] = 1.0f;
+        }
+    }
+
+    void InvertRowScalar(uint8_t* row, int width) {
+        for (int x = 0; x < width; x++) {
+            uint8_t* p = row + x * 4;
+            p[0] = (uint8_t)(255 - p[0]);
+            p[1] = (uint8_t)(255 - p[1]);
+            p[2] = (uint8_t)(255 - p[2]);
+            p[3] = 255;
+        }
+    }
+
+    void ConvertRowScalar(const float* src, uint8_t* dst, int width) {
+        for (int x = 0; x < width; x++) {
+            dst[x * 4 + 0] = ToUNorm8(src[x * 4 + 2]);
+            dst[x * 4 + 1] = ToUNorm8(src[x * 4 + 1]);
+            dst[x * 4 + 2] = ToUNorm8(src[x * 4 + 0]);
+            dst[x * 4 + 3] = ToUNorm8(src[x * 4 + 3]);
+        }
+    }
+
+    uint64_t SquaredErrorRowScalar(const uint8_t* a, const uint8_t* b, int width) {
+        uint64_t sum = 0;
+        for (int x = 0; x < width; x++) {
+            for (int c = 0; c < 3; c++) {
+                int d = (int)a[x * 4 + c] - (int)b[x * 4 + c];
+                sum += (uint64_t)(d * d);
+            }
+        }
+        return sum;
+    }
+
+    void BlockSumsScalar(const uint8_t* a, const uint8_t* b, int rowPitch, int blockWidth, int blockHeight, BlockSums& sums) {
+        for (int c = 0; c < 4; c++) {
+            sums.a[c] = sums.b[c] = sums.aa[c] = sums.bb[c] = sums.ab[c] = 0;
+        }
+        for (int y = 0; y < blockHeight; y++) {
+            const uint8_t* rowA = a + (size_t)y * rowPitch;
+            const uint8_t* rowB = b + (size_t)y * rowPitch;
+            for (int i = 0; i < blockWidth * 4; i++) {
+                int c = i & 3;
+                int va = rowA[i], vb = rowB[i];
+                sums.a[c] += va;
+                sums.b[c] += vb;
+                sums.aa[c] += va * va;
+                sums.bb[c] += vb * vb;
+                sums.ab[c] += va * vb;
+            }
+        }
+    }
+
+#if IMAGE_KERNELS_X86
+    AVX2_TARGET void InvertRowAVX2(float* row, int width) {
+        const __m256 ones = _mm256_set1_ps(1.0f);
+        int x = 0;
+        for (; x + 2 <= width; x += 2) {
+            __m256 v = _mm256_loadu_ps(row + x * 4);
+            v = _mm256_sub_ps(ones, v);
+            // Lanes 3 and 7 are alpha
+            _mm256_storeu_ps(row + x * 4, _mm256_blend_ps(v, ones, 0x88));
+        }
+        InvertRowScalar(row + x * 4, width - x);
+    }
+
+    AVX2_TARGET void InvertRowAVX2(uint8_t* row, int width) {
+        const __m256i ones = _mm256_set1_epi32(-1);
+        const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+        int x = 0;
+        for (; x + 8 <= width; x += 8) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(row + x * 4));
+            v = _mm256_or_si256(_mm256_xor_si256(v, ones), alpha);
+            _mm256_storeu_si256((__m256i*)(row + x * 4), v);
+        }
+        InvertRowScalar(row + x * 4, width - x);
+    }
+
+    AVX2_TARGET __m256i ToUNorm8AVX2(const float* src) {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 scale = _mm256_set1_ps(255.0f);
+        const __m256 half = _mm256_set1_ps(0.5f);
+        __m256 v = _mm256_loadu_ps(src);
+        // rgba -> bgra
+        v = _mm256_permute_ps(v, _MM_SHUFFLE(3, 0, 1, 2));
+        v = _mm256_min_ps(_mm256_max_ps(v, zero), one);
+        v = _mm256_add_ps(_mm256_mul_ps(v, scale), half);
+        return _mm256_cvttps_epi32(v);
+    }
+
+    AVX2_TARGET void ConvertRowAVX2(const float* src, uint8_t* dst, int width) {
+        // packs works per 128-bit lane, the permute restores the pixel order
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        int x = 0;
+        for (; x + 8 <= width; x += 8) {
+            const float* p = src + x * 4;
+            __m256i p01 = _mm256_packs_epi32(ToUNorm8AVX2(p), ToUNorm8AVX2(p + 8));
+            __m256i p23 = _mm256_packs_epi32(ToUNorm8AVX2(p + 16), ToUNorm8AVX2(p + 24));
+            __m256i bytes = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(p01, p23), order);
+            _mm256_storeu_si256((__m256i*)(dst + x * 4), bytes);
+        }
+        ConvertRowScalar(src + x * 4, dst + x * 4, width - x);
+    }
+
+    AVX2_TARGET uint64_t SquaredErrorRowAVX2(const uint8_t* a, const uint8_t* b, int width) {
+        const __m256i rgb = _mm256_set1_epi32(0x00FFFFFF);
+        __m256i acc = _mm256_setzero_si256();
+        int x = 0;
+        for (; x + 8 <= width; x += 8) {
+            __m256i va = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(a + x * 4)), rgb);
+            __m256i vb = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(b + x * 4)), rgb);
+            __m256i lo = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(va)), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(vb)));
+            __m256i hi = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(va, 1)), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(vb, 1)));
+            // At most 2 * 255^2 per lane and step, a 16K wide row still fits in 32 bits
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(lo, lo));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(hi, hi));
+        }
+
+        alignas(32) uint32_t lanes[8];
+        _mm256_store_si256((__m256i*)lanes, acc);
+        uint64_t sum = 0;
+        for (int i = 0; i < 8; i++) {
+            sum += lanes[i];
+        }
+        return sum + SquaredErrorRowScalar(a + x * 4, b + x * 4, width - x);
+    }
+
+    AVX2_TARGET void BlockSumsAVX2(const uint8_t* a, const uint8_t* b, int rowPitch, BlockSums& sums) {
+        // Two pixels per register, lane i holds channel i & 3
+        __m256i sa = _mm256_setzero_si256(), sb = _mm256_setzero_si256();
+        __m256i saa = _mm256_setzero_si256(), sbb = _mm256_setzero_si256(), sab = _mm256_setzero_si256();
+        for (int y = 0; y < SSIMBlock; y++) {
+            const uint8_t* rowA = a + (size_t)y * rowPitch;
+            const uint8_t* rowB = b + (size_t)y * rowPitch;
+            for (int i = 0; i < SSIMBlock * 4; i += 8) {
+                __m256i va = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(rowA + i)));
+                __m256i vb = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(rowB + i)));
+                sa = _mm256_add_epi32(sa, va);
+                sb = _mm256_add_epi32(sb, vb);
+                saa = _mm256_add_epi32(saa, _mm256_mullo_epi32(va, va));
+                sbb = _mm256_add_epi32(sbb, _mm256_mullo_epi32(vb, vb));
+                sab = _mm256_add_epi32(sab, _mm256_mullo_epi32(va, vb));
+            }
+        }
+
+        alignas(32) int32_t lanes[5][8];
+        _mm256_store_si256((__m256i*)lanes[0], sa);
+        _mm256_store_si256((__m256i*)lanes[1], sb);
+        _mm256_store_si256((__m256i*)lanes[2], saa);
+        _mm256_store_si256((__m256i*)lanes[3], sbb);
+        _mm256_store_si256((__m256i*)lanes[4], sab);
+        for (int c = 0; c < 4; c++) {
+            sums.a[c] = lanes[0][c] + lanes[0][c + 4];
+            sums.b[c] = lanes[1][c] + lanes[1][c + 4];
+            sums.aa[c] = lanes[2][c] + lanes[2][c + 4];
+            sums.bb[c] = lanes[3][c] + lanes[3][c + 4];
+            sums.ab[c] = lanes[4][c] + lanes[4][c + 4];
+        }
+    }
+#else
+    void InvertRowAVX2(float* row, int width) { InvertRowScalar(row, width); }
+    void InvertRowAVX2(uint8_t* row, int width) { InvertRowScalar(row, width); }
+    void ConvertRowAVX2(const float* src, uint8_t* dst, int width) { ConvertRowScalar(src, dst, width); }
+    uint64_t SquaredErrorRowAVX2(const uint8_t* a, const uint8_t* b, int width) { return SquaredErrorRowScalar(a, b, width); }
+    void BlockSumsAVX2(const uint8_t* a, const uint8_t* b, int rowPitch, BlockSums& sums) { BlockSumsScalar(a, b, rowPitch, SSIMBlock, SSIMBlock, sums); }
+#endif
+}
+
+bool IsAVX2Supported() {
+#if IMAGE_KERNELS_X86 && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    // The OS has to save the ymm registers (OSXSAVE and XCR0 bits 1, 2)
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif IMAGE_KERNELS_X86
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+void SetImageKernelPath(ImageKernelPath path) {
+    if (path == ImageKernelPath::AVX2 && !IsAVX2Supported()) {
+        path = ImageKernelPath::Scalar;
+    }
+    ActivePath() = path;
+}
+
+ImageKernelPath GetImageKernelPath() {
+    return ActivePath();
+}
+
+void InvertRGBA32F(float* pixels, int width, int height, int stride) {
+    bool avx2 = UseAVX2();
+    ParallelRows(height, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            float* row = pixels + (size_t)y * stride * 4;
+            avx2 ? InvertRowAVX2(row, width) : InvertRowScalar(row, width);
+        }
+    });
+}
+
+void InvertRGBA8(uint8_t* pixels, int width, int height, int stride) {
+    bool avx2 = UseAVX2();
+    ParallelRows(height, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            uint8_t* row = pixels + (size_t)y * stride * 4;
+            avx2 ? InvertRowAVX2(row, width) : InvertRowScalar(row, width);
+        }
+    });
+}
+
+void ConvertRGBA32FToBGRA8(const float* src, int srcStride, uint8_t* dst, int width, int height) {
+    bool avx2 = UseAVX2();
+    ParallelRows(height, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            const float* srcRow = src + (size_t)y * srcStride * 4;
+            uint8_t* dstRow = dst + (size_t)y * width * 4;
+            avx2 ? ConvertRowAVX2(srcRow, dstRow, width) : ConvertRowScalar(srcRow, dstRow, width);
+        }
+    });
+}
+
+double ComputePSNR(const uint8_t* a, const uint8_t* b, int width, int height) {
+    bool avx2 = UseAVX2();
+    // One partial sum per task, added in order so the result does not depend on scheduling
+    std::vector<uint64_t> partial((size_t)((height + RowsPerTask - 1) / RowsPerTask), 0);
+    ParallelRows(height, [&](int y0, int y1) {
+        uint64_t sum = 0;
+        for (int y = y0; y < y1; y++) {
+            const uint8_t* rowA = a + (size_t)y * width * 4;
+            const uint8_t* rowB = b + (size_t)y * width * 4;
+            sum += avx2 ? SquaredErrorRowAVX2(rowA, rowB, width) : SquaredErrorRowScalar(rowA, rowB, width);
+        }
+        partial[y0 / RowsPerTask] = sum;
+    });
+
+    uint64_t sum = 0;
+    for (uint64_t value : partial) {
+        sum += value;
+    }
+    if (sum == 0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    double mse = (double)sum / ((double)width * height * 3.0);
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+double ComputeSSIM(const uint8_t* a, const uint8_t* b, int width, int height) {
+    if (width <= 0 || height <= 0) {
+        return 1.0;
+    }
+    // A thumbnail still gets compared, in blocks as wide or as high as the whole image
+    int blockWidth = width < SSIMBlock ? width : SSIMBlock;
+    int blockHeight = height < SSIMBlock ? height : SSIMBlock;
+    int blocksX = width / blockWidth;
+    int blocksY = height / blockHeight;
+
+    // The AVX2 sums only take full blocks
+    bool avx2 = UseAVX2() && blockWidth == SSIMBlock && blockHeight == SSIMBlock;
+    int rowPitch = width * 4;
+    std::vector<double> partial((size_t)blocksY, 0.0);
+    ThreadPool::GetInstance().ParallelFor((size_t)blocksY, [&](size_t by) {
+        double sum = 0.0;
+        for (int bx = 0; bx < blocksX; bx++) {
+            size_t offset = by * blockHeight * (size_t)rowPitch + (size_t)bx * blockWidth * 4;
+            BlockSums sums;
+            if (avx2) {
+                BlockSumsAVX2(a + offset, b + offset, rowPitch, sums);
+            }
+            else {
+                BlockSumsScalar(a + offset, b + offset, rowPitch, blockWidth, blockHeight, sums);
+            }
+            sum += BlockSSIM(sums, blockWidth * blockHeight);
+        }
+        partial[by] = sum;
+    });
+
+    double sum = 0.0;
+    for (double value : partial) {
+        sum += value;
+    }
+    return sum / ((double)blocksX * blocksY);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+// CPU image kernels for headless validation. Images are row-major RGBA with a row stride
+// in pixels, rows are split across ThreadPool. Every kernel has an AVX2 path and a scalar
+// path that give bit-identical results; the AVX2 path is used when the CPU supports it.
+enum class ImageKernelPath {
+    Scalar,
+    AVX2
+};
+
+bool IsAVX2Supported();
+// Forcing AVX2 on a CPU without it falls back to Scalar
+void SetImageKernelPath(ImageKernelPath path);
+ImageKernelPath GetImageKernelPath();
+
+// Same as the Invert post effect: rgb = 1 - rgb, alpha = 1
+void InvertRGBA32F(float* pixels, int width, int height, int stride);
+void InvertRGBA8(uint8_t* pixels, int width, int height, int stride);
+
+// Saturates and rounds to 8 bit, swapping red and blue. dst is tightly packed
+void ConvertRGBA32FToBGRA8(const float* src, int srcStride, uint8_t* dst, int width, int height);
+
+// Image comparison over the rgb channels of two tightly packed 4-byte images with the same
+// channel order. PSNR is in dB, identical images give +infinity
+double ComputePSNR(const uint8_t* a, const uint8_t* b, int width, int height);
+// SSIM of the r, g and b channels averaged over 8x8 blocks, 1 for identical images. Edge pixels
+// that do not fill a block are left out, blocks shrink to fit images smaller than 8 pixels
+double ComputeSSIM(const uint8_t* a, const uint8_t* b, int width, int height);
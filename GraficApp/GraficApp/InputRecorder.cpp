@@ -0,0 +1,154 @@
+#include "InputRecorder.h"
+
+#include <cstring>
+
+namespace {
+    const size_t FrameSize = 7;
+    const std::streamoff FrameCountOffset = 16;
+
+    void PutU32(uint8_t* dst, uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            dst[i] = (uint8_t)(value >> (i * 8));
+        }
+    }
+
+    uint32_t GetU32(const uint8_t* src) {
+        return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+    }
+
+    void PutI16(uint8_t* dst, int16_t value) {
+        dst[0] = (uint8_t)((uint16_t)value & 0xFF);
+        dst[1] = (uint8_t)((uint16_t)value >> 8);
+    }
+
+    int16_t GetI16(const uint8_t* src) {
+        return (int16_t)(uint16_t)(src[0] | (src[1] << 8));
+    }
+}
+
+CameraInput TranslateInput(const InputFrame& frame) {
+    // Same scale factors Renderer::InputHandler used with raw DirectInput state
+    CameraInput input;
+    input.dphi = frame.mouseX / 200.0f;
+    input.dtheta = frame.mouseY / 200.0f;
+    input.dr = -frame.mouseZ / 100.0f;
+
+    if (frame.keys & InputKeyForward)
+        input.dj += 0.05f;
+    if (frame.keys & InputKeyBackward)
+        input.dj -= 0.05f;
+    if (frame.keys & InputKeyLeft)
+        input.di += 0.05f;
+    if (frame.keys & InputKeyRight)
+        input.di -= 0.05f;
+    if (frame.keys & InputKeyDown)
+        input.dz -= 0.05f;
+    if (frame.keys & InputKeyUp)
+        input.dz += 0.05f;
+
+    return input;
+}
+
+bool InputRecorder::Open(const std::string& fileName, const InputRecordHeader& header) {
+    file_.open(fileName, std::ios::binary | std::ios::trunc);
+    if (!file_.is_open()) {
+        return false;
+    }
+
+    header_ = header;
+    header_.frameCount = 0;
+    WriteHeader();
+    return file_.good();
+}
+
+void InputRecorder::WriteHeader() {
+    uint8_t data[20];
+    uint32_t timeStepBits;
+    memcpy(&timeStepBits, &header_.timeStep, sizeof(timeStepBits));
+    PutU32(data, InputRecordHeader::Magic);
+    PutU32(data + 4, InputRecordHeader::Version);
+    PutU32(data + 8, header_.seed);
+    PutU32(data + 12, timeStepBits);
+    PutU32(data + 16, header_.frameCount);
+    file_.write((const char*)data, sizeof(data));
+}
+
+void InputRecorder::Write(const InputFrame& frame) {
+    if (!file_.is_open()) {
+        return;
+    }
+
+    uint8_t data[FrameSize];
+    PutI16(data, frame.mouseX);
+    PutI16(data + 2, frame.mouseY);
+    PutI16(data + 4, frame.mouseZ);
+    data[6] = frame.keys;
+    file_.write((const char*)data, sizeof(data));
+    header_.frameCount++;
+}
+
+bool InputRecorder::Close() {
+    if (!file_.is_open()) {
+        return false;
+    }
+
+    uint8_t data[4];
+    PutU32(data, header_.frameCount);
+    file_.seekp(FrameCountOffset);
+    file_.write((const char*)data, sizeof(data));
+
+    bool result = file_.good();
+    file_.close();
+    return result;
+}
+
+InputRecorder::~InputRecorder() {
+    Close();
+}
+
+bool InputReplayer::Open(const std::string& fileName) {
+    file_.open(fileName, std::ios::binary);
+    if (!file_.is_open()) {
+        return false;
+    }
+
+    uint8_t data[20];
+    file_.read((char*)data, sizeof(data));
+    if (!file_.good() || GetU32(data) != InputRecordHeader::Magic || GetU32(data + 4) != InputRecordHeader::Version) {
+        file_.close();
+        return false;
+    }
+
+    uint32_t timeStepBits = GetU32(data + 12);
+    header_.seed = GetU32(data + 8);
+    memcpy(&header_.timeStep, &timeStepBits, sizeof(timeStepBits));
+    header_.frameCount = GetU32(data + 16);
+    frameIndex_ = 0;
+
+    return header_.timeStep > 0.0f;
+}
+
+bool InputReplayer::Read(InputFrame& frame) {
+    if (!file_.is_open() || frameIndex_ >= header_.frameCount) {
+        return false;
+    }
+
+    uint8_t data[FrameSize];
+    file_.read((char*)data, sizeof(data));
+    if (!file_.good()) {
+        return false;
+    }
+
+    frame.mouseX = GetI16(data);
+    frame.mouseY = GetI16(data + 2);
+    frame.mouseZ = GetI16(data + 4);
+    frame.keys = data[6];
+    frameIndex_++;
+    return true;
+}
+
+void InputReplayer::Close() {
+    if (file_.is_open()) {
+        file_.close();
+    }
+}
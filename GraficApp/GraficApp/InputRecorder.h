@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// Per-frame input snapshot, the only thing Renderer::InputHandler reads.
+// Portable, InputRecorderTest replays recordings on any platform.
+enum InputKey : uint8_t {
+    InputKeyForward  = 1 << 0,
+    InputKeyBackward = 1 << 1,
+    InputKeyLeft     = 1 << 2,
+    InputKeyRight    = 1 << 3,
+    InputKeyDown     = 1 << 4,
+    InputKeyUp       = 1 << 5
+};
+
+struct InputFrame {
+    int16_t mouseX = 0;
+    int16_t mouseY = 0;
+    int16_t mouseZ = 0;
+    uint8_t keys = 0;
+};
+
+// Camera deltas produced by one InputFrame
+struct CameraInput {
+    float dphi = 0.0f;
+    float dtheta = 0.0f;
+    float dr = 0.0f;
+    float di = 0.0f;
+    float dj = 0.0f;
+    float dz = 0.0f;
+};
+
+CameraInput TranslateInput(const InputFrame& frame);
+
+struct InputRecordHeader {
+    static constexpr uint32_t Magic = 0x504E4947; // "GINP"
+    static constexpr uint32_t Version = 1;
+
+    uint32_t seed = 1;
+    float timeStep = 1.0f / 60.0f;
+    uint32_t frameCount = 0;
+};
+
+// File layout: magic, version, seed, timeStep, frameCount, then frameCount records of 7 bytes
+class InputRecorder {
+public:
+    InputRecorder() = default;
+
+    InputRecorder(const InputRecorder&) = delete;
+    InputRecorder(InputRecorder&&) = delete;
+
+    bool Open(const std::string& fileName, const InputRecordHeader& header);
+    void Write(const InputFrame& frame);
+    // Patches the frame count into the header
+    bool Close();
+
+    bool IsOpen() const { return file_.is_open(); };
+    const InputRecordHeader& GetHeader() const { return header_; };
+
+    ~InputRecorder();
+private:
+    void WriteHeader();
+
+    std::ofstream file_;
+    InputRecordHeader header_;
+};
+
+class InputReplayer {
+public:
+    InputReplayer() = default;
+
+    InputReplayer(const InputReplayer&) = delete;
+    InputReplayer(InputReplayer&&) = delete;
+
+    bool Open(const std::string& fileName);
+    // Returns false once every recorded frame was consumed
+    bool Read(InputFrame& frame);
+    void Close();
+
+    bool IsOpen() const { return file_.is_open(); };
+    const InputRecordHeader& GetHeader() const { return header_; };
+    uint32_t GetFrameIndex() const { return frameIndex_; };
+
+    ~InputReplayer() = default;
+private:
+    std::ifstream file_;
+    InputRecordHeader header_;
+    uint32_t frameIndex_ = 0;
+};
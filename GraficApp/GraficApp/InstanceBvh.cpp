@@ -0,0 +1,444 @@
+#include "InstanceBvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define INSTANCE_BVH_X86 1
+#include <emmintrin.h>
+#else
+#define INSTANCE_BVH_X86 0
+#endif
+
+namespace {
+    const uint32_t LeafSize = 4;
+    // Leaves this small are kept when no split beats them
+    const uint32_t MaxLeafSize = 16;
+    const int BinCount = 16;
+
+    const float Infinity = std::numeric_limits<float>::infinity();
+
+    struct Bounds {
+        float min[3];
+        float max[3];
+
+        void Reset() {
+            for (int axis = 0; axis < 3; axis++) {
+                min[axis] = Infinity;
+                max[axis] = -Infinity;
+            }
+        }
+
+        void Grow(const float* low, const float* high) {
+            for (int axis = 0; axis < 3; axis++) {
+                min[axis] = low[axis] < min[axis] ? low[axis] : min[axis];
+                max[axis] = high[axis] > max[axis] ? high[axis] : max[axis];
+            }
+        }
+
+        float Area() const {
+            float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+            return dx < 0.0f ? 0.0f : 2.0f * (dx * dy + dy * dz + dz * dx);
+        }
+    };
+
+    // Precomputed once per ray; zero direction components are nudged so no slab produces NaN
+    struct RayData {
+        float origin[3];
+        float inverse[3];
+    };
+
+    RayData PrepareRay(const PickRay& ray) {
+        RayData data;
+        for (int axis = 0; axis < 3; axis++) {
+            float d = ray.direction[axis];
+            d = fabsf(d) < 1e-20f ? (d < 0.0f ? -1e-20f : 1e-20f) : d;
+            data.origin[axis] = ray.origin[axis];
+            data.inverse[axis] = 1.0f / d;
+        }
+        return data;
+    }
+
+    bool SlabTest(const float origin[3], const float inverse[3], const float* min, const float* max, float best, float& distance) {
+        float tNear = 0.0f, tFar = best;
+        for (int axis = 0; axis < 3; axis++) {
+            float t0 = (min[axis] - origin[axis]) * inverse[axis];
+            float t1 = (max[axis] - origin[axis]) * inverse[axis];
+            tNear = std::max(tNear, std::min(t0, t1));
+            tFar = std::min(tFar, std::max(t0, t1));
+        }
+        distance = tNear;
+        return tNear <= tFar;
+    }
+
+    // The ray in instance space keeps its parameter, so the local hit distance is the world one
+    bool IntersectInstance(const PickRay& ray, const float* m, const float boxMin[3], const float boxMax[3], float best, float& distance) {
+        // Inverse of the upper 3x3 by cofactors
+        float c00 = m[5] * m[10] - m[6] * m[9], c01 = m[6] * m[8] - m[4] * m[10], c02 = m[4] * m[9] - m[5] * m[8];
+        float det = m[0] * c00 + m[1] * c01 + m[2] * c02;
+        if (fabsf(det) < 1e-30f) {
+            return false;
+        }
+        float s = 1.0f / det;
+        const float inv[9] = {
+            c00 * s, (m[2] * m[9] - m[1] * m[10]) * s, (m[1] * m[6] - m[2] * m[5]) * s,
+            c01 * s, (m[0] * m[10] - m[2] * m[8]) * s, (m[2] * m[4] - m[0] * m[6]) * s,
+            c02 * s, (m[1] * m[8] - m[0] * m[9]) * s, (m[0] * m[5] - m[1] * m[4]) * s
+        };
+
+        // Row vectors: local = (world - translation) * inverse
+        PickRay local;
+        const float offset[3] = { ray.origin[0] - m[12], ray.origin[1] - m[13], ray.origin[2] - m[14] };
+        for (int column = 0; column < 3; column++) {
+            local.origin[column] = offset[0] * inv[column] + offset[1] * inv[3 + column] + offset[2] * inv[6 + column];
+            local.direction[column] = ray.direction[0] * inv[column] + ray.direction[1] * inv[3 + column] + ray.direction[2] * inv[6 + column];
+        }
+        RayData data = PrepareRay(local);
+        return SlabTest(data.origin, data.inverse, boxMin, boxMax, best, distance);
+    }
+
+    // Bit i set when child i of the node is hit before best, distances in near
+    uint32_t TestChildren(const RayData& ray, const float* node, uint32_t count, float best, float near[4]) {
+#if INSTANCE_BVH_X86
+        const __m128 zero = _mm_setzero_ps();
+        __m128 tNear = zero, tFar = _mm_set1_ps(best);
+        for (int axis = 0; axis < 3; axis++) {
+            __m128 origin = _mm_set1_ps(ray.origin[axis]), inverse = _mm_set1_ps(ray.inverse[axis]);
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node + axis * 4), origin), inverse);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node + 12 + axis * 4), origin), inverse);
+            tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+            tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+        }
+        _mm_storeu_ps(near, tNear);
+        return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) & ((1u << count) - 1);
+#else
+        uint32_t mask = 0;
+        for (uint32_t lane = 0; lane < count; lane++) {
+            const float min[3] = { node[lane], node[4 + lane], node[8 + lane] };
+            const float max[3] = { node[12 + lane], node[16 + lane], node[20 + lane] };
+            mask |= SlabTest(ray.origin, ray.inverse, min, max, best, near[lane]) ? 1u << lane : 0;
+        }
+        return mask;
+#endif
+    }
+}
+
+void ComputeInstanceBounds(const float* matrices, size_t count, const float boxMin[3], const float boxMax[3], float* bounds) {
+    const float center[3] = { (boxMin[0] + boxMax[0]) * 0.5f, (boxMin[1] + boxMax[1]) * 0.5f, (boxMin[2] + boxMax[2]) * 0.5f };
+    const float extent[3] = { (boxMax[0] - boxMin[0]) * 0.5f, (boxMax[1] - boxMin[1]) * 0.5f, (boxMax[2] - boxMin[2]) * 0.5f };
+    for (size_t i = 0; i < count; i++) {
+        const float* m = matrices + i * 16;
+        float* out = bounds + i * 6;
+        // Center transformed, extent through the absolute matrix
+        for (int column = 0; column < 3; column++) {
+            float c = center[0] * m[column] + center[1] * m[4 + column] + center[2] * m[8 + column] + m[12 + column];
+            float e = extent[0] * fabsf(m[column]) + extent[1] * fabsf(m[4 + column]) + extent[2] * fabsf(m[8 + column]);
+            out[column] = c - e;
+            out[3 + column] = c + e;
+        }
+    }
+}
+
+void BuildBvh(const float* bounds, uint32_t count, std::vector<SceneBvhNode>& nodes, std::vector<uint32_t>& indices) {
+    nodes.clear();
+    indices.resize(count);
+    if (count == 0) {
+        return;
+    }
+
+    // Bounds travel with their index so every pass over a range reads memory in order
+    struct Reference {
+        float min[3];
+        float max[3];
+        uint32_t index;
+
+        float Centroid(int axis) const { return (min[axis] + max[axis]) * 0.5f; };
+    };
+    std::vector<Reference> references(count);
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(references[i].min, bounds + (size_t)i * 6, 3 * sizeof(float));
+        memcpy(references[i].max, bounds + (size_t)i * 6 + 3, 3 * sizeof(float));
+        references[i].index = i;
+    }
+
+    struct Item {
+        uint32_t node;
+        uint32_t begin;
+        uint32_t end;
+    };
+    std::vector<Item> stack;
+    nodes.push_back({});
+    stack.push_back({ 0, 0, count });
+    while (!stack.empty()) {
+        Item item = stack.back();
+        stack.pop_back();
+
+        Bounds box, centroidBox;
+        box.Reset();
+        centroidBox.Reset();
+        for (uint32_t i = item.begin; i < item.end; i++) {
+            const Reference& reference = references[i];
+            const float centroid[3] = { reference.Centroid(0), reference.Centroid(1), reference.Centroid(2) };
+            box.Grow(reference.min, reference.max);
+            centroidBox.Grow(centroid, centroid);
+        }
+        SceneBvhNode& node = nodes[item.node];
+        memcpy(node.min, box.min, sizeof(node.min));
+        memcpy(node.max, box.max, sizeof(node.max));
+        node.first = item.begin;
+        node.count = item.end - item.begin;
+        if (node.count <= LeafSize) {
+            continue;
+        }
+
+        int axis = 0;
+        for (int a = 1; a < 3; a++) {
+            if (centroidBox.max[a] - centroidBox.min[a] > centroidBox.max[axis] - centroidBox.min[axis]) {
+                axis = a;
+            }
+        }
+        float low = centroidBox.min[axis], extent = centroidBox.max[axis] - low;
+
+        uint32_t middle = item.begin;
+        if (extent > 0.0f) {
+            // Binned SAH along the widest centroid axis
+            Bounds bins[BinCount];
+            uint32_t binCounts[BinCount] = {};
+            for (int bin = 0; bin < BinCount; bin++) {
+                bins[bin].Reset();
+            }
+            float scale = BinCount / extent;
+            auto binOf = [&](const Reference& reference) {
+                int bin = (int)((reference.Centroid(axis) - low) * scale);
+                return bin < BinCount ? bin : BinCount - 1;
+            };
+            for (uint32_t i = item.begin; i < item.end; i++) {
+                int bin = binOf(references[i]);
+                bins[bin].Grow(references[i].min, references[i].max);
+                binCounts[bin]++;
+            }
+
+            float rightArea[BinCount];
+            uint32_t rightCount[BinCount];
+            Bounds right;
+            right.Reset();
+            uint32_t sum = 0;
+            for (int bin = BinCount - 1; bin > 0; bin--) {
+                right.Grow(bins[bin].min, bins[bin].max);
+                sum += binCounts[bin];
+                rightArea[bin] = right.Area();
+                rightCount[bin] = sum;
+            }
+
+            Bounds left;
+            left.Reset();
+            sum = 0;
+            float bestCost = Infinity;
+            int bestSplit = -1;
+            for (int split = 1; split < BinCount; split++) {
+                left.Grow(bins[split - 1].min, bins[split - 1].max);
+                sum += binCounts[split - 1];
+                if (sum == 0 || rightCount[split] == 0) {
+                    continue;
+                }
+                float cost = left.Area() * sum + rightArea[split] * rightCount[split];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestSplit = split;
+                }
+            }
+
+            if (bestSplit < 0 || (bestCost >= box.Area() * node.count && node.count <= MaxLeafSize)) {
+                if (node.count <= MaxLeafSize) {
+                    continue;
+                }
+            }
+            else {
+                middle = (uint32_t)(std::partition(references.begin() + item.begin, references.begin() + item.end,
+                    [&](const Reference& reference) { return binOf(reference) < bestSplit; }) - references.begin());
+            }
+        }
+        // Equal centroids or no useful split of a big node: halve it
+        if (middle == item.begin || middle == item.end) {
+            middle = item.begin + (item.end - item.begin) / 2;
+            std::nth_element(references.begin() + item.begin, references.begin() + middle, references.begin() + item.end,
+                [&](const Reference& a, const Reference& b) { return a.Centroid(axis) < b.Centroid(axis); });
+        }
+
+        // Children go to the end, after their parent
+        uint32_t first = (uint32_t)nodes.size();
+        nodes[item.node].first = first;
+        nodes[item.node].count = 0;
+        nodes.push_back({});
+        nodes.push_back({});
+        stack.push_back({ first, item.begin, middle });
+        stack.push_back({ first + 1, middle, item.end });
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        indices[i] = references[i].index;
+    }
+}
+
+void InstanceBvh::Build(const float* bounds, uint32_t count) {
+    BuildBvh(bounds, count, nodes_, indices_);
+    Collapse();
+}
+
+void InstanceBvh::Assign(const SceneBvhNode* nodes, uint32_t nodeCount, const uint32_t* indices, uint32_t indexCount) {
+    nodes_.assign(nodes, nodes + nodeCount);
+    indices_.assign(indices, indices + indexCount);
+    Collapse();
+}
+
+void InstanceBvh::Collapse() {
+    wide_.clear();
+    if (nodes_.empty()) {
+        return;
+    }
+
+    // A wide node takes the children of a binary node and keeps opening its largest inner
+    // child until it has four
+    struct Item {
+        uint32_t binary;
+        int32_t parent;
+        uint32_t lane;
+    };
+    std::vector<Item> stack;
+    stack.push_back({ 0, -1, 0 });
+    while (!stack.empty()) {
+        Item item = stack.back();
+        stack.pop_back();
+
+        uint32_t children[4];
+        uint32_t count = 0;
+        if (nodes_[item.binary].count > 0) {
+            children[count++] = item.binary;
+        }
+        else {
+            children[count++] = nodes_[item.binary].first;
+            children[count++] = nodes_[item.binary].first + 1;
+        }
+        while (count < 4) {
+            int open = -1;
+            float openArea = -1.0f;
+            for (uint32_t i = 0; i < count; i++) {
+                const SceneBvhNode& child = nodes_[children[i]];
+                Bounds box;
+                memcpy(box.min, child.min, sizeof(box.min));
+                memcpy(box.max, child.max, sizeof(box.max));
+                if (child.count == 0 && box.Area() > openArea) {
+                    open = (int)i;
+                    openArea = box.Area();
+                }
+            }
+            if (open < 0) {
+                break;
+            }
+            uint32_t first = nodes_[children[open]].first;
+            children[open] = first;
+            children[count++] = first + 1;
+        }
+
+        int32_t index = (int32_t)wide_.size();
+        WideNode wide = {};
+        wide.count = count;
+        for (uint32_t lane = 0; lane < count; lane++) {
+            const SceneBvhNode& child = nodes_[children[lane]];
+            wide.minX[lane] = child.min[0];
+            wide.minY[lane] = child.min[1];
+            wide.minZ[lane] = child.min[2];
+            wide.maxX[lane] = child.max[0];
+            wide.maxY[lane] = child.max[1];
+            wide.maxZ[lane] = child.max[2];
+            wide.children[lane] = ~(int32_t)children[lane];
+        }
+        wide_.push_back(wide);
+        if (item.parent >= 0) {
+            wide_[item.parent].children[item.lane] = index;
+        }
+        for (uint32_t lane = 0; lane < count; lane++) {
+            if (nodes_[children[lane]].count == 0) {
+                stack.push_back({ children[lane], index, lane });
+            }
+        }
+    }
+}
+
+bool InstanceBvh::Pick(const PickRay& ray, const float* matrices, const float boxMin[3], const float boxMax[3], PickHit& hit) const {
+    hit.instance = UINT32_MAX;
+    hit.distance = Infinity;
+    if (wide_.empty()) {
+        return false;
+    }
+
+    struct Entry {
+        int32_t node;
+        float distance;
+    };
+    std::vector<Entry> stack;
+    stack.reserve(64);
+    stack.push_back({ 0, 0.0f });
+    RayData data = PrepareRay(ray);
+    while (!stack.empty()) {
+        Entry entry = stack.back();
+        stack.pop_back();
+        if (entry.distance > hit.distance) {
+            continue;
+        }
+
+        const WideNode& node = wide_[entry.node];
+        float near[4];
+        uint32_t mask = TestChildren(data, node.minX, node.count, hit.distance, near);
+
+        // Inner children are pushed far to near so the nearest is opened first
+        Entry inner[4];
+        uint32_t innerCount = 0;
+        for (uint32_t lane = 0; lane < node.count; lane++) {
+            if ((mask & (1u << lane)) == 0) {
+                continue;
+            }
+            int32_t child = node.children[lane];
+            if (child >= 0) {
+                inner[innerCount++] = { child, near[lane] };
+                continue;
+            }
+
+            const SceneBvhNode& leaf = nodes_[~child];
+            for (uint32_t i = leaf.first; i < leaf.first + leaf.count; i++) {
+                uint32_t instance = indices_[i];
+                float distance;
+                if (IntersectInstance(ray, matrices + (size_t)instance * 16, boxMin, boxMax, hit.distance, distance) &&
+                    (distance < hit.distance || (distance == hit.distance && instance < hit.instance))) {
+                    hit.instance = instance;
+                    hit.distance = distance;
+                }
+            }
+        }
+        for (uint32_t i = 1; i < innerCount; i++) {
+            for (uint32_t j = i; j > 0 && inner[j - 1].distance < inner[j].distance; j--) {
+                std::swap(inner[j - 1], inner[j]);
+            }
+        }
+        for (uint32_t i = 0; i < innerCount; i++) {
+            stack.push_back(inner[i]);
+        }
+    }
+
+    return hit.instance != UINT32_MAX;
+}
+
+bool PickBruteForce(const PickRay& ray, const float* matrices, size_t count, const float boxMin[3], const float boxMax[3], PickHit& hit) {
+    hit.instance = UINT32_MAX;
+    hit.distance = Infinity;
+    for (size_t i = 0; i < count; i++) {
+        float distance;
+        if (IntersectInstance(ray, matrices + i * 16, boxMin, boxMax, hit.distance, distance) && distance < hit.distance) {
+            hit.instance = (uint32_t)i;
+            hit.distance = distance;
+        }
+    }
+    return hit.instance != UINT32_MAX;
+}
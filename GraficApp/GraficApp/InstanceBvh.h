@@ -0,0 +1,68 @@
+#pragma once
+
+#include "SceneFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// direction has to be normalized, hit distances are measured along it
+struct PickRay {
+    float origin[3];
+    float direction[3];
+};
+
+struct PickHit {
+    uint32_t instance;
+    float distance;
+};
+
+// World bounds of boxes placed by matrices (16 floats per instance, row-major for row
+// vectors like AnimateInstances writes them); 6 floats per instance, min then max
+void ComputeInstanceBounds(const float* matrices, size_t count, const float boxMin[3], const float boxMax[3], float* bounds);
+
+// Binned SAH build into the scene file layout, so a BVH can be stored with the scene
+void BuildBvh(const float* bounds, uint32_t count, std::vector<SceneBvhNode>& nodes, std::vector<uint32_t>& indices);
+
+// Picking structure over instance bounds. The binary BVH is collapsed into nodes with four
+// children whose bounds are stored as structure of arrays, so one SSE slab test checks all
+// four. Leaves are tested exactly against the box in instance space.
+class InstanceBvh {
+public:
+    InstanceBvh() = default;
+
+    void Build(const float* bounds, uint32_t count);
+    // Copies a BVH loaded with a scene file, SceneFile has validated it
+    void Assign(const SceneBvhNode* nodes, uint32_t nodeCount, const uint32_t* indices, uint32_t indexCount);
+
+    // Nearest instance whose box the ray hits, matrices are the ones the bounds came from
+    bool Pick(const PickRay& ray, const float* matrices, const float boxMin[3], const float boxMax[3], PickHit& hit) const;
+
+    const std::vector<SceneBvhNode>& GetNodes() const { return nodes_; };
+    const std::vector<uint32_t>& GetIndices() const { return indices_; };
+    size_t GetWideNodeCount() const { return wide_.size(); };
+
+    ~InstanceBvh() = default;
+private:
+    // children >= 0 are wide nodes, ~children are binary leaves; lanes past count are unused
+    struct WideNode {
+        float minX[4];
+        float minY[4];
+        float minZ[4];
+        float maxX[4];
+        float maxY[4];
+        float maxZ[4];
+        int32_t children[4];
+        uint32_t count;
+    };
+
+    void Collapse();
+
+    std::vector<SceneBvhNode> nodes_;
+    std::vector<uint32_t> indices_;
+    std::vector<WideNode> wide_;
+};
+
+// Reference for the tests, checks every instance
+bool PickBruteForce(const PickRay& ray, const float* matrices, size_t count, const float boxMin[3], const float boxMax[3], PickHit& hit);
@@ -0,0 +1,153 @@
+#include "InstancePacking.h"
+
+#include <cmath>
+#include <cstring>
+
+uint16_t FloatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (((bits >> 23) & 0xFF) == 0xFF) {
+        return (uint16_t)(sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0));
+    }
+    if (exponent >= 31) {
+        return (uint16_t)(sign | 0x7C00);
+    }
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return (uint16_t)sign;
+        }
+        // Denormal, round to nearest even
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t middle = 1u << (shift - 1);
+        if (rest > middle || (rest == middle && (half & 1))) {
+            half++;
+        }
+        return (uint16_t)(sign | half);
+    }
+
+    uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+        half++; // may carry into the exponent, which rounds up to the next power of two or infinity
+    }
+    return (uint16_t)(sign | half);
+}
+
+float HalfToFloat(uint16_t value) {
+    uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+
+    uint32_t bits;
+    if (exponent == 0x1F) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    }
+    else if (exponent != 0) {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    else if (mantissa != 0) {
+        // Denormal, normalize it
+        exponent = 127 - 15 + 1;
+        while ((mantissa & 0x400) == 0) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+    }
+    else {
+        bits = sign;
+    }
+
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+namespace {
+    uint32_t PackSnorm16(float value) {
+        value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+        return (uint32_t)(uint16_t)(int16_t)lroundf(value * 32767.0f);
+    }
+
+    float UnpackSnorm16(uint32_t value) {
+        float result = (float)(int16_t)(uint16_t)value / 32767.0f;
+        return result < -1.0f ? -1.0f : result;
+    }
+}
+
+PackedInstance PackInstance(const InstanceTransform& transform) {
+    PackedInstance instance;
+    for (int i = 0; i < 3; i++) {
+        instance.position[i] = transform.position[i];
+    }
+    instance.scale = transform.scale;
+
+    // q and -q are the same rotation, store the one with w >= 0
+    float sign = transform.rotation[3] < 0.0f ? -1.0f : 1.0f;
+    const float* q = transform.rotation;
+    instance.rotation[0] = PackSnorm16(sign * q[0]) | (PackSnorm16(sign * q[1]) << 16);
+    instance.rotation[1] = PackSnorm16(sign * q[2]) | (PackSnorm16(sign * q[3]) << 16);
+
+    instance.material = FloatToHalf(transform.shininess);
+    instance.textureIds = (transform.textureIndex & 0xFFFF) | (transform.normalMap ? 0x10000u : 0u);
+    return instance;
+}
+
+InstanceTransform UnpackInstance(const PackedInstance& instance) {
+    InstanceTransform transform;
+    for (int i = 0; i < 3; i++) {
+        transform.position[i] = instance.position[i];
+    }
+    transform.scale = instance.scale;
+
+    float q[4] = {
+        UnpackSnorm16(instance.rotation[0] & 0xFFFF), UnpackSnorm16(instance.rotation[0] >> 16),
+        UnpackSnorm16(instance.rotation[1] & 0xFFFF), UnpackSnorm16(instance.rotation[1] >> 16)
+    };
+    float length = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for (int i = 0; i < 4; i++) {
+        transform.rotation[i] = length > 0.0f ? q[i] / length : (i == 3 ? 1.0f : 0.0f);
+    }
+
+    transform.shininess = HalfToFloat((uint16_t)(instance.material & 0xFFFF));
+    transform.textureIndex = instance.textureIds & 0xFFFF;
+    transform.normalMap = (instance.textureIds & 0x10000) != 0;
+    return transform;
+}
+
+void RotateVector(const float rotation[4], const float v[3], float result[3]) {
+    const float* q = rotation;
+    // t = 2 * cross(q.xyz, v), result = v + q.w * t + cross(q.xyz, t)
+    float t[3] = {
+        2.0f * (q[1] * v[2] - q[2] * v[1]),
+        2.0f * (q[2] * v[0] - q[0] * v[2]),
+        2.0f * (q[0] * v[1] - q[1] * v[0])
+    };
+    result[0] = v[0] + q[3] * t[0] + (q[1] * t[2] - q[2] * t[1]);
+    result[1] = v[1] + q[3] * t[1] + (q[2] * t[0] - q[0] * t[2]);
+    result[2] = v[2] + q[3] * t[2] + (q[0] * t[1] - q[1] * t[0]);
+}
+
+void BuildWorldMatrix(const InstanceTransform& transform, float matrix[16]) {
+    // Rows are the rotated and scaled basis vectors
+    for (int row = 0; row < 3; row++) {
+        float axis[3] = { row == 0 ? 1.0f : 0.0f, row == 1 ? 1.0f : 0.0f, row == 2 ? 1.0f : 0.0f };
+        float rotated[3];
+        RotateVector(transform.rotation, axis, rotated);
+        for (int column = 0; column < 3; column++) {
+            matrix[row * 4 + column] = rotated[column] * transform.scale;
+        }
+        matrix[row * 4 + 3] = 0.0f;
+    }
+    for (int column = 0; column < 3; column++) {
+        matrix[12 + column] = transform.position[column];
+    }
+    matrix[15] = 1.0f;
+}
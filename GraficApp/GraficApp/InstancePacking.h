@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+// Compact per-instance record, mirror of GeomBuffer in Buffers.hlsli. Two float4 registers
+// instead of two matrices and a float4 (144 bytes); the vertex shader rebuilds the world
+// transform and, since the scale is uniform, uses the rotation as the normal matrix.
+struct PackedInstance {
+    float position[3];
+    float scale;
+    uint32_t rotation[2]; // quaternion xyzw as snorm16, x and z in the low halves
+    uint32_t material;    // shininess as half in the low 16 bits
+    uint32_t textureIds;  // texture remap index in the low 16 bits, bit 16 enables the normal map
+};
+
+static_assert(sizeof(PackedInstance) == 32, "PackedInstance must fill two float4 registers");
+
+struct InstanceTransform {
+    float position[3];
+    float rotation[4]; // unit quaternion xyzw
+    float scale;
+    float shininess;
+    uint32_t textureIndex;
+    bool normalMap;
+};
+
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
+
+PackedInstance PackInstance(const InstanceTransform& transform);
+// Same decoding as Buffers.hlsli, the quaternion is renormalized
+InstanceTransform UnpackInstance(const PackedInstance& instance);
+
+// q * v * q^-1, as RotateVector in Buffers.hlsli
+void RotateVector(const float rotation[4], const float v[3], float result[3]);
+// Row-major matrix for row vectors like XMMATRIX: scale, rotation, then translation
+void BuildWorldMatrix(const InstanceTransform& transform, float matrix[16]);
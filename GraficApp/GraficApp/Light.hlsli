@@ -9,7 +9,7 @@ struct LIGHT {
 
 cbuffer LightBuffer : register (b2) {
     float4 cameraPos;
-    int4 lightParams;
+    int4 lightParams; // x is the light count, features are shader permutations
     LIGHT lights[MAX_LIGHT];
     float4 ambientColor;;
 };
\ No newline at end of file
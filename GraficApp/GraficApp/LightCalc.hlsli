@@ -2,13 +2,13 @@
 
 #include "Light.hlsli"
 
+// SHOW_NORMALS variants return the normal as color
 float3 CalculateColor(in float3 objColor, in float3 objNormal, in float3 pos, in float shine, in bool transparent) {
+#ifdef SHOW_NORMALS
+    return float3(objNormal * 0.5 + float3(0.5, 0.5, 0.5));
+#else
     float3 finalColor = float3(0, 0, 0);
 
-    if (lightParams.z > 0) {
-        return float3(objNormal * 0.5 + float3(0.5, 0.5, 0.5));
-    }
-
     [unroll]
     for (int i = 0; i < lightParams.x; i++) {
         float3 norm = objNormal;
@@ -32,4 +32,5 @@ float3 CalculateColor(in float3 objColor, in float3 objNormal, in float3 pos, in
     }
 
     return finalColor;
+#endif // !SHOW_NORMALS
 }
@@ -0,0 +1,70 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::Open(const std::string& fileName) {
+    Close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+    // The view keeps the mapping and the file alive
+    CloseHandle(file);
+    if (mapping == NULL) {
+        return false;
+    }
+
+    pData_ = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    size_ = pData_ != nullptr ? (size_t)size.QuadPart : 0;
+#else
+    int file = open(fileName.c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+
+    struct stat info;
+    void* pView = MAP_FAILED;
+    if (fstat(file, &info) == 0 && info.st_size > 0) {
+        pView = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    }
+    close(file);
+    if (pView == MAP_FAILED) {
+        return false;
+    }
+
+    pData_ = (const uint8_t*)pView;
+    size_ = (size_t)info.st_size;
+#endif
+
+    return pData_ != nullptr;
+}
+
+void MappedFile::Close() {
+    if (pData_ == nullptr) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(pData_);
+#else
+    munmap((void*)pData_, size_);
+#endif
+    pData_ = nullptr;
+    size_ = 0;
+}
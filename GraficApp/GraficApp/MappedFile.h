@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only view of a whole file, CreateFileMapping on Windows and mmap elsewhere.
+// The view is page aligned and stays valid until Close.
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile(MappedFile&&) = delete;
+
+    bool Open(const std::string& fileName);
+    void Close();
+
+    bool IsOpen() const { return pData_ != nullptr; };
+    const uint8_t* GetData() const { return pData_; };
+    size_t GetSize() const { return size_; };
+
+    ~MappedFile() { Close(); };
+private:
+    const uint8_t* pData_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,407 @@
+#include "MipGeneration.h"
+#include "BlockCompression.h"
+#include "DdsHeader.h"
+#include "ImageKernels.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MIP_GENERATION_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#else
+#define MIP_GENERATION_X86 0
+#endif
+
+namespace {
+    const int RowsPerTask = 16;
+    // Kaiser window over three destination pixels each side, alpha as in common mip tools
+    const double KaiserWidth = 3.0;
+    const double KaiserAlpha = 4.0;
+
+    bool UseAVX2() {
+        return GetImageKernelPath() == ImageKernelPath::AVX2;
+    }
+
+    void ParallelRows(int height, const std::function<void(int, int)>& task) {
+        size_t count = (size_t)((height + RowsPerTask - 1) / RowsPerTask);
+        ThreadPool::GetInstance().ParallelFor(count, [&](size_t i) {
+            int y0 = (int)i * RowsPerTask;
+            int y1 = y0 + RowsPerTask < height ? y0 + RowsPerTask : height;
+            task(y0, y1);
+        });
+    }
+
+    // sRGB decode per byte and the linear values halfway between neighbouring bytes, so that
+    // encoding is a search that rounds to the nearest byte exactly
+    struct SrgbTables {
+        float toLinear[256];
+        float thresholds[255];
+
+        SrgbTables() {
+            for (int i = 0; i < 256; i++) {
+                toLinear[i] = (float)Decode(i / 255.0);
+            }
+            for (int i = 0; i < 255; i++) {
+                thresholds[i] = (float)Decode((i + 0.5) / 255.0);
+            }
+        }
+
+        static double Decode(double value) {
+            return value <= 0.04045 ? value / 12.92 : pow((value + 0.055) / 1.055, 2.4);
+        }
+    };
+
+    const SrgbTables& GetSrgbTables() {
+        static const SrgbTables tables;
+        return tables;
+    }
+
+    uint8_t EncodeSrgb(float value) {
+        const SrgbTables& tables = GetSrgbTables();
+        return (uint8_t)(std::upper_bound(tables.thresholds, tables.thresholds + 255, value) - tables.thresholds);
+    }
+
+    uint8_t EncodeUNorm(float value) {
+        value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+        return (uint8_t)(value * 255.0f + 0.5f);
+    }
+
+    // Normal map channels live in [-1, 1], color and alpha in [0, 1]
+    void ToFloat(const uint8_t* pixels, size_t count, const MipSettings& settings, float* level) {
+        const SrgbTables& tables = GetSrgbTables();
+        for (size_t i = 0; i < count; i++) {
+            for (int c = 0; c < 3; c++) {
+                uint8_t value = pixels[i * 4 + c];
+                level[i * 4 + c] = settings.normalMap ? value / 127.5f - 1.0f :
+                    (settings.srgb ? tables.toLinear[value] : value / 255.0f);
+            }
+            level[i * 4 + 3] = pixels[i * 4 + 3] / 255.0f;
+        }
+    }
+
+    // Clamps the ringing of the Kaiser filter and renormalizes normals in place, so the next
+    // level is filtered from what this one stores
+    void FinishLevel(float* level, size_t count, const MipSettings& settings, uint8_t* pixels) {
+        for (size_t i = 0; i < count; i++) {
+            float* p = level + i * 4;
+            if (settings.normalMap) {
+                for (int c = 0; c < 3; c++) {
+                    p[c] = p[c] < -1.0f ? -1.0f : (p[c] > 1.0f ? 1.0f : p[c]);
+                }
+                float length = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+                if (length > 1e-6f) {
+                    p[0] /= length;
+                    p[1] /= length;
+                    p[2] /= length;
+                }
+                else {
+                    p[0] = 0.0f;
+                    p[1] = 0.0f;
+                    p[2] = 1.0f;
+                }
+                for (int c = 0; c < 3; c++) {
+                    pixels[i * 4 + c] = EncodeUNorm(p[c] * 0.5f + 0.5f);
+                }
+            }
+            else {
+                for (int c = 0; c < 3; c++) {
+                    p[c] = p[c] < 0.0f ? 0.0f : (p[c] > 1.0f ? 1.0f : p[c]);
+                    pixels[i * 4 + c] = settings.srgb ? EncodeSrgb(p[c]) : EncodeUNorm(p[c]);
+                }
+            }
+            p[3] = p[3] < 0.0f ? 0.0f : (p[3] > 1.0f ? 1.0f : p[3]);
+            pixels[i * 4 + 3] = EncodeUNorm(p[3]);
+        }
+    }
+
+    double Sinc(double x) {
+        const double Pi = 3.14159265358979323846;
+        return fabs(x) < 1e-9 ? 1.0 : sin(Pi * x) / (Pi * x);
+    }
+
+    // Modified Bessel function of the first kind, order zero
+    double BesselI0(double x) {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 32; k++) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    double Kaiser(double x) {
+        if (fabs(x) >= KaiserWidth) {
+            return 0.0;
+        }
+        double t = x / KaiserWidth;
+        return Sinc(x) * BesselI0(KaiserAlpha * sqrt(1.0 - t * t)) / BesselI0(KaiserAlpha);
+    }
+
+    // The same number of taps for every destination pixel, short ones padded with zero weights
+    struct FilterTaps {
+        int count = 0;
+        std::vector<int> index;
+        std::vector<float> weight;
+    };
+
+    void BuildTaps(int source, int destination, MipFilter filter, FilterTaps& taps) {
+        double scale = (double)source / destination;
+        double radius = filter == MipFilter::Box ? scale * 0.5 : KaiserWidth * scale;
+        std::vector<std::vector<std::pair<int, double>>> rows(destination);
+        for (int i = 0; i < destination; i++) {
+            double center = (i + 0.5) * scale;
+            int first = (int)floor(center - radius), last = (int)ceil(center + radius);
+            double sum = 0.0;
+            for (int j = first; j < last; j++) {
+                double weight;
+                if (filter == MipFilter::Box) {
+                    double low = j > center - radius ? j : center - radius;
+                    double high = j + 1 < center + radius ? j + 1 : center + radius;
+                    weight = high - low;
+                }
+                else {
+                    weight = Kaiser((j + 0.5 - center) / scale);
+                }
+                if (weight == 0.0) {
+                    continue;
+                }
+                // Clamp addressing, taps past the edge add to the edge pixel
+                int clamped = j < 0 ? 0 : (j >= source ? source - 1 : j);
+                if (!rows[i].empty() && rows[i].back().first == clamped) {
+                    rows[i].back().second += weight;
+                }
+                else {
+                    rows[i].push_back(std::make_pair(clamped, weight));
+                }
+                sum += weight;
+            }
+            for (auto& tap : rows[i]) {
+                tap.second /= sum;
+            }
+            taps.count = (int)rows[i].size() > taps.count ? (int)rows[i].size() : taps.count;
+        }
+
+        taps.index.assign((size_t)destination * taps.count, 0);
+        taps.weight.assign((size_t)destination * taps.count, 0.0f);
+        for (int i = 0; i < destination; i++) {
+            for (int t = 0; t < taps.count; t++) {
+                size_t k = (size_t)i * taps.count + t;
+                bool valid = t < (int)rows[i].size();
+                taps.index[k] = valid ? rows[i][t].first : rows[i].back().first;
+                taps.weight[k] = valid ? (float)rows[i][t].second : 0.0f;
+            }
+        }
+    }
+
+    void FilterRowScalar(const float* source, const FilterTaps& taps, int width, float* destination) {
+        for (int x = 0; x < width; x++) {
+            float sum[4] = {};
+            for (int t = 0; t < taps.count; t++) {
+                size_t k = (size_t)x * taps.count + t;
+                const float* p = source + (size_t)taps.index[k] * 4;
+                float w = taps.weight[k];
+                for (int c = 0; c < 4; c++) {
+                    sum[c] = sum[c] + w * p[c];
+                }
+            }
+            for (int c = 0; c < 4; c++) {
+                destination[x * 4 + c] = sum[c];
+            }
+        }
+    }
+
+    void FilterColumnsScalar(const float* const* rows, const float* weights, int count, int floats, float* destination) {
+        for (int x = 0; x < floats; x++) {
+            float sum = 0.0f;
+            for (int t = 0; t < count; t++) {
+                sum = sum + weights[t] * rows[t][x];
+            }
+            destination[x] = sum;
+        }
+    }
+
+#if MIP_GENERATION_X86
+    // Two destination pixels per register, same multiply-then-add order as the scalar loop
+    AVX2_TARGET void FilterRowAVX2(const float* source, const FilterTaps& taps, int width, float* destination) {
+        int x = 0;
+        for (; x + 2 <= width; x += 2) {
+            const int* indexA = taps.index.data() + (size_t)x * taps.count;
+            const int* indexB = indexA + taps.count;
+            const float* weightA = taps.weight.data() + (size_t)x * taps.count;
+            const float* weightB = weightA + taps.count;
+            __m256 sum = _mm256_setzero_ps();
+            for (int t = 0; t < taps.count; t++) {
+                __m256 p = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(source + (size_t)indexA[t] * 4)),
+                    _mm_loadu_ps(source + (size_t)indexB[t] * 4), 1);
+                __m256 w = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(weightA[t])), _mm_set1_ps(weightB[t]), 1);
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(w, p));
+            }
+            _mm256_storeu_ps(destination + x * 4, sum);
+        }
+        if (x < width) {
+            FilterTaps tail;
+            tail.count = taps.count;
+            tail.index.assign(taps.index.begin() + (size_t)x * taps.count, taps.index.end());
+            tail.weight.assign(taps.weight.begin() + (size_t)x * taps.count, taps.weight.end());
+            FilterRowScalar(source, tail, width - x, destination + x * 4);
+        }
+    }
+
+    AVX2_TARGET void FilterColumnsAVX2(const float* const* rows, const float* weights, int count, int floats, float* destination) {
+        int x = 0;
+        for (; x + 8 <= floats; x += 8) {
+            __m256 sum = _mm256_setzero_ps();
+            for (int t = 0; t < count; t++) {
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[t]), _mm256_loadu_ps(rows[t] + x)));
+            }
+            _mm256_storeu_ps(destination + x, sum);
+        }
+        for (; x < floats; x++) {
+            float sum = 0.0f;
+            for (int t = 0; t < count; t++) {
+                sum = sum + weights[t] * rows[t][x];
+            }
+            destination[x] = sum;
+        }
+    }
+#else
+    void FilterRowAVX2(const float* source, const FilterTaps& taps, int width, float* destination) { FilterRowScalar(source, taps, width, destination); }
+    void FilterColumnsAVX2(const float* const* rows, const float* weights, int count, int floats, float* destination) { FilterColumnsScalar(rows, weights, count, floats, destination); }
+#endif
+
+    // Rows first into a temporary of the destination width, then columns
+    void Downsample(const std::vector<float>& source, int width, int height, MipFilter filter,
+        int newWidth, int newHeight, std::vector<float>& destination) {
+        FilterTaps horizontal, vertical;
+        BuildTaps(width, newWidth, filter, horizontal);
+        BuildTaps(height, newHeight, filter, vertical);
+        bool avx2 = UseAVX2();
+
+        std::vector<float> rows((size_t)newWidth * height * 4);
+        ParallelRows(height, [&](int y0, int y1) {
+            for (int y = y0; y < y1; y++) {
+                const float* src = source.data() + (size_t)y * width * 4;
+                float* dst = rows.data() + (size_t)y * newWidth * 4;
+                avx2 ? FilterRowAVX2(src, horizontal, newWidth, dst) : FilterRowScalar(src, horizontal, newWidth, dst);
+            }
+        });
+
+        destination.resize((size_t)newWidth * newHeight * 4);
+        ParallelRows(newHeight, [&](int y0, int y1) {
+            std::vector<const float*> taps(vertical.count);
+            for (int y = y0; y < y1; y++) {
+                for (int t = 0; t < vertical.count; t++) {
+                    taps[t] = rows.data() + (size_t)vertical.index[(size_t)y * vertical.count + t] * newWidth * 4;
+                }
+                const float* weights = vertical.weight.data() + (size_t)y * vertical.count;
+                float* dst = destination.data() + (size_t)y * newWidth * 4;
+                avx2 ? FilterColumnsAVX2(taps.data(), weights, vertical.count, newWidth * 4, dst) :
+                    FilterColumnsScalar(taps.data(), weights, vertical.count, newWidth * 4, dst);
+            }
+        });
+    }
+}
+
+uint32_t GetFullMipCount(uint32_t width, uint32_t height) {
+    uint32_t size = width > height ? width : height;
+    uint32_t count = 1;
+    while (size > 1) {
+        size >>= 1;
+        count++;
+    }
+    return count;
+}
+
+bool GenerateMips(const uint8_t* pixels, uint32_t width, uint32_t height, const MipSettings& settings,
+    std::vector<std::vector<uint8_t>>& mips) {
+    mips.clear();
+    if (width == 0 || height == 0 || width > DdsMaxDimension || height > DdsMaxDimension) {
+        return false;
+    }
+    uint32_t count = GetFullMipCount(width, height);
+    count = settings.mipCount > 0 && settings.mipCount < count ? settings.mipCount : count;
+    mips.resize(count);
+    mips[0].assign(pixels, pixels + (size_t)width * height * 4);
+
+    std::vector<float> level((size_t)width * height * 4), next;
+    ToFloat(pixels, (size_t)width * height, settings, level.data());
+    for (uint32_t mip = 1; mip < count; mip++) {
+        uint32_t newWidth = width > 1 ? width / 2 : 1, newHeight = height > 1 ? height / 2 : 1;
+        Downsample(level, (int)width, (int)height, settings.filter, (int)newWidth, (int)newHeight, next);
+        mips[mip].resize((size_t)newWidth * newHeight * 4);
+        FinishLevel(next.data(), (size_t)newWidth * newHeight, settings, mips[mip].data());
+        level.swap(next);
+        width = newWidth;
+        height = newHeight;
+    }
+    return true;
+}
+
+bool BuildMipChainDds(const std::vector<std::vector<uint8_t>>& mips, uint32_t width, uint32_t height, uint32_t format,
+    std::vector<uint8_t>& file) {
+    bool raw = format == DdsFormatRGBA8 || format == DdsFormatRGBA8Srgb;
+    if (mips.empty() || (!raw && !IsBlockEncodeSupported(format))) {
+        return false;
+    }
+    DdsInfo info = { width, height, (uint32_t)mips.size(), 1, 1, format, 0 };
+    if (!BuildDdsHeader(info, file)) {
+        return false;
+    }
+    info.dataOffset = (uint32_t)file.size();
+    file.resize((size_t)(info.dataOffset + GetDdsTextureBytes(info, 0)));
+    for (uint32_t mip = 0; mip < info.mipCount; mip++) {
+        uint32_t mipWidth = GetDdsMipWidth(info, mip), mipHeight = GetDdsMipHeight(info, mip);
+        if (mips[mip].size() != (size_t)mipWidth * mipHeight * 4) {
+            return false;
+        }
+        uint8_t* data = file.data() + GetDdsMipOffset(info, 0, mip);
+        if (raw) {
+            std::copy(mips[mip].begin(), mips[mip].end(), data);
+        }
+        else {
+            EncodeImage(format, mips[mip].data(), mipWidth, mipHeight, data);
+        }
+    }
+    return true;
+}
+
+bool GenerateDdsMips(const std::string& inFile, const std::string& outFile, const MipSettings& settings) {
+    std::ifstream input(inFile, std::ios::binary);
+    if (!input.is_open()) {
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    DdsInfo info;
+    if (!ParseDdsHeader(data.data(), data.size(), data.size(), info) || info.arraySize * info.faces != 1) {
+        return false;
+    }
+    std::vector<uint8_t> pixels;
+    uint32_t width = 0, height = 0;
+    if (!DecodeDdsImage(data.data(), data.size(), 0, 0, pixels, width, height)) {
+        return false;
+    }
+
+    uint32_t format = info.format;
+    if (format == DdsFormatBGRA8Srgb || format == DdsFormatBC7Srgb || format == DdsFormatBC2Srgb) {
+        format = DdsFormatRGBA8Srgb;
+    }
+    else if (format != DdsFormatRGBA8Srgb && !IsBlockEncodeSupported(format)) {
+        format = DdsFormatRGBA8;
+    }
+    std::vector<std::vector<uint8_t>> mips;
+    std::vector<uint8_t> file;
+    if (!GenerateMips(pixels.data(), width, height, settings, mips) || !BuildMipChainDds(mips, width, height, format, file)) {
+        return false;
+    }
+    std::ofstream output(outFile, std::ios::binary | std::ios::trunc);
+    return output.write((const char*)file.data(), file.size()).good();
+}
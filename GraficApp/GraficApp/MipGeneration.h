@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Offline mip chains for textures that ship with a single level. Each level is filtered from
+// the previous one kept in float, separably, with rows split across ThreadPool. The filter
+// loops have an AVX2 path that gives the same bytes as the scalar one and is chosen by
+// SetImageKernelPath. Pixels are tightly packed RGBA8 rows.
+enum class MipFilter {
+    Box,
+    Kaiser  // windowed sinc over three destination pixels, sharper than box without its aliasing
+};
+
+struct MipSettings {
+    MipFilter filter = MipFilter::Kaiser;
+    bool srgb = true;       // rgb is gamma encoded and filtered in linear light, alpha is linear
+    bool normalMap = false; // rgb is a unit vector, renormalized at every level; srgb is ignored
+    uint32_t mipCount = 0;  // 0 goes down to 1x1
+};
+
+// Levels down to 1x1, each dimension halved and rounded down
+uint32_t GetFullMipCount(uint32_t width, uint32_t height);
+
+// mips[0] is a copy of the source. Sizes follow GetDdsMipWidth/Height, edges are clamped
+// like the samplers do
+bool GenerateMips(const uint8_t* pixels, uint32_t width, uint32_t height, const MipSettings& settings,
+    std::vector<std::vector<uint8_t>>& mips);
+
+// Header and every level, BC formats go through EncodeImage; false for formats it cannot write
+bool BuildMipChainDds(const std::vector<std::vector<uint8_t>>& mips, uint32_t width, uint32_t height, uint32_t format,
+    std::vector<uint8_t>& file);
+
+// Replaces the mips of a single texture with generated ones. The format is kept when it can be
+// encoded, anything else (BC2, BC4, BC7) is written as RGBA8
+bool GenerateDdsMips(const std::string& inFile, const std::string& outFile, const MipSettings& settings);
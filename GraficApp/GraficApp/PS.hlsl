@@ -14,18 +14,19 @@ struct PS_INPUT {
 };
 
 float4 main(PS_INPUT input) : SV_TARGET{
-    float3 color = cubeTexture.Sample(cubeSampler, float3(input.uv, geomBuffer[input.instanceId].shineSpeedTexIdNM.z)).xyz;
+    TextureRemap remap = GetTextureRemap(geomBuffer[input.instanceId]);
+    float2 uv = input.uv * remap.scaleOffset.xy + remap.scaleOffset.zw;
+    float3 color = cubeTexture.Sample(cubeSampler, float3(uv, remap.slice.x)).xyz;
     float3 finalColor = ambientColor.xyz * color;
 
-    float3 norm = float3(0, 0, 0);
-    if (lightParams.y > 0 && geomBuffer[input.instanceId].shineSpeedTexIdNM.w > 0.0f) {
-        float3 binorm = normalize(cross(input.normal, input.tangent));
-        float3 localNorm = cubeNormal.Sample(cubeSampler, input.uv).xyz * 2.0 - 1.0;
-        norm = localNorm.x * normalize(input.tangent) + localNorm.y * binorm + localNorm.z * normalize(input.normal);
-    }
-    else {
-        norm = input.normal;
-    }
+    // Compiled with NORMAL_MAP for the draws of cubes that have one while normal maps are on
+#ifdef NORMAL_MAP
+    float3 binorm = normalize(cross(input.normal, input.tangent));
+    float3 localNorm = cubeNormal.Sample(cubeSampler, input.uv).xyz * 2.0 - 1.0;
+    float3 norm = localNorm.x * normalize(input.tangent) + localNorm.y * binorm + localNorm.z * normalize(input.normal);
+#else
+    float3 norm = input.normal;
+#endif
 
-    return float4(CalculateColor(finalColor, norm, input.worldPos.xyz, geomBuffer[input.instanceId].shineSpeedTexIdNM.x, false), 1.0);
+    return float4(CalculateColor(finalColor, norm, input.worldPos.xyz, GetShininess(geomBuffer[input.instanceId]), false), 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "ParallelCommandRecorder.h"
+
+#include <atomic>
+#include <chrono>
+
+std::vector<DrawRange> ParallelCommandRecorder::Partition(size_t drawCount, int contextCount, size_t minDraws) {
+    std::vector<DrawRange> ranges;
+    if (drawCount == 0 || contextCount <= 0) {
+        return ranges;
+    }
+
+    size_t count = drawCount / (minDraws > 0 ? minDraws : 1);
+    count = count < (size_t)contextCount ? count : (size_t)contextCount;
+    count = count > 0 ? count : 1;
+
+    size_t first = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t size = drawCount / count + (i < drawCount % count ? 1 : 0);
+        ranges.push_back({ first, size });
+        first += size;
+    }
+    return ranges;
+}
+
+bool ParallelCommandRecorder::Run(ICommandContextSet& contexts, size_t drawCount, size_t minDraws) {
+    ranges_ = Partition(drawCount, contexts.GetContextCount(), minDraws);
+
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<bool> failed{ false };
+    pool_.ParallelFor(ranges_.size(), [&](size_t i) {
+        if (!contexts.Record((int)i, ranges_[i])) {
+            failed = true;
+        }
+    });
+    auto recorded = std::chrono::steady_clock::now();
+    recordMs_ = std::chrono::duration<double, std::milli>(recorded - start).count();
+    if (failed) {
+        executeMs_ = 0.0;
+        return false;
+    }
+
+    for (size_t i = 0; i < ranges_.size(); i++) {
+        contexts.Execute((int)i);
+    }
+    executeMs_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recorded).count();
+    return true;
+}
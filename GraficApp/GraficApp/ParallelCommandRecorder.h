@@ -0,0 +1,52 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+#include <cstddef>
+#include <vector>
+
+struct DrawRange {
+    size_t first;
+    size_t count;
+};
+
+// Contexts that record draw ranges. D3D11CommandContexts uses deferred contexts or the
+// immediate context when the driver has no native command lists, tests can fake it.
+class ICommandContextSet {
+public:
+    virtual int GetContextCount() const = 0;
+    // Called from worker threads, never twice at the same time for one context
+    virtual bool Record(int context, const DrawRange& range) = 0;
+    // Called on the render thread in context order once every range was recorded
+    virtual void Execute(int context) = 0;
+
+    virtual ~ICommandContextSet() = default;
+};
+
+// Splits a draw list into contiguous ranges, one per context, records them in parallel
+// and executes them in order, so the result does not depend on the thread timing.
+class ParallelCommandRecorder {
+public:
+    explicit ParallelCommandRecorder(ThreadPool& pool) : pool_(pool) {};
+
+    ParallelCommandRecorder(const ParallelCommandRecorder&) = delete;
+    ParallelCommandRecorder(ParallelCommandRecorder&&) = delete;
+
+    // At most contextCount ranges of at least minDraws draws, sizes differ by one at most
+    static std::vector<DrawRange> Partition(size_t drawCount, int contextCount, size_t minDraws);
+
+    // false if a context failed to record, nothing is executed then
+    bool Run(ICommandContextSet& contexts, size_t drawCount, size_t minDraws);
+
+    size_t GetRangeCount() const { return ranges_.size(); };
+    const std::vector<DrawRange>& GetRanges() const { return ranges_; };
+    double GetRecordMs() const { return recordMs_; };
+    double GetExecuteMs() const { return executeMs_; };
+
+    ~ParallelCommandRecorder() = default;
+private:
+    ThreadPool& pool_;
+    std::vector<DrawRange> ranges_;
+    double recordMs_ = 0.0;
+    double executeMs_ = 0.0;
+};
@@ -0,0 +1,40 @@
+#include "PostEffectFormat.h"
+
+IntermediateFormat SelectIntermediateFormat(const PostEffectNeeds& needs) {
+    if (needs.hdr) {
+        return needs.alpha ? IntermediateFormat::RGBA16F : IntermediateFormat::R11G11B10F;
+    }
+    // The back buffer is 8-bit UNORM, effects limited to [0, 1] lose nothing at the same precision
+    return IntermediateFormat::RGBA8;
+}
+
+uint32_t GetBytesPerPixel(IntermediateFormat format) {
+    switch (format) {
+    case IntermediateFormat::RGBA32F:
+        return 16;
+    case IntermediateFormat::RGBA16F:
+        return 8;
+    case IntermediateFormat::R11G11B10F:
+    case IntermediateFormat::RGBA8:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+const char* GetFormatName(IntermediateFormat format) {
+    switch (format) {
+    case IntermediateFormat::Auto:
+        return "Auto";
+    case IntermediateFormat::RGBA32F:
+        return "R32G32B32A32_FLOAT";
+    case IntermediateFormat::RGBA16F:
+        return "R16G16B16A16_FLOAT";
+    case IntermediateFormat::R11G11B10F:
+        return "R11G11B10_FLOAT";
+    case IntermediateFormat::RGBA8:
+        return "R8G8B8A8_UNORM";
+    default:
+        return "Unknown";
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+// Storage format of the offscreen target read by the post-effect pass
+enum class IntermediateFormat {
+    Auto,
+    RGBA32F,
+    RGBA16F,
+    R11G11B10F,
+    RGBA8
+};
+
+// What the enabled post effects require from their input
+struct PostEffectNeeds {
+    bool active = false; // false when every effect is a no-op, the pass is skipped
+    bool hdr = false;    // reads values outside [0, 1]
+    bool alpha = false;  // reads the alpha channel
+};
+
+// Smallest format that satisfies the needs
+IntermediateFormat SelectIntermediateFormat(const PostEffectNeeds& needs);
+
+uint32_t GetBytesPerPixel(IntermediateFormat format);
+const char* GetFormatName(IntermediateFormat format);
+
+// Bytes moved by writing the intermediate target once and reading it once
+inline uint64_t GetIntermediateTraffic(IntermediateFormat format, uint32_t width, uint32_t height) {
+    return 2ull * width * height * GetBytesPerPixel(format);
+}
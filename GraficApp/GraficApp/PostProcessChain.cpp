@@ -0,0 +1,315 @@
+#include "PostProcessChain.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+    const int BlurTaps = 5;
+    const float BlurWeights[BlurTaps] = { 0.227027f, 0.1945946f, 0.1216216f, 0.054054f, 0.016216f };
+
+    bool IsPerPixel(PostEffectType type) {
+        return type != PostEffectType::Blur;
+    }
+
+    PostOpType ToOpType(PostEffectType type) {
+        switch (type) {
+        case PostEffectType::ToneMap:
+            return PostOpType::ToneMap;
+        case PostEffectType::ColorGrade:
+            return PostOpType::ColorGrade;
+        case PostEffectType::Vignette:
+            return PostOpType::Vignette;
+        default:
+            return PostOpType::Invert;
+        }
+    }
+
+    PostOp MakeOp(PostOpType type, const float params[4]) {
+        PostOp op;
+        op.type = type;
+        memcpy(op.params, params, sizeof(op.params));
+        return op;
+    }
+
+    float Clamp01(float value) {
+        return value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+    }
+
+    int GetBlurStep(const float params[4]) {
+        int step = (int)std::floor(params[0] + 0.5f);
+        return step < 1 ? 1 : step;
+    }
+
+    // Must stay in sync with the HLSL emitted by AddOpCode
+    void ApplyPixelOp(const PostOp& op, float* color, float u, float v) {
+        const float* p = op.params;
+        switch (op.type) {
+        case PostOpType::ToneMap:
+            for (int c = 0; c < 3; c++) {
+                float value = color[c] * p[0];
+                color[c] = value / (1.0f + value);
+            }
+            break;
+        case PostOpType::ColorGrade: {
+            float luma = color[0] * 0.2126f + color[1] * 0.7152f + color[2] * 0.0722f;
+            for (int c = 0; c < 3; c++) {
+                float value = luma + (color[c] - luma) * p[1];
+                color[c] = (value - 0.5f) * p[0] + 0.5f + p[2];
+            }
+            break;
+        }
+        case PostOpType::Vignette: {
+            float dx = u - 0.5f, dy = v - 0.5f;
+            float factor = Clamp01(1.0f - (dx * dx + dy * dy) * 2.0f * p[0]);
+            for (int c = 0; c < 3; c++) {
+                color[c] *= factor;
+            }
+            break;
+        }
+        case PostOpType::Invert:
+            for (int c = 0; c < 3; c++) {
+                color[c] = 1.0f - color[c];
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    void ReadHead(const PostOp& head, const float* src, int width, int height, int stride, int x, int y, float* color) {
+        if (head.type == PostOpType::Sample) {
+            const float* texel = src + ((size_t)y * stride + x) * 4;
+            color[0] = texel[0];
+            color[1] = texel[1];
+            color[2] = texel[2];
+            return;
+        }
+
+        // Clamp addressing like the PostProcessRenderer sampler
+        int step = GetBlurStep(head.params);
+        int dx = head.type == PostOpType::BlurHorizontal ? step : 0;
+        int dy = head.type == PostOpType::BlurVertical ? step : 0;
+        color[0] = color[1] = color[2] = 0.0f;
+        for (int i = -(BlurTaps - 1); i < BlurTaps; i++) {
+            int sx = x + dx * i, sy = y + dy * i;
+            sx = sx < 0 ? 0 : (sx >= width ? width - 1 : sx);
+            sy = sy < 0 ? 0 : (sy >= height ? height - 1 : sy);
+            const float* texel = src + ((size_t)sy * stride + sx) * 4;
+            float weight = BlurWeights[i < 0 ? -i : i];
+            color[0] += texel[0] * weight;
+            color[1] += texel[1] * weight;
+            color[2] += texel[2] * weight;
+        }
+    }
+
+    void RunPass(const PostPass& pass, const float* src, float* dst, int width, int height, int stride) {
+        ThreadPool::GetInstance().ParallelFor((size_t)height, [&](size_t row) {
+            int y = (int)row;
+            float v = (y + 0.5f) / height;
+            for (int x = 0; x < width; x++) {
+                float color[3];
+                ReadHead(pass.head, src, width, height, stride, x, y, color);
+                float u = (x + 0.5f) / width;
+                for (const PostOp& op : pass.ops) {
+                    ApplyPixelOp(op, color, u, v);
+                }
+                float* out = dst + ((size_t)y * stride + x) * 4;
+                out[0] = color[0];
+                out[1] = color[1];
+                out[2] = color[2];
+                out[3] = 1.0f;
+            }
+        });
+    }
+
+    void AddOpCode(std::string& code, PostOpType type, int index) {
+        std::string p = "opParams[" + std::to_string(index) + "]";
+        switch (type) {
+        case PostOpType::ToneMap:
+            code += "    color *= " + p + ".x;\n";
+            code += "    color = color / (1.0 + color);\n";
+            break;
+        case PostOpType::ColorGrade:
+            code += "    {\n";
+            code += "        float luma = dot(color, float3(0.2126, 0.7152, 0.0722));\n";
+            code += "        color = luma + (color - luma) * " + p + ".y;\n";
+            code += "        color = (color - 0.5) * " + p + ".x + 0.5 + " + p + ".z;\n";
+            code += "    }\n";
+            break;
+        case PostOpType::Vignette:
+            code += "    {\n";
+            code += "        float2 d = input.tex - 0.5;\n";
+            code += "        color *= saturate(1.0 - dot(d, d) * 2.0 * " + p + ".x);\n";
+            code += "    }\n";
+            break;
+        case PostOpType::Invert:
+            code += "    color = 1.0 - color;\n";
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void PostProcessChain::AddStage(PostEffectType type, bool enabled, float p0, float p1, float p2, float p3) {
+    PostEffectStage stage = { type, enabled, { p0, p1, p2, p3 } };
+    stages_.push_back(stage);
+}
+
+PostEffectNeeds PostProcessChain::GetNeeds() const {
+    PostEffectNeeds needs;
+    for (const PostEffectStage& stage : stages_) {
+        if (!stage.enabled) {
+            continue;
+        }
+        needs.active = true;
+        // Highlights above 1 are clamped by an 8-bit target. That only goes unseen when the
+        // stage keeps them at 1 or above: darkening, lower contrast, a change of saturation, a
+        // vignette or a blur bring them back into range and the result would depend on the format
+        const float* p = stage.params;
+        switch (stage.type) {
+        case PostEffectType::ToneMap:
+        case PostEffectType::Blur:
+            needs.hdr = true;
+            break;
+        case PostEffectType::ColorGrade:
+            needs.hdr = needs.hdr || p[0] < 1.0f || p[1] != 1.0f || p[2] < 0.0f;
+            break;
+        case PostEffectType::Vignette:
+            needs.hdr = needs.hdr || p[0] > 0.0f;
+            break;
+        default:
+            break;
+        }
+    }
+    return needs;
+}
+
+std::vector<PostPass> PostProcessChain::Plan() const {
+    static const float NoParams[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+    std::vector<PostPass> passes;
+    for (const PostEffectStage& stage : stages_) {
+        if (!stage.enabled) {
+            continue;
+        }
+
+        if (!IsPerPixel(stage.type)) {
+            // Separable blur, per-pixel stages after it are fused into the vertical pass
+            passes.push_back({ MakeOp(PostOpType::BlurHorizontal, stage.params), {} });
+            passes.push_back({ MakeOp(PostOpType::BlurVertical, stage.params), {} });
+            continue;
+        }
+
+        if (passes.empty() || passes.back().ops.size() >= MaxFusedOps) {
+            passes.push_back({ MakeOp(PostOpType::Sample, NoParams), {} });
+        }
+        passes.back().ops.push_back(MakeOp(ToOpType(stage.type), stage.params));
+    }
+    return passes;
+}
+
+std::string PostProcessChain::GetShaderKey(const PostPass& pass) {
+    std::string key = std::to_string((int)pass.head.type);
+    for (const PostOp& op : pass.ops) {
+        key += ',' + std::to_string((int)op.type);
+    }
+    return key;
+}
+
+std::string PostProcessChain::GenerateShader(const PostPass& pass) {
+    std::string code =
+        "// Generated by PostProcessChain, key " + GetShaderKey(pass) + "\n"
+        "Texture2D sourceTexture : register(t0);\n"
+        "SamplerState Sampler : register(s0);\n"
+        "\n"
+        "cbuffer PostProcessBuffer : register(b0) {\n"
+        "    float4 headParams;\n"
+        "    float4 texelSize;\n"
+        "    float4 opParams[" + std::to_string(MaxFusedOps) + "];\n"
+        "};\n"
+        "\n"
+        "struct PS_INPUT {\n"
+        "    float4 pos : SV_POSITION;\n"
+        "    float2 tex : TEXCOORD;\n"
+        "};\n"
+        "\n";
+
+    if (pass.head.type != PostOpType::Sample) {
+        code += "static const float BlurWeights[" + std::to_string(BlurTaps) + "] = { ";
+        for (int i = 0; i < BlurTaps; i++) {
+            code += std::to_string(BlurWeights[i]) + (i + 1 < BlurTaps ? ", " : " };\n\n");
+        }
+    }
+
+    code += "float4 main(PS_INPUT input) : SV_TARGET {\n";
+    if (pass.head.type == PostOpType::Sample) {
+        code += "    float3 color = sourceTexture.Sample(Sampler, input.tex).xyz;\n";
+    }
+    else {
+        const char* axis = pass.head.type == PostOpType::BlurHorizontal ? "float2(texelSize.x, 0.0)" : "float2(0.0, texelSize.y)";
+        code += "    float2 dir = " + std::string(axis) + " * max(1.0, floor(headParams.x + 0.5));\n";
+        code += "    float3 color = sourceTexture.Sample(Sampler, input.tex).xyz * BlurWeights[0];\n";
+        code += "    [unroll] for (int i = 1; i < " + std::to_string(BlurTaps) + "; i++) {\n";
+        code += "        color += sourceTexture.Sample(Sampler, input.tex + dir * i).xyz * BlurWeights[i];\n";
+        code += "        color += sourceTexture.Sample(Sampler, input.tex - dir * i).xyz * BlurWeights[i];\n";
+        code += "    }\n";
+    }
+    for (size_t i = 0; i < pass.ops.size(); i++) {
+        AddOpCode(code, pass.ops[i].type, (int)i);
+    }
+    code += "    return float4(color, 1.0);\n";
+    code += "}\n";
+
+    return code;
+}
+
+void PostProcessChain::ApplyReference(float* pixels, int width, int height, int stride) const {
+    static const float NoParams[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+    // One unfused pass per stage, blur as its two separable halves
+    std::vector<PostPass> passes;
+    for (const PostEffectStage& stage : stages_) {
+        if (!stage.enabled) {
+            continue;
+        }
+        if (IsPerPixel(stage.type)) {
+            passes.push_back({ MakeOp(PostOpType::Sample, NoParams), { MakeOp(ToOpType(stage.type), stage.params) } });
+        }
+        else {
+            passes.push_back({ MakeOp(PostOpType::BlurHorizontal, stage.params), {} });
+            passes.push_back({ MakeOp(PostOpType::BlurVertical, stage.params), {} });
+        }
+    }
+    ApplyPlan(passes, pixels, width, height, stride);
+}
+
+void PostProcessChain::ApplyPlan(const std::vector<PostPass>& passes, float* pixels, int width, int height, int stride) {
+    if (passes.empty()) {
+        return;
+    }
+
+    std::vector<float> source((size_t)stride * height * 4);
+    for (const PostPass& pass : passes) {
+        memcpy(source.data(), pixels, source.size() * sizeof(float));
+        RunPass(pass, source.data(), pixels, width, height, stride);
+    }
+}
+
+const char* GetPostEffectName(PostEffectType type) {
+    switch (type) {
+    case PostEffectType::ToneMap:
+        return "Tone map";
+    case PostEffectType::ColorGrade:
+        return "Color grade";
+    case PostEffectType::Blur:
+        return "Blur";
+    case PostEffectType::Vignette:
+        return "Vignette";
+    case PostEffectType::Invert:
+        return "Invert";
+    default:
+        return "Unknown";
+    }
+}
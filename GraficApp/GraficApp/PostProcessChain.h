@@ -0,0 +1,73 @@
+#pragma once
+
+#include "PostEffectFormat.h"
+
+#include <string>
+#include <vector>
+
+// Effects that can be registered in a PostProcessChain
+enum class PostEffectType {
+    ToneMap,    // params: exposure
+    ColorGrade, // params: contrast, saturation, brightness
+    Blur,       // params: tap step in texels, separable 9-tap gaussian
+    Vignette,   // params: strength
+    Invert
+};
+
+struct PostEffectStage {
+    PostEffectType type;
+    bool enabled;
+    float params[4];
+};
+
+enum class PostOpType {
+    Sample,
+    BlurHorizontal,
+    BlurVertical,
+    ToneMap,
+    ColorGrade,
+    Vignette,
+    Invert
+};
+
+struct PostOp {
+    PostOpType type;
+    float params[4];
+};
+
+// One full-screen pass: a head that reads the source texture, then per-pixel ops fused
+// into the same shader
+struct PostPass {
+    PostOp head;
+    std::vector<PostOp> ops;
+};
+
+// Ordered list of post effects. Plan() fuses consecutive per-pixel effects into one pass,
+// only neighbourhood effects (blur) need their input in a separate texture.
+// Everything here is portable; PostProcessRenderer runs the plan with D3D11.
+class PostProcessChain {
+public:
+    static constexpr int MaxFusedOps = 8;
+
+    void AddStage(PostEffectType type, bool enabled, float p0 = 0.0f, float p1 = 0.0f, float p2 = 0.0f, float p3 = 0.0f);
+
+    std::vector<PostEffectStage>& GetStages() { return stages_; };
+    const std::vector<PostEffectStage>& GetStages() const { return stages_; };
+
+    PostEffectNeeds GetNeeds() const;
+    std::vector<PostPass> Plan() const;
+
+    // HLSL for a pass, only depends on GetShaderKey(pass), parameters come from the constant buffer:
+    // cbuffer PostProcessBuffer : register(b0) { float4 headParams; float4 texelSize; float4 opParams[MaxFusedOps]; }
+    static std::string GenerateShader(const PostPass& pass);
+    static std::string GetShaderKey(const PostPass& pass);
+
+    // CPU reference on an RGBA float image with a row stride in pixels. ApplyReference runs every
+    // enabled stage on its own, ApplyPlan runs the fused passes, both give the same result.
+    void ApplyReference(float* pixels, int width, int height, int stride) const;
+    static void ApplyPlan(const std::vector<PostPass>& passes, float* pixels, int width, int height, int stride);
+private:
+    std::vector<PostEffectStage> stages_;
+};
+
+const char* GetPostEffectName(PostEffectType type);
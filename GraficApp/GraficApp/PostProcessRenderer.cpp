@@ -0,0 +1,129 @@
+#include "PostProcessRenderer.h"
+
+HRESULT PostProcessRenderer::Init(ID3D11Device* pDevice) {
+    Release();
+    pDevice_ = pDevice;
+
+    ID3D10Blob* vertexShaderBuffer = nullptr;
+    int flags = 0;
+#ifdef _DEBUG
+    flags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+    HRESULT result = D3DCompileFromFile(L"PostEffectVS.hlsl", NULL, NULL, "main", "vs_5_0", flags, 0, &vertexShaderBuffer, NULL);
+    if (SUCCEEDED(result)) {
+        result = pDevice_->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, &pVertexShader_);
+    }
+    SAFE_RELEASE(vertexShaderBuffer);
+
+    if (SUCCEEDED(result)) {
+        D3D11_SAMPLER_DESC samplerDesc;
+        ZeroMemory(&samplerDesc, sizeof(samplerDesc));
+        samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_POINT;
+        samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+        samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+        samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+        samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+        samplerDesc.MinLOD = 0;
+        samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+        samplerDesc.MaxAnisotropy = D3D11_MAX_MAXANISOTROPY;
+
+        result = pDevice_->CreateSamplerState(&samplerDesc, &pSamplerState_);
+    }
+    if (SUCCEEDED(result)) {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(PostProcessBuffer);
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+        result = pDevice_->CreateBuffer(&desc, NULL, &pConstantBuffer_);
+    }
+
+    if (FAILED(result)) {
+        Release();
+    }
+
+    return result;
+}
+
+void PostProcessRenderer::Release() {
+    for (auto& shader : shaders_) {
+        SAFE_RELEASE(shader.second);
+    }
+    shaders_.clear();
+
+    SAFE_RELEASE(pVertexShader_);
+    SAFE_RELEASE(pSamplerState_);
+    SAFE_RELEASE(pConstantBuffer_);
+    pDevice_ = NULL;
+}
+
+ID3D11PixelShader* PostProcessRenderer::GetShader(const PostPass& pass) {
+    std::string key = PostProcessChain::GetShaderKey(pass);
+    auto it = shaders_.find(key);
+    if (it != shaders_.end()) {
+        return it->second;
+    }
+
+    std::string code = PostProcessChain::GenerateShader(pass);
+    ID3D10Blob* pixelShaderBuffer = nullptr;
+    ID3D10Blob* errorBuffer = nullptr;
+    int flags = 0;
+#ifdef _DEBUG
+    flags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+    ID3D11PixelShader* pPixelShader = NULL;
+    HRESULT result = D3DCompile(code.c_str(), code.size(), key.c_str(), NULL, NULL, "main", "ps_5_0", flags, 0, &pixelShaderBuffer, &errorBuffer);
+    if (SUCCEEDED(result)) {
+        result = pDevice_->CreatePixelShader(pixelShaderBuffer->GetBufferPointer(), pixelShaderBuffer->GetBufferSize(), NULL, &pPixelShader);
+    }
+    else if (errorBuffer != nullptr) {
+        OutputDebugStringA((const char*)errorBuffer->GetBufferPointer());
+    }
+    SAFE_RELEASE(pixelShaderBuffer);
+    SAFE_RELEASE(errorBuffer);
+
+    shaders_[key] = pPixelShader;
+    return pPixelShader;
+}
+
+HRESULT PostProcessRenderer::RenderPass(ID3D11DeviceContext* pDeviceContext, const PostPass& pass,
+    ID3D11ShaderResourceView* pInput, ID3D11RenderTargetView* pOutput, UINT width, UINT height, UINT& drawCount) {
+    ID3D11PixelShader* pPixelShader = GetShader(pass);
+    if (pPixelShader == NULL) {
+        return E_FAIL;
+    }
+
+    D3D11_MAPPED_SUBRESOURCE subresource;
+    HRESULT result = pDeviceContext->Map(pConstantBuffer_, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
+    if (FAILED(result)) {
+        return result;
+    }
+    PostProcessBuffer& buffer = *(PostProcessBuffer*)subresource.pData;
+    buffer.headParams = XMFLOAT4(pass.head.params);
+    buffer.texelSize = XMFLOAT4(1.0f / width, 1.0f / height, (float)width, (float)height);
+    for (size_t j = 0; j < pass.ops.size(); j++) {
+        buffer.opParams[j] = XMFLOAT4(pass.ops[j].params);
+    }
+    pDeviceContext->Unmap(pConstantBuffer_, 0);
+
+    D3D11_VIEWPORT viewport = { 0.0f, 0.0f, (FLOAT)width, (FLOAT)height, 0.0f, 1.0f };
+    pDeviceContext->RSSetViewports(1, &viewport);
+    pDeviceContext->OMSetRenderTargets(1, &pOutput, nullptr);
+    pDeviceContext->IASetInputLayout(nullptr);
+    pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    pDeviceContext->VSSetShader(pVertexShader_, nullptr, 0);
+    pDeviceContext->PSSetShader(pPixelShader, nullptr, 0);
+    pDeviceContext->PSSetConstantBuffers(0, 1, &pConstantBuffer_);
+    pDeviceContext->PSSetSamplers(0, 1, &pSamplerState_);
+    pDeviceContext->PSSetShaderResources(0, 1, &pInput);
+
+    pDeviceContext->Draw(3, 0);
+    drawCount++;
+
+    return S_OK;
+}
+
+PostProcessRenderer::~PostProcessRenderer() {
+    Release();
+}
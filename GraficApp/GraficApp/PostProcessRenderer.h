@@ -0,0 +1,46 @@
+#pragma once
+
+#include "framework.h"
+#include "PostProcessChain.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+struct PostProcessBuffer {
+    XMFLOAT4 headParams;
+    XMFLOAT4 texelSize;
+    XMFLOAT4 opParams[PostProcessChain::MaxFusedOps];
+};
+
+// Runs a PostProcessChain plan with D3D11. Pixel shaders are generated per fused pass and
+// cached by PostProcessChain::GetShaderKey. Intermediate targets and the unbinds between
+// passes are left to the frame graph, each plan pass is one graph pass.
+class PostProcessRenderer {
+public:
+    PostProcessRenderer() = default;
+
+    PostProcessRenderer(const PostProcessRenderer&) = delete;
+    PostProcessRenderer(PostProcessRenderer&&) = delete;
+
+    HRESULT Init(ID3D11Device* pDevice);
+    void Release();
+
+    // Draws one fused pass from pInput into pOutput, binds all the state it needs
+    HRESULT RenderPass(ID3D11DeviceContext* pDeviceContext, const PostPass& pass,
+        ID3D11ShaderResourceView* pInput, ID3D11RenderTargetView* pOutput, UINT width, UINT height, UINT& drawCount);
+
+    size_t GetShaderCount() const { return shaders_.size(); };
+
+    ~PostProcessRenderer();
+private:
+    ID3D11PixelShader* GetShader(const PostPass& pass);
+
+    ID3D11Device* pDevice_ = NULL;
+    ID3D11VertexShader* pVertexShader_ = NULL;
+    ID3D11SamplerState* pSamplerState_ = NULL;
+    ID3D11Buffer* pConstantBuffer_ = NULL;
+
+    // Failed compilations are cached as NULL so they are not retried every frame
+    std::map<std::string, ID3D11PixelShader*> shaders_;
+};
@@ -0,0 +1,81 @@
+#include "QueryRing.h"
+
+QueryRing::QueryRing(IQuerySource& source, int stageCount, int slotCount) :
+    source_(source),
+    stageCount_(stageCount < MaxStages ? stageCount : MaxStages),
+    slots_(slotCount > 1 ? slotCount : 2) {}
+
+void QueryRing::BeginFrame() {
+    recording_ = false;
+
+    Slot& slot = slots_[writeSlot_];
+    if (slot.state == SlotState::Pending) {
+        Collect();
+    }
+    if (slot.state != SlotState::Free) {
+        droppedFrames_++;
+        return;
+    }
+
+    source_.Begin(writeSlot_);
+    slot.state = SlotState::Recording;
+    slot.timestampMask = 0;
+    slot.frame = frame_;
+    recording_ = true;
+}
+
+void QueryRing::BeginStage(int stage) {
+    if (!recording_ || stage < 0 || stage >= stageCount_) {
+        return;
+    }
+    source_.Timestamp(writeSlot_, stage * 2);
+    slots_[writeSlot_].timestampMask |= 1u << (stage * 2);
+}
+
+void QueryRing::EndStage(int stage) {
+    if (!recording_ || stage < 0 || stage >= stageCount_) {
+        return;
+    }
+    source_.Timestamp(writeSlot_, stage * 2 + 1);
+    slots_[writeSlot_].timestampMask |= 1u << (stage * 2 + 1);
+}
+
+void QueryRing::EndFrame() {
+    frame_++;
+    if (!recording_) {
+        return;
+    }
+
+    source_.End(writeSlot_);
+    slots_[writeSlot_].state = SlotState::Pending;
+    writeSlot_ = (writeSlot_ + 1) % (int)slots_.size();
+    recording_ = false;
+}
+
+void QueryRing::Collect() {
+    uint64_t timestamps[MaxStages * 2];
+    while (slots_[readSlot_].state == SlotState::Pending) {
+        Slot& slot = slots_[readSlot_];
+        uint64_t frequency = 0;
+        QueryStatus status = source_.Read(readSlot_, slot.timestampMask, timestamps, frequency);
+        if (status == QueryStatus::NotReady) {
+            break;
+        }
+
+        if (status == QueryStatus::Disjoint || frequency == 0) {
+            disjointFrames_++;
+        }
+        else {
+            for (int i = 0; i < stageCount_; i++) {
+                uint32_t stageMask = 3u << (i * 2);
+                stageMs_[i] = (slot.timestampMask & stageMask) == stageMask ?
+                    (double)(timestamps[i * 2 + 1] - timestamps[i * 2]) * 1000.0 / (double)frequency : 0.0;
+            }
+            latency_ = frame_ - slot.frame;
+            hasResult_ = true;
+        }
+
+        slot.state = SlotState::Free;
+        readSlot_ = (readSlot_ + 1) % (int)slots_.size();
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+enum class QueryStatus {
+    Ready,
+    NotReady,
+    Disjoint
+};
+
+// Backend for QueryRing. A slot groups the queries of one frame: a disjoint query around
+// the frame and up to 32 timestamps. D3D11QuerySource wraps ID3D11Query, tests can fake it.
+class IQuerySource {
+public:
+    virtual void Begin(int slot) = 0;
+    virtual void Timestamp(int slot, int index) = 0;
+    virtual void End(int slot) = 0;
+    // Must not block. Only timestamps set in timestampMask were issued for this slot
+    virtual QueryStatus Read(int slot, uint32_t timestampMask, uint64_t* timestamps, uint64_t& frequency) = 0;
+
+    virtual ~IQuerySource() = default;
+};
+
+// Per-stage GPU timings read back a few frames late so the CPU never waits for the GPU.
+// If every slot is still in flight the frame is not measured instead of stalling.
+class QueryRing {
+public:
+    static constexpr int MaxStages = 16;
+
+    QueryRing(IQuerySource& source, int stageCount, int slotCount);
+
+    QueryRing(const QueryRing&) = delete;
+    QueryRing(QueryRing&&) = delete;
+
+    void BeginFrame();
+    void BeginStage(int stage);
+    void EndStage(int stage);
+    void EndFrame();
+    // Reads finished slots in issue order, stops at the first one that is not ready
+    void Collect();
+
+    // Result of the latest frame read back, 0 for stages it did not record
+    double GetStageMs(int stage) const { return stageMs_[stage]; };
+    int GetStageCount() const { return stageCount_; };
+    // Frames between issuing the latest result and reading it
+    uint64_t GetLatency() const { return latency_; };
+    uint64_t GetDroppedFrames() const { return droppedFrames_; };
+    uint64_t GetDisjointFrames() const { return disjointFrames_; };
+    bool HasResult() const { return hasResult_; };
+
+    ~QueryRing() = default;
+private:
+    enum class SlotState {
+        Free,
+        Recording,
+        Pending
+    };
+
+    struct Slot {
+        SlotState state = SlotState::Free;
+        uint32_t timestampMask = 0;
+        uint64_t frame = 0;
+    };
+
+    IQuerySource& source_;
+    int stageCount_;
+    std::vector<Slot> slots_;
+    int writeSlot_ = 0;
+    int readSlot_ = 0;
+    bool recording_ = false;
+
+    uint64_t frame_ = 0;
+    uint64_t latency_ = 0;
+    uint64_t droppedFrames_ = 0;
+    uint64_t disjointFrames_ = 0;
+    bool hasResult_ = false;
+    double stageMs_[MaxStages] = {};
+};
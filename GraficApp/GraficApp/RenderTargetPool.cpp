@@ -0,0 +1,81 @@
+#include "RenderTargetPool.h"
+
+RenderTargetPool::RenderTargetPool(IRenderTargetAllocator& allocator, uint32_t maxAge) :
+    allocator_(allocator),
+    maxAge_(maxAge) {
+}
+
+void RenderTargetPool::BeginFrame() {
+    frame_++;
+    for (Entry& entry : entries_) {
+        entry.inUse = false;
+        if (entry.resource != NULL && frame_ - entry.lastUsed > maxAge_) {
+            allocator_.Destroy(entry.resource);
+            entry.resource = NULL;
+            evictions_++;
+        }
+    }
+}
+
+int RenderTargetPool::Acquire(const RenderTargetDesc& desc) {
+    int empty = -1;
+    for (size_t i = 0; i < entries_.size(); i++) {
+        Entry& entry = entries_[i];
+        if (entry.resource == NULL) {
+            if (empty < 0) {
+                empty = (int)i;
+            }
+            continue;
+        }
+        if (!entry.inUse && entry.desc == desc) {
+            entry.inUse = true;
+            entry.lastUsed = frame_;
+            reuses_++;
+            return (int)i;
+        }
+    }
+
+    void* resource = allocator_.Create(desc);
+    if (resource == NULL) {
+        return -1;
+    }
+    allocations_++;
+
+    Entry entry = { desc, resource, frame_, true };
+    if (empty >= 0) {
+        entries_[empty] = entry;
+        return empty;
+    }
+    entries_.push_back(entry);
+    return (int)entries_.size() - 1;
+}
+
+void RenderTargetPool::Release(int handle) {
+    if (handle >= 0 && handle < (int)entries_.size()) {
+        entries_[handle].inUse = false;
+    }
+}
+
+void RenderTargetPool::Clear() {
+    for (Entry& entry : entries_) {
+        if (entry.resource != NULL) {
+            allocator_.Destroy(entry.resource);
+        }
+    }
+    entries_.clear();
+}
+
+RenderTargetPoolStats RenderTargetPool::GetStats() const {
+    RenderTargetPoolStats stats = { 0, 0, allocations_, reuses_, evictions_ };
+    for (const Entry& entry : entries_) {
+        if (entry.resource != NULL) {
+            stats.entries++;
+            stats.inUse += entry.inUse ? 1 : 0;
+        }
+    }
+    return stats;
+}
+
+RenderTargetPool::~RenderTargetPool() {
+    Clear();
+}
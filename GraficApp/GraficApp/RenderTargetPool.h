@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Everything that decides whether two targets are interchangeable. format and bindFlags
+// hold DXGI_FORMAT and D3D11_BIND_FLAG values, they are only compared here.
+struct RenderTargetDesc {
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t bindFlags;
+    uint32_t samples;
+
+    bool operator==(const RenderTargetDesc& other) const {
+        return width == other.width && height == other.height && format == other.format &&
+            bindFlags == other.bindFlags && samples == other.samples;
+    }
+};
+
+// Backend for RenderTargetPool. D3D11RenderTargetAllocator creates textures and views,
+// tests can fake it.
+class IRenderTargetAllocator {
+public:
+    // NULL on failure
+    virtual void* Create(const RenderTargetDesc& desc) = 0;
+    virtual void Destroy(void* resource) = 0;
+
+    virtual ~IRenderTargetAllocator() = default;
+};
+
+struct RenderTargetPoolStats {
+    uint32_t entries;
+    uint32_t inUse;
+    uint64_t allocations;
+    uint64_t reuses;
+    uint64_t evictions;
+};
+
+// Transient targets keyed by descriptor. Acquire hands out a free entry with the same
+// descriptor or creates one, Release returns it so a later pass of the same frame can
+// alias it. BeginFrame frees everything still held and destroys entries that were not
+// acquired during the last maxAge frames, so a window resize does not reallocate every
+// frame and old sizes disappear on their own.
+class RenderTargetPool {
+public:
+    RenderTargetPool(IRenderTargetAllocator& allocator, uint32_t maxAge);
+
+    RenderTargetPool(const RenderTargetPool&) = delete;
+    RenderTargetPool(RenderTargetPool&&) = delete;
+
+    void BeginFrame();
+    // Handle stays valid until Release or the next BeginFrame, -1 if creation failed
+    int Acquire(const RenderTargetDesc& desc);
+    void Release(int handle);
+    void* GetResource(int handle) const { return entries_[handle].resource; };
+    const RenderTargetDesc& GetDesc(int handle) const { return entries_[handle].desc; };
+    // Destroys every entry, handles become invalid
+    void Clear();
+
+    RenderTargetPoolStats GetStats() const;
+    uint64_t GetFrame() const { return frame_; };
+
+    ~RenderTargetPool();
+private:
+    struct Entry {
+        RenderTargetDesc desc;
+        void* resource; // NULL for an empty slot
+        uint64_t lastUsed;
+        bool inUse;
+    };
+
+    IRenderTargetAllocator& allocator_;
+    uint32_t maxAge_;
+    uint64_t frame_ = 0;
+    std::vector<Entry> entries_;
+
+    uint64_t allocations_ = 0;
+    uint64_t reuses_ = 0;
+    uint64_t evictions_ = 0;
+};
@@ -0,0 +1,235 @@
+#include "SceneFile.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace {
+    const uint32_t ElementSizes[SceneSectionTypeCount] = {
+        0,
+        sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(uint32_t),
+        sizeof(SceneLight), sizeof(SceneMaterial), sizeof(SceneBvhNode), sizeof(uint32_t)
+    };
+
+    // The tables are used in place, so the host has to share the file's byte order
+    bool IsLittleEndian() {
+        const uint32_t value = 1;
+        uint8_t first;
+        memcpy(&first, &value, 1);
+        return first == 1;
+    }
+
+    uint64_t AlignUp(uint64_t value) {
+        return (value + SceneFileHeader::Alignment - 1) & ~(uint64_t)(SceneFileHeader::Alignment - 1);
+    }
+}
+
+bool SerializeSceneFile(const SceneData& scene, std::vector<uint8_t>& data) {
+    size_t instanceCount = scene.x.size();
+    if (!IsLittleEndian() || scene.y.size() != instanceCount || scene.z.size() != instanceCount ||
+        scene.speed.size() != instanceCount || scene.material.size() != instanceCount ||
+        (scene.bvhNodes.empty() != scene.bvhIndices.empty()) || instanceCount > UINT32_MAX) {
+        return false;
+    }
+
+    struct Table {
+        uint32_t type;
+        const void* pData;
+        size_t count;
+    };
+    std::vector<Table> tables = {
+        { SceneSectionPositionX, scene.x.data(), instanceCount },
+        { SceneSectionPositionY, scene.y.data(), instanceCount },
+        { SceneSectionPositionZ, scene.z.data(), instanceCount },
+        { SceneSectionSpeed, scene.speed.data(), instanceCount },
+        { SceneSectionMaterialIndex, scene.material.data(), instanceCount },
+        { SceneSectionLights, scene.lights.data(), scene.lights.size() },
+        { SceneSectionMaterials, scene.materials.data(), scene.materials.size() }
+    };
+    if (!scene.bvhNodes.empty()) {
+        tables.push_back({ SceneSectionBvhNodes, scene.bvhNodes.data(), scene.bvhNodes.size() });
+        tables.push_back({ SceneSectionBvhIndices, scene.bvhIndices.data(), scene.bvhIndices.size() });
+    }
+
+    SceneFileHeader header = {};
+    header.magic = SceneFileHeader::Magic;
+    header.version = SceneFileHeader::Version;
+    header.headerSize = sizeof(SceneFileHeader);
+    header.sectionCount = (uint32_t)tables.size();
+    header.sectionOffset = sizeof(SceneFileHeader);
+    header.instanceCount = (uint32_t)instanceCount;
+    header.lightCount = (uint32_t)scene.lights.size();
+    header.materialCount = (uint32_t)scene.materials.size();
+    header.bvhNodeCount = (uint32_t)scene.bvhNodes.size();
+
+    std::vector<SceneFileSection> sections;
+    uint64_t offset = AlignUp(header.sectionOffset + tables.size() * sizeof(SceneFileSection));
+    for (const Table& table : tables) {
+        SceneFileSection section = { table.type, ElementSizes[table.type], offset, table.count, 0 };
+        sections.push_back(section);
+        offset = AlignUp(offset + table.count * section.elementSize);
+    }
+    header.fileSize = offset;
+
+    // Gaps between sections stay zero
+    data.assign((size_t)header.fileSize, 0);
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + header.sectionOffset, sections.data(), sections.size() * sizeof(SceneFileSection));
+    for (size_t i = 0; i < tables.size(); i++) {
+        if (tables[i].count > 0) {
+            memcpy(data.data() + sections[i].offset, tables[i].pData, tables[i].count * sections[i].elementSize);
+        }
+    }
+    return true;
+}
+
+bool WriteSceneFile(const std::string& fileName, const SceneData& scene) {
+    std::vector<uint8_t> data;
+    if (!SerializeSceneFile(scene, data)) {
+        return false;
+    }
+
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+    file.write((const char*)data.data(), data.size());
+    return file.good();
+}
+
+bool SceneFile::Open(const std::string& fileName) {
+    Close();
+    if (!file_.Open(fileName)) {
+        return false;
+    }
+    if (!Attach(file_.GetData(), file_.GetSize())) {
+        file_.Close();
+        return false;
+    }
+    return true;
+}
+
+bool SceneFile::Attach(const void* pData, size_t size) {
+    pData_ = (const uint8_t*)pData;
+    size_ = size;
+    if (!Validate()) {
+        pData_ = nullptr;
+        size_ = 0;
+        return false;
+    }
+    return true;
+}
+
+void SceneFile::Close() {
+    file_.Close();
+    pData_ = nullptr;
+    size_ = 0;
+}
+
+bool SceneFile::Validate() {
+    instances_ = {};
+    pLights_ = nullptr;
+    pMaterials_ = nullptr;
+    pBvhNodes_ = nullptr;
+    pBvhIndices_ = nullptr;
+    bvhIndexCount_ = 0;
+
+    // Tables are read as floats and integers straight from the view
+    if (!IsLittleEndian() || pData_ == nullptr || ((uintptr_t)pData_ & 3) != 0 || size_ < sizeof(SceneFileHeader)) {
+        return false;
+    }
+
+    const SceneFileHeader& header = GetHeader();
+    if (header.magic != SceneFileHeader::Magic || header.version != SceneFileHeader::Version ||
+        header.headerSize != sizeof(SceneFileHeader) || header.fileSize != size_ ||
+        header.sectionCount > SceneFileHeader::MaxSections || header.sectionOffset < sizeof(SceneFileHeader) ||
+        header.sectionOffset % alignof(SceneFileSection) != 0 ||
+        header.sectionOffset > size_ || header.sectionCount * sizeof(SceneFileSection) > size_ - header.sectionOffset) {
+        return false;
+    }
+
+    // Every known section at most once, aligned, inside the file and with the expected element size
+    const SceneFileSection* sections = reinterpret_cast<const SceneFileSection*>(pData_ + header.sectionOffset);
+    const SceneFileSection* known[SceneSectionTypeCount] = {};
+    for (uint32_t i = 0; i < header.sectionCount; i++) {
+        const SceneFileSection& section = sections[i];
+        if (section.offset % SceneFileHeader::Alignment != 0 || section.offset < sizeof(SceneFileHeader) ||
+            section.offset > size_ || section.elementSize == 0 ||
+            section.count > (size_ - section.offset) / section.elementSize) {
+            return false;
+        }
+        if (section.type == 0 || section.type >= SceneSectionTypeCount) {
+            continue;
+        }
+        if (known[section.type] != nullptr || section.elementSize != ElementSizes[section.type]) {
+            return false;
+        }
+        known[section.type] = &section;
+    }
+
+    // Instance tables are required, the others may be left out when empty
+    auto table = [&](uint32_t type, uint64_t count, bool required) -> const uint8_t* {
+        const SceneFileSection* section = known[type];
+        if (section == nullptr) {
+            return required || count > 0 ? nullptr : pData_;
+        }
+        return section->count == count ? pData_ + section->offset : nullptr;
+    };
+    instances_.count = header.instanceCount;
+    instances_.x = reinterpret_cast<const float*>(table(SceneSectionPositionX, header.instanceCount, true));
+    instances_.y = reinterpret_cast<const float*>(table(SceneSectionPositionY, header.instanceCount, true));
+    instances_.z = reinterpret_cast<const float*>(table(SceneSectionPositionZ, header.instanceCount, true));
+    instances_.speed = reinterpret_cast<const float*>(table(SceneSectionSpeed, header.instanceCount, true));
+    instances_.material = reinterpret_cast<const uint32_t*>(table(SceneSectionMaterialIndex, header.instanceCount, true));
+    pLights_ = reinterpret_cast<const SceneLight*>(table(SceneSectionLights, header.lightCount, false));
+    pMaterials_ = reinterpret_cast<const SceneMaterial*>(table(SceneSectionMaterials, header.materialCount, false));
+    if (instances_.x == nullptr || instances_.y == nullptr || instances_.z == nullptr || instances_.speed == nullptr ||
+        instances_.material == nullptr || pLights_ == nullptr || pMaterials_ == nullptr) {
+        return false;
+    }
+
+    // Indices are the only values that can send a reader outside the tables
+    uint32_t invalid = header.instanceCount > 0 && header.materialCount == 0 ? 1 : 0;
+    for (uint32_t i = 0; i < header.instanceCount; i++) {
+        invalid |= instances_.material[i] >= header.materialCount ? 1 : 0;
+    }
+    if (invalid != 0) {
+        return false;
+    }
+
+    if (header.bvhNodeCount == 0) {
+        return known[SceneSectionBvhNodes] == nullptr && known[SceneSectionBvhIndices] == nullptr;
+    }
+
+    const SceneFileSection* indexSection = known[SceneSectionBvhIndices];
+    if (indexSection == nullptr || indexSection->count > UINT32_MAX) {
+        return false;
+    }
+    bvhIndexCount_ = (uint32_t)indexSection->count;
+    pBvhNodes_ = reinterpret_cast<const SceneBvhNode*>(table(SceneSectionBvhNodes, header.bvhNodeCount, true));
+    pBvhIndices_ = reinterpret_cast<const uint32_t*>(pData_ + indexSection->offset);
+    if (pBvhNodes_ == nullptr) {
+        return false;
+    }
+
+    // Children after their parent keeps every traversal finite
+    for (uint32_t i = 0; i < header.bvhNodeCount; i++) {
+        const SceneBvhNode& node = pBvhNodes_[i];
+        if (node.count == 0) {
+            invalid |= node.first <= i || node.first >= header.bvhNodeCount - 1 ? 1 : 0;
+        }
+        else {
+            invalid |= node.first > bvhIndexCount_ || node.count > bvhIndexCount_ - node.first ? 1 : 0;
+        }
+    }
+    for (uint32_t i = 0; i < bvhIndexCount_; i++) {
+        invalid |= pBvhIndices_[i] >= header.instanceCount ? 1 : 0;
+    }
+    if (invalid != 0) {
+        pBvhNodes_ = nullptr;
+        pBvhIndices_ = nullptr;
+        bvhIndexCount_ = 0;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Scene file: a 64-byte header, a table of sections and the sections themselves, every one
+// starting on a 64-byte boundary. All values are little-endian and the tables are stored the
+// way they are used, so a mapped file is read in place. Readers skip section types they do
+// not know; a new required section needs a new version.
+struct SceneFileHeader {
+    static constexpr uint32_t Magic = 0x4E435347; // "GSCN"
+    static constexpr uint32_t Version = 1;
+    static constexpr uint32_t Alignment = 64;
+    static constexpr uint32_t MaxSections = 64;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t sectionCount;
+    uint64_t fileSize;
+    uint64_t sectionOffset;
+    uint32_t instanceCount;
+    uint32_t lightCount;
+    uint32_t materialCount;
+    uint32_t bvhNodeCount;
+    uint32_t reserved[4];
+};
+static_assert(sizeof(SceneFileHeader) == 64, "SceneFileHeader is part of the file format");
+
+enum SceneSectionType : uint32_t {
+    SceneSectionPositionX = 1,
+    SceneSectionPositionY,
+    SceneSectionPositionZ,
+    SceneSectionSpeed,
+    SceneSectionMaterialIndex,
+    SceneSectionLights,
+    SceneSectionMaterials,
+    SceneSectionBvhNodes,
+    SceneSectionBvhIndices,
+    SceneSectionTypeCount
+};
+
+struct SceneFileSection {
+    uint32_t type;
+    uint32_t elementSize;
+    uint64_t offset;
+    uint64_t count;
+    uint64_t reserved;
+};
+static_assert(sizeof(SceneFileSection) == 32, "SceneFileSection is part of the file format");
+
+// Same layout as the renderer's Light
+struct SceneLight {
+    float position[4];
+    float color[4];
+};
+
+struct SceneMaterial {
+    float shininess;
+    uint32_t textureIndex;
+    uint32_t normalMap;
+    uint32_t reserved;
+};
+
+// Leaves have count > 0 and own bvhIndices[first, first + count), inner nodes have count 0
+// and children first and first + 1, which always come after the node itself
+struct SceneBvhNode {
+    float min[3];
+    uint32_t first;
+    float max[3];
+    uint32_t count;
+};
+static_assert(sizeof(SceneBvhNode) == 32, "SceneBvhNode is part of the file format");
+
+// Instances as structure of arrays, the same layout InstanceAnimation uses
+struct SceneInstances {
+    const float* x;
+    const float* y;
+    const float* z;
+    const float* speed;
+    const uint32_t* material;
+    uint32_t count;
+};
+
+// Owning tables for WriteSceneFile, the BVH is optional
+struct SceneData {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> speed;
+    std::vector<uint32_t> material;
+    std::vector<SceneLight> lights;
+    std::vector<SceneMaterial> materials;
+    std::vector<SceneBvhNode> bvhNodes;
+    std::vector<uint32_t> bvhIndices;
+};
+
+bool SerializeSceneFile(const SceneData& scene, std::vector<uint8_t>& data);
+bool WriteSceneFile(const std::string& fileName, const SceneData& scene);
+
+// Maps a scene file and checks that every table and every index in it stays inside the
+// file, nothing is copied. Pointers stay valid until Close or the next Open.
+class SceneFile {
+public:
+    SceneFile() = default;
+
+    SceneFile(const SceneFile&) = delete;
+    SceneFile(SceneFile&&) = delete;
+
+    bool Open(const std::string& fileName);
+    // Validates a file already in memory, the memory must outlive the SceneFile
+    bool Attach(const void* pData, size_t size);
+    void Close();
+
+    bool IsOpen() const { return pData_ != nullptr; };
+    const SceneFileHeader& GetHeader() const { return *reinterpret_cast<const SceneFileHeader*>(pData_); };
+    const SceneInstances& GetInstances() const { return instances_; };
+    const SceneLight* GetLights() const { return pLights_; };
+    const SceneMaterial* GetMaterials() const { return pMaterials_; };
+    bool HasBvh() const { return pBvhNodes_ != nullptr; };
+    const SceneBvhNode* GetBvhNodes() const { return pBvhNodes_; };
+    const uint32_t* GetBvhIndices() const { return pBvhIndices_; };
+    uint32_t GetBvhIndexCount() const { return bvhIndexCount_; };
+
+    ~SceneFile() = default;
+private:
+    bool Validate();
+
+    MappedFile file_;
+    const uint8_t* pData_ = nullptr;
+    size_t size_ = 0;
+
+    SceneInstances instances_ = {};
+    const SceneLight* pLights_ = nullptr;
+    const SceneMaterial* pMaterials_ = nullptr;
+    const SceneBvhNode* pBvhNodes_ = nullptr;
+    const uint32_t* pBvhIndices_ = nullptr;
+    uint32_t bvhIndexCount_ = 0;
+};
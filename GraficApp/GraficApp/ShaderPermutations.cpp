@@ -0,0 +1,114 @@
+#include "ShaderPermutations.h"
+#include "ThreadPool.h"
+
+namespace {
+    const char* const FeatureMacros[ShaderFeatureCount] = { "NORMAL_MAP", "SHOW_NORMALS", "USE_LIGHTS" };
+
+    const uint32_t FeatureMask = (1u << ShaderFeatureCount) - 1;
+    const uint32_t ShaderShift = 16;
+}
+
+void GetShaderMacros(uint32_t features, std::vector<const char*>& macros) {
+    macros.clear();
+    for (uint32_t i = 0; i < ShaderFeatureCount; i++) {
+        if ((features & (1u << i)) != 0) {
+            macros.push_back(FeatureMacros[i]);
+        }
+    }
+}
+
+// Finalizer of MurmurHash3, keys differ only in a few low bits
+uint32_t HashShaderKey(ShaderKey key) {
+    key ^= key >> 16;
+    key *= 0x85EBCA6Bu;
+    key ^= key >> 13;
+    key *= 0xC2B2AE35u;
+    key ^= key >> 16;
+    return key;
+}
+
+ShaderPermutations::ShaderPermutations(IShaderCompiler& compiler) : compiler_(compiler), slots_(16, 0) {}
+
+int ShaderPermutations::AddShader(const ShaderSource& source) {
+    if (shaders_.size() >= 0xFFFF) {
+        return -1;
+    }
+    shaders_.push_back(source);
+    return (int)shaders_.size() - 1;
+}
+
+ShaderKey ShaderPermutations::MakeKey(int shader, uint32_t features) const {
+    return ((ShaderKey)(shader + 1) << ShaderShift) | (features & shaders_[shader].features & FeatureMask);
+}
+
+size_t ShaderPermutations::FindSlot(ShaderKey key) const {
+    size_t mask = slots_.size() - 1;
+    size_t slot = HashShaderKey(key) & mask;
+    while (slots_[slot] != 0 && variants_[slots_[slot] - 1].key != key) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void ShaderPermutations::Grow() {
+    slots_.assign(slots_.size() * 2, 0);
+    for (size_t i = 0; i < variants_.size(); i++) {
+        slots_[FindSlot(variants_[i].key)] = (uint32_t)i + 1;
+    }
+}
+
+void ShaderPermutations::Request(ShaderKey key) {
+    if (slots_[FindSlot(key)] != 0) {
+        return;
+    }
+    if ((variants_.size() + 1) * 2 > slots_.size()) {
+        Grow();
+    }
+    variants_.push_back({ key, nullptr, false });
+    slots_[FindSlot(key)] = (uint32_t)variants_.size();
+    pending_.push_back(variants_.size() - 1);
+}
+
+bool ShaderPermutations::Compile() {
+    if (pending_.empty()) {
+        return !failed_;
+    }
+
+    ThreadPool::GetInstance().ParallelFor(pending_.size(), [&](size_t i) {
+        Variant& variant = variants_[pending_[i]];
+        std::vector<const char*> macros;
+        GetShaderMacros(variant.key & FeatureMask, macros);
+        variant.pShader = compiler_.Compile(shaders_[(variant.key >> ShaderShift) - 1], macros);
+    });
+
+    for (size_t index : pending_) {
+        Variant& variant = variants_[index];
+        variant.compiled = true;
+        failed_ = failed_ || variant.pShader == nullptr;
+    }
+    compiles_ += pending_.size();
+    pending_.clear();
+    return !failed_;
+}
+
+void* ShaderPermutations::Find(ShaderKey key) const {
+    uint32_t index = slots_[FindSlot(key)];
+    return index != 0 && variants_[index - 1].compiled ? variants_[index - 1].pShader : nullptr;
+}
+
+void* ShaderPermutations::Find(ShaderKey key, ShaderKey fallback) const {
+    void* pShader = Find(key);
+    return pShader != nullptr ? pShader : Find(fallback);
+}
+
+void ShaderPermutations::Release() {
+    for (Variant& variant : variants_) {
+        if (variant.pShader != nullptr) {
+            compiler_.Destroy(variant.pShader);
+        }
+    }
+    variants_.clear();
+    pending_.clear();
+    slots_.assign(16, 0);
+    failed_ = false;
+}
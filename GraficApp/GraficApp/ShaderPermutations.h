@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Switches the scene shaders are specialized on instead of branching at run time; every
+// feature a variant has is a macro defined as 1
+enum ShaderFeature : uint32_t {
+    ShaderFeatureNormalMap = 1u << 0,   // NORMAL_MAP, tangent space normals from cubeNormal
+    ShaderFeatureShowNormals = 1u << 1, // SHOW_NORMALS, the normal as color instead of lighting
+    ShaderFeatureLights = 1u << 2       // USE_LIGHTS, lit transparent planes
+};
+
+const uint32_t ShaderFeatureCount = 3;
+
+// Macro names of the features in bit order
+void GetShaderMacros(uint32_t features, std::vector<const char*>& macros);
+
+struct ShaderSource {
+    std::string file;
+    std::string entry;
+    std::string target;
+    uint32_t features; // the ones the file reacts to, others are dropped from its keys
+};
+
+// Backend for ShaderPermutations. D3D11ShaderCompiler creates pixel shaders, tests fake it.
+class IShaderCompiler {
+public:
+    // Called from ThreadPool workers for different variants at the same time, NULL on failure
+    virtual void* Compile(const ShaderSource& source, const std::vector<const char*>& macros) = 0;
+    virtual void Destroy(void* shader) = 0;
+
+    virtual ~IShaderCompiler() = default;
+};
+
+// Shader index above the feature bits, never 0
+typedef uint32_t ShaderKey;
+
+uint32_t HashShaderKey(ShaderKey key);
+
+// Variants of a few shader files keyed by their features. Request() queues the variants a
+// frame needs, Compile() builds the new ones in parallel on ThreadPool and Find() looks one up
+// per draw in an open addressing table. Failed variants stay NULL and are not retried.
+class ShaderPermutations {
+public:
+    explicit ShaderPermutations(IShaderCompiler& compiler);
+
+    ShaderPermutations(const ShaderPermutations&) = delete;
+    ShaderPermutations(ShaderPermutations&&) = delete;
+
+    // Index for MakeKey, at most 65535 shaders
+    int AddShader(const ShaderSource& source);
+    ShaderKey MakeKey(int shader, uint32_t features) const;
+
+    void Request(ShaderKey key);
+    // false if a variant failed to compile now or before
+    bool Compile();
+    // NULL until compiled or if compilation failed
+    void* Find(ShaderKey key) const;
+    // The fallback variant when key is not usable, for draws that must not be skipped
+    void* Find(ShaderKey key, ShaderKey fallback) const;
+
+    size_t GetVariantCount() const { return variants_.size(); };
+    size_t GetPendingCount() const { return pending_.size(); };
+    uint64_t GetCompileCount() const { return compiles_; };
+
+    // Destroys every variant, shaders stay registered
+    void Release();
+
+    ~ShaderPermutations() { Release(); };
+private:
+    struct Variant {
+        ShaderKey key;
+        void* pShader;
+        bool compiled;
+    };
+
+    // Slot of the key or the empty one where it belongs
+    size_t FindSlot(ShaderKey key) const;
+    void Grow();
+
+    IShaderCompiler& compiler_;
+    std::vector<ShaderSource> shaders_;
+    std::vector<Variant> variants_;
+    // Indices into variants_ plus one, 0 is empty; power of two size, at most half full
+    std::vector<uint32_t> slots_;
+    std::vector<size_t> pending_;
+    uint64_t compiles_ = 0;
+    bool failed_ = false;
+};
@@ -0,0 +1,566 @@
+#include "SoftwareRasterizer.h"
+#include "ThreadPool.h"
+#include "ImageKernels.h"
+
+#include <emmintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+namespace {
+    inline float Saturate(float value) {
+        return value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+    }
+
+    inline float Dot(const RasterFloat3& a, const RasterFloat3& b) {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    inline RasterFloat3 Normalize(const RasterFloat3& v) {
+        float length = sqrtf(Dot(v, v));
+        if (length <= 0.0f) {
+            return v;
+        }
+        return RasterFloat3(v.x / length, v.y / length, v.z / length);
+    }
+
+    inline RasterFloat3 Cross(const RasterFloat3& a, const RasterFloat3& b) {
+        return RasterFloat3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+    }
+
+    // (v, w) * m, w is 1 for points and 0 for directions
+    inline RasterFloat4 Transform(const RasterFloat3& v, float w, const RasterMatrix& m) {
+        return RasterFloat4(
+            v.x * m.m[0][0] + v.y * m.m[1][0] + v.z * m.m[2][0] + w * m.m[3][0],
+            v.x * m.m[0][1] + v.y * m.m[1][1] + v.z * m.m[2][1] + w * m.m[3][1],
+            v.x * m.m[0][2] + v.y * m.m[1][2] + v.z * m.m[2][2] + w * m.m[3][2],
+            v.x * m.m[0][3] + v.y * m.m[1][3] + v.z * m.m[2][3] + w * m.m[3][3]);
+    }
+
+    inline RasterFloat3 TransformPoint(const RasterFloat3& v, const RasterMatrix& m) {
+        RasterFloat4 result = Transform(v, 1.0f, m);
+        return RasterFloat3(result.x, result.y, result.z);
+    }
+
+    inline RasterFloat3 TransformNormal(const RasterFloat3& v, const RasterMatrix& m) {
+        RasterFloat4 result = Transform(v, 0.0f, m);
+        return RasterFloat3(result.x, result.y, result.z);
+    }
+
+    void WriteUInt16(std::ofstream& file, uint16_t value) {
+        file.put((char)(value & 0xFF));
+        file.put((char)(value >> 8));
+    }
+
+    void WriteUInt32(std::ofstream& file, uint32_t value) {
+        WriteUInt16(file, (uint16_t)(value & 0xFFFF));
+        WriteUInt16(file, (uint16_t)(value >> 16));
+    }
+}
+
+RasterFloat4 RasterTexture::Sample(float u, float v, int layer) const {
+    if (texels.empty()) {
+        return RasterFloat4(1.0f, 1.0f, 1.0f, 1.0f);
+    }
+    layer = std::min(std::max(layer, 0), layers - 1);
+
+    float fx = Saturate(u) * width - 0.5f;
+    float fy = Saturate(v) * height - 0.5f;
+    int x0 = (int)floorf(fx);
+    int y0 = (int)floorf(fy);
+    float tx = fx - x0;
+    float ty = fy - y0;
+    int x1 = std::min(x0 + 1, width - 1);
+    int y1 = std::min(y0 + 1, height - 1);
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+
+    const RasterFloat4* base = texels.data() + (size_t)layer * width * height;
+    const RasterFloat4& c00 = base[y0 * width + x0];
+    const RasterFloat4& c10 = base[y0 * width + x1];
+    const RasterFloat4& c01 = base[y1 * width + x0];
+    const RasterFloat4& c11 = base[y1 * width + x1];
+
+    float w00 = (1.0f - tx) * (1.0f - ty), w10 = tx * (1.0f - ty);
+    float w01 = (1.0f - tx) * ty, w11 = tx * ty;
+    return RasterFloat4(
+        c00.x * w00 + c10.x * w10 + c01.x * w01 + c11.x * w11,
+        c00.y * w00 + c10.y * w10 + c01.y * w01 + c11.y * w11,
+        c00.z * w00 + c10.z * w10 + c01.z * w01 + c11.z * w11,
+        c00.w * w00 + c10.w * w10 + c01.w * w01 + c11.w * w11);
+}
+
+bool SoftwareRasterizer::Init(int width, int height) {
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+
+    width_ = width;
+    height_ = height;
+    stride_ = (width + 3) & ~3;
+    tilesX_ = (width + TileSize - 1) / TileSize;
+    tilesY_ = (height + TileSize - 1) / TileSize;
+
+    color_.assign((size_t)stride_ * height_, RasterFloat4(0.0f, 0.0f, 0.0f, 1.0f));
+    depth_.assign((size_t)stride_ * height_, 0.0f);
+    bins_.assign((size_t)tilesX_ * tilesY_, std::vector<uint32_t>());
+
+    return true;
+}
+
+void SoftwareRasterizer::Clear(const float color[4], float depth) {
+    std::fill(color_.begin(), color_.end(), RasterFloat4(color[0], color[1], color[2], color[3]));
+    std::fill(depth_.begin(), depth_.end(), depth);
+}
+
+void SoftwareRasterizer::SetViewProjection(const RasterMatrix& viewProjectionMatrix) {
+    viewProjectionMatrix_ = viewProjectionMatrix;
+}
+
+void SoftwareRasterizer::SetTextures(const RasterTexture* colorTexture, const RasterTexture* normalTexture) {
+    colorTexture_ = colorTexture;
+    normalTexture_ = normalTexture;
+}
+
+void SoftwareRasterizer::DrawIndexedInstanced(const RasterVertex* vertices, const uint16_t* indices, int indexCount,
+    const RasterInstance* instances, const int* instanceIndices, int instanceCount) {
+    if (width_ == 0 || instanceCount <= 0 || indexCount < 3) {
+        return;
+    }
+
+    mode_ = ShadeMode::Opaque;
+    attribCount_ = 11;
+    instances_ = instances;
+
+    int vertexCount = 0;
+    for (int i = 0; i < indexCount; i++) {
+        vertexCount = std::max(vertexCount, (int)indices[i] + 1);
+    }
+
+    std::vector<std::vector<Triangle>> instanceTriangles(instanceCount);
+
+    ThreadPool::GetInstance().ParallelFor((size_t)instanceCount, [&](size_t k) {
+        int instance = instanceIndices != nullptr ? instanceIndices[k] : (int)k;
+        const RasterMatrix& world = instances[instance].worldMatrix;
+
+        std::vector<ClipVertex> transformed(vertexCount);
+        for (int i = 0; i < vertexCount; i++) {
+            const RasterVertex& src = vertices[i];
+            RasterFloat3 position = TransformPoint(src.pos, world);
+            RasterFloat3 normal = TransformNormal(src.normal, world);
+            RasterFloat3 tangent = TransformNormal(src.tangent, world);
+
+            ClipVertex& dst = transformed[i];
+            dst.position = Transform(position, 1.0f, viewProjectionMatrix_);
+            float attribs[MaxAttribs] = {
+                position.x, position.y, position.z,
+                src.uv.x, src.uv.y,
+                normal.x, normal.y, normal.z,
+                tangent.x, tangent.y, tangent.z
+            };
+            std::copy(attribs, attribs + MaxAttribs, dst.attribs);
+        }
+
+        for (int i = 0; i + 2 < indexCount; i += 3) {
+            ClipAndSetup(&transformed[indices[i]], &transformed[indices[i + 1]], &transformed[indices[i + 2]], instance, instanceTriangles[k]);
+        }
+    });
+
+    triangles_.clear();
+    for (auto& list : instanceTriangles) {
+        triangles_.insert(triangles_.end(), list.begin(), list.end());
+    }
+    BinAndRasterize();
+}
+
+void SoftwareRasterizer::DrawTransparent(const RasterFloat3* positions, const uint16_t* indices, int indexCount,
+    const RasterMatrix& worldMatrix, const RasterFloat4& color, bool useLights) {
+    if (width_ == 0 || indexCount < 3) {
+        return;
+    }
+
+    mode_ = ShadeMode::Transparent;
+    attribCount_ = 3;
+    transparentColor_ = color;
+    useLights_ = useLights;
+
+    int vertexCount = 0;
+    for (int i = 0; i < indexCount; i++) {
+        vertexCount = std::max(vertexCount, (int)indices[i] + 1);
+    }
+
+    std::vector<ClipVertex> transformed(vertexCount);
+    for (int i = 0; i < vertexCount; i++) {
+        RasterFloat3 position = TransformPoint(positions[i], worldMatrix);
+        transformed[i].position = Transform(position, 1.0f, viewProjectionMatrix_);
+        transformed[i].attribs[0] = position.x;
+        transformed[i].attribs[1] = position.y;
+        transformed[i].attribs[2] = position.z;
+    }
+
+    triangles_.clear();
+    for (int i = 0; i + 2 < indexCount; i += 3) {
+        ClipAndSetup(&transformed[indices[i]], &transformed[indices[i + 1]], &transformed[indices[i + 2]], -1, triangles_);
+    }
+    BinAndRasterize();
+}
+
+void SoftwareRasterizer::ClipAndSetup(const ClipVertex* v0, const ClipVertex* v1, const ClipVertex* v2, int instance, std::vector<Triangle>& out) const {
+    const ClipVertex* input[3] = { v0, v1, v2 };
+
+    // Trivial reject against the side planes
+    bool outside[4] = { true, true, true, true };
+    for (int i = 0; i < 3; i++) {
+        const RasterFloat4& p = input[i]->position;
+        outside[0] = outside[0] && p.x > p.w;
+        outside[1] = outside[1] && p.x < -p.w;
+        outside[2] = outside[2] && p.y > p.w;
+        outside[3] = outside[3] && p.y < -p.w;
+    }
+    if (outside[0] || outside[1] || outside[2] || outside[3]) {
+        return;
+    }
+
+    // Projection is reversed (SCREEN_FAR, SCREEN_NEAR) so the near plane is z <= w
+    float distance[3];
+    int insideCount = 0;
+    for (int i = 0; i < 3; i++) {
+        distance[i] = input[i]->position.w - input[i]->position.z;
+        insideCount += distance[i] >= 0.0f ? 1 : 0;
+    }
+
+    Triangle tri;
+    if (insideCount == 3) {
+        if (SetupTriangle(*v0, *v1, *v2, instance, tri)) {
+            out.push_back(tri);
+        }
+        return;
+    }
+    if (insideCount == 0) {
+        return;
+    }
+
+    ClipVertex polygon[4];
+    int polygonSize = 0;
+    for (int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3;
+        if (distance[i] >= 0.0f) {
+            polygon[polygonSize++] = *input[i];
+        }
+        if ((distance[i] >= 0.0f) != (distance[j] >= 0.0f)) {
+            float t = distance[i] / (distance[i] - distance[j]);
+            ClipVertex& v = polygon[polygonSize++];
+            const RasterFloat4& a = input[i]->position;
+            const RasterFloat4& b = input[j]->position;
+            v.position = RasterFloat4(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t);
+            for (int k = 0; k < attribCount_; k++) {
+                v.attribs[k] = input[i]->attribs[k] + (input[j]->attribs[k] - input[i]->attribs[k]) * t;
+            }
+        }
+    }
+
+    for (int i = 1; i + 1 < polygonSize; i++) {
+        if (SetupTriangle(polygon[0], polygon[i], polygon[i + 1], instance, tri)) {
+            out.push_back(tri);
+        }
+    }
+}
+
+bool SoftwareRasterizer::SetupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, int instance, Triangle& tri) const {
+    const ClipVertex* v[3] = { &v0, &v1, &v2 };
+    for (int i = 0; i < 3; i++) {
+        const RasterFloat4& p = v[i]->position;
+        if (p.w <= 0.0f) {
+            return false;
+        }
+        tri.invW[i] = 1.0f / p.w;
+        tri.x[i] = (p.x * tri.invW[i] * 0.5f + 0.5f) * width_;
+        tri.y[i] = (0.5f - p.y * tri.invW[i] * 0.5f) * height_;
+        tri.z[i] = p.z * tri.invW[i];
+        for (int k = 0; k < attribCount_; k++) {
+            tri.attribs[i][k] = v[i]->attribs[k] * tri.invW[i];
+        }
+    }
+
+    float area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.y[1] - tri.y[0]) * (tri.x[2] - tri.x[0]);
+    if (area == 0.0f || !std::isfinite(area)) {
+        return false;
+    }
+    // Rasterizer state has CullMode NONE: bring both windings to the same orientation
+    if (area < 0.0f) {
+        std::swap(tri.x[1], tri.x[2]);
+        std::swap(tri.y[1], tri.y[2]);
+        std::swap(tri.z[1], tri.z[2]);
+        std::swap(tri.invW[1], tri.invW[2]);
+        for (int k = 0; k < attribCount_; k++) {
+            std::swap(tri.attribs[1][k], tri.attribs[2][k]);
+        }
+        area = -area;
+    }
+    tri.invArea = 1.0f / area;
+
+    // Edge k is opposite to vertex k, so E_k / area is the barycentric weight of vertex k
+    for (int k = 0; k < 3; k++) {
+        int a = (k + 1) % 3;
+        int b = (k + 2) % 3;
+        tri.edgeA[k] = tri.y[a] - tri.y[b];
+        tri.edgeB[k] = tri.x[b] - tri.x[a];
+        tri.edgeC[k] = -(tri.edgeA[k] * tri.x[a] + tri.edgeB[k] * tri.y[a]);
+        tri.topLeft[k] = tri.edgeA[k] > 0.0f || (tri.edgeA[k] == 0.0f && tri.edgeB[k] > 0.0f);
+    }
+
+    float minX = std::min(tri.x[0], std::min(tri.x[1], tri.x[2]));
+    float maxX = std::max(tri.x[0], std::max(tri.x[1], tri.x[2]));
+    float minY = std::min(tri.y[0], std::min(tri.y[1], tri.y[2]));
+    float maxY = std::max(tri.y[0], std::max(tri.y[1], tri.y[2]));
+    tri.minX = std::max(0, (int)floorf(std::max(minX, -1.0f)));
+    tri.minY = std::max(0, (int)floorf(std::max(minY, -1.0f)));
+    tri.maxX = std::min(width_ - 1, (int)ceilf(std::min(maxX, (float)width_)));
+    tri.maxY = std::min(height_ - 1, (int)ceilf(std::min(maxY, (float)height_)));
+    tri.instance = instance;
+
+    return tri.minX <= tri.maxX && tri.minY <= tri.maxY;
+}
+
+void SoftwareRasterizer::BinAndRasterize() {
+    for (auto& bin : bins_) {
+        bin.clear();
+    }
+    for (uint32_t i = 0; i < (uint32_t)triangles_.size(); i++) {
+        const Triangle& tri = triangles_[i];
+        for (int ty = tri.minY / TileSize; ty <= tri.maxY / TileSize; ty++) {
+            for (int tx = tri.minX / TileSize; tx <= tri.maxX / TileSize; tx++) {
+                bins_[(size_t)ty * tilesX_ + tx].push_back(i);
+            }
+        }
+    }
+
+    ThreadPool::GetInstance().ParallelFor(bins_.size(), [this](size_t tile) {
+        if (!bins_[tile].empty()) {
+            RasterizeTile((int)(tile % tilesX_), (int)(tile / tilesX_));
+        }
+    });
+}
+
+void SoftwareRasterizer::RasterizeTile(int tileX, int tileY) {
+    int x0 = tileX * TileSize;
+    int y0 = tileY * TileSize;
+    int x1 = std::min(x0 + TileSize, width_) - 1;
+    int y1 = std::min(y0 + TileSize, height_) - 1;
+
+    for (uint32_t index : bins_[(size_t)tileY * tilesX_ + tileX]) {
+        const Triangle& tri = triangles_[index];
+        RasterizeTriangle(tri, std::max(x0, tri.minX), std::max(y0, tri.minY), std::min(x1, tri.maxX), std::min(y1, tri.maxY));
+    }
+}
+
+void SoftwareRasterizer::RasterizeTriangle(const Triangle& tri, int x0, int y0, int x1, int y1) {
+    const __m128 laneOffset = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 invArea = _mm_set1_ps(tri.invArea);
+
+    __m128 edgeA[3], topLeft[3];
+    for (int k = 0; k < 3; k++) {
+        edgeA[k] = _mm_set1_ps(tri.edgeA[k]);
+        topLeft[k] = _mm_castsi128_ps(_mm_set1_epi32(tri.topLeft[k] ? -1 : 0));
+    }
+    const __m128 z0 = _mm_set1_ps(tri.z[0]);
+    const __m128 z1 = _mm_set1_ps(tri.z[1]);
+    const __m128 z2 = _mm_set1_ps(tri.z[2]);
+
+    // Tiles and stride_ are multiples of 4, so aligned quads never cross a tile
+    int startX = x0 & ~3;
+    for (int y = y0; y <= y1; y++) {
+        float fy = y + 0.5f;
+        __m128 rowEdge[3];
+        for (int k = 0; k < 3; k++) {
+            rowEdge[k] = _mm_set1_ps(tri.edgeB[k] * fy + tri.edgeC[k]);
+        }
+
+        float* depthRow = depth_.data() + (size_t)y * stride_;
+        RasterFloat4* colorRow = color_.data() + (size_t)y * stride_;
+
+        for (int x = startX; x <= x1; x += 4) {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffset);
+
+            __m128 e[3];
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int k = 0; k < 3; k++) {
+                e[k] = _mm_add_ps(_mm_mul_ps(edgeA[k], px), rowEdge[k]);
+                __m128 covered = _mm_or_ps(_mm_cmpgt_ps(e[k], zero), _mm_and_ps(_mm_cmpeq_ps(e[k], zero), topLeft[k]));
+                inside = _mm_and_ps(inside, covered);
+            }
+
+            int laneMask = _mm_movemask_ps(inside);
+            int validLanes = std::min(x1 - x + 1, 4);
+            laneMask &= (1 << validLanes) - 1;
+            if (x < x0) {
+                laneMask &= ~((1 << (x0 - x)) - 1);
+            }
+            if (laneMask == 0) {
+                continue;
+            }
+
+            __m128 b0 = _mm_mul_ps(e[0], invArea);
+            __m128 b1 = _mm_mul_ps(e[1], invArea);
+            __m128 b2 = _mm_mul_ps(e[2], invArea);
+            __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(z0, b0), _mm_mul_ps(z1, b1)), _mm_mul_ps(z2, b2));
+
+            __m128 depth = _mm_loadu_ps(depthRow + x);
+            __m128 depthPass = mode_ == ShadeMode::Opaque ? _mm_cmpgt_ps(z, depth) : _mm_cmpge_ps(z, depth);
+            depthPass = _mm_and_ps(depthPass, _mm_and_ps(_mm_cmpge_ps(z, zero), _mm_cmple_ps(z, one)));
+            laneMask &= _mm_movemask_ps(depthPass);
+            if (laneMask == 0) {
+                continue;
+            }
+
+            alignas(16) float bary[3][4];
+            alignas(16) float zValues[4];
+            _mm_store_ps(bary[0], b0);
+            _mm_store_ps(bary[1], b1);
+            _mm_store_ps(bary[2], b2);
+            _mm_store_ps(zValues, z);
+
+            for (int lane = 0; lane < 4; lane++) {
+                if (!(laneMask & (1 << lane))) {
+                    continue;
+                }
+
+                float w = bary[0][lane] * tri.invW[0] + bary[1][lane] * tri.invW[1] + bary[2][lane] * tri.invW[2];
+                float invW = 1.0f / w;
+                float attribs[MaxAttribs];
+                for (int k = 0; k < attribCount_; k++) {
+                    attribs[k] = (bary[0][lane] * tri.attribs[0][k] + bary[1][lane] * tri.attribs[1][k] + bary[2][lane] * tri.attribs[2][k]) * invW;
+                }
+
+                RasterFloat4 shaded = ShadePixel(tri, attribs);
+                RasterFloat4& dst = colorRow[x + lane];
+                if (mode_ == ShadeMode::Opaque) {
+                    dst = shaded;
+                    depthRow[x + lane] = zValues[lane];
+                }
+                else {
+                    // SrcBlend SRC_ALPHA, DestBlend INV_SRC_ALPHA, alpha channel masked out
+                    dst.x = shaded.x * shaded.w + dst.x * (1.0f - shaded.w);
+                    dst.y = shaded.y * shaded.w + dst.y * (1.0f - shaded.w);
+                    dst.z = shaded.z * shaded.w + dst.z * (1.0f - shaded.w);
+                }
+            }
+        }
+    }
+}
+
+RasterFloat4 SoftwareRasterizer::ShadePixel(const Triangle& tri, const float* attribs) const {
+    RasterFloat3 worldPos(attribs[0], attribs[1], attribs[2]);
+
+    if (mode_ == ShadeMode::Transparent) {
+        RasterFloat3 color(transparentColor_.x, transparentColor_.y, transparentColor_.z);
+        if (useLights_) {
+            color = CalculateColor(color, RasterFloat3(1.0f, 0.0f, 0.0f), worldPos, 0.0f, true);
+        }
+        return RasterFloat4(color.x, color.y, color.z, 0.5f);
+    }
+
+    const RasterFloat4& shineSpeedTexIdNM = instances_[tri.instance].shineSpeedTexIdNM;
+    float u = attribs[3], v = attribs[4];
+    RasterFloat3 normal(attribs[5], attribs[6], attribs[7]);
+    RasterFloat3 tangent(attribs[8], attribs[9], attribs[10]);
+
+    RasterFloat4 texColor = colorTexture_ != nullptr ? colorTexture_->Sample(u, v, (int)shineSpeedTexIdNM.z) : RasterFloat4(1.0f, 1.0f, 1.0f, 1.0f);
+    RasterFloat3 finalColor(lighting_.ambientColor.x * texColor.x, lighting_.ambientColor.y * texColor.y, lighting_.ambientColor.z * texColor.z);
+
+    RasterFloat3 norm = normal;
+    if (lighting_.useNormalMap && shineSpeedTexIdNM.w > 0.0f) {
+        RasterFloat3 binorm = Normalize(Cross(normal, tangent));
+        RasterFloat4 sampled = normalTexture_ != nullptr ? normalTexture_->Sample(u, v, 0) : RasterFloat4(0.5f, 0.5f, 1.0f, 1.0f);
+        RasterFloat3 localNorm(sampled.x * 2.0f - 1.0f, sampled.y * 2.0f - 1.0f, sampled.z * 2.0f - 1.0f);
+        RasterFloat3 t = Normalize(tangent);
+        RasterFloat3 n = Normalize(normal);
+        norm = RasterFloat3(localNorm.x * t.x + localNorm.y * binorm.x + localNorm.z * n.x,
+            localNorm.x * t.y + localNorm.y * binorm.y + localNorm.z * n.y,
+            localNorm.x * t.z + localNorm.y * binorm.z + localNorm.z * n.z);
+    }
+
+    RasterFloat3 color = CalculateColor(finalColor, norm, worldPos, shineSpeedTexIdNM.x, false);
+    return RasterFloat4(color.x, color.y, color.z, 1.0f);
+}
+
+// Port of CalculateColor from LightCalc.hlsli
+RasterFloat3 SoftwareRasterizer::CalculateColor(const RasterFloat3& objColor, const RasterFloat3& objNormal,
+    const RasterFloat3& pos, float shine, bool transparent) const {
+    if (lighting_.showNormals) {
+        return RasterFloat3(objNormal.x * 0.5f + 0.5f, objNormal.y * 0.5f + 0.5f, objNormal.z * 0.5f + 0.5f);
+    }
+
+    RasterFloat3 finalColor(0.0f, 0.0f, 0.0f);
+    RasterFloat3 viewDir = Normalize(RasterFloat3(lighting_.cameraPos.x - pos.x, lighting_.cameraPos.y - pos.y, lighting_.cameraPos.z - pos.z));
+
+    for (int i = 0; i < lighting_.lightCount; i++) {
+        const RasterLight& light = lighting_.lights[i];
+        RasterFloat3 norm = objNormal;
+
+        RasterFloat3 lightDir(light.pos.x - pos.x, light.pos.y - pos.y, light.pos.z - pos.z);
+        float lightDist = sqrtf(Dot(lightDir, lightDir));
+        lightDir = RasterFloat3(lightDir.x / lightDist, lightDir.y / lightDist, lightDir.z / lightDist);
+
+        float atten = Saturate(1.0f / (lightDist * lightDist));
+
+        if (transparent && Dot(lightDir, objNormal) < 0.0f) {
+            norm = RasterFloat3(-norm.x, -norm.y, -norm.z);
+        }
+        float diffuse = std::max(Dot(lightDir, norm), 0.0f) * atten;
+        finalColor.x += objColor.x * diffuse * light.color.x;
+        finalColor.y += objColor.y * diffuse * light.color.y;
+        finalColor.z += objColor.z * diffuse * light.color.z;
+
+        // reflect(-lightDir, norm)
+        float d = 2.0f * Dot(lightDir, norm);
+        RasterFloat3 reflectDir(norm.x * d - lightDir.x, norm.y * d - lightDir.y, norm.z * d - lightDir.z);
+        float spec = shine > 0.0f ? powf(std::max(Dot(viewDir, reflectDir), 0.0f), shine) : 0.0f;
+
+        finalColor.x += objColor.x * spec * light.color.x;
+        finalColor.y += objColor.y * spec * light.color.y;
+        finalColor.z += objColor.z * spec * light.color.z;
+    }
+
+    return finalColor;
+}
+
+void SoftwareRasterizer::ResolveBGRA8(std::vector<uint8_t>& pixels) const {
+    pixels.resize((size_t)width_ * height_ * 4);
+    ConvertRGBA32FToBGRA8(reinterpret_cast<const float*>(color_.data()), stride_, pixels.data(), width_, height_);
+}
+
+bool SoftwareRasterizer::SaveBMP(const char* fileName) const {
+    std::vector<uint8_t> pixels;
+    ResolveBGRA8(pixels);
+
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    uint32_t imageSize = (uint32_t)pixels.size();
+    // BITMAPFILEHEADER
+    file.put('B');
+    file.put('M');
+    WriteUInt32(file, 14 + 40 + imageSize);
+    WriteUInt32(file, 0);
+    WriteUInt32(file, 14 + 40);
+    // BITMAPINFOHEADER, negative height for top-down rows
+    WriteUInt32(file, 40);
+    WriteUInt32(file, (uint32_t)width_);
+    WriteUInt32(file, (uint32_t)(-height_));
+    WriteUInt16(file, 1);
+    WriteUInt16(file, 32);
+    WriteUInt32(file, 0);
+    WriteUInt32(file, imageSize);
+    WriteUInt32(file, 2835);
+    WriteUInt32(file, 2835);
+    WriteUInt32(file, 0);
+    WriteUInt32(file, 0);
+
+    file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+    return file.good();
+}
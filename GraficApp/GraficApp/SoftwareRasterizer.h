@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// CPU reference backend for the subset of D3D11 state used by Renderer.
+// Has no Windows or DirectXMath dependencies, the CMake build renders its golden images anywhere.
+
+// Laid out like XMFLOAT2/3/4, the renderer passes its vertices and lights as they are
+struct RasterFloat2 {
+    float x, y;
+};
+
+struct RasterFloat3 {
+    float x, y, z;
+
+    RasterFloat3() = default;
+    RasterFloat3(float x_, float y_, float z_) : x(x_), y(y_), z(z_) {};
+};
+
+struct RasterFloat4 {
+    float x, y, z, w;
+
+    RasterFloat4() = default;
+    RasterFloat4(float x_, float y_, float z_, float w_) : x(x_), y(y_), z(z_), w(w_) {};
+};
+
+// Row major with row vectors like XMFLOAT4X4, translation in m[3]
+struct RasterMatrix {
+    float m[4][4];
+};
+
+// Same layout as Vertex in renderer.h
+struct RasterVertex {
+    RasterFloat3 pos;
+    RasterFloat2 uv;
+    RasterFloat3 normal;
+    RasterFloat3 tangent;
+};
+
+struct RasterInstance {
+    RasterMatrix worldMatrix;
+    RasterFloat4 shineSpeedTexIdNM;
+};
+
+struct RasterLight {
+    RasterFloat4 pos;
+    RasterFloat4 color;
+};
+
+// Mirror of LightBuffer from Light.hlsli
+struct RasterLighting {
+    RasterFloat3 cameraPos = { 0.0f, 0.0f, 0.0f };
+    RasterFloat3 ambientColor = { 0.9f, 0.9f, 0.9f };
+    const RasterLight* lights = nullptr;
+    int lightCount = 0;
+    bool useNormalMap = true;
+    bool showNormals = false;
+};
+
+// Texture array in linear RGBA, sampled bilinear with clamp addressing like pSampler_
+struct RasterTexture {
+    int width = 0;
+    int height = 0;
+    int layers = 0;
+    std::vector<RasterFloat4> texels;
+
+    RasterFloat4 Sample(float u, float v, int layer) const;
+};
+
+class SoftwareRasterizer {
+public:
+    static constexpr int TileSize = 64;
+    static constexpr int MaxAttribs = 11;
+
+    SoftwareRasterizer() = default;
+
+    SoftwareRasterizer(const SoftwareRasterizer&) = delete;
+    SoftwareRasterizer(SoftwareRasterizer&&) = delete;
+
+    bool Init(int width, int height);
+    void Clear(const float color[4], float depth);
+
+    void SetViewProjection(const RasterMatrix& viewProjectionMatrix);
+    void SetLighting(const RasterLighting& lighting) { lighting_ = lighting; };
+    void SetTextures(const RasterTexture* colorTexture, const RasterTexture* normalTexture);
+
+    // Cubes pass: VS.hlsl/PS.hlsl, depth GREATER with depth write
+    void DrawIndexedInstanced(const RasterVertex* vertices, const uint16_t* indices, int indexCount,
+        const RasterInstance* instances, const int* instanceIndices, int instanceCount);
+    // Transparent pass: TVS.hlsl/TPS.hlsl, depth GREATER_EQUAL without write, blended as pBlendState_
+    void DrawTransparent(const RasterFloat3* positions, const uint16_t* indices, int indexCount,
+        const RasterMatrix& worldMatrix, const RasterFloat4& color, bool useLights);
+
+    void ResolveBGRA8(std::vector<uint8_t>& pixels) const;
+    bool SaveBMP(const char* fileName) const;
+
+    int GetWidth() const { return width_; };
+    int GetHeight() const { return height_; };
+    RasterFloat4* GetColorBuffer() { return color_.data(); };
+    const RasterFloat4* GetColorBuffer() const { return color_.data(); };
+    int GetStride() const { return stride_; };
+
+    ~SoftwareRasterizer() = default;
+private:
+    enum class ShadeMode {
+        Opaque,
+        Transparent
+    };
+
+    struct ClipVertex {
+        RasterFloat4 position;
+        float attribs[MaxAttribs];
+    };
+
+    struct Triangle {
+        float x[3], y[3], z[3], invW[3];
+        float attribs[3][MaxAttribs]; // premultiplied by invW
+        float edgeA[3], edgeB[3], edgeC[3];
+        bool topLeft[3];
+        float invArea;
+        int minX, minY, maxX, maxY;
+        int instance;
+    };
+
+    void ClipAndSetup(const ClipVertex* v0, const ClipVertex* v1, const ClipVertex* v2, int instance, std::vector<Triangle>& out) const;
+    bool SetupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, int instance, Triangle& tri) const;
+    void BinAndRasterize();
+    void RasterizeTile(int tileX, int tileY);
+    void RasterizeTriangle(const Triangle& tri, int x0, int y0, int x1, int y1);
+    RasterFloat4 ShadePixel(const Triangle& tri, const float* attribs) const;
+    RasterFloat3 CalculateColor(const RasterFloat3& objColor, const RasterFloat3& objNormal,
+        const RasterFloat3& pos, float shine, bool transparent) const;
+
+    int width_ = 0;
+    int height_ = 0;
+    int stride_ = 0;
+    int tilesX_ = 0;
+    int tilesY_ = 0;
+
+    std::vector<RasterFloat4> color_;
+    std::vector<float> depth_;
+
+    std::vector<Triangle> triangles_;
+    std::vector<std::vector<uint32_t>> bins_;
+
+    RasterMatrix viewProjectionMatrix_ = {};
+    RasterLighting lighting_;
+    const RasterTexture* colorTexture_ = nullptr;
+    const RasterTexture* normalTexture_ = nullptr;
+
+    ShadeMode mode_ = ShadeMode::Opaque;
+    int attribCount_ = 0;
+    const RasterInstance* instances_ = nullptr;
+    RasterFloat4 transparentColor_ = {};
+    bool useLights_ = true;
+};
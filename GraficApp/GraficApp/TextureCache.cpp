@@ -0,0 +1,264 @@
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <cmath>
+
+TextureCache::TextureCache(ITextureLoader& loader, uint64_t budget, uint32_t minMipSize) :
+    loader_(loader),
+    budget_(budget),
+    minMipSize_(minMipSize) {
+}
+
+int TextureCache::Register(const DdsInfo& info) {
+    Entry entry = { info, nullptr, info.mipCount, 0, 0, 0, 0 };
+    while (entry.lowestMip + 1 < info.mipCount &&
+        GetDdsMipWidth(info, entry.lowestMip + 1) >= minMipSize_ && GetDdsMipHeight(info, entry.lowestMip + 1) >= minMipSize_) {
+        entry.lowestMip++;
+    }
+    entries_.push_back(entry);
+    return (int)entries_.size() - 1;
+}
+
+uint32_t TextureCache::GetTargetMip(const Entry& entry) const {
+    return entry.wantedMip < entry.lowestMip ? entry.wantedMip : entry.lowestMip;
+}
+
+uint32_t TextureCache::GetFirstMip(int texture) const {
+    if (!IsRegistered(texture)) {
+        return 0;
+    }
+    const Entry& entry = entries_[texture];
+    return entry.resource != nullptr ? entry.firstMip : entry.info.mipCount;
+}
+
+bool TextureCache::SetLevel(int texture, uint32_t firstMip) {
+    Entry& entry = entries_[texture];
+    void* resource = loader_.Load(texture, firstMip);
+    if (resource == nullptr) {
+        failures_++;
+        return false;
+    }
+    loads_++;
+
+    if (entry.resource != nullptr) {
+        loader_.Destroy(entry.resource);
+        if (firstMip > entry.firstMip) {
+            demotions_++;
+        }
+        else {
+            promotions_++;
+        }
+    }
+    residentBytes_ -= entry.bytes;
+    entry.resource = resource;
+    entry.firstMip = firstMip;
+    entry.bytes = GetDdsTextureBytes(entry.info, firstMip);
+    residentBytes_ += entry.bytes;
+    return true;
+}
+
+void TextureCache::Evict(int texture) {
+    Entry& entry = entries_[texture];
+    loader_.Destroy(entry.resource);
+    residentBytes_ -= entry.bytes;
+    entry.resource = nullptr;
+    entry.firstMip = entry.info.mipCount;
+    entry.bytes = 0;
+    evictions_++;
+}
+
+bool TextureCache::MakeRoom(uint64_t bytes, bool demoteUsed) {
+    std::vector<int> unused, surplus, used;
+    uint64_t reclaimable = 0;
+    for (int i = 0; i < (int)entries_.size(); i++) {
+        const Entry& entry = entries_[i];
+        if (entry.resource == nullptr) {
+            continue;
+        }
+        // Used last frame counts as in use, whatever order this frame's requests come in
+        if (entry.lastUsed + 1 < frame_) {
+            unused.push_back(i);
+            reclaimable += entry.bytes;
+        }
+        else if (entry.firstMip < entry.lowestMip) {
+            uint64_t targetBytes = entry.bytes;
+            if (entry.firstMip < GetTargetMip(entry)) {
+                surplus.push_back(i);
+                targetBytes = GetDdsTextureBytes(entry.info, GetTargetMip(entry));
+                reclaimable += entry.bytes - targetBytes;
+            }
+            if (demoteUsed) {
+                used.push_back(i);
+                reclaimable += targetBytes - GetDdsTextureBytes(entry.info, entry.lowestMip);
+            }
+        }
+    }
+    if (residentBytes_ - reclaimable + bytes > budget_) {
+        return false;
+    }
+    std::stable_sort(unused.begin(), unused.end(), [this](int a, int b) {
+        return entries_[a].lastUsed < entries_[b].lastUsed;
+    });
+    // Textures in use are only made smaller, biggest first
+    std::stable_sort(used.begin(), used.end(), [this](int a, int b) {
+        return entries_[a].bytes > entries_[b].bytes;
+    });
+
+    auto demote = [&](int texture, uint32_t lowest) {
+        Entry& entry = entries_[texture];
+        while (residentBytes_ + bytes > budget_ && entry.firstMip < lowest) {
+            if (!SetLevel(texture, entry.firstMip + 1)) {
+                break;
+            }
+        }
+    };
+    // Every unused texture loses detail before the first one is evicted, and so does
+    // detail nothing on screen needs
+    for (int texture : unused) {
+        demote(texture, entries_[texture].lowestMip);
+    }
+    for (int texture : surplus) {
+        demote(texture, GetTargetMip(entries_[texture]));
+    }
+    for (int texture : unused) {
+        if (residentBytes_ + bytes <= budget_) {
+            break;
+        }
+        Evict(texture);
+    }
+    for (int texture : used) {
+        demote(texture, entries_[texture].lowestMip);
+    }
+    return residentBytes_ + bytes <= budget_;
+}
+
+void TextureCache::BeginFrame() {
+    frame_++;
+    if (residentBytes_ > budget_) {
+        MakeRoom(0, true);
+    }
+}
+
+void* TextureCache::Request(int texture, uint32_t wantedMip) {
+    if (!IsRegistered(texture)) {
+        return nullptr;
+    }
+    Entry& entry = entries_[texture];
+    entry.wantedMip = entry.lastUsed != frame_ || wantedMip < entry.wantedMip ? wantedMip : entry.wantedMip;
+    entry.lastUsed = frame_;
+
+    // Streaming starts from the tail, Stream() does the rest
+    uint32_t target = GetTargetMip(entry);
+    if (streamBytesPerFrame_ > 0) {
+        if (entry.resource == nullptr && (residentBytes_ + GetDdsTextureBytes(entry.info, entry.lowestMip) <= budget_ ||
+            MakeRoom(GetDdsTextureBytes(entry.info, entry.lowestMip), true))) {
+            SetLevel(texture, entry.lowestMip);
+        }
+        return entry.resource;
+    }
+
+    // The most detailed level that fits; a resident texture only moves up
+    for (uint32_t mip = target; mip <= entry.lowestMip; mip++) {
+        if (entry.resource != nullptr && mip >= entry.firstMip) {
+            break;
+        }
+        uint64_t bytes = GetDdsTextureBytes(entry.info, mip);
+        uint64_t freed = entry.bytes;
+        // Textures in use give up detail only to let a new one in at its
+        // lowest level, otherwise two visible textures would take it from each other every frame
+        bool demoteUsed = entry.resource == nullptr && mip == entry.lowestMip;
+        if (residentBytes_ - freed + bytes > budget_ && !MakeRoom(bytes - freed, demoteUsed)) {
+            continue;
+        }
+        if (SetLevel(texture, mip)) {
+            break;
+        }
+    }
+    return entry.resource;
+}
+
+uint64_t TextureCache::Stream() {
+    std::vector<int> pending;
+    for (int i = 0; i < (int)entries_.size(); i++) {
+        const Entry& entry = entries_[i];
+        if (entry.resource != nullptr && entry.lastUsed == frame_ && entry.firstMip > GetTargetMip(entry)) {
+            pending.push_back(i);
+        }
+    }
+    std::stable_sort(pending.begin(), pending.end(), [this](int a, int b) {
+        return entries_[a].firstMip - GetTargetMip(entries_[a]) > entries_[b].firstMip - GetTargetMip(entries_[b]);
+    });
+
+    // Rounds of one mip each, so a big texture cannot hold the others back; the first load
+    // of a frame may go over the limit, otherwise a level bigger than it would never load
+    uint64_t loaded = 0;
+    bool progress = true;
+    while (progress && loaded < streamBytesPerFrame_) {
+        progress = false;
+        for (int texture : pending) {
+            Entry& entry = entries_[texture];
+            if (entry.firstMip <= GetTargetMip(entry)) {
+                continue;
+            }
+            uint32_t mip = entry.firstMip - 1;
+            uint64_t bytes = GetDdsTextureBytes(entry.info, mip);
+            if (loaded > 0 && loaded + bytes > streamBytesPerFrame_) {
+                continue;
+            }
+            if (residentBytes_ - entry.bytes + bytes > budget_ && !MakeRoom(bytes - entry.bytes, false)) {
+                continue;
+            }
+            if (SetLevel(texture, mip)) {
+                loaded += bytes;
+                progress = true;
+            }
+        }
+    }
+    streamedBytes_ += loaded;
+    return loaded;
+}
+
+void TextureCache::Clear() {
+    for (Entry& entry : entries_) {
+        if (entry.resource != nullptr) {
+            loader_.Destroy(entry.resource);
+            entry.resource = nullptr;
+            entry.firstMip = entry.info.mipCount;
+            entry.bytes = 0;
+        }
+    }
+    residentBytes_ = 0;
+}
+
+TextureCacheStats TextureCache::GetStats() const {
+    TextureCacheStats stats = { 0, residentBytes_, loads_, promotions_, demotions_, evictions_, failures_, 0, streamedBytes_ };
+    for (const Entry& entry : entries_) {
+        stats.resident += entry.resource != nullptr ? 1 : 0;
+        stats.pending += entry.resource != nullptr && entry.lastUsed == frame_ && entry.firstMip > GetTargetMip(entry) ? 1 : 0;
+    }
+    return stats;
+}
+
+TextureCache::~TextureCache() {
+    Clear();
+}
+
+uint32_t SelectRequiredMip(uint32_t textureSize, float projectedPixels, uint32_t mipCount, float bias) {
+    if (mipCount == 0) {
+        return 0;
+    }
+    if (projectedPixels <= 0.0f) {
+        return mipCount - 1;
+    }
+    // The finer of the two mips around the exact texel to pixel ratio
+    float level = log2f(textureSize / projectedPixels) + bias;
+    uint32_t mip = level > 0.0f ? (uint32_t)floorf(level) : 0;
+    return mip < mipCount ? mip : mipCount - 1;
+}
+
+float GetProjectedSize(float worldSize, float distance, float fovY, float screenHeight) {
+    if (distance <= 1e-6f) {
+        return 1e9f;
+    }
+    return worldSize / (2.0f * distance * tanf(fovY * 0.5f)) * screenHeight;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "DdsHeader.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Backend for TextureCache. D3D11TextureLoader creates textures from DDS files, tests fake it.
+class ITextureLoader {
+public:
+    // Texture with the mips from firstMip down, NULL on failure
+    virtual void* Load(int texture, uint32_t firstMip) = 0;
+    virtual void Destroy(void* resource) = 0;
+
+    virtual ~ITextureLoader() = default;
+};
+
+struct TextureCacheStats {
+    uint32_t resident;
+    uint64_t residentBytes;
+    uint64_t loads;
+    uint64_t promotions;
+    uint64_t demotions;
+    uint64_t evictions;
+    uint64_t failures;
+    uint32_t pending;       // resident below the wanted detail, waiting for Stream
+    uint64_t streamedBytes;
+};
+
+// Keeps textures resident within a byte budget. Sizes come from the DDS header, a texture
+// without its top mips counts what is left. Request() stamps a texture with the current
+// frame and brings it to the most detailed level that fits; to make room, textures not
+// used this or the previous frame give up their top mips, least recently used first,
+// down to minMipSize, and only then are evicted in the same order. When the visible set
+// itself does not fit, visible textures are demoted to let the rest in at low detail.
+// With streaming on, Request() loads only the tail from the lowest level and Stream()
+// brings textures up towards the mip they were requested with, a few bytes per frame.
+class TextureCache {
+public:
+    TextureCache(ITextureLoader& loader, uint64_t budget, uint32_t minMipSize = 64);
+
+    TextureCache(const TextureCache&) = delete;
+    TextureCache(TextureCache&&) = delete;
+
+    int Register(const DdsInfo& info);
+    // A smaller budget is enforced at the next BeginFrame
+    void SetBudget(uint64_t budget) { budget_ = budget; };
+    uint64_t GetBudget() const { return budget_; };
+    // Bytes Stream() may load per frame, 0 loads everything in Request()
+    void SetStreaming(uint64_t bytesPerFrame) { streamBytesPerFrame_ = bytesPerFrame; };
+
+    void BeginFrame();
+    // For textures of visible instances, NULL if not even the smallest level fits. wantedMip is
+    // the most detailed mip they need, the lowest of the frame's requests counts; textures
+    // loaded with more detail keep it until the memory is needed
+    void* Request(int texture, uint32_t wantedMip = 0);
+    // After the frame's requests: promotes one mip at a time, the textures furthest from what
+    // they want first, until bytesPerFrame is spent; returns the bytes loaded
+    uint64_t Stream();
+    // NULL for ids Register() did not return
+    void* GetResource(int texture) const { return IsRegistered(texture) ? entries_[texture].resource : nullptr; };
+    // Most detailed resident mip, mipCount when not resident and 0 for unknown ids
+    uint32_t GetFirstMip(int texture) const;
+    uint64_t GetFrame() const { return frame_; };
+    // Destroys every texture, registrations stay
+    void Clear();
+
+    TextureCacheStats GetStats() const;
+
+    ~TextureCache();
+private:
+    struct Entry {
+        DdsInfo info;
+        void* resource;     // NULL when not resident
+        uint32_t firstMip;
+        uint32_t lowestMip; // demotion stops here
+        uint32_t wantedMip;
+        uint64_t bytes;
+        uint64_t lastUsed;
+    };
+
+    bool IsRegistered(int texture) const { return texture >= 0 && texture < (int)entries_.size(); };
+    // Where streaming stops, never below the lowest level
+    uint32_t GetTargetMip(const Entry& entry) const;
+
+    bool SetLevel(int texture, uint32_t firstMip);
+    void Evict(int texture);
+    // Frees bytes from textures not used this or the previous frame, then from textures in use
+    // with more detail than they want; with demoteUsed also demotes the ones in use below that.
+    // false without touching anything if that cannot free enough
+    bool MakeRoom(uint64_t bytes, bool demoteUsed);
+
+    ITextureLoader& loader_;
+    uint64_t budget_;
+    uint32_t minMipSize_;
+    uint64_t streamBytesPerFrame_ = 0;
+    uint64_t frame_ = 0;
+    uint64_t residentBytes_ = 0;
+    std::vector<Entry> entries_;
+
+    uint64_t loads_ = 0;
+    uint64_t promotions_ = 0;
+    uint64_t demotions_ = 0;
+    uint64_t evictions_ = 0;
+    uint64_t failures_ = 0;
+    uint64_t streamedBytes_ = 0;
+};
+
+// Mip whose texels are about the size of a pixel on a surface projectedPixels across that
+// maps the texture once; bias > 0 trades detail for memory
+uint32_t SelectRequiredMip(uint32_t textureSize, float projectedPixels, uint32_t mipCount, float bias = 0.0f);
+// Pixels covered by worldSize at distance with a perspective of vertical fovY on a screen
+// screenHeight pixels tall
+float GetProjectedSize(float worldSize, float distance, float fovY, float screenHeight);
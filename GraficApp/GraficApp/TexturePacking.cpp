@@ -0,0 +1,166 @@
+#include "TexturePacking.h"
+
+#include <algorithm>
+#include <cstring>
+
+// imgui_draw.cpp keeps its copy static as well
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "imstb_rectpack.h"
+
+namespace {
+    uint32_t GetBlockDim(uint32_t format) {
+        return GetDdsBlockBytes(format) != 0 ? 4 : 1;
+    }
+
+    uint32_t GetUnitBytes(uint32_t format) {
+        return GetDdsBlockBytes(format) != 0 ? GetDdsBlockBytes(format) : GetDdsPixelBytes(format);
+    }
+
+    // Atlas rects never cover a whole slice, they need the gutter
+    bool IsFullSlice(const TexturePackLayout& layout, const TexturePackRect& rect) {
+        return rect.width == layout.page.width && rect.height == layout.page.height;
+    }
+
+    uint32_t GetFullMipCount(uint32_t width, uint32_t height) {
+        uint32_t count = 1;
+        for (uint32_t size = std::max(width, height); size > 1; size >>= 1) {
+            count++;
+        }
+        return count;
+    }
+}
+
+bool PackTextures(const std::vector<DdsInfo>& sources, const TexturePackSettings& settings, TexturePackLayout& layout) {
+    if (sources.empty() || GetUnitBytes(sources[0].format) == 0) {
+        return false;
+    }
+    uint32_t format = sources[0].format;
+    uint32_t pageWidth = settings.pageWidth;
+    uint32_t pageHeight = settings.pageHeight;
+    for (const DdsInfo& source : sources) {
+        if (source.format != format || source.arraySize * source.faces != 1) {
+            return false;
+        }
+        if (settings.pageWidth == 0) {
+            pageWidth = std::max(pageWidth, source.width);
+            pageHeight = std::max(pageHeight, source.height);
+        }
+    }
+
+    layout.rects.assign(sources.size(), TexturePackRect());
+    layout.remap.assign(sources.size(), TextureRemap());
+    layout.gutter = 0;
+    layout.fullSlices = 0;
+
+    // Page sized sources keep their own slice and as many mips as all of them have
+    uint32_t mipCount = GetFullMipCount(pageWidth, pageHeight);
+    std::vector<int> atlas;
+    for (int i = 0; i < (int)sources.size(); i++) {
+        const DdsInfo& source = sources[i];
+        if (source.width == pageWidth && source.height == pageHeight) {
+            layout.rects[i] = { layout.fullSlices++, 0, 0, pageWidth, pageHeight };
+            mipCount = std::min(mipCount, source.mipCount);
+        }
+        else {
+            atlas.push_back(i);
+        }
+    }
+
+    uint32_t slices = layout.fullSlices;
+    if (!atlas.empty()) {
+        for (int i : atlas) {
+            mipCount = std::min(mipCount, sources[i].mipCount);
+        }
+        mipCount = std::max(1u, std::min(mipCount, settings.atlasMipCount));
+        // Rects are packed on a grid of whole blocks of the last kept mip, one cell of gutter around each
+        uint32_t align = GetBlockDim(format) << (mipCount - 1);
+        layout.gutter = align;
+        int pageUnitsX = (int)(pageWidth / align);
+        int pageUnitsY = (int)(pageHeight / align);
+
+        std::vector<stbrp_rect> pending;
+        for (int i : atlas) {
+            stbrp_rect rect = {};
+            rect.id = i;
+            rect.w = (int)((sources[i].width + align - 1) / align) + 2;
+            rect.h = (int)((sources[i].height + align - 1) / align) + 2;
+            if (rect.w > pageUnitsX || rect.h > pageUnitsY) {
+                return false;
+            }
+            pending.push_back(rect);
+        }
+
+        std::vector<stbrp_node> nodes(pageUnitsX);
+        while (!pending.empty()) {
+            stbrp_context context;
+            stbrp_init_target(&context, pageUnitsX, pageUnitsY, nodes.data(), (int)nodes.size());
+            stbrp_setup_heuristic(&context, STBRP_HEURISTIC_Skyline_BF_sortHeight);
+            stbrp_pack_rects(&context, pending.data(), (int)pending.size());
+
+            std::vector<stbrp_rect> next;
+            for (const stbrp_rect& rect : pending) {
+                if (rect.was_packed) {
+                    const DdsInfo& source = sources[rect.id];
+                    layout.rects[rect.id] = { slices, (uint32_t)(rect.x + 1) * align, (uint32_t)(rect.y + 1) * align,
+                        source.width, source.height };
+                }
+                else {
+                    next.push_back(rect);
+                }
+            }
+            // Every rect fits an empty page, so each page takes at least one
+            if (next.size() == pending.size()) {
+                return false;
+            }
+            pending.swap(next);
+            slices++;
+        }
+    }
+
+    layout.page = { pageWidth, pageHeight, mipCount, slices, 1, format, 0 };
+    for (size_t i = 0; i < sources.size(); i++) {
+        const TexturePackRect& rect = layout.rects[i];
+        TextureRemap& remap = layout.remap[i];
+        remap.scaleOffset[0] = rect.width / (float)pageWidth;
+        remap.scaleOffset[1] = rect.height / (float)pageHeight;
+        remap.scaleOffset[2] = rect.x / (float)pageWidth;
+        remap.scaleOffset[3] = rect.y / (float)pageHeight;
+        remap.slice = rect.slice;
+    }
+    return true;
+}
+
+void BlitPackedTexture(const TexturePackLayout& layout, int texture, const DdsInfo& source, uint32_t mip,
+    const uint8_t* sourceMip, uint8_t* sliceMip) {
+    const TexturePackRect& rect = layout.rects[texture];
+    uint32_t blockDim = GetBlockDim(source.format);
+    ptrdiff_t unitBytes = GetUnitBytes(source.format);
+    int blocksX = (int)((GetDdsMipWidth(source, mip) + blockDim - 1) / blockDim);
+    int blocksY = (int)((GetDdsMipHeight(source, mip) + blockDim - 1) / blockDim);
+    int gutter = IsFullSlice(layout, rect) ? 0 : (int)((layout.gutter >> mip) / blockDim);
+    size_t sourcePitch = GetDdsRowPitch(source, mip);
+    size_t slicePitch = GetDdsRowPitch(layout.page, mip);
+
+    uint8_t* origin = sliceMip + ((rect.y >> mip) / blockDim) * slicePitch + ((rect.x >> mip) / blockDim) * unitBytes;
+    for (int y = -gutter; y < blocksY + gutter; y++) {
+        const uint8_t* sourceRow = sourceMip + std::min(std::max(y, 0), blocksY - 1) * sourcePitch;
+        uint8_t* row = origin + y * (ptrdiff_t)slicePitch;
+        for (int x = -gutter; x < 0; x++) {
+            memcpy(row + x * unitBytes, sourceRow, unitBytes);
+        }
+        memcpy(row, sourceRow, blocksX * unitBytes);
+        for (int x = blocksX; x < blocksX + gutter; x++) {
+            memcpy(row + x * unitBytes, sourceRow + (blocksX - 1) * unitBytes, unitBytes);
+        }
+    }
+}
+
+double GetTexturePackEfficiency(const TexturePackLayout& layout) {
+    double used = 0.0;
+    for (const TexturePackRect& rect : layout.rects) {
+        used += (double)rect.width * rect.height;
+    }
+    double total = (double)layout.page.width * layout.page.height * layout.page.arraySize;
+    return total > 0.0 ? used / total : 0.0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "DdsHeader.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Mirror of TextureRemap in Buffers.hlsli: uv * scaleOffset.xy + scaleOffset.zw in slice
+struct TextureRemap {
+    float scaleOffset[4];
+    uint32_t slice;
+    uint32_t reserved[3];
+};
+
+// Where a source texture went, mip 0 pixels without the gutter
+struct TexturePackRect {
+    uint32_t slice;
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+struct TexturePackSettings {
+    uint32_t pageWidth;     // 0 takes the largest source
+    uint32_t pageHeight;
+    uint32_t atlasMipCount; // mips kept when some textures share a slice
+};
+
+// Slices of one Texture2DArray; rects and remap are indexed like the sources
+struct TexturePackLayout {
+    DdsInfo page;     // arraySize is the slice count, dataOffset is 0
+    uint32_t gutter;  // pixels of repeated edge around each atlas rect at mip 0
+    uint32_t fullSlices; // taken by sources of the page size, one each, before the atlas slices
+    std::vector<TexturePackRect> rects;
+    std::vector<TextureRemap> remap;
+};
+
+// Sources have to share the format. Ones of exactly the page size become array slices with
+// their whole mip chain, the others are skyline packed (imstb_rectpack) into atlas slices.
+// Atlas rects are aligned so that they stay whole BC blocks down to the last kept mip and get
+// a gutter of one block at that mip. false for mixed formats or a source larger than a page.
+bool PackTextures(const std::vector<DdsInfo>& sources, const TexturePackSettings& settings, TexturePackLayout& layout);
+
+// Copies mip of a source into the slice of the page holding it, edges repeated into the gutter;
+// sourceMip and sliceMip point to that mip level of the source and of the slice
+void BlitPackedTexture(const TexturePackLayout& layout, int texture, const DdsInfo& source, uint32_t mip,
+    const uint8_t* sourceMip, uint8_t* sliceMip);
+
+// Source pixels over slice pixels at mip 0
+double GetTexturePackEfficiency(const TexturePackLayout& layout);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fixed-size worker pool. ParallelFor() blocks until every index was processed,
+// the calling thread takes part in the work. Calls are serialized, do not nest them.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threadCount = 0);
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool(ThreadPool&&) = delete;
+
+    static ThreadPool& GetInstance();
+
+    void ParallelFor(size_t count, const std::function<void(size_t)>& task);
+
+    unsigned GetThreadCount() const {
+        return (unsigned)workers_.size() + 1;
+    };
+
+    ~ThreadPool();
+private:
+    void WorkerLoop();
+    void RunTasks();
+
+    std::vector<std::thread> workers_;
+    std::mutex submitMutex_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+
+    const std::function<void(size_t)>* task_ = nullptr;
+    size_t count_ = 0;
+    std::atomic<size_t> next_{ 0 };
+    unsigned active_ = 0;
+    uint64_t generation_ = 0;
+    bool stop_ = false;
+};
@@ -0,0 +1,142 @@
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // Enough nodes per task to hide the ParallelFor overhead
+    const size_t NodesPerTask = 4096;
+}
+
+void MultiplyAffine(const float* local, const float* parent, float* result) {
+    for (int row = 0; row < 4; row++) {
+        const float* l = local + row * 4;
+        for (int column = 0; column < 3; column++) {
+            result[row * 4 + column] = l[0] * parent[column] + l[1] * parent[4 + column] + l[2] * parent[8 + column] +
+                (row == 3 ? parent[12 + column] : 0.0f);
+        }
+        result[row * 4 + 3] = row == 3 ? 1.0f : 0.0f;
+    }
+}
+
+int TransformHierarchy::AddNode(int parent, const float local[16]) {
+    if (parent < -1 || parent >= (int)parentHandles_.size()) {
+        return -1;
+    }
+
+    // Appended unsorted, Update() moves it next to its level
+    int handle = (int)parentHandles_.size();
+    parentHandles_.push_back(parent);
+    slots_.push_back((uint32_t)handle);
+    parents_.push_back(parent >= 0 ? (int)slots_[parent] : -1);
+    local_.insert(local_.end(), local, local + 16);
+    world_.insert(world_.end(), local, local + 16);
+    dirty_.push_back(1);
+    sorted_ = false;
+    return handle;
+}
+
+void TransformHierarchy::SetLocal(int node, const float local[16]) {
+    uint32_t slot = slots_[node];
+    memcpy(&local_[(size_t)slot * 16], local, 16 * sizeof(float));
+    dirty_[slot] = 1;
+}
+
+void TransformHierarchy::Clear() {
+    parentHandles_.clear();
+    slots_.clear();
+    parents_.clear();
+    local_.clear();
+    world_.clear();
+    dirty_.clear();
+    levels_.clear();
+    sorted_ = true;
+    updated_ = 0;
+}
+
+void TransformHierarchy::Sort() {
+    size_t count = parentHandles_.size();
+
+    // Handles are created after their parents, so one pass finds every depth
+    std::vector<uint32_t> depth(count);
+    uint32_t maxDepth = 0;
+    for (size_t i = 0; i < count; i++) {
+        depth[i] = parentHandles_[i] >= 0 ? depth[parentHandles_[i]] + 1 : 0;
+        maxDepth = depth[i] > maxDepth ? depth[i] : maxDepth;
+    }
+
+    // Counting sort by depth, stable so siblings keep their relative order
+    levels_.assign((size_t)maxDepth + 2, 0);
+    for (size_t i = 0; i < count; i++) {
+        levels_[depth[i] + 1]++;
+    }
+    for (size_t level = 1; level < levels_.size(); level++) {
+        levels_[level] += levels_[level - 1];
+    }
+    std::vector<size_t> next(levels_.begin(), levels_.end() - 1);
+
+    std::vector<uint32_t> oldSlots = slots_;
+    std::vector<float> local(count * 16);
+    std::vector<uint8_t> dirty(count);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t slot = (uint32_t)next[depth[i]]++;
+        slots_[i] = slot;
+        memcpy(&local[(size_t)slot * 16], &local_[(size_t)oldSlots[i] * 16], 16 * sizeof(float));
+        dirty[slot] = dirty_[oldSlots[i]];
+    }
+    for (size_t i = 0; i < count; i++) {
+        parents_[slots_[i]] = parentHandles_[i] >= 0 ? (int)slots_[parentHandles_[i]] : -1;
+    }
+    local_.swap(local);
+    dirty_.swap(dirty);
+    world_.resize(count * 16);
+
+    // World matrices moved too, recompute everything once
+    std::fill(dirty_.begin(), dirty_.end(), (uint8_t)1);
+    sorted_ = true;
+}
+
+void TransformHierarchy::UpdateRange(size_t begin, size_t end, size_t& updated) {
+    for (size_t slot = begin; slot < end; slot++) {
+        int parent = parents_[slot];
+        // The parent level is finished, its flag already includes its own ancestors
+        if (parent >= 0 && dirty_[parent]) {
+            dirty_[slot] = 1;
+        }
+        if (!dirty_[slot]) {
+            continue;
+        }
+
+        const float* local = &local_[slot * 16];
+        if (parent >= 0) {
+            MultiplyAffine(local, &world_[(size_t)parent * 16], &world_[slot * 16]);
+        }
+        else {
+            memcpy(&world_[slot * 16], local, 16 * sizeof(float));
+        }
+        updated++;
+    }
+}
+
+void TransformHierarchy::Update() {
+    if (!sorted_) {
+        Sort();
+    }
+
+    updated_ = 0;
+    std::vector<size_t> updated;
+    for (size_t level = 0; level + 1 < levels_.size(); level++) {
+        size_t begin = levels_[level], end = levels_[level + 1];
+        size_t tasks = (end - begin + NodesPerTask - 1) / NodesPerTask;
+        updated.assign(tasks, 0);
+        pool_.ParallelFor(tasks, [&](size_t task) {
+            size_t first = begin + task * NodesPerTask;
+            UpdateRange(first, first + NodesPerTask < end ? first + NodesPerTask : end, updated[task]);
+        });
+        for (size_t count : updated) {
+            updated_ += count;
+        }
+    }
+
+    std::fill(dirty_.begin(), dirty_.end(), (uint8_t)0);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Parented affine transforms in flat arrays. Matrices are row-major for row vectors like
+// XMMATRIX, so world = local * parent world. Nodes are referenced by the handle AddNode
+// returns; storage is ordered by depth so every parent precedes its children and each
+// level is one contiguous range, which Update() walks once, a level at a time, splitting
+// big levels across the thread pool. Only dirty nodes and their descendants are recomputed.
+class TransformHierarchy {
+public:
+    explicit TransformHierarchy(ThreadPool& pool = ThreadPool::GetInstance()) : pool_(pool) {};
+
+    TransformHierarchy(const TransformHierarchy&) = delete;
+    TransformHierarchy(TransformHierarchy&&) = delete;
+
+    // parent is -1 for a root or a handle returned earlier; returns -1 for any other parent
+    int AddNode(int parent, const float local[16]);
+    void SetLocal(int node, const float local[16]);
+    void Clear();
+
+    // Recomputes world matrices of dirty nodes and their descendants, sorts first if nodes were added
+    void Update();
+
+    const float* GetWorld(int node) const { return &world_[(size_t)slots_[node] * 16]; };
+    const float* GetLocal(int node) const { return &local_[(size_t)slots_[node] * 16]; };
+    int GetParent(int node) const { return parentHandles_[node]; };
+    size_t GetNodeCount() const { return parentHandles_.size(); };
+    size_t GetLevelCount() const { return levels_.empty() ? 0 : levels_.size() - 1; };
+    // Nodes recomputed by the last Update()
+    size_t GetUpdatedCount() const { return updated_; };
+
+    ~TransformHierarchy() = default;
+private:
+    void Sort();
+    void UpdateRange(size_t begin, size_t end, size_t& updated);
+
+    ThreadPool& pool_;
+
+    // By handle
+    std::vector<int> parentHandles_;
+    std::vector<uint32_t> slots_;
+
+    // By slot, in depth order
+    std::vector<int> parents_;
+    std::vector<float> local_;
+    std::vector<float> world_;
+    std::vector<uint8_t> dirty_;
+    std::vector<size_t> levels_; // first slot of every level and the node count at the end
+
+    bool sorted_ = true;
+    size_t updated_ = 0;
+};
+
+// local * parent for affine matrices, the last column is taken as (0, 0, 0, 1)
+void MultiplyAffine(const float* local, const float* parent, float* result);
@@ -20,12 +20,14 @@ struct PS_INPUT {
 PS_INPUT main(VS_INPUT input) {
     PS_INPUT output;
 
-    unsigned int idx = indexBuffer[input.instanceId].x;
-    output.worldPos = mul(geomBuffer[idx].worldMatrix, float4(input.position, 1.0f));
+    unsigned int idx = indexBuffer[firstInstance.x + input.instanceId].x;
+    // The scale is uniform, so the rotation alone transforms normals and tangents
+    float4 rotation = UnpackRotation(geomBuffer[idx].rotation);
+    output.worldPos = float4(geomBuffer[idx].position + geomBuffer[idx].scale * RotateVector(rotation, input.position), 1.0f);
     output.position = mul(viewProjectionMatrix, output.worldPos);
     output.uv = input.uv;
-    output.normal = mul(geomBuffer[idx].norm, float4(input.normal, 0.0f)).xyz;
-    output.tangent = mul(geomBuffer[idx].norm, float4(input.tangent, 0.0f)).xyz;
+    output.normal = RotateVector(rotation, input.normal);
+    output.tangent = RotateVector(rotation, input.tangent);
     output.instanceId = idx;
 
     return output;
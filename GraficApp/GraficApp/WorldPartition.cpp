@@ -0,0 +1,343 @@
+#include "WorldPartition.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace {
+    // Cubes fit in a sphere of this radius around their position
+    const float InstanceRadius = 1.0f;
+
+    struct WorldIndexHeader {
+        uint32_t magic;
+        uint32_t version;
+        float cellSize;
+        uint32_t cellCount;
+    };
+
+    const uint32_t MaxWorldCells = 1 << 24;
+}
+
+bool BuildWorld(const SceneFile& scene, float cellSize, const std::string& directory) {
+    if (!scene.IsOpen() || !(cellSize > 0.0f)) {
+        return false;
+    }
+
+    // Instances ordered by cell, then written one cell at a time
+    const SceneInstances& instances = scene.GetInstances();
+    std::vector<int32_t> cellX(instances.count), cellZ(instances.count);
+    std::vector<uint32_t> order(instances.count);
+    for (uint32_t i = 0; i < instances.count; i++) {
+        cellX[i] = (int32_t)floorf(instances.x[i] / cellSize);
+        cellZ[i] = (int32_t)floorf(instances.z[i] / cellSize);
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return cellX[a] != cellX[b] ? cellX[a] < cellX[b] : cellZ[a] < cellZ[b];
+    });
+
+    const SceneFileHeader& header = scene.GetHeader();
+    WorldIndex names;
+    std::vector<WorldCell> cells;
+    SceneData cellScene;
+    cellScene.materials.assign(scene.GetMaterials(), scene.GetMaterials() + header.materialCount);
+    std::vector<uint8_t> data;
+    for (size_t first = 0; first < order.size();) {
+        size_t last = first;
+        WorldCell cell = { cellX[order[first]], cellZ[order[first]], {}, {}, 0, 0, 0 };
+        while (last < order.size() && cellX[order[last]] == cell.x && cellZ[order[last]] == cell.z) {
+            last++;
+        }
+
+        cellScene.x.clear();
+        cellScene.y.clear();
+        cellScene.z.clear();
+        cellScene.speed.clear();
+        cellScene.material.clear();
+        for (size_t i = first; i < last; i++) {
+            uint32_t instance = order[i];
+            const float position[3] = { instances.x[instance], instances.y[instance], instances.z[instance] };
+            for (int axis = 0; axis < 3; axis++) {
+                float low = position[axis] - InstanceRadius, high = position[axis] + InstanceRadius;
+                cell.min[axis] = i == first || low < cell.min[axis] ? low : cell.min[axis];
+                cell.max[axis] = i == first || high > cell.max[axis] ? high : cell.max[axis];
+            }
+            cellScene.x.push_back(position[0]);
+            cellScene.y.push_back(position[1]);
+            cellScene.z.push_back(position[2]);
+            cellScene.speed.push_back(instances.speed[instance]);
+            cellScene.material.push_back(instances.material[instance]);
+        }
+
+        if (!SerializeSceneFile(cellScene, data)) {
+            return false;
+        }
+        cell.instanceCount = (uint32_t)(last - first);
+        cell.size = data.size();
+
+        std::ofstream file(directory + "/cell_" + std::to_string(cell.x) + "_" + std::to_string(cell.z) + ".scene",
+            std::ios::binary | std::ios::trunc);
+        file.write((const char*)data.data(), data.size());
+        if (!file.good()) {
+            return false;
+        }
+        cells.push_back(cell);
+        first = last;
+    }
+
+    std::ofstream file(directory + "/world.index", std::ios::binary | std::ios::trunc);
+    WorldIndexHeader indexHeader = { WorldIndex::Magic, WorldIndex::Version, cellSize, (uint32_t)cells.size() };
+    file.write((const char*)&indexHeader, sizeof(indexHeader));
+    file.write((const char*)cells.data(), cells.size() * sizeof(WorldCell));
+    return file.good();
+}
+
+bool WorldIndex::Load(const std::string& directory) {
+    cells_.clear();
+    directory_ = directory;
+
+    std::ifstream file(directory + "/world.index", std::ios::binary);
+    WorldIndexHeader header = {};
+    file.read((char*)&header, sizeof(header));
+    if (!file.good() || header.magic != Magic || header.version != Version || !(header.cellSize > 0.0f) ||
+        header.cellCount > MaxWorldCells) {
+        return false;
+    }
+
+    cells_.resize(header.cellCount);
+    file.read((char*)cells_.data(), cells_.size() * sizeof(WorldCell));
+    if (!file.good()) {
+        cells_.clear();
+        return false;
+    }
+    cellSize_ = header.cellSize;
+    return true;
+}
+
+std::string WorldIndex::GetCellFileName(size_t cell) const {
+    return directory_ + "/cell_" + std::to_string(cells_[cell].x) + "_" + std::to_string(cells_[cell].z) + ".scene";
+}
+
+bool FileCellReader::Read(size_t cell, std::vector<uint64_t>& data, size_t& size) {
+    std::ifstream file(index_.GetCellFileName(cell), std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    // A file that changed since the index was built would break the memory accounting
+    size = (size_t)file.tellg();
+    if (size != index_.GetCells()[cell].size) {
+        return false;
+    }
+    data.resize((size + 7) / 8);
+    file.seekg(0);
+    file.read((char*)data.data(), size);
+    return file.good();
+}
+
+CellStreamer::CellStreamer(const WorldIndex& index, ICellReader& reader, uint64_t memoryBudget, uint32_t maxInFlight) :
+    index_(index),
+    reader_(reader),
+    memoryBudget_(memoryBudget),
+    maxInFlight_(maxInFlight > 0 ? maxInFlight : 1),
+    states_(index.GetCells().size(), CellState::Unloaded),
+    resident_(index.GetCells().size()),
+    distances_(index.GetCells().size(), 0.0f) {
+    loader_ = std::thread(&CellStreamer::LoaderThread, this);
+}
+
+CellStreamer::~CellStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    loader_.join();
+}
+
+void CellStreamer::LoaderThread() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+        if (stop_) {
+            return;
+        }
+
+        Completed done = { queue_.front(), false, 0, {} };
+        queue_.pop_front();
+        lock.unlock();
+        done.ok = reader_.Read(done.cell, done.data, done.size);
+        lock.lock();
+        completed_.push_back(std::move(done));
+    }
+}
+
+float CellStreamer::Distance(uint32_t cell, const float camera[3]) const {
+    const WorldCell& bounds = index_.GetCells()[cell];
+    float sum = 0.0f;
+    for (int axis = 0; axis < 3; axis++) {
+        float d = camera[axis] < bounds.min[axis] ? bounds.min[axis] - camera[axis] :
+            (camera[axis] > bounds.max[axis] ? camera[axis] - bounds.max[axis] : 0.0f);
+        sum += d * d;
+    }
+    return sqrtf(sum);
+}
+
+void CellStreamer::Evict(uint32_t cell) {
+    resident_[cell].reset();
+    states_[cell] = CellState::Unloaded;
+    stats_.residentCells--;
+    stats_.residentBytes -= index_.GetCells()[cell].size;
+    stats_.evictions++;
+}
+
+void CellStreamer::Update(const float camera[3], float loadRadius, float unloadScale) {
+    const std::vector<WorldCell>& cells = index_.GetCells();
+    float unloadRadius = loadRadius * (unloadScale > 1.0f ? unloadScale : 1.0f);
+    for (uint32_t i = 0; i < (uint32_t)cells.size(); i++) {
+        distances_[i] = Distance(i, camera);
+    }
+
+    std::vector<Completed> completed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        completed.swap(completed_);
+    }
+    for (Completed& done : completed) {
+        uint64_t size = cells[done.cell].size;
+        inFlight_--;
+        stats_.loadingBytes -= size;
+        if (!done.ok || done.size != size) {
+            states_[done.cell] = CellState::Failed;
+            stats_.failed++;
+            continue;
+        }
+        if (distances_[done.cell] > unloadRadius) {
+            states_[done.cell] = CellState::Unloaded;
+            stats_.cancelled++;
+            continue;
+        }
+
+        std::unique_ptr<ResidentCell> resident(new ResidentCell);
+        resident->data.swap(done.data);
+        if (!resident->scene.Attach(resident->data.data(), done.size)) {
+            states_[done.cell] = CellState::Failed;
+            stats_.failed++;
+            continue;
+        }
+        resident_[done.cell] = std::move(resident);
+        states_[done.cell] = CellState::Resident;
+        stats_.residentCells++;
+        stats_.residentBytes += size;
+        stats_.loads++;
+    }
+
+    for (uint32_t i = 0; i < (uint32_t)cells.size(); i++) {
+        if (states_[i] == CellState::Resident && distances_[i] > unloadRadius) {
+            Evict(i);
+        }
+    }
+
+    std::vector<uint32_t> candidates;
+    for (uint32_t i = 0; i < (uint32_t)cells.size(); i++) {
+        if (states_[i] == CellState::Unloaded && distances_[i] <= loadRadius) {
+            candidates.push_back(i);
+        }
+    }
+    auto nearer = [this](uint32_t a, uint32_t b) { return distances_[a] < distances_[b]; };
+    std::sort(candidates.begin(), candidates.end(), nearer);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Queued cells the camera moved away from give their slot to nearer ones
+    for (auto it = queue_.begin(); it != queue_.end();) {
+        if (distances_[*it] > loadRadius) {
+            states_[*it] = CellState::Unloaded;
+            inFlight_--;
+            stats_.loadingBytes -= cells[*it].size;
+            stats_.cancelled++;
+            it = queue_.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    for (uint32_t cell : candidates) {
+        if (inFlight_ >= maxInFlight_) {
+            break;
+        }
+        uint64_t size = cells[cell].size;
+        if (size > memoryBudget_) {
+            states_[cell] = CellState::Failed;
+            stats_.failed++;
+            continue;
+        }
+
+        while (stats_.residentBytes + stats_.loadingBytes + size > memoryBudget_) {
+            uint32_t farthest = UINT32_MAX;
+            for (uint32_t i = 0; i < (uint32_t)cells.size(); i++) {
+                if (states_[i] == CellState::Resident && distances_[i] > distances_[cell] &&
+                    (farthest == UINT32_MAX || distances_[i] > distances_[farthest])) {
+                    farthest = i;
+                }
+            }
+            if (farthest == UINT32_MAX) {
+                break;
+            }
+            Evict(farthest);
+        }
+        // Everything resident is nearer, the remaining candidates are farther still
+        if (stats_.residentBytes + stats_.loadingBytes + size > memoryBudget_) {
+            break;
+        }
+
+        states_[cell] = CellState::Queued;
+        inFlight_++;
+        stats_.loadingBytes += size;
+        queue_.push_back(cell);
+    }
+
+    std::stable_sort(queue_.begin(), queue_.end(), nearer);
+    if (!queue_.empty()) {
+        wake_.notify_one();
+    }
+}
+
+const SceneFile* CellStreamer::GetCell(size_t cell) const {
+    return states_[cell] == CellState::Resident ? &resident_[cell]->scene : nullptr;
+}
+
+void CellStreamer::CollectVisible(const float camera[3], float maxDistance,
+    const std::function<bool(const float* min, const float* max)>& visible, std::vector<uint32_t>& cells) const {
+    cells.clear();
+    std::vector<float> distances;
+    for (uint32_t i = 0; i < (uint32_t)states_.size(); i++) {
+        if (states_[i] != CellState::Resident) {
+            continue;
+        }
+        const WorldCell& cell = index_.GetCells()[i];
+        float distance = Distance(i, camera);
+        if (distance <= maxDistance && (!visible || visible(cell.min, cell.max))) {
+            cells.push_back(i);
+            distances.push_back(distance);
+        }
+    }
+
+    std::vector<uint32_t> order(cells.size());
+    for (uint32_t i = 0; i < (uint32_t)order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return distances[a] < distances[b]; });
+    std::vector<uint32_t> sorted(cells.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        sorted[i] = cells[order[i]];
+    }
+    cells.swap(sorted);
+}
+
+CellStreamerStats CellStreamer::GetStats() const {
+    CellStreamerStats stats = stats_;
+    stats.loadingCells = inFlight_;
+    return stats;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "SceneFile.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A cell of the world grid on the XZ plane, stored as a scene file of its own
+struct WorldCell {
+    int32_t x;
+    int32_t z;
+    float min[3];          // bounds of the instances, not of the grid square
+    float max[3];
+    uint32_t instanceCount;
+    uint32_t reserved;
+    uint64_t size;         // bytes of the cell file
+};
+static_assert(sizeof(WorldCell) == 48, "WorldCell is part of the file format");
+
+// Splits a scene into cellSize x cellSize columns and writes world.index and one
+// cell_<x>_<z>.scene per non-empty cell into an existing directory. Every cell gets all
+// materials, lights stay with the original scene.
+bool BuildWorld(const SceneFile& scene, float cellSize, const std::string& directory);
+
+// world.index: magic, version, cell size, cell count and the WorldCell table
+class WorldIndex {
+public:
+    static constexpr uint32_t Magic = 0x444C5747; // "GWLD"
+    static constexpr uint32_t Version = 1;
+
+    WorldIndex() = default;
+
+    bool Load(const std::string& directory);
+
+    const std::vector<WorldCell>& GetCells() const { return cells_; };
+    float GetCellSize() const { return cellSize_; };
+    std::string GetCellFileName(size_t cell) const;
+
+    ~WorldIndex() = default;
+private:
+    std::string directory_;
+    float cellSize_ = 0.0f;
+    std::vector<WorldCell> cells_;
+};
+
+// Backend for CellStreamer, called on the loader thread. FileCellReader reads cell files,
+// tests wrap it to simulate a slow disk.
+class ICellReader {
+public:
+    // data is 8-byte aligned storage for size bytes
+    virtual bool Read(size_t cell, std::vector<uint64_t>& data, size_t& size) = 0;
+
+    virtual ~ICellReader() = default;
+};
+
+class FileCellReader : public ICellReader {
+public:
+    explicit FileCellReader(const WorldIndex& index) : index_(index) {};
+
+    bool Read(size_t cell, std::vector<uint64_t>& data, size_t& size) override;
+private:
+    const WorldIndex& index_;
+};
+
+struct CellStreamerStats {
+    uint32_t residentCells;
+    uint32_t loadingCells;
+    uint64_t residentBytes;
+    uint64_t loadingBytes;
+    uint64_t loads;
+    uint64_t evictions;
+    uint64_t cancelled;
+    uint64_t failed;
+};
+
+// Pages world cells in and out around the camera. Update() runs on the main thread: it
+// takes finished loads, evicts resident cells beyond the unload radius and queues the
+// nearest missing cells inside the load radius. Resident and loading cells never exceed
+// the memory budget; to make room a farther resident cell is evicted for a nearer one.
+// A single loader thread reads the queue nearest first. Queued cells that left the load
+// radius are dropped, cells that arrive after leaving the unload radius are discarded.
+class CellStreamer {
+public:
+    CellStreamer(const WorldIndex& index, ICellReader& reader, uint64_t memoryBudget, uint32_t maxInFlight);
+
+    CellStreamer(const CellStreamer&) = delete;
+    CellStreamer(CellStreamer&&) = delete;
+
+    // Cells are kept until unloadScale * loadRadius so a camera on a cell border does not thrash
+    void Update(const float camera[3], float loadRadius, float unloadScale = 1.25f);
+
+    // NULL unless the cell is resident, valid until the Update() that evicts it
+    const SceneFile* GetCell(size_t cell) const;
+    // Resident cells within maxDistance whose bounds pass visible, nearest first
+    void CollectVisible(const float camera[3], float maxDistance,
+        const std::function<bool(const float* min, const float* max)>& visible, std::vector<uint32_t>& cells) const;
+
+    CellStreamerStats GetStats() const;
+    uint64_t GetMemoryBudget() const { return memoryBudget_; };
+
+    ~CellStreamer();
+private:
+    enum class CellState : uint8_t {
+        Unloaded,
+        Queued,   // in queue_ or being read
+        Resident,
+        Failed    // unreadable or invalid, not requested again
+    };
+
+    struct ResidentCell {
+        std::vector<uint64_t> data;
+        SceneFile scene;
+    };
+
+    struct Completed {
+        uint32_t cell;
+        bool ok;
+        size_t size;
+        std::vector<uint64_t> data;
+    };
+
+    void LoaderThread();
+    void Evict(uint32_t cell);
+    float Distance(uint32_t cell, const float camera[3]) const;
+
+    const WorldIndex& index_;
+    ICellReader& reader_;
+    uint64_t memoryBudget_;
+    uint32_t maxInFlight_;
+
+    // Main thread only
+    std::vector<CellState> states_;
+    std::vector<std::unique_ptr<ResidentCell>> resident_;
+    std::vector<float> distances_;
+    uint32_t inFlight_ = 0;
+    CellStreamerStats stats_ = {};
+
+    // Shared with the loader thread
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<uint32_t> queue_;
+    std::vector<Completed> completed_;
+    bool stop_ = false;
+    std::thread loader_;
+};
@@ -53,6 +53,23 @@ void Camera::Move(float di, float dj, float dz) {
     UpdateViewMatrix();
 }
 
+void Camera::SetPose(const XMFLOAT3& position, const XMFLOAT4& orientation) {
+    XMVECTOR q = XMLoadFloat4(&orientation);
+    XMVECTOR forward = XMVector3Rotate(XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), q);
+    XMVECTOR up = XMVector3Rotate(XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), q);
+
+    // Keep the spherical parameters in sync so Rotate/Move continue from this pose
+    XMFLOAT3 dir;
+    XMStoreFloat3(&dir, forward);
+    theta_ = asinf(min(max(dir.y, -1.0f), 1.0f));
+    phi_ = atan2f(dir.z, dir.x);
+    position_ = position;
+    focus_ = XMFLOAT3(position_.x + dir.x * r_, position_.y + dir.y * r_, position_.z + dir.z * r_);
+
+    // The view is built from the full orientation so roll is preserved
+    viewMatrix_ = XMMatrixLookToLH(XMVectorSet(position_.x, position_.y, position_.z, 0.0f), forward, up);
+}
+
 void Camera::UpdateViewMatrix() {
     float upTheta = theta_ + XM_PIDIV2;
     XMFLOAT3 up = XMFLOAT3(cosf(upTheta) * cosf(phi_), sinf(upTheta), cosf(upTheta) * sinf(phi_));
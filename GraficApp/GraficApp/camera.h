@@ -9,6 +9,7 @@ public:
     void Rotate(float dphi, float dtheta);
     void Zoom(float dr);
     void Move(float di, float dj, float dz); // di - right/left relative to the camera, di - foward/becward relative to the camers, dz - up/down relative to the camera
+    void SetPose(const XMFLOAT3& position, const XMFLOAT4& orientation); // orientation - quaternion, identity looks along +z
 
     XMMATRIX& GetViewMatrix() {
         return viewMatrix_;
@@ -18,6 +18,7 @@
 
 #include <d3d11.h>
 #include <dxgi.h>
+#include <dxgi1_3.h>
 #include <d3dcompiler.h>
 #include <dinput.h>
 #include <directxmath.h>
@@ -104,6 +104,34 @@ unsigned char* Input::ReadKeyboard() {
     return key;
 }
 
+InputFrame Input::ReadFrame() {
+    InputFrame frame;
+
+    XMFLOAT3 mouse = ReadMouse();
+    frame.mouseX = (int16_t)max(min(mouse.x, 32767.0f), -32768.0f);
+    frame.mouseY = (int16_t)max(min(mouse.y, 32767.0f), -32768.0f);
+    frame.mouseZ = (int16_t)max(min(mouse.z, 32767.0f), -32768.0f);
+
+    unsigned char* keyboard = ReadKeyboard();
+    if (nullptr == keyboard)
+        return frame;
+
+    if (keyboard[DIK_UP] || keyboard[DIK_W])
+        frame.keys |= InputKeyForward;
+    if (keyboard[DIK_DOWN] || keyboard[DIK_S])
+        frame.keys |= InputKeyBackward;
+    if (keyboard[DIK_LEFT] || keyboard[DIK_A])
+        frame.keys |= InputKeyLeft;
+    if (keyboard[DIK_RIGHT] || keyboard[DIK_D])
+        frame.keys |= InputKeyRight;
+    if (keyboard[DIK_LCONTROL])
+        frame.keys |= InputKeyDown;
+    if (keyboard[DIK_LSHIFT])
+        frame.keys |= InputKeyUp;
+
+    return frame;
+}
+
 Input::~Input() {
     Realese();
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "framework.h"
+#include "InputRecorder.h"
 
 class Input {
 public:
@@ -10,6 +11,8 @@ public:
     void Realese();
     XMFLOAT3 ReadMouse();
     unsigned char* ReadKeyboard();
+    // Polls both devices into a snapshot that can be recorded and replayed
+    InputFrame ReadFrame();
 
     ~Input();
 private:
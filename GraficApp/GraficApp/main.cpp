@@ -3,16 +3,29 @@
 
 #include "main.h"
 #include "Renderer.h"
+#include "ImageCompare.h"
+#include "MipGeneration.h"
+#include "DdsValidation.h"
+
+#include <shellapi.h>
+#include <timeapi.h>
 
 #define MAX_LOADSTRING 100
 
 HINSTANCE hInst;                                  // текущий экземпляр
 WCHAR szTitle[MAX_LOADSTRING];                    // текст строки заголовка
 WCHAR szWindowClass[MAX_LOADSTRING];              // имя класса главного окна
+POINT clickStart;                                 // где нажата левая кнопка
+bool clickPending = false;                        // кнопка нажата и мышь не сдвинулась
+
+// Сдвиг в пикселях, после которого нажатие считается перетаскиванием камеры, а не выбором
+const int ClickSlop = 2;
 
 ATOM                 MyRegisterClass(HINSTANCE hInstance);
 BOOL                 InitInstance(HINSTANCE, int);
 LRESULT CALLBACK     WndProc(HWND, UINT, WPARAM, LPARAM);
+bool                 ParseCommandLine(int& exitCode);
+static void          WriteOutput(const std::string& text);
 
 int APIENTRY wWinMain(_In_ HINSTANCE     hInstance,
     _In_opt_ HINSTANCE hPrevInstance,
@@ -36,6 +49,12 @@ int APIENTRY wWinMain(_In_ HINSTANCE     hInstance,
         SetCurrentDirectory(dir.c_str());
     }
 
+    // Инструменты командной строки завершаются без создания окна
+    int exitCode = 0;
+    if (ParseCommandLine(exitCode)) {
+        return exitCode;
+    }
+
     // Выполнить инициализацию приложения:
     if (!InitInstance(hInstance, nCmdShow)) {
         return FALSE;
@@ -46,10 +65,13 @@ int APIENTRY wWinMain(_In_ HINSTANCE     hInstance,
     MSG msg;
     Renderer& renderer = Renderer::GetInstance();
 
+    // Точность Sleep 1 мс для ограничителя кадров
+    timeBeginPeriod(1);
+
     // Цикл основного сообщения:
     bool exit = false;
     while (!exit) {
-        if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE) > 0) {
+        while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE) > 0) {
             if (!TranslateAccelerator(msg.hwnd, hAccelTable, &msg)) {
                 TranslateMessage(&msg);
                 DispatchMessage(&msg);
@@ -57,13 +79,143 @@ int APIENTRY wWinMain(_In_ HINSTANCE     hInstance,
             if (WM_QUIT == msg.message)
                 exit = true;
         }
-        renderer.Render();
+        if (!exit)
+            renderer.Render();
+    }
+
+    timeEndPeriod(1);
+
+    if (!renderer.GetReplayResult().empty()) {
+        WriteOutput(renderer.GetReplayResult());
     }
 
     return (int)msg.wParam;
 }
 
 
+static std::string ToNarrow(const wchar_t* str) {
+    int size = WideCharToMultiByte(CP_ACP, 0, str, -1, NULL, 0, NULL, NULL);
+    std::string result(size > 0 ? size - 1 : 0, '\0');
+    if (size > 1) {
+        WideCharToMultiByte(CP_ACP, 0, str, -1, &result[0], size, NULL, NULL);
+    }
+    return result;
+}
+
+// Вывод для CI: в перенаправленный stdout или в консоль, из которой запущено приложение
+static void WriteOutput(const std::string& text) {
+    HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (output == NULL || output == INVALID_HANDLE_VALUE) {
+        AttachConsole(ATTACH_PARENT_PROCESS);
+        output = GetStdHandle(STD_OUTPUT_HANDLE);
+    }
+    if (output != NULL && output != INVALID_HANDLE_VALUE) {
+        DWORD written = 0;
+        WriteFile(output, text.c_str(), (DWORD)text.size(), &written, NULL);
+    }
+}
+
+//  -capture <file> [<frames>] - без окна отрисовать кадры (по умолчанию 60, после -replay - до конца записи) программным растеризатором,
+//      записать последний в BMP и выйти; результат воспроизведения выводится в stdout
+//  -compare <a.bmp> <b.bmp> [<min psnr>] - сравнить два кадра и выйти, код 1 если PSNR ниже порога (по умолчанию 40 дБ), 2 при ошибке
+//  -genmips <in.dds> <out.dds> [box|kaiser|normal] - построить все мипы текстуры заново (normal - карта нормалей) и выйти, код 1 при ошибке
+//  -ddscheck <dir> [<file>] - параллельно проверить заголовки и размещение мипов всех DDS в каталоге, записать dds_check.csv и выйти, код 1 если есть битые файлы
+//  -scene <file> - загрузить кубы и источники света из файла сцены
+//  -world <dir> - подгружать ячейки мира из каталога вокруг камеры
+//  -record <file> - записать ввод в файл
+//  -replay <file> - воспроизвести записанный ввод, вывести результат в stdout и выйти
+//  -benchmark <file> <path> - пролететь по пути камеры и записать benchmark_<path>.csv
+//  -fps <n> - ограничить частоту кадров
+//  -vsync - вертикальная синхронизация
+bool ParseCommandLine(int& exitCode) {
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (argv == NULL) {
+        return false;
+    }
+
+    bool exit = false;
+    Renderer& renderer = Renderer::GetInstance();
+    for (int i = 1; i < argc && !exit; i++) {
+        bool hasValue = i + 1 < argc;
+        if (wcscmp(argv[i], L"-compare") == 0 && i + 2 < argc) {
+            double minPsnr = i + 3 < argc ? _wtof(argv[i + 3]) : 40.0;
+            ImageCompareResult result;
+            if (CompareImages(ToNarrow(argv[i + 1]), ToNarrow(argv[i + 2]), result)) {
+                char line[128];
+                sprintf_s(line, "%dx%d psnr %.2f ssim %.5f\n", result.width, result.height, result.psnr, result.ssim);
+                WriteOutput(line);
+                exitCode = result.psnr >= minPsnr ? 0 : 1;
+            }
+            else {
+                WriteOutput("failed to compare images\n");
+                exitCode = 2;
+            }
+            exit = true;
+        }
+        else if (wcscmp(argv[i], L"-capture") == 0 && hasValue) {
+            // Флаги сцены и воспроизведения должны стоять раньше
+            int frames = i + 2 < argc ? _wtoi(argv[i + 2]) : 0;
+            if (renderer.Capture(ToNarrow(argv[i + 1]), frames)) {
+                exitCode = 0;
+            }
+            else {
+                WriteOutput("failed to capture\n");
+                exitCode = 1;
+            }
+            if (!renderer.GetReplayResult().empty()) {
+                WriteOutput(renderer.GetReplayResult());
+            }
+            exit = true;
+        }
+        else if (wcscmp(argv[i], L"-genmips") == 0 && i + 2 < argc) {
+            MipSettings settings;
+            if (i + 3 < argc) {
+                settings.filter = wcscmp(argv[i + 3], L"box") == 0 ? MipFilter::Box : MipFilter::Kaiser;
+                settings.normalMap = wcscmp(argv[i + 3], L"normal") == 0;
+            }
+            if (GenerateDdsMips(ToNarrow(argv[i + 1]), ToNarrow(argv[i + 2]), settings)) {
+                exitCode = 0;
+            }
+            else {
+                WriteOutput("failed to generate mips\n");
+                exitCode = 1;
+            }
+            exit = true;
+        }
+        else if (wcscmp(argv[i], L"-ddscheck") == 0 && hasValue) {
+            std::string fileName = i + 2 < argc ? ToNarrow(argv[i + 2]) : "dds_check.csv";
+            exitCode = RunDdsDirectoryCheck(ToNarrow(argv[i + 1]), fileName) ? 0 : 1;
+            exit = true;
+        }
+        else if (wcscmp(argv[i], L"-benchmark") == 0 && i + 2 < argc) {
+            renderer.StartBenchmark(ToNarrow(argv[i + 1]), ToNarrow(argv[i + 2]));
+            i += 2;
+        }
+        else if (wcscmp(argv[i], L"-record") == 0 && hasValue) {
+            renderer.StartRecording(ToNarrow(argv[++i]));
+        }
+        else if (wcscmp(argv[i], L"-replay") == 0 && hasValue) {
+            renderer.StartReplay(ToNarrow(argv[++i]));
+        }
+        else if (wcscmp(argv[i], L"-scene") == 0 && hasValue) {
+            renderer.LoadScene(ToNarrow(argv[++i]));
+        }
+        else if (wcscmp(argv[i], L"-world") == 0 && hasValue) {
+            renderer.LoadWorld(ToNarrow(argv[++i]));
+        }
+        else if (wcscmp(argv[i], L"-fps") == 0 && hasValue) {
+            renderer.SetPacing(PacingMode::TargetFps, _wtof(argv[++i]));
+        }
+        else if (wcscmp(argv[i], L"-vsync") == 0) {
+            renderer.SetPacing(PacingMode::VSync, 0.0);
+        }
+    }
+
+    LocalFree(argv);
+    return exit;
+}
+
 ATOM MyRegisterClass(HINSTANCE hInstance) {
     WNDCLASSEXW wcex;
 
@@ -128,7 +280,11 @@ extern IMGUI_IMPL_API LRESULT ImGui_ImplWin32_WndProcHandler(HWND hWnd, UINT msg
 //  ЦЕЛЬ: Обрабатывает сообщения в главном окне.
 //
 //  WM_DESTROY  - Отправить сообщение о выходе и вернуться
-//  WM_SIZE     - Изменить размер окна
+//  WM_SIZE     - Изменить размер окна (применяется после паузы)
+//  WM_EXITSIZEMOVE - Применить размер сразу по окончании перетаскивания
+//  WM_LBUTTONDOWN - Запомнить место нажатия
+//  WM_MOUSEMOVE - Отменить выбор, если мышь сдвинулась (перетаскивание камеры)
+//  WM_LBUTTONUP - Выбрать куб под курсором, если это был щелчок
 //
 LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
@@ -145,6 +301,26 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
             Renderer::GetInstance().Resize(rc.right - rc.left, rc.bottom - rc.top);
         }
         break;
+    case WM_EXITSIZEMOVE:
+        Renderer::GetInstance().FlushResize();
+        break;
+    case WM_LBUTTONDOWN:
+        clickStart.x = (short)LOWORD(lParam);
+        clickStart.y = (short)HIWORD(lParam);
+        clickPending = true;
+        break;
+    case WM_MOUSEMOVE:
+        if (clickPending && (abs((short)LOWORD(lParam) - clickStart.x) > ClickSlop ||
+            abs((short)HIWORD(lParam) - clickStart.y) > ClickSlop)) {
+            clickPending = false;
+        }
+        break;
+    case WM_LBUTTONUP:
+        if (clickPending) {
+            clickPending = false;
+            Renderer::GetInstance().Pick(clickStart.x, clickStart.y);
+        }
+        break;
     case WM_DESTROY:
         PostQuitMessage(0);
         break;
@@ -1,8 +1,68 @@
 ﻿#include "renderer.h"
 #include "Renderer.h"
 
+#include <algorithm>
+#include <climits>
+#include <fstream>
+
 #define SAFE_RELEASE(A) if ((A) != NULL) { (A)->Release(); (A) = NULL; }
 
+static const Vertex CubeVertices[] = {
+    {{-1.0, -1.0,  1.0}, {0,1}, {0,-1,0}, {1,0,0}},
+    {{ 1.0, -1.0,  1.0}, {1,1}, {0,-1,0}, {1,0,0}},
+    {{ 1.0, -1.0, -1.0}, {1,0}, {0,-1,0}, {1,0,0}},
+    {{-1.0, -1.0, -1.0}, {0,0}, {0,-1,0}, {1,0,0}},
+
+    {{-1.0,  1.0, -1.0}, {0,1}, {0,1,0}, {1,0,0}},
+    {{ 1.0,  1.0, -1.0}, {1,1}, {0,1,0}, {1,0,0}},
+    {{ 1.0,  1.0,  1.0}, {1,0}, {0,1,0}, {1,0,0}},
+    {{-1.0,  1.0,  1.0}, {0,0}, {0,1,0}, {1,0,0}},
+
+    {{ 1.0, -1.0, -1.0}, {0,1}, {1,0,0}, {0,0,1}},
+    {{ 1.0, -1.0,  1.0}, {1,1}, {1,0,0}, {0,0,1}},
+    {{ 1.0,  1.0,  1.0}, {1,0}, {1,0,0}, {0,0,1}},
+    {{ 1.0,  1.0, -1.0}, {0,0}, {1,0,0}, {0,0,1}},
+
+    {{-1.0, -1.0,  1.0}, {0,1}, {-1,0,0}, {0,0,-1}},
+    {{-1.0, -1.0, -1.0}, {1,1}, {-1,0,0}, {0,0,-1}},
+    {{-1.0,  1.0, -1.0}, {1,0}, {-1,0,0}, {0,0,-1}},
+    {{-1.0,  1.0,  1.0}, {0,0}, {-1,0,0}, {0,0,-1}},
+
+    {{ 1.0, -1.0,  1.0}, {0,1}, {0,0,1}, {-1,0,0}},
+    {{-1.0, -1.0,  1.0}, {1,1}, {0,0,1}, {-1,0,0}},
+    {{-1.0,  1.0,  1.0}, {1,0}, {0,0,1}, {-1,0,0}},
+    {{ 1.0,  1.0,  1.0}, {0,0}, {0,0,1}, {-1,0,0}},
+
+    {{-1.0, -1.0, -1.0}, {0,1}, {0,0,-1}, {1,0,0}},
+    {{ 1.0, -1.0, -1.0}, {1,1}, {0,0,-1}, {1,0,0}},
+    {{ 1.0,  1.0, -1.0}, {1,0}, {0,0,-1}, {1,0,0}},
+    {{-1.0,  1.0, -1.0}, {0,0}, {0,0,-1}, {1,0,0}}
+};
+static const USHORT CubeIndices[] = {
+    0, 2, 1, 0, 3, 2,
+    4, 6, 5, 4, 7, 6,
+    8, 10, 9, 8, 11, 10,
+    12, 14, 13, 12, 15, 14,
+    16, 18, 17, 16, 19, 18,
+    20, 22, 21, 20, 23, 22
+};
+// Local box of CubeVertices; picking tests rays against the mesh as drawn, culling has its
+// own smaller AABB
+static const float CubeBoxMin[3] = { -1.0f, -1.0f, -1.0f };
+static const float CubeBoxMax[3] = { 1.0f, 1.0f, 1.0f };
+
+static const char* ProfileStageNames[ProfileStageCount] = {
+    "Opaque", "Skybox", "Transparent", "ImGui", "Post effect"
+};
+
+static const USHORT PlaneIndices[] = {
+    0, 2, 1, 0, 3, 2
+};
+
+// Packed into one texture array at startup, texture ids of instances index this list
+static const wchar_t* MaterialTextures[] = { L"textures/156.dds", L"textures/198.dds" };
+static const int MaterialTextureCount = sizeof(MaterialTextures) / sizeof(MaterialTextures[0]);
+
 Renderer& Renderer::GetInstance() {
     static Renderer instance;
     return instance;
@@ -18,17 +78,24 @@ Renderer::Renderer() :
     pCamera_(NULL),
     pInput_(NULL),
     pFrustum_(NULL),
-    pDepthBuffer_(NULL),
-    pDepthBufferDSV_(NULL),
     pBlendState_(NULL),
     skybox_(NULL),
     width_(defaultWidth),
     height_(defaultHeight)
     //numSphereTriangles_(0),
     //radius_(1.0) 
-    {}
+    {
+        // Invert alone keeps the look of the original post effect
+        postChain_.AddStage(PostEffectType::ToneMap, false, 1.0f);
+        postChain_.AddStage(PostEffectType::ColorGrade, false, 1.0f, 1.0f, 0.0f);
+        postChain_.AddStage(PostEffectType::Blur, false, 1.0f);
+        postChain_.AddStage(PostEffectType::Vignette, false, 1.0f);
+        postChain_.AddStage(PostEffectType::Invert, true);
+    }
 
 bool Renderer::Init(HINSTANCE hInstance, HWND hWnd) {
+    hWnd_ = hWnd;
+
     // Create a DirectX graphics interface factory.​
     IDXGIFactory* pFactory = nullptr;
     HRESULT result = CreateDXGIFactory(__uuidof(IDXGIFactory), (void**)&pFactory);
@@ -50,7 +117,7 @@ bool Renderer::Init(HINSTANCE hInstance, HWND hWnd) {
     }
     if (pSelectedAdapter == NULL) {
         SAFE_RELEASE(pFactory);
-        return false;
+        return InitSoftware(hInstance, hWnd);
     }
 
     // Create DirectX11 pDevice_
@@ -76,7 +143,7 @@ bool Renderer::Init(HINSTANCE hInstance, HWND hWnd) {
         SAFE_RELEASE(pFactory);
         SAFE_RELEASE(pSelectedAdapter);
         Cleanup();
-        return false;
+        return InitSoftware(hInstance, hWnd);
     }
 
     // Create swap chain
@@ -95,8 +162,23 @@ bool Renderer::Init(HINSTANCE hInstance, HWND hWnd) {
     swapChainDesc.SampleDesc.Quality = 0;
     swapChainDesc.Windowed = true;
     swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-    swapChainDesc.Flags = 0;
+    // The waitable latency object needs Windows 8.1, fall back to a plain flip chain without it
+    swapChainFlags_ = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+    swapChainDesc.Flags = swapChainFlags_;
     result = pFactory->CreateSwapChain(pDevice_, &swapChainDesc, &pSwapChain_);
+    if (FAILED(result)) {
+        swapChainFlags_ = 0;
+        swapChainDesc.Flags = swapChainFlags_;
+        result = pFactory->CreateSwapChain(pDevice_, &swapChainDesc, &pSwapChain_);
+    }
+    if (SUCCEEDED(result) && swapChainFlags_ != 0) {
+        if (SUCCEEDED(pSwapChain_->QueryInterface(__uuidof(IDXGISwapChain2), (void**)&pSwapChain2_))) {
+            frameLatencyWaitable_ = pSwapChain2_->GetFrameLatencyWaitableObject();
+        }
+    }
+    if (SUCCEEDED(result)) {
+        ApplyFrameLatency();
+    }
 
     ID3D11Texture2D* pBackBuffer = NULL;
     if (SUCCEEDED(result)) {
@@ -106,6 +188,7 @@ bool Renderer::Init(HINSTANCE hInstance, HWND hWnd) {
         result = pDevice_->CreateRenderTargetView(pBackBuffer, NULL, &pRenderTargetView_);
     }
     if (SUCCEEDED(result)) {
+        targetAllocator_.Init(pDevice_);
         result = InitScene();
     }
     SAFE_RELEASE(pFactory);
@@ -133,7 +216,10 @@ bool Renderer::Init(HINSTANCE hInstance, HWND hWnd) {
         result = pInput_->Init(hInstance, hWnd);
     }
     if (SUCCEEDED(result)) {
-        result = InitRenderTexture(defaultWidth, defaultHeight);
+        // Timings are optional, the renderer works without them
+        if (SUCCEEDED(querySource_.Init(pDevice_, pDeviceContext_, GpuQuerySlots, ProfileStageCount * 2))) {
+            pGpuProfiler_ = new QueryRing(querySource_, ProfileStageCount, GpuQuerySlots);
+        }
     }
 
     IMGUI_CHECKVERSION();
@@ -150,100 +236,175 @@ bool Renderer::Init(HINSTANCE hInstance, HWND hWnd) {
     return SUCCEEDED(result);
 }
 
-HRESULT Renderer::InitRenderTexture(int textureWidth, int textureHeight) {
-    D3D11_TEXTURE2D_DESC textureDesc;
-    ZeroMemory(&textureDesc, sizeof(textureDesc));
-
-    textureDesc.Width = textureWidth;
-    textureDesc.Height = textureHeight;
-    textureDesc.MipLevels = 1;
-    textureDesc.ArraySize = 1;
-    textureDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-    textureDesc.SampleDesc.Count = 1;
-    textureDesc.Usage = D3D11_USAGE_DEFAULT;
-    textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-    textureDesc.CPUAccessFlags = 0;
-    textureDesc.MiscFlags = 0;
-
-    HRESULT result = pDevice_->CreateTexture2D(&textureDesc, NULL, &pRenderTargetTexture_);
-    if (FAILED(result)) {
-        return result;
+static DXGI_FORMAT ToDXGIFormat(IntermediateFormat format) {
+    switch (format) {
+    case IntermediateFormat::RGBA16F:
+        return DXGI_FORMAT_R16G16B16A16_FLOAT;
+    case IntermediateFormat::R11G11B10F:
+        return DXGI_FORMAT_R11G11B10_FLOAT;
+    case IntermediateFormat::RGBA8:
+        return DXGI_FORMAT_R8G8B8A8_UNORM;
+    default:
+        return DXGI_FORMAT_R32G32B32A32_FLOAT;
     }
+}
 
-    D3D11_RENDER_TARGET_VIEW_DESC renderTargetViewDesc;
-    renderTargetViewDesc.Format = textureDesc.Format;
-    renderTargetViewDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
-    renderTargetViewDesc.Texture2D.MipSlice = 0;
+static PackedInstance PackCube(const Cube& cube, float angle) {
+    XMFLOAT4 rotation;
+    XMStoreFloat4(&rotation, XMQuaternionRotationRollPitchYaw(0.0f, angle, 0.0f));
+
+    InstanceTransform transform = {};
+    transform.position[0] = cube.pos.x;
+    transform.position[1] = cube.pos.y;
+    transform.position[2] = cube.pos.z;
+    transform.rotation[0] = rotation.x;
+    transform.rotation[1] = rotation.y;
+    transform.rotation[2] = rotation.z;
+    transform.rotation[3] = rotation.w;
+    transform.scale = 1.0f;
+    transform.shininess = cube.shineSpeedIdNM.x;
+    transform.textureIndex = (uint32_t)cube.shineSpeedIdNM.z;
+    transform.normalMap = cube.shineSpeedIdNM.w > 0.0f;
+    return PackInstance(transform);
+}
 
-    result = pDevice_->CreateRenderTargetView(pRenderTargetTexture_, &renderTargetViewDesc, &pPostEffectRenderTargetView_);
-    if (FAILED(result)) {
-        return result;
+PostEffectNeeds Renderer::GetPostEffectNeeds() const {
+    return postChain_.GetNeeds();
+}
+
+IntermediateFormat Renderer::GetIntermediateFormat() const {
+    if (intermediateOverride_ != IntermediateFormat::Auto) {
+        return intermediateOverride_;
     }
+    return SelectIntermediateFormat(GetPostEffectNeeds());
+}
 
-    D3D11_SHADER_RESOURCE_VIEW_DESC shaderResourceViewDesc;
-    shaderResourceViewDesc.Format = textureDesc.Format;
-    shaderResourceViewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-    shaderResourceViewDesc.Texture2D.MostDetailedMip = 0;
-    shaderResourceViewDesc.Texture2D.MipLevels = 1;
+// The reference backend has its own math types with the layout of the DirectXMath ones
+static RasterMatrix ToRasterMatrix(const XMMATRIX& matrix) {
+    static_assert(sizeof(RasterMatrix) == sizeof(XMFLOAT4X4), "RasterMatrix must match XMFLOAT4X4");
+    RasterMatrix result;
+    XMStoreFloat4x4(reinterpret_cast<XMFLOAT4X4*>(&result), matrix);
+    return result;
+}
 
-    result = pDevice_->CreateShaderResourceView(pRenderTargetTexture_, &shaderResourceViewDesc, &pShaderResourceView_);
+// One layer per file, decoded from mip 1 (mip 0 of single-level files): the software path
+// renders small and keeps float texels
+static bool LoadRasterTexture(const wchar_t* const* files, int count, RasterTexture& texture) {
+    texture = RasterTexture();
+    for (int layer = 0; layer < count; layer++) {
+        std::ifstream file(files[layer], std::ios::binary | std::ios::ate);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::vector<uint8_t> data((size_t)file.tellg());
+        file.seekg(0);
+        std::vector<uint8_t> pixels;
+        uint32_t width = 0, height = 0;
+        DdsInfo info;
+        if (!file.read((char*)data.data(), data.size()) || !ParseDdsHeader(data.data(), data.size(), data.size(), info) ||
+            !DecodeDdsImage(data.data(), data.size(), 0, info.mipCount > 1 ? 1 : 0, pixels, width, height) ||
+            (layer > 0 && (texture.width != (int)width || texture.height != (int)height))) {
+            texture = RasterTexture();
+            return false;
+        }
+        texture.width = (int)width;
+        texture.height = (int)height;
+        texture.layers = layer + 1;
+        for (size_t i = 0; i < pixels.size(); i += 4) {
+            texture.texels.push_back(RasterFloat4(pixels[i] / 255.0f, pixels[i + 1] / 255.0f, pixels[i + 2] / 255.0f,
+                pixels[i + 3] / 255.0f));
+        }
+    }
+    return true;
+}
+
+bool Renderer::InitSoftware(HINSTANCE hInstance, HWND hWnd) {
+    hWnd_ = hWnd;
+    InitCubes();
+
+    pSoftwareRasterizer_ = new SoftwareRasterizer;
+    if (!pSoftwareRasterizer_->Init(width_, height_)) {
+        Cleanup();
+        return false;
+    }
+    // Missing textures leave the cubes untextured instead of failing the fallback
+    static const wchar_t* NormalTextures[] = { L"textures/156_norm.dds" };
+    if (!LoadRasterTexture(MaterialTextures, MaterialTextureCount, softwareColor_)) {
+        OutputDebugStringA("Software color textures failed to load, cubes are untextured\n");
+    }
+    if (!LoadRasterTexture(NormalTextures, 1, softwareNormal_)) {
+        OutputDebugStringA("Software normal map failed to load, cubes are not normal mapped\n");
+    }
+
+    pCamera_ = new Camera;
+    pFrustum_ = new Frustum(SCREEN_NEAR);
+    // Headless captures have no window to read input from
+    if (hWnd == NULL) {
+        return true;
+    }
+    pInput_ = new Input;
+    HRESULT result = pInput_->Init(hInstance, hWnd);
     if (FAILED(result)) {
-        return result;
+        Cleanup();
     }
 
-    return S_OK;
+    return SUCCEEDED(result);
 }
 
-HRESULT Renderer::InitScene() {
-    HRESULT result;
+void Renderer::InitCubes() {
+    XMFLOAT4X4 local;
+    XMStoreFloat4x4(&local, XMMatrixTranslation(sceneOffset_.x, sceneOffset_.y, sceneOffset_.z));
+    sceneHierarchy_.Clear();
+    sceneNode_ = sceneHierarchy_.AddNode(-1, &local._11);
 
+    srand(sceneSeed_);
+    const SceneInstances& instances = sceneFile_.GetInstances();
     for (int i = 0; i < MAX_CUBE; i++) {
         Cube tmp;
-        float textureIndex = (float)(rand() % 2);
-        tmp.pos = XMFLOAT4((float)(rand() % 12 - 6), (float)(rand() % 12 - 6), (float)(rand() % 12 - 6), 1.0f);
-        tmp.shineSpeedIdNM = XMFLOAT4(5.0f, (float)(rand() % 5), textureIndex, textureIndex > 0.0f ? 0.0f : 1.0f);
+        if (sceneFile_.IsOpen() && instances.count > 0) {
+            // Scenes with fewer instances repeat them, the count below hides the copies
+            uint32_t index = i % instances.count;
+            const SceneMaterial& material = sceneFile_.GetMaterials()[instances.material[index]];
+            tmp.pos = XMFLOAT4(instances.x[index], instances.y[index], instances.z[index], 1.0f);
+            tmp.shineSpeedIdNM = XMFLOAT4(material.shininess, instances.speed[index], (float)(material.textureIndex % MaterialTextureCount),
+                material.normalMap != 0 ? 1.0f : 0.0f);
+        }
+        else {
+            float textureIndex = (float)(rand() % MaterialTextureCount);
+            tmp.pos = XMFLOAT4((float)(rand() % 12 - 6), (float)(rand() % 12 - 6), (float)(rand() % 12 - 6), 1.0f);
+            tmp.shineSpeedIdNM = XMFLOAT4(5.0f, (float)(rand() % 5), textureIndex, textureIndex > 0.0f ? 0.0f : 1.0f);
+        }
+        XMStoreFloat4x4(&local, XMMatrixTranslation(tmp.pos.x, tmp.pos.y, tmp.pos.z));
+        tmp.node = sceneHierarchy_.AddNode(sceneNode_, &local._11);
         cubes_.push_back(tmp);
     }
 
-    static const Vertex Vertices[] = {
-        {{-1.0, -1.0,  1.0}, {0,1}, {0,-1,0}, {1,0,0}},
-        {{ 1.0, -1.0,  1.0}, {1,1}, {0,-1,0}, {1,0,0}},
-        {{ 1.0, -1.0, -1.0}, {1,0}, {0,-1,0}, {1,0,0}},
-        {{-1.0, -1.0, -1.0}, {0,0}, {0,-1,0}, {1,0,0}},
-
-        {{-1.0,  1.0, -1.0}, {0,1}, {0,1,0}, {1,0,0}},
-        {{ 1.0,  1.0, -1.0}, {1,1}, {0,1,0}, {1,0,0}},
-        {{ 1.0,  1.0,  1.0}, {1,0}, {0,1,0}, {1,0,0}},
-        {{-1.0,  1.0,  1.0}, {0,0}, {0,1,0}, {1,0,0}},
-
-        {{ 1.0, -1.0, -1.0}, {0,1}, {1,0,0}, {0,0,1}},
-        {{ 1.0, -1.0,  1.0}, {1,1}, {1,0,0}, {0,0,1}},
-        {{ 1.0,  1.0,  1.0}, {1,0}, {1,0,0}, {0,0,1}},
-        {{ 1.0,  1.0, -1.0}, {0,0}, {1,0,0}, {0,0,1}},
-
-        {{-1.0, -1.0,  1.0}, {0,1}, {-1,0,0}, {0,0,-1}},
-        {{-1.0, -1.0, -1.0}, {1,1}, {-1,0,0}, {0,0,-1}},
-        {{-1.0,  1.0, -1.0}, {1,0}, {-1,0,0}, {0,0,-1}},
-        {{-1.0,  1.0,  1.0}, {0,0}, {-1,0,0}, {0,0,-1}},
-
-        {{ 1.0, -1.0,  1.0}, {0,1}, {0,0,1}, {-1,0,0}},
-        {{-1.0, -1.0,  1.0}, {1,1}, {0,0,1}, {-1,0,0}},
-        {{-1.0,  1.0,  1.0}, {1,0}, {0,0,1}, {-1,0,0}},
-        {{ 1.0,  1.0,  1.0}, {0,0}, {0,0,1}, {-1,0,0}},
-
-        {{-1.0, -1.0, -1.0}, {0,1}, {0,0,-1}, {1,0,0}},
-        {{ 1.0, -1.0, -1.0}, {1,1}, {0,0,-1}, {1,0,0}},
-        {{ 1.0,  1.0, -1.0}, {1,0}, {0,0,-1}, {1,0,0}},
-        {{-1.0,  1.0, -1.0}, {0,0}, {0,0,-1}, {1,0,0}}
-    };
-    static const USHORT Indices[] = {
-        0, 2, 1, 0, 3, 2,
-        4, 6, 5, 4, 7, 6,
-        8, 10, 9, 8, 11, 10,
-        12, 14, 13, 12, 15, 14,
-        16, 18, 17, 16, 19, 18,
-        20, 22, 21, 20, 23, 22
-    };
+    cubeAnimation_.Resize(MAX_CUBE);
+    for (int i = 0; i < MAX_CUBE; i++) {
+        cubeAnimation_.x[i] = cubes_[i].pos.x;
+        cubeAnimation_.y[i] = cubes_[i].pos.y;
+        cubeAnimation_.z[i] = cubes_[i].pos.z;
+        cubeAnimation_.speed[i] = cubes_[i].pos.w * cubes_[i].shineSpeedIdNM.y;
+        // Material and texture ids never change, AnimateInstances fills the rest every frame
+        geomBufferInst_[i] = PackCube(cubes_[i], 0.0f);
+    }
+
+    if (sceneFile_.IsOpen()) {
+        const SceneFileHeader& header = sceneFile_.GetHeader();
+        cubesCount_ = header.instanceCount < MAX_CUBE ? (int)header.instanceCount : MAX_CUBE;
+        lights_.clear();
+        for (uint32_t i = 0; i < header.lightCount && i < MAX_LIGHT; i++) {
+            const SceneLight& light = sceneFile_.GetLights()[i];
+            lights_.push_back({ XMFLOAT4(light.position), XMFLOAT4(light.color) });
+        }
+    }
+}
+
+HRESULT Renderer::InitScene() {
+    HRESULT result;
+
+    InitCubes();
+
     static const D3D11_INPUT_ELEMENT_DESC InputDesc[] = {
         {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
         {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
@@ -251,9 +412,6 @@ HRESULT Renderer::InitScene() {
         {"TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D11_INPUT_PER_VERTEX_DATA, 0},
     };
 
-    static const USHORT IndicesT[] = {
-        0, 2, 1, 0, 3, 2
-    };
     static const D3D11_INPUT_ELEMENT_DESC InputDescT[] = {
         {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0}
     };
@@ -272,7 +430,7 @@ HRESULT Renderer::InitScene() {
 
 
     D3D11_BUFFER_DESC desc = {};
-    desc.ByteWidth = sizeof(Vertices);
+    desc.ByteWidth = sizeof(CubeVertices);
     desc.Usage = D3D11_USAGE_IMMUTABLE;
     desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
     desc.CPUAccessFlags = 0;
@@ -280,15 +438,15 @@ HRESULT Renderer::InitScene() {
     desc.StructureByteStride = 0;
 
     D3D11_SUBRESOURCE_DATA data;
-    data.pSysMem = &Vertices;
-    data.SysMemPitch = sizeof(Vertices);
+    data.pSysMem = &CubeVertices;
+    data.SysMemPitch = sizeof(CubeVertices);
     data.SysMemSlicePitch = 0;
 
     result = pDevice_->CreateBuffer(&desc, &data, &pVertexBuffer_[0]);
 
     if (SUCCEEDED(result)) {
         D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = sizeof(Indices);
+        desc.ByteWidth = sizeof(CubeIndices);
         desc.Usage = D3D11_USAGE_IMMUTABLE;
         desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
         desc.CPUAccessFlags = 0;
@@ -296,15 +454,14 @@ HRESULT Renderer::InitScene() {
         desc.StructureByteStride = 0;
 
         D3D11_SUBRESOURCE_DATA data;
-        data.pSysMem = &Indices;
-        data.SysMemPitch = sizeof(Indices);
+        data.pSysMem = &CubeIndices;
+        data.SysMemPitch = sizeof(CubeIndices);
         data.SysMemSlicePitch = 0;
 
         result = pDevice_->CreateBuffer(&desc, &data, &pIndexBuffer_[0]);
     }
 
     ID3D10Blob* vertexShaderBuffer = nullptr;
-    ID3D10Blob* pixelShaderBuffer = nullptr;
     int flags = 0;
 #ifdef _DEBUG
     flags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
@@ -318,39 +475,25 @@ HRESULT Renderer::InitScene() {
             result = pDevice_->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, &pVertexShader_[0]);
         }
     }
-    if (SUCCEEDED(result)) {
-        result = D3DCompileFromFile(L"PS.hlsl", NULL, &includeObj, "main", "ps_5_0", flags, 0, &pixelShaderBuffer, NULL);
-        if (SUCCEEDED(result)) {
-            result = pDevice_->CreatePixelShader(pixelShaderBuffer->GetBufferPointer(), pixelShaderBuffer->GetBufferSize(), NULL, &pPixelShader_[0]);
-        }
-    }
     if (SUCCEEDED(result)) {
         int numElements = sizeof(InputDesc) / sizeof(InputDesc[0]);
         result = pDevice_->CreateInputLayout(InputDesc, numElements, vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), &pInputLayout_[0]);
     }
 
     SAFE_RELEASE(vertexShaderBuffer);
-    SAFE_RELEASE(pixelShaderBuffer);
 
     if (SUCCEEDED(result)) {
         D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = sizeof(GeomBuffer) * MAX_CUBE;
+        desc.ByteWidth = sizeof(PackedInstance) * MAX_CUBE;
         desc.Usage = D3D11_USAGE_DEFAULT;
         desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
         desc.CPUAccessFlags = 0;
         desc.MiscFlags = 0;
         desc.StructureByteStride = 0;
 
-        GeomBuffer geomBufferInst[MAX_CUBE];
-        for (int i = 0; i < cubes_.size(); i++) {
-            geomBufferInst[i].worldMatrix = XMMatrixTranslation(cubes_[i].pos.x, cubes_[i].pos.y, cubes_[i].pos.z);
-            geomBufferInst[i].norm = geomBufferInst[i].worldMatrix;
-            geomBufferInst[i].shineSpeedTexIdNM = cubes_[i].shineSpeedIdNM;
-        }
-
         D3D11_SUBRESOURCE_DATA data;
-        data.pSysMem = &geomBufferInst;
-        data.SysMemPitch = sizeof(geomBufferInst);
+        data.pSysMem = &geomBufferInst_;
+        data.SysMemPitch = sizeof(geomBufferInst_);
         data.SysMemSlicePitch = 0;
 
         result = pDevice_->CreateBuffer(&desc, &data, &pGeomBufferInst_);
@@ -369,12 +512,12 @@ HRESULT Renderer::InitScene() {
         data.SysMemSlicePitch = 0;
         if (SUCCEEDED(result)) {
             worldMatrixBuffer.worldMatrix = TransparentMatrixs[0];
-            worldMatrixBuffer.color = XMFLOAT4(1.0f, 0.0f, 0.0f, 0.0f);
+            worldMatrixBuffer.color = TransparentColors[0];
             result = pDevice_->CreateBuffer(&desc, &data, &pPlanesWorldMatrixBuffer_[0]);
         }
         if (SUCCEEDED(result)) {
             worldMatrixBuffer.worldMatrix = TransparentMatrixs[1];
-            worldMatrixBuffer.color = XMFLOAT4(0.0f, 1.0f, 0.0f, 0.0f);
+            worldMatrixBuffer.color = TransparentColors[1];
             result = pDevice_->CreateBuffer(&desc, &data, &pPlanesWorldMatrixBuffer_[1]);
         }
     }
@@ -419,7 +562,7 @@ HRESULT Renderer::InitScene() {
         }
         if (SUCCEEDED(result)) {
             D3D11_BUFFER_DESC desc = {};
-            desc.ByteWidth = sizeof(IndicesT);
+            desc.ByteWidth = sizeof(PlaneIndices);
             desc.Usage = D3D11_USAGE_IMMUTABLE;
             desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
             desc.CPUAccessFlags = 0;
@@ -427,20 +570,18 @@ HRESULT Renderer::InitScene() {
             desc.StructureByteStride = 0;
 
             D3D11_SUBRESOURCE_DATA data;
-            data.pSysMem = &IndicesT;
-            data.SysMemPitch = sizeof(IndicesT);
+            data.pSysMem = &PlaneIndices;
+            data.SysMemPitch = sizeof(PlaneIndices);
             data.SysMemSlicePitch = 0;
 
             result = pDevice_->CreateBuffer(&desc, &data, &pIndexBuffer_[2]);
         }
 
         ID3D10Blob* vertexShaderBuffer = nullptr;
-        ID3D10Blob* pixelShaderBuffer = nullptr;
         int flags = 0;
 #ifdef _DEBUG
         flags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
 #endif
-        D3D_SHADER_MACRO Shader_Macros[] = { {"USE_LIGHTS"}, {NULL, NULL} };
 
         if (SUCCEEDED(result)) {
             result = D3DCompileFromFile(L"TVS.hlsl", NULL, &includeObj, "main", "vs_5_0", flags, 0, &vertexShaderBuffer, NULL);
@@ -448,76 +589,51 @@ HRESULT Renderer::InitScene() {
                 result = pDevice_->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, &pVertexShader_[2]);
             }
         }
-        if (SUCCEEDED(result)) {
-            result = D3DCompileFromFile(L"TPS.hlsl", Shader_Macros, &includeObj, "main", "ps_5_0", flags, 0, &pixelShaderBuffer, NULL);
-            if (SUCCEEDED(result)) {
-                result = pDevice_->CreatePixelShader(pixelShaderBuffer->GetBufferPointer(), pixelShaderBuffer->GetBufferSize(), NULL, &pPixelShader_[2]);
-            }
-        }
         if (SUCCEEDED(result)) {
             int numElements = sizeof(InputDescT) / sizeof(InputDescT[0]);
             result = pDevice_->CreateInputLayout(InputDescT, numElements, vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), &pInputLayout_[2]);
         }
 
         SAFE_RELEASE(vertexShaderBuffer);
-        SAFE_RELEASE(pixelShaderBuffer);
     }
-    {
-        ID3D10Blob* vertexShaderBuffer = nullptr;
-        ID3D10Blob* pixelShaderBuffer = nullptr;
-        int flags = 0;
-#ifdef _DEBUG
-        flags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
-#endif
-        if (SUCCEEDED(result)) {
-            result = D3DCompileFromFile(L"PostEffectVS.hlsl", NULL, NULL, "main", "vs_5_0", flags, 0, &vertexShaderBuffer, NULL);
-            if (SUCCEEDED(result)) {
-                result = pDevice_->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, &pPostEffectVertexShader_);
-            }
-        }
-        if (SUCCEEDED(result)) {
-            result = D3DCompileFromFile(L"PostEffectPS.hlsl", NULL, NULL, "main", "ps_5_0", flags, 0, &pixelShaderBuffer, NULL);
-            if (SUCCEEDED(result)) {
-                result = pDevice_->CreatePixelShader(pixelShaderBuffer->GetBufferPointer(), pixelShaderBuffer->GetBufferSize(), NULL, &pPostEffectPixelShader_);
-            }
-        }
-
-        SAFE_RELEASE(vertexShaderBuffer);
-        SAFE_RELEASE(pixelShaderBuffer);
-
-        if (SUCCEEDED(result)) {
-            D3D11_SAMPLER_DESC samplerDesc;
-            ZeroMemory(&samplerDesc, sizeof(samplerDesc));
-            samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_POINT;
-            samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
-            samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
-            samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
-            samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
-            samplerDesc.MinLOD = 0;
-            samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
-            samplerDesc.MaxAnisotropy = D3D11_MAX_MAXANISOTROPY;
-
-            result = pDevice_->CreateSamplerState(&samplerDesc, &pPostEffectSamplerState_);
+    if (SUCCEEDED(result)) {
+        // Pixel shaders are variants of PS.hlsl and TPS.hlsl. The plain opaque and the lit
+        // transparent ones stand in for any variant that fails later, without them there is
+        // nothing to draw with. The rest are compiled when a frame first asks for them
+        shaderCompiler_.Init(pDevice_);
+        opaqueShader_ = shaderPermutations_.AddShader({ "PS.hlsl", "main", "ps_5_0", ShaderFeatureNormalMap | ShaderFeatureShowNormals });
+        transparentShader_ = shaderPermutations_.AddShader({ "TPS.hlsl", "main", "ps_5_0", ShaderFeatureLights | ShaderFeatureShowNormals });
+        opaqueFallbackKey_ = shaderPermutations_.MakeKey(opaqueShader_, 0);
+        transparentFallbackKey_ = shaderPermutations_.MakeKey(transparentShader_, ShaderFeatureLights);
+        shaderPermutations_.Request(opaqueFallbackKey_);
+        shaderPermutations_.Request(transparentFallbackKey_);
+        result = shaderPermutations_.Compile() && shaderPermutations_.Find(opaqueFallbackKey_) != nullptr &&
+            shaderPermutations_.Find(transparentFallbackKey_) != nullptr ? S_OK : E_FAIL;
+    }
+    if (SUCCEEDED(result)) {
+        // Most scenes have normal mapped cubes, a failure here only costs the normal maps
+        shaderPermutations_.Request(shaderPermutations_.MakeKey(opaqueShader_, ShaderFeatureNormalMap));
+        if (!shaderPermutations_.Compile()) {
+            OutputDebugStringA("Shader variant compilation failed\n");
         }
-        if (SUCCEEDED(result)) {
-            D3D11_BUFFER_DESC desc = {};
-            desc.ByteWidth = sizeof(PostEffectConstantBuffer);
-            desc.Usage = D3D11_USAGE_DEFAULT;
-            desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-            desc.CPUAccessFlags = 0;
-            desc.MiscFlags = 0;
-            desc.StructureByteStride = 0;
-
-            PostEffectConstantBuffer postEffectConstantBuffer;
-            postEffectConstantBuffer.params = XMINT4(withPostEffect_, 0, 0, 0);
-
-            D3D11_SUBRESOURCE_DATA data;
-            data.pSysMem = &postEffectConstantBuffer;
-            data.SysMemPitch = sizeof(postEffectConstantBuffer);
-            data.SysMemSlicePitch = 0;
+    }
+    if (SUCCEEDED(result)) {
+        result = postProcess_.Init(pDevice_);
+    }
+    for (int i = 0; i < D3D11CommandContexts::MaxContexts && SUCCEEDED(result); i++) {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(DrawRangeBuffer);
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 
-            result = pDevice_->CreateBuffer(&desc, &data, &pPostEffectConstantBuffer_);
-        }
+        result = pDevice_->CreateBuffer(&desc, nullptr, &pDrawRangeBuffer_[i]);
+    }
+    if (SUCCEEDED(result)) {
+        result = commandContexts_.Init(pDevice_, pDeviceContext_, (int)ThreadPool::GetInstance().GetThreadCount());
+        commandContexts_.SetDrawFunction([this](ID3D11DeviceContext* pContext, int context, const DrawRange& range) {
+            DrawOpaqueRange(pContext, context, range);
+        });
     }
     if (SUCCEEDED(result)) {
         D3D11_RASTERIZER_DESC desc = {};
@@ -535,68 +651,39 @@ HRESULT Renderer::InitScene() {
         result = pDevice_->CreateRasterizerState(&desc, &pRasterizerState_);
     }
     if (SUCCEEDED(result)) {
-        std::vector<const wchar_t*> filenames = { L"textures/156.dds", L"textures/198.dds" };
-        UINT textureCount = (UINT)filenames.size();
-
-        std::vector<ID3D11Texture2D*> textures(textureCount);
-
-        for (UINT i = 0; i < textureCount; ++i) {
-            result = DirectX::CreateDDSTextureFromFile(pDevice_, pDeviceContext_, filenames[i], (ID3D11Resource**)(&textures[i]), nullptr);
-        }
-        if (FAILED(result)) {
-            return result;
-        }
-
-        D3D11_TEXTURE2D_DESC textureDesc;
-        textures[0]->GetDesc(&textureDesc);
-
-        D3D11_TEXTURE2D_DESC arrayDesc;
-        arrayDesc.Width = textureDesc.Width;
-        arrayDesc.Height = textureDesc.Height;
-        arrayDesc.MipLevels = textureDesc.MipLevels;
-        arrayDesc.ArraySize = textureCount;
-        arrayDesc.Format = textureDesc.Format;
-        arrayDesc.SampleDesc.Count = 1;
-        arrayDesc.SampleDesc.Quality = 0;
-        arrayDesc.Usage = D3D11_USAGE_DEFAULT;
-        arrayDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-        arrayDesc.CPUAccessFlags = 0;
-        arrayDesc.MiscFlags = 0;
-
-        ID3D11Texture2D* textureArray = nullptr;
-        result = pDevice_->CreateTexture2D(&arrayDesc, 0, &textureArray);
-        if (FAILED(result)) {
-            return result;
+        // Only headers are read here, the cache creates the textures when visible cubes need them
+        textureLoader_.Init(pDevice_);
+        DdsInfo info;
+        // Same sized textures take a slice each, the rest share atlas slices; 4 mips keep atlas gutters small
+        TexturePackSettings settings = { 0, 0, 4 };
+        std::vector<std::wstring> files(MaterialTextures, MaterialTextures + MaterialTextureCount);
+        colorTexture_ = textureLoader_.AddPacked(files, settings, textureLayout_, info);
+        if (colorTexture_ >= 0 && textureLayout_.remap.size() <= MAX_TEXTURE_REMAP) {
+            textureCache_.Register(info);
+            normalTexture_ = textureLoader_.Add({ L"textures/156_norm.dds" }, false, info);
         }
-
-        for (UINT texElement = 0; texElement < textureCount; ++texElement) {
-            for (UINT mipLevel = 0; mipLevel < textureDesc.MipLevels; ++mipLevel) {
-                const int sourceSubresource = D3D11CalcSubresource(mipLevel, 0, textureDesc.MipLevels);
-                const int destSubresource = D3D11CalcSubresource(mipLevel, texElement, textureDesc.MipLevels);
-                pDeviceContext_->CopySubresourceRegion(textureArray, destSubresource, 0, 0, 0, textures[texElement], sourceSubresource, nullptr);
-            }
+        if (normalTexture_ >= 0) {
+            textureCache_.Register(info);
+            normalInfo_ = info;
+            // Tails come in with the first request, the detail cubes need at 2 MB a frame
+            textureCache_.SetStreaming(2ull << 20);
         }
-
-        D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
-        viewDesc.Format = arrayDesc.Format;
-        viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
-        viewDesc.Texture2DArray.MostDetailedMip = 0;
-        viewDesc.Texture2DArray.MipLevels = arrayDesc.MipLevels;
-        viewDesc.Texture2DArray.FirstArraySlice = 0;
-        viewDesc.Texture2DArray.ArraySize = textureCount;
-
-        result = pDevice_->CreateShaderResourceView(textureArray, &viewDesc, &pTexture_[0]);
-        if (FAILED(result)) {
-            return result;
-        }
-        textureArray->Release();
-        for (UINT i = 0; i < textureCount; ++i) {
-            textures[i]->Release();
+        else {
+            result = E_FAIL;
         }
-
     }
     if (SUCCEEDED(result)) {
-        result = CreateDDSTextureFromFile(pDevice_, pDeviceContext_, L"textures/156_norm.dds", nullptr, &pTexture_[1]);
+        // Every material draws from the same array, the table says where its texture went
+        std::vector<TextureRemap> remap = textureLayout_.remap;
+        remap.resize(MAX_TEXTURE_REMAP, TextureRemap());
+
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = (UINT)(sizeof(TextureRemap) * remap.size());
+        desc.Usage = D3D11_USAGE_IMMUTABLE;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+        D3D11_SUBRESOURCE_DATA data = { remap.data(), 0, 0 };
+        result = pDevice_->CreateBuffer(&desc, &data, &pTextureRemapBuffer_);
     }
     if (SUCCEEDED(result)) {
         D3D11_SAMPLER_DESC desc = {};
@@ -652,72 +739,478 @@ HRESULT Renderer::InitScene() {
     return result;
 }
 
-void Renderer::ProcessPostEffect(D3D11_VIEWPORT viewport) {
-    pDeviceContext_->OMSetRenderTargets(1, &pRenderTargetView_, nullptr);
-    pDeviceContext_->RSSetViewports(1, &viewport);
+bool Renderer::BuildFrameGraph() {
+    frameGraph_.Reset();
+    int backBuffer = frameGraph_.ImportResource("BackBuffer");
+    D3D11RenderTarget backBufferTarget;
+    backBufferTarget.pRenderTargetView = pRenderTargetView_;
+    frameBackend_.SetImported(backBuffer, backBufferTarget);
+
+    sceneDepth_ = frameGraph_.CreateResource("Depth", MakeRenderTargetDesc(width_, height_, DXGI_FORMAT_D32_FLOAT, D3D11_BIND_DEPTH_STENCIL));
+
+    // A no-op post chain renders straight into the back buffer
+    postPasses_.clear();
+    postResources_.clear();
+    if (GetPostEffectNeeds().active) {
+        postPasses_ = postChain_.Plan();
+    }
+    RenderTargetDesc colorDesc = {};
+    if (postPasses_.empty()) {
+        sceneColor_ = backBuffer;
+    }
+    else {
+        renderTextureFormat_ = GetIntermediateFormat();
+        colorDesc = MakeRenderTargetDesc(width_, height_, ToDXGIFormat(renderTextureFormat_),
+            D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE);
+        sceneColor_ = frameGraph_.CreateResource("SceneColor", colorDesc);
+    }
+
+    int pass = frameGraph_.AddPass("Opaque", [this]() { RenderOpaque(); });
+    frameGraph_.Write(pass, sceneColor_);
+    frameGraph_.Write(pass, sceneDepth_);
+    pass = frameGraph_.AddPass("Skybox", [this]() { RenderSkybox(); });
+    frameGraph_.Write(pass, sceneColor_);
+    frameGraph_.Write(pass, sceneDepth_);
+    pass = frameGraph_.AddPass("Transparent", [this]() { RenderTransparent(); });
+    frameGraph_.Write(pass, sceneColor_);
+    frameGraph_.Write(pass, sceneDepth_);
+    pass = frameGraph_.AddPass("ImGui", [this]() { RenderImGui(); });
+    frameGraph_.Write(pass, sceneColor_);
+
+    // Every fused pass reads the previous output, intermediates with disjoint lifetimes share a target
+    postResources_.push_back(sceneColor_);
+    for (size_t i = 0; i < postPasses_.size(); i++) {
+        bool isLast = i + 1 == postPasses_.size();
+        postResources_.push_back(isLast ? backBuffer : frameGraph_.CreateResource("PostIntermediate", colorDesc));
+        pass = frameGraph_.AddPass("PostEffect", [this, i]() { RenderPostPass(i); });
+        frameGraph_.Read(pass, postResources_[i]);
+        frameGraph_.Write(pass, postResources_[i + 1]);
+    }
+
+    return frameGraph_.Compile();
+}
+
+void Renderer::BindTargets(int color, int depth) {
+    ID3D11RenderTargetView* views[] = { frameBackend_.GetTarget(frameGraph_, color).pRenderTargetView };
+    ID3D11DepthStencilView* pDepthView = depth >= 0 ? frameBackend_.GetTarget(frameGraph_, depth).pDepthStencilView : nullptr;
+    pDeviceContext_->OMSetRenderTargets(1, views, pDepthView);
+}
+
+void Renderer::RenderOpaque() {
+    BeginStage(ProfileStageOpaque);
+    BindOpaqueState(pDeviceContext_);
+    static const FLOAT color[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    pDeviceContext_->ClearRenderTargetView(frameBackend_.GetTarget(frameGraph_, sceneColor_).pRenderTargetView, color);
+    pDeviceContext_->ClearDepthStencilView(frameBackend_.GetTarget(frameGraph_, sceneDepth_).pDepthStencilView, D3D11_CLEAR_DEPTH, 0.0f, 0);
+
+    commandContexts_.SetDeferred(deferredRecording_ && cubeIndexies_.size() >= (size_t)drawsPerContext_ * 2);
+    if (!commandRecorder_.Run(commandContexts_, cubeIndexies_.size(), (size_t)drawsPerContext_)) {
+        OutputDebugStringA("Opaque command recording failed\n");
+    }
+    // A range draws once per shader variant it covers
+    for (const DrawRange& range : commandRecorder_.GetRanges()) {
+        for (size_t first = range.first; first < range.first + range.count; first = GetShaderRunEnd(first, range)) {
+            drawCount_++;
+        }
+    }
+    EndStage(ProfileStageOpaque);
+}
+
+// Deferred contexts start from the default state, so everything is bound for each of them
+void Renderer::BindOpaqueState(ID3D11DeviceContext* pContext) {
+    ID3D11RenderTargetView* views[] = { frameBackend_.GetTarget(frameGraph_, sceneColor_).pRenderTargetView };
+    pContext->OMSetRenderTargets(1, views, frameBackend_.GetTarget(frameGraph_, sceneDepth_).pDepthStencilView);
+    D3D11_VIEWPORT viewport = { 0.0f, 0.0f, (FLOAT)width_, (FLOAT)height_, 0.0f, 1.0f };
+    pContext->RSSetViewports(1, &viewport);
+
+    pContext->RSSetState(pRasterizerState_);
+    pContext->OMSetDepthStencilState(pDepthState_[0], 0);
+
+    ID3D11ShaderResourceView* resources[] = {
+        static_cast<ID3D11ShaderResourceView*>(textureCache_.GetResource(colorTexture_)),
+        static_cast<ID3D11ShaderResourceView*>(textureCache_.GetResource(normalTexture_))
+    };
+    pContext->PSSetShaderResources(0, 2, resources);
+
+    ID3D11SamplerState* samplers[] = { pSampler_ };
+    pContext->PSSetSamplers(0, 1, samplers);
+
+    pContext->IASetIndexBuffer(pIndexBuffer_[0], DXGI_FORMAT_R16_UINT, 0);
+    ID3D11Buffer* vertexBuffers[] = { pVertexBuffer_[0] };
+    UINT strides[] = { sizeof(Vertex) };
+    UINT offsets[] = { 0 };
+    pContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
+    pContext->IASetInputLayout(pInputLayout_[0]);
+    pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    pContext->VSSetConstantBuffers(0, 1, &pGeomBufferInst_);
+    pContext->VSSetConstantBuffers(1, 1, &pViewMatrixBuffer_[0]);
+    pContext->VSSetConstantBuffers(2, 1, &pLightBuffer_);
+    pContext->VSSetShader(pVertexShader_[0], nullptr, 0);
+    pContext->PSSetConstantBuffers(0, 1, &pGeomBufferInst_);
+    pContext->PSSetConstantBuffers(1, 1, &pViewMatrixBuffer_[0]);
+    pContext->PSSetConstantBuffers(2, 1, &pLightBuffer_);
+    pContext->PSSetConstantBuffers(4, 1, &pTextureRemapBuffer_);
+}
+
+void Renderer::DrawOpaqueRange(ID3D11DeviceContext* pContext, int context, const DrawRange& range) {
+    if (pContext != pDeviceContext_) {
+        BindOpaqueState(pContext);
+    }
+
+    // Visible cubes are sorted by shader key, each run of one key is a draw with its variant.
+    // SV_InstanceID starts at 0 for every draw, the shader adds the first instance of the run
+    pContext->VSSetConstantBuffers(3, 1, &pDrawRangeBuffer_[context]);
+    for (size_t first = range.first, end; first < range.first + range.count; first = end) {
+        end = GetShaderRunEnd(first, range);
+        // A variant that failed to compile draws with the plain one rather than not at all
+        ID3D11PixelShader* pPixelShader = static_cast<ID3D11PixelShader*>(
+            shaderPermutations_.Find(cubeShaderKeys_[cubeIndexies_[first]], opaqueFallbackKey_));
+
+        D3D11_MAPPED_SUBRESOURCE subresource;
+        if (FAILED(pContext->Map(pDrawRangeBuffer_[context], 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource))) {
+            return;
+        }
+        DrawRangeBuffer& buffer = *(DrawRangeBuffer*)subresource.pData;
+        buffer.firstInstance = XMINT4((int32_t)first, 0, 0, 0);
+        pContext->Unmap(pDrawRangeBuffer_[context], 0);
+
+        pContext->PSSetShader(pPixelShader, nullptr, 0);
+        pContext->DrawIndexedInstanced(36, (UINT)(end - first), 0, 0, 0);
+    }
+}
+
+size_t Renderer::GetShaderRunEnd(size_t first, const DrawRange& range) const {
+    ShaderKey key = cubeShaderKeys_[cubeIndexies_[first]];
+    size_t end = first + 1;
+    while (end < range.first + range.count && cubeShaderKeys_[cubeIndexies_[end]] == key) {
+        end++;
+    }
+    return end;
+}
+
+void Renderer::RenderSkybox() {
+    BeginStage(ProfileStageSkybox);
+    BindTargets(sceneColor_, sceneDepth_);
+    pDeviceContext_->OMSetDepthStencilState(pDepthState_[1], 0);
+    skybox_->draw(pDeviceContext_);
+    drawCount_++;
+    EndStage(ProfileStageSkybox);
+}
+
+void Renderer::RenderTransparent() {
+    BeginStage(ProfileStageTransparent);
+    BindTargets(sceneColor_, sceneDepth_);
+    pDeviceContext_->IASetIndexBuffer(pIndexBuffer_[2], DXGI_FORMAT_R16_UINT, 0);
+    ID3D11Buffer* vertexBuffers[] = { pVertexBuffer_[2] };
+    UINT strides[] = { 12 };
+    UINT offsets[] = { 0 };
+    pDeviceContext_->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
+    pDeviceContext_->IASetInputLayout(pInputLayout_[2]);
+
+    pDeviceContext_->VSSetShader(pVertexShader_[2], nullptr, 0);
+    pDeviceContext_->PSSetShader(static_cast<ID3D11PixelShader*>(shaderPermutations_.Find(transparentKey_, transparentFallbackKey_)),
+        nullptr, 0);
+    pDeviceContext_->VSSetConstantBuffers(1, 1, &pViewMatrixBuffer_[0]);
+
+    pDeviceContext_->OMSetBlendState(pBlendState_, nullptr, 0xFFFFFFFF);
+
+    if (isFirst_) {
+        pDeviceContext_->VSSetConstantBuffers(0, 1, &pPlanesWorldMatrixBuffer_[0]);
+        pDeviceContext_->PSSetConstantBuffers(0, 1, &pPlanesWorldMatrixBuffer_[0]);
+        pDeviceContext_->DrawIndexed(6, 0, 0);
+        drawCount_++;
+
+        pDeviceContext_->VSSetConstantBuffers(0, 1, &pPlanesWorldMatrixBuffer_[1]);
+        pDeviceContext_->PSSetConstantBuffers(0, 1, &pPlanesWorldMatrixBuffer_[1]);
+        pDeviceContext_->DrawIndexed(6, 0, 0);
+        drawCount_++;
+    }
+    else {
+        pDeviceContext_->VSSetConstantBuffers(0, 1, &pPlanesWorldMatrixBuffer_[1]);
+        pDeviceContext_->PSSetConstantBuffers(0, 1, &pPlanesWorldMatrixBuffer_[1]);
+        pDeviceContext_->DrawIndexed(6, 0, 0);
+        drawCount_++;
+
+        pDeviceContext_->VSSetConstantBuffers(0, 1, &pPlanesWorldMatrixBuffer_[0]);
+        pDeviceContext_->PSSetConstantBuffers(0, 1, &pPlanesWorldMatrixBuffer_[0]);
+        pDeviceContext_->DrawIndexed(6, 0, 0);
+        drawCount_++;
+    }
+    EndStage(ProfileStageTransparent);
+}
+
+void Renderer::RenderImGui() {
+    BeginStage(ProfileStageImGui);
+    BindTargets(sceneColor_, -1);
+    ImDrawData* drawData = ImGui::GetDrawData();
+    ImGui_ImplDX11_RenderDrawData(drawData);
+    for (int i = 0; i < drawData->CmdListsCount; i++) {
+        drawCount_ += drawData->CmdLists[i]->CmdBuffer.Size;
+    }
+    EndStage(ProfileStageImGui);
+}
+
+void Renderer::RenderPostPass(size_t index) {
+    if (index == 0) {
+        BeginStage(ProfileStagePostEffect);
+    }
+    D3D11RenderTarget input = frameBackend_.GetTarget(frameGraph_, postResources_[index]);
+    D3D11RenderTarget output = frameBackend_.GetTarget(frameGraph_, postResources_[index + 1]);
+    HRESULT result = postProcess_.RenderPass(pDeviceContext_, postPasses_[index], input.pShaderResourceView,
+        output.pRenderTargetView, width_, height_, drawCount_);
+    if (FAILED(result)) {
+        OutputDebugStringA("Post process pass failed\n");
+    }
+    if (index + 1 == postPasses_.size()) {
+        EndStage(ProfileStagePostEffect);
+    }
+}
+
+void Renderer::InputHandler(int steps) {
+    InputFrame frame;
+    if (replayer_.IsOpen()) {
+        if (replayer_.GetFrameIndex() == 0) {
+            QueryPerformanceCounter(&replayStart_);
+        }
+        if (!replayer_.Read(frame)) {
+            FinishReplay();
+            return;
+        }
+    }
+    else if (pInput_ != NULL) {
+        frame = pInput_->ReadFrame();
+        recorder_.Write(frame);
+    }
+
+    CameraInput input = TranslateInput(frame);
+    // Mouse deltas accumulate between polls, so they are applied once per frame
+    pCamera_->Rotate(input.dphi, input.dtheta);
+    pCamera_->Zoom(input.dr);
+    // Held keys move the camera by a fixed distance per simulation step
+    for (int i = 0; i < steps; i++) {
+        pCamera_->Move(input.di, input.dj, input.dz);
+    }
+}
+
+void Renderer::SimulateStep(float step) {
+    StepAnimation(cubeAnimation_, step);
+}
+
+bool Renderer::StartRecording(const std::string& fileName) {
+    InputRecordHeader header;
+    header.seed = sceneSeed_;
+    header.timeStep = 1.0f / 60.0f;
+    if (!recorder_.Open(fileName, header)) {
+        return false;
+    }
+
+    fixedTimeStep_ = header.timeStep;
+    simulationTimer_.Reset(fixedTimeStep_);
+    return true;
+}
+
+bool Renderer::StartReplay(const std::string& fileName) {
+    if (!replayer_.Open(fileName)) {
+        return false;
+    }
+
+    sceneSeed_ = replayer_.GetHeader().seed;
+    fixedTimeStep_ = replayer_.GetHeader().timeStep;
+    simulationTimer_.Reset(fixedTimeStep_);
+    return true;
+}
 
-    pDeviceContext_->IASetInputLayout(nullptr);
-    pDeviceContext_->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+bool Renderer::LoadScene(const std::string& fileName) {
+    return sceneFile_.Open(fileName);
+}
 
-    pDeviceContext_->VSSetShader(pPostEffectVertexShader_, nullptr, 0);
-    pDeviceContext_->PSSetShader(pPostEffectPixelShader_, nullptr, 0);
-    pDeviceContext_->PSSetConstantBuffers(0, 1, &pPostEffectConstantBuffer_);
-    pDeviceContext_->PSSetShaderResources(0, 1, &pShaderResourceView_);
-    pDeviceContext_->PSSetSamplers(0, 1, &pPostEffectSamplerState_);
+bool Renderer::LoadWorld(const std::string& directory) {
+    if (!worldIndex_.Load(directory)) {
+        return false;
+    }
 
-    pDeviceContext_->Draw(3, 0);
+    pWorldReader_ = new FileCellReader(worldIndex_);
+    pWorldStreamer_ = new CellStreamer(worldIndex_, *pWorldReader_, WorldMemoryBudget, 4);
+    return true;
+}
 
-    ID3D11ShaderResourceView* nullsrv[] = { nullptr };
-    pDeviceContext_->PSSetShaderResources(0, 1, nullsrv);
+void Renderer::StreamWorld() {
+    XMFLOAT3 camera = pCamera_->GetPosition();
+    pWorldStreamer_->Update(&camera.x, WorldLoadRadius);
+    pWorldStreamer_->CollectVisible(&camera.x, WorldLoadRadius, [this](const float* min, const float* max) {
+        return pFrustum_->CheckRectangle(max[0], max[1], max[2], min[0], min[1], min[2]);
+    }, visibleCells_);
+
+    // Cells come nearest first, instance culling then runs on the slots as usual
+    int count = 0;
+    for (uint32_t cell : visibleCells_) {
+        const SceneFile* pScene = pWorldStreamer_->GetCell(cell);
+        const SceneInstances& instances = pScene->GetInstances();
+        for (uint32_t i = 0; i < instances.count && count < MAX_CUBE; i++, count++) {
+            const SceneMaterial& material = pScene->GetMaterials()[instances.material[i]];
+            Cube& cube = cubes_[count];
+            cube.pos = XMFLOAT4(instances.x[i], instances.y[i], instances.z[i], 1.0f);
+            cube.shineSpeedIdNM = XMFLOAT4(material.shininess, instances.speed[i], (float)(material.textureIndex % MaterialTextureCount),
+                material.normalMap != 0 ? 1.0f : 0.0f);
+            cubeAnimation_.speed[count] = instances.speed[i];
+            geomBufferInst_[count] = PackCube(cube, 0.0f);
+
+            XMFLOAT4X4 local;
+            XMStoreFloat4x4(&local, XMMatrixTranslation(cube.pos.x, cube.pos.y, cube.pos.z));
+            sceneHierarchy_.SetLocal(cube.node, &local._11);
+        }
+    }
+    cubesCount_ = count;
 }
 
-void Renderer::InputHandler() {
-    XMFLOAT3 mouse = pInput_->ReadMouse();
-    pCamera_->Rotate(mouse.x / 200.0f, mouse.y / 200.0f);
-    pCamera_->Zoom(-mouse.z / 100.0f);
+void Renderer::Pick(int x, int y) {
+    if (ImGui::GetCurrentContext() != NULL && ImGui::GetIO().WantCaptureMouse) {
+        return;
+    }
 
-    unsigned char* keyboard = pInput_->ReadKeyboard();
-    if (nullptr == keyboard)
+    // Depth is reversed, the near plane is at z = 1
+    XMMATRIX inverse = XMMatrixInverse(nullptr, viewProjectionMatrix_);
+    float ndcX = 2.0f * (x + 0.5f) / width_ - 1.0f;
+    float ndcY = 1.0f - 2.0f * (y + 0.5f) / height_;
+    XMVECTOR nearPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 1.0f, 1.0f), inverse);
+    XMVECTOR farPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 0.0f, 1.0f), inverse);
+    XMFLOAT3 origin, direction;
+    XMStoreFloat3(&origin, nearPoint);
+    XMStoreFloat3(&direction, XMVector3Normalize(XMVectorSubtract(farPoint, nearPoint)));
+    PickRay ray = { { origin.x, origin.y, origin.z }, { direction.x, direction.y, direction.z } };
+
+    float bounds[MAX_CUBE * 6];
+    ComputeInstanceBounds(&worldMatrices_[0]._11, cubesCount_, CubeBoxMin, CubeBoxMax, bounds);
+    pickBvh_.Build(bounds, cubesCount_);
+
+    PickHit hit;
+    selectedCube_ = pickBvh_.Pick(ray, &worldMatrices_[0]._11, CubeBoxMin, CubeBoxMax, hit) ? (int)hit.instance : -1;
+    selectedDistance_ = hit.distance;
+}
+
+void Renderer::FinishReplay() {
+    LARGE_INTEGER end, frequency;
+    QueryPerformanceCounter(&end);
+    QueryPerformanceFrequency(&frequency);
+
+    UINT frames = replayer_.GetFrameIndex();
+    double seconds = (end.QuadPart - replayStart_.QuadPart) / (double)frequency.QuadPart;
+    // The camera position shows whether two replays of one recording ended in the same state
+    XMFLOAT3 camera = pCamera_->GetPosition();
+    replayResult_ = "Replay finished: " + std::to_string(frames) + " frames, " +
+        std::to_string(frames > 0 ? seconds * 1000.0 / frames : 0.0) + " ms per frame, camera " +
+        std::to_string(camera.x) + " " + std::to_string(camera.y) + " " + std::to_string(camera.z) + "\n";
+    OutputDebugStringA(replayResult_.c_str());
+
+    replayer_.Close();
+    PostQuitMessage(0);
+}
+
+bool Renderer::StartBenchmark(const std::string& pathFile, const std::string& pathName) {
+    if (!benchmarkPath_.Load(pathFile, pathName)) {
+        return false;
+    }
+
+    // Culling is measured on the full instance set
+    cubesCount_ = MAX_CUBE;
+    fixedTimeStep_ = 1.0f / 60.0f;
+    simulationTimer_.Reset(fixedTimeStep_);
+    benchmarkLog_.Clear();
+    benchmarkLog_.Reserve((size_t)(benchmarkPath_.GetDuration() / fixedTimeStep_) + 2);
+    lastFrameStart_.QuadPart = 0;
+    return true;
+}
+
+void Renderer::RecordBenchmarkFrame() {
+    if (benchmarkPath_.IsEmpty()) {
         return;
-    float di = 0.0, dj = 0.0, dz = 0.0;
-
-    if (keyboard[DIK_UP] || keyboard[DIK_W])
-        dj += 0.05f;
-    if (keyboard[DIK_DOWN] || keyboard[DIK_S])
-        dj -= 0.05f;
-    if (keyboard[DIK_LEFT] || keyboard[DIK_A])
-        di += 0.05f;
-    if (keyboard[DIK_RIGHT] || keyboard[DIK_D])
-        di -= 0.05f;
-    if (keyboard[DIK_LCONTROL])
-        dz -= 0.05f;
-    if (keyboard[DIK_LSHIFT])
-        dz += 0.05f;
-
-    pCamera_->Move(di, dj, dz);
+    }
+
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+
+    BenchmarkFrame frame;
+    frame.frame = (uint32_t)benchmarkLog_.GetFrameCount();
+    frame.time = (float)simulationTimer_.GetTime();
+    frame.cpuMs = (now.QuadPart - frameStart_.QuadPart) * 1000.0 / frequency.QuadPart;
+    frame.frameMs = lastFrameStart_.QuadPart != 0 ? (frameStart_.QuadPart - lastFrameStart_.QuadPart) * 1000.0 / frequency.QuadPart : 0.0;
+    frame.visible = (uint32_t)cubeIndexies_.size();
+    frame.draws = drawCount_;
+    frame.recordMs = commandRecorder_.GetRecordMs();
+    frame.executeMs = commandRecorder_.GetExecuteMs();
+    frame.contexts = commandContexts_.IsDeferred() ? (uint32_t)commandRecorder_.GetRangeCount() : 0;
+    benchmarkLog_.AddFrame(frame);
+
+    lastFrameStart_ = frameStart_;
 }
 
-bool Renderer::UpdateScene() {
-    HRESULT result;
+void Renderer::FinishBenchmark() {
+    std::string fileName = "benchmark_" + benchmarkPath_.GetName() + ".csv";
+    bool saved = benchmarkLog_.SaveCSV(fileName);
+
+    std::string str = "Benchmark " + benchmarkPath_.GetName() + ": " + std::to_string(benchmarkLog_.GetFrameCount()) +
+        " frames" + (saved ? ", written to " + fileName : ", failed to write " + fileName) + "\n";
+    OutputDebugStringA(str.c_str());
 
+    benchmarkPath_ = CameraPath();
+    PostQuitMessage(0);
+}
+
+void Renderer::UpdateUI() {
     ImGui_ImplDX11_NewFrame();
     ImGui_ImplWin32_NewFrame();
     ImGui::NewFrame();
 
     static bool window = true;
     static bool window2 = true;
+    static bool window3 = true;
+    static bool window4 = true;
 
     if (window) {
         ImGui::Begin("Lights", &window);
 
         ImGui::Checkbox("Use normal maps", &useNormalMap_);
         ImGui::Checkbox("Show normals", &showNormals_);
-        if (ImGui::Checkbox("Post effect", &withPostEffect_)) {
-            PostEffectConstantBuffer postEffectConstantBuffer;
-            postEffectConstantBuffer.params = XMINT4(withPostEffect_, 0, 0, 0);
-            pDeviceContext_->UpdateSubresource(pPostEffectConstantBuffer_, 0, nullptr, &postEffectConstantBuffer, 0, 0);
+        if (ImGui::CollapsingHeader("Post effects")) {
+            std::vector<PostEffectStage>& stages = postChain_.GetStages();
+            for (size_t i = 0; i < stages.size(); i++) {
+                PostEffectStage& stage = stages[i];
+                ImGui::PushID((int)i);
+                ImGui::Checkbox(GetPostEffectName(stage.type), &stage.enabled);
+                switch (stage.type) {
+                case PostEffectType::ToneMap:
+                    ImGui::SliderFloat("Exposure", &stage.params[0], 0.1f, 4.0f);
+                    break;
+                case PostEffectType::ColorGrade:
+                    ImGui::SliderFloat("Contrast", &stage.params[0], 0.0f, 2.0f);
+                    ImGui::SliderFloat("Saturation", &stage.params[1], 0.0f, 2.0f);
+                    ImGui::SliderFloat("Brightness", &stage.params[2], -0.5f, 0.5f);
+                    break;
+                case PostEffectType::Blur:
+                    ImGui::SliderFloat("Step", &stage.params[0], 1.0f, 4.0f);
+                    break;
+                case PostEffectType::Vignette:
+                    ImGui::SliderFloat("Strength", &stage.params[0], 0.0f, 2.0f);
+                    break;
+                default:
+                    break;
+                }
+                ImGui::PopID();
+            }
+            ImGui::Text("Passes: %d, shaders: %d", (int)postChain_.Plan().size(), (int)postProcess_.GetShaderCount());
+        }
+        int format = (int)intermediateOverride_;
+        if (ImGui::Combo("Intermediate", &format, "Auto\0RGBA32F\0RGBA16F\0R11G11B10F\0RGBA8\0")) {
+            intermediateOverride_ = (IntermediateFormat)format;
         }
 
+        // Scene edits are not part of a recording, they would make the replay differ
+        bool sceneLocked = recorder_.IsOpen() || replayer_.IsOpen();
+        if (sceneLocked) {
+            ImGui::Text("Recording or replaying, scene edits are off");
+        }
+        ImGui::BeginDisabled(sceneLocked);
         if (ImGui::Button("+")) {
             if (lights_.size() < MAX_LIGHT)
                 lights_.push_back({ XMFLOAT4((float)(rand() % 12 - 6), (float)(rand() % 12 - 6), (float)(rand() % 12 - 6), 0.0f),
@@ -750,12 +1243,15 @@ bool Renderer::UpdateScene() {
             ImGui::ColorEdit3(str.c_str(), col[i]);
             lights_[i].color = XMFLOAT4(col[i][0], col[i][1], col[i][2], 1.0f);
         }
+        ImGui::EndDisabled();
 
         ImGui::End();
     }
     if (window2) {
         ImGui::Begin("Instances", &window2);
 
+        bool sceneLocked = recorder_.IsOpen() || replayer_.IsOpen();
+        ImGui::BeginDisabled(sceneLocked);
         if (ImGui::Button("+")) {
             if (cubesCount_ < MAX_CUBE) {
                 ++cubesCount_;
@@ -767,79 +1263,287 @@ bool Renderer::UpdateScene() {
                 --cubesCount_;
             }
         }
+        ImGui::EndDisabled();
 
         std::string str = "Count: " + std::to_string(cubesCount_);
         ImGui::Text(str.c_str());
         str = "Rendered: " + std::to_string(cubeIndexies_.size());
         ImGui::Text(str.c_str());
+        ImGui::Text("Instance data: %d bytes, %d with matrices", (int)(sizeof(PackedInstance) * cubesCount_),
+            (int)((2 * sizeof(XMMATRIX) + sizeof(XMFLOAT4)) * cubesCount_));
+        if (pWorldStreamer_ != NULL) {
+            CellStreamerStats stats = pWorldStreamer_->GetStats();
+            ImGui::Text("World: %d/%d cells resident, %d loading, %d visible", (int)stats.residentCells,
+                (int)worldIndex_.GetCells().size(), (int)stats.loadingCells, (int)visibleCells_.size());
+            ImGui::Text("World memory: %.1f of %.0f MB", (stats.residentBytes + stats.loadingBytes) / (1024.0 * 1024.0),
+                WorldMemoryBudget / (1024.0 * 1024.0));
+        }
+        TextureCacheStats textureStats = textureCache_.GetStats();
+        ImGui::Text("Textures: %d resident, %.2f MB, color from mip %d, %d streaming", (int)textureStats.resident,
+            textureStats.residentBytes / (1024.0 * 1024.0), (int)textureCache_.GetFirstMip(colorTexture_), (int)textureStats.pending);
+        ImGui::Text("Shader variants: %d", (int)shaderPermutations_.GetVariantCount());
+        ImGui::Text("Material textures: %d in %d slices of %dx%d, %.0f%% used", (int)textureLayout_.rects.size(),
+            (int)textureLayout_.page.arraySize, (int)textureLayout_.page.width, (int)textureLayout_.page.height,
+            GetTexturePackEfficiency(textureLayout_) * 100.0);
+        if (ImGui::SliderFloat("Texture budget, MB", &textureBudgetMb_, 0.25f, 64.0f)) {
+            textureCache_.SetBudget((uint64_t)(textureBudgetMb_ * 1024.0 * 1024.0));
+        }
+        ImGui::BeginDisabled(sceneLocked);
+        if (ImGui::DragFloat3("Scene offset", &sceneOffset_.x, 0.05f)) {
+            XMFLOAT4X4 local;
+            XMStoreFloat4x4(&local, XMMatrixTranslation(sceneOffset_.x, sceneOffset_.y, sceneOffset_.z));
+            sceneHierarchy_.SetLocal(sceneNode_, &local._11);
+        }
+        ImGui::EndDisabled();
+        if (selectedCube_ >= 0 && selectedCube_ < cubesCount_) {
+            ImGui::Text("Selected: cube %d at %.2f", selectedCube_, selectedDistance_);
+        }
+        else {
+            ImGui::Text("Selected: none, click a cube");
+        }
         ImGui::Checkbox("Culling", &withCulling_);
+        if (commandContexts_.HasDriverCommandLists()) {
+            ImGui::Checkbox("Deferred contexts", &deferredRecording_);
+        }
+        else {
+            ImGui::Text("No driver command lists, immediate context");
+        }
+        ImGui::SliderInt("Draws per context", &drawsPerContext_, 1, 1024, "%d", ImGuiSliderFlags_Logarithmic);
+        ImGui::Text("Ranges: %d on the %s context, record %.3f ms, execute %.3f ms", (int)commandRecorder_.GetRangeCount(),
+            commandContexts_.IsDeferred() ? "deferred" : "immediate", commandRecorder_.GetRecordMs(), commandRecorder_.GetExecuteMs());
+        if (ImGui::Button("Capture reference")) {
+            CaptureFrame("reference.bmp");
+        }
+
+        ImGui::End();
+    }
+    if (window3) {
+        ImGui::Begin("Frame pacing", &window3);
+
+        int mode = (int)pacingMode_;
+        bool changed = ImGui::Combo("Mode", &mode, "Unlimited\0VSync\0Target FPS\0");
+        changed |= ImGui::SliderFloat("Target FPS", &targetFps_, 15.0f, 240.0f, "%.0f");
+        if (changed) {
+            SetPacing((PacingMode)mode, targetFps_);
+        }
+        if (ImGui::SliderInt("Frames in flight", &maxFramesInFlight_, 1, 3)) {
+            ApplyFrameLatency();
+        }
+
+        FrameStats stats = framePacer_.GetStats();
+        ImGui::Text("Frame: %.2f ms (%.2f - %.2f)", stats.averageMs, stats.minMs, stats.maxMs);
+        ImGui::Text("Deviation: %.2f ms", stats.deviationMs);
+        ImGui::Text("Input to present: %.2f ms", stats.latencyMs);
+
+        ImGui::End();
+    }
+    if (window4) {
+        ImGui::Begin("Profiler", &window4);
+
+        ImGui::Text("%-12s %8s %8s", "Stage", "CPU ms", "GPU ms");
+        double cpuTotal = 0.0, gpuTotal = 0.0;
+        for (int i = 0; i < ProfileStageCount; i++) {
+            ImGui::Text("%-12s %8.3f %8.3f", ProfileStageNames[i], stageCpuMs_[i], stageGpuMs_[i]);
+            cpuTotal += stageCpuMs_[i];
+            gpuTotal += stageGpuMs_[i];
+        }
+        ImGui::Text("%-12s %8.3f %8.3f", "Total", cpuTotal, gpuTotal);
+
+        if (GetPostEffectNeeds().active) {
+            // One full-screen write and read per pass except the last one, which writes the back buffer
+            double traffic = postPasses_.size() * GetIntermediateTraffic(renderTextureFormat_, width_, height_) / (1024.0 * 1024.0);
+            double baseline = postPasses_.size() * GetIntermediateTraffic(IntermediateFormat::RGBA32F, width_, height_) / (1024.0 * 1024.0);
+            ImGui::Text("Intermediate: %s, %d passes", GetFormatName(renderTextureFormat_), (int)postPasses_.size());
+            ImGui::Text("Traffic: %.1f MB/frame, saved %.1f MB vs RGBA32F", traffic, baseline - traffic);
+        }
+        else {
+            double baseline = GetIntermediateTraffic(IntermediateFormat::RGBA32F, width_, height_) / (1024.0 * 1024.0);
+            ImGui::Text("Post pass skipped, saved %.1f MB/frame", baseline);
+        }
+        ImGui::Text("Graph: %d passes, %d culled, %d transient -> %d targets", frameGraph_.GetPassCount(),
+            frameGraph_.GetCulledCount(), frameGraph_.GetTransientCount(), frameGraph_.GetPhysicalCount());
+        RenderTargetPoolStats poolStats = targetPool_.GetStats();
+        ImGui::Text("Targets: %u, allocations: %llu, evictions: %llu", poolStats.entries,
+            (unsigned long long)poolStats.allocations, (unsigned long long)poolStats.evictions);
+        if (pGpuProfiler_ != NULL) {
+            ImGui::Text("GPU latency: %d frames, skipped: %d, disjoint: %d", (int)pGpuProfiler_->GetLatency(),
+                (int)pGpuProfiler_->GetDroppedFrames(), (int)pGpuProfiler_->GetDisjointFrames());
+        }
+        else {
+            ImGui::Text("GPU timestamps unavailable");
+        }
 
         ImGui::End();
     }
+}
+
+bool Renderer::UpdateScene() {
+    HRESULT result = S_OK;
+
+    drawCount_ = 0;
+    if (!benchmarkPath_.IsEmpty()) {
+        QueryPerformanceCounter(&frameStart_);
+    }
+
+    if (pDeviceContext_ != NULL) {
+        UpdateUI();
+    }
 
-    InputHandler();
+    double elapsed = 0.0;
+    if (fixedTimeStep_ > 0.0f) {
+        // Recorded, replayed and benchmark runs take exactly one step per frame
+        elapsed = fixedTimeStep_;
+    }
+    else {
+        LARGE_INTEGER timeCur, frequency;
+        QueryPerformanceCounter(&timeCur);
+        QueryPerformanceFrequency(&frequency);
+        if (lastFrameTime_.QuadPart != 0) {
+            elapsed = (timeCur.QuadPart - lastFrameTime_.QuadPart) / (double)frequency.QuadPart;
+        }
+        lastFrameTime_ = timeCur;
+    }
+
+    int steps = simulationTimer_.Advance(elapsed);
+    for (int i = 0; i < steps; i++) {
+        SimulateStep((float)simulationTimer_.GetStep());
+    }
+    float t = (float)simulationTimer_.GetTime();
+    float alpha = (float)simulationTimer_.GetAlpha();
+
+    framePacer_.MarkInput();
+    if (!benchmarkPath_.IsEmpty()) {
+        XMFLOAT3 position;
+        XMFLOAT4 orientation;
+        benchmarkPath_.Evaluate(t, position, orientation);
+        pCamera_->SetPose(position, orientation);
+        if (t >= benchmarkPath_.GetDuration()) {
+            FinishBenchmark();
+        }
+    }
+    else {
+        InputHandler(steps);
+    }
 
     XMMATRIX mView = pCamera_->GetViewMatrix();
 
     XMMATRIX mProjection = XMMatrixPerspectiveFovLH(XM_PI / 3, width_ / (FLOAT)height_, SCREEN_FAR, SCREEN_NEAR);
 
-    static float t = 0.0f;
-    static ULONGLONG timeStart = 0;
-    ULONGLONG timeCur = GetTickCount64();
-    if (timeStart == 0) {
-        timeStart = timeCur;
+    pFrustum_->ConstructFrustum(mView, mProjection);
+    if (pWorldStreamer_ != NULL) {
+        StreamWorld();
     }
-    t = (timeCur - timeStart) / 1000.0f;
 
-    GeomBuffer geomBufferInst[MAX_CUBE];
+    // Cube nodes only translate, the spin is applied on top of the node position by the kernel
+    sceneHierarchy_.Update();
     for (int i = 0; i < cubesCount_; i++) {
-        geomBufferInst[i].worldMatrix = XMMatrixRotationY(cubes_[i].pos.w * t * cubes_[i].shineSpeedIdNM.y) * XMMatrixTranslation(cubes_[i].pos.x, cubes_[i].pos.y, cubes_[i].pos.z);
-        geomBufferInst[i].norm = geomBufferInst[i].worldMatrix;
-        geomBufferInst[i].shineSpeedTexIdNM = cubes_[i].shineSpeedIdNM;
+        const float* world = sceneHierarchy_.GetWorld(cubes_[i].node);
+        cubeAnimation_.x[i] = world[12];
+        cubeAnimation_.y[i] = world[13];
+        cubeAnimation_.z[i] = world[14];
     }
+    AnimateInstances(cubeAnimation_, 0, cubesCount_, alpha, &worldMatrices_[0]._11, geomBufferInst_);
 
-    pDeviceContext_->UpdateSubresource(pGeomBufferInst_, 0, nullptr, &geomBufferInst, 0, 0);
-
-    pFrustum_->ConstructFrustum(mView, mProjection);
     cubeIndexies_.clear();
     for (int i = 0; i < cubesCount_; i++) {
         XMFLOAT4 min, max;
-        XMStoreFloat4(&min, XMVector4Transform(XMLoadFloat4(&AABB[0]), geomBufferInst[i].worldMatrix));
-        XMStoreFloat4(&max, XMVector4Transform(XMLoadFloat4(&AABB[1]), geomBufferInst[i].worldMatrix));
+        XMStoreFloat4(&min, XMVector4Transform(XMLoadFloat4(&AABB[0]), XMLoadFloat4x4(&worldMatrices_[i])));
+        XMStoreFloat4(&max, XMVector4Transform(XMLoadFloat4(&AABB[1]), XMLoadFloat4x4(&worldMatrices_[i])));
         if (!withCulling_ || pFrustum_->CheckRectangle(max.x, max.y, max.z, min.x, min.y, min.z)) {
             cubeIndexies_.push_back(i);
         }
     }
 
-    XMFLOAT3 cameraPos = pCamera_->GetPosition();
-    D3D11_MAPPED_SUBRESOURCE subresource;
-    result = pDeviceContext_->Map(pViewMatrixBuffer_[0], 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
-    if (SUCCEEDED(result)) {
-        SceneBuffer& sceneBuffer = *reinterpret_cast<SceneBuffer*>(subresource.pData);
-        sceneBuffer.viewProjectionMatrix = XMMatrixMultiply(mView, mProjection);
-        for (int i = 0; i < cubeIndexies_.size(); i++) {
-            sceneBuffer.indexBuffer[i] = XMINT4(cubeIndexies_[i], 0, 0, 0);
+    // Pixel shader variant of every visible cube; sorted by it, cubes with the same variant
+    // are drawn together. New variants are compiled before the frame is drawn
+    cubeShaderKeys_.resize(cubesCount_);
+    if (opaqueShader_ >= 0) {
+        uint32_t sceneFeatures = showNormals_ ? ShaderFeatureShowNormals : 0;
+        for (int index : cubeIndexies_) {
+            bool normalMap = useNormalMap_ && cubes_[index].shineSpeedIdNM.w > 0.0f;
+            cubeShaderKeys_[index] = shaderPermutations_.MakeKey(opaqueShader_, sceneFeatures | (normalMap ? ShaderFeatureNormalMap : 0));
+            shaderPermutations_.Request(cubeShaderKeys_[index]);
         }
-        pDeviceContext_->Unmap(pViewMatrixBuffer_[0], 0);
-    }
-    result = pDeviceContext_->Map(pLightBuffer_, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
-    if (SUCCEEDED(result)) {
-        LightBuffer& lightBuffer = *reinterpret_cast<LightBuffer*>(subresource.pData);
-        lightBuffer.cameraPos = XMFLOAT4(cameraPos.x, cameraPos.y, cameraPos.z, 1.0f);
-        lightBuffer.ambientColor = XMFLOAT4(0.9f, 0.9f, 0.9f, 1.0f);
-        lightBuffer.lightParams = XMINT4(int(lights_.size()), (int)useNormalMap_, (int)showNormals_, 0);
-        for (int i = 0; i < lights_.size(); i++) {
-            lightBuffer.lights[i].pos = lights_[i].pos;
-            lightBuffer.lights[i].color = lights_[i].color;
+        std::stable_sort(cubeIndexies_.begin(), cubeIndexies_.end(), [this](int a, int b) {
+            return cubeShaderKeys_[a] < cubeShaderKeys_[b];
+        });
+        transparentKey_ = shaderPermutations_.MakeKey(transparentShader_, sceneFeatures | ShaderFeatureLights);
+        shaderPermutations_.Request(transparentKey_);
+        if (shaderPermutations_.GetPendingCount() > 0 && !shaderPermutations_.Compile()) {
+            OutputDebugStringA("Shader variant compilation failed\n");
         }
-        pDeviceContext_->Unmap(pLightBuffer_, 0);
     }
 
-    if (SUCCEEDED(result)) {
-        skybox_->update(pDeviceContext_, pCamera_, mProjection);
+    // Textures are requested for what is visible this frame, the rest ages out of the cache.
+    // Each visible cube asks for the mip its material needs at its size on screen, a face
+    // maps the texture once across the cube's edge
+    textureCache_.BeginFrame();
+    XMFLOAT3 eye = pCamera_->GetPosition();
+    uint32_t colorMip = textureLayout_.page.mipCount, normalMip = normalInfo_.mipCount;
+    bool normalMapVisible = false;
+    for (int index : cubeIndexies_) {
+        const XMFLOAT4X4& world = worldMatrices_[index];
+        float edge = 2.0f * sqrtf(world._11 * world._11 + world._12 * world._12 + world._13 * world._13);
+        XMFLOAT3 offset(world._41 - eye.x, world._42 - eye.y, world._43 - eye.z);
+        float distance = sqrtf(offset.x * offset.x + offset.y * offset.y + offset.z * offset.z);
+        float pixels = GetProjectedSize(edge, distance, XM_PI / 3, (float)height_);
+
+        int material = (int)cubes_[index].shineSpeedIdNM.z;
+        if (material >= 0 && material < (int)textureLayout_.rects.size()) {
+            const TexturePackRect& rect = textureLayout_.rects[material];
+            uint32_t mip = SelectRequiredMip(rect.width > rect.height ? rect.width : rect.height, pixels, textureLayout_.page.mipCount);
+            colorMip = mip < colorMip ? mip : colorMip;
+        }
+        if (cubes_[index].shineSpeedIdNM.w > 0.0f) {
+            normalMapVisible = true;
+            uint32_t mip = SelectRequiredMip(normalInfo_.width, pixels, normalInfo_.mipCount);
+            normalMip = mip < normalMip ? mip : normalMip;
+        }
+    }
+    // The software path and a failed load leave the ids at -1
+    if (colorTexture_ >= 0 && !cubeIndexies_.empty()) {
+        textureCache_.Request(colorTexture_, colorMip);
     }
+    if (normalTexture_ >= 0 && useNormalMap_ && normalMapVisible) {
+        textureCache_.Request(normalTexture_, normalMip);
+    }
+    textureCache_.Stream();
+
+    viewProjectionMatrix_ = XMMatrixMultiply(mView, mProjection);
+    XMFLOAT3 cameraPos = pCamera_->GetPosition();
+
+    if (pDeviceContext_ != NULL) {
+        pDeviceContext_->UpdateSubresource(pGeomBufferInst_, 0, nullptr, &geomBufferInst_, 0, 0);
+
+        D3D11_MAPPED_SUBRESOURCE subresource;
+        result = pDeviceContext_->Map(pViewMatrixBuffer_[0], 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
+        if (SUCCEEDED(result)) {
+            SceneBuffer& sceneBuffer = *reinterpret_cast<SceneBuffer*>(subresource.pData);
+            sceneBuffer.viewProjectionMatrix = viewProjectionMatrix_;
+            for (int i = 0; i < cubeIndexies_.size(); i++) {
+                sceneBuffer.indexBuffer[i] = XMINT4(cubeIndexies_[i], 0, 0, 0);
+            }
+            pDeviceContext_->Unmap(pViewMatrixBuffer_[0], 0);
+        }
+        result = pDeviceContext_->Map(pLightBuffer_, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
+        if (SUCCEEDED(result)) {
+            LightBuffer& lightBuffer = *reinterpret_cast<LightBuffer*>(subresource.pData);
+            lightBuffer.cameraPos = XMFLOAT4(cameraPos.x, cameraPos.y, cameraPos.z, 1.0f);
+            lightBuffer.ambientColor = XMFLOAT4(0.9f, 0.9f, 0.9f, 1.0f);
+            lightBuffer.lightParams = XMINT4(int(lights_.size()), 0, 0, 0);
+            for (int i = 0; i < lights_.size(); i++) {
+                lightBuffer.lights[i].pos = lights_[i].pos;
+                lightBuffer.lights[i].color = lights_[i].color;
+            }
+            pDeviceContext_->Unmap(pLightBuffer_, 0);
+        }
 
-    ImGui::Render();
+        if (SUCCEEDED(result)) {
+            skybox_->update(pDeviceContext_, pCamera_, mProjection);
+        }
+
+        ImGui::Render();
+    }
 
     XMFLOAT4 rectVert[4];
     float maxDist = -D3D11_FLOAT32_MAX;
@@ -869,10 +1573,90 @@ bool Renderer::UpdateScene() {
     return SUCCEEDED(result);
 }
 
+void Renderer::ApplyFrameLatency() {
+    if (pSwapChain2_ != NULL) {
+        pSwapChain2_->SetMaximumFrameLatency(maxFramesInFlight_);
+        return;
+    }
+
+    IDXGIDevice1* pDXGIDevice = NULL;
+    if (SUCCEEDED(pDevice_->QueryInterface(__uuidof(IDXGIDevice1), (void**)&pDXGIDevice))) {
+        pDXGIDevice->SetMaximumFrameLatency(maxFramesInFlight_);
+        SAFE_RELEASE(pDXGIDevice);
+    }
+}
+
+void Renderer::SetPacing(PacingMode mode, double fps) {
+    pacingMode_ = mode;
+    if (fps > 0.0) {
+        targetFps_ = (float)fps;
+    }
+    framePacer_.SetTargetFps(pacingMode_ == PacingMode::TargetFps ? targetFps_ : 0.0);
+}
+
+void Renderer::BeginStage(ProfileStage stage) {
+    QueryPerformanceCounter(&stageStart_[stage]);
+    if (pGpuProfiler_ != NULL) {
+        pGpuProfiler_->BeginStage(stage);
+    }
+}
+
+void Renderer::EndStage(ProfileStage stage) {
+    if (pGpuProfiler_ != NULL) {
+        pGpuProfiler_->EndStage(stage);
+    }
+
+    LARGE_INTEGER end, frequency;
+    QueryPerformanceCounter(&end);
+    QueryPerformanceFrequency(&frequency);
+    double ms = (end.QuadPart - stageStart_[stage].QuadPart) * 1000.0 / frequency.QuadPart;
+    // Smoothed so the panel is readable
+    stageCpuMs_[stage] += (ms - stageCpuMs_[stage]) * 0.1;
+}
+
+void Renderer::UpdateGpuTimings() {
+    if (pGpuProfiler_ == NULL) {
+        return;
+    }
+
+    pGpuProfiler_->Collect();
+    if (pGpuProfiler_->HasResult()) {
+        for (int i = 0; i < ProfileStageCount; i++) {
+            stageGpuMs_[i] += (pGpuProfiler_->GetStageMs(i) - stageGpuMs_[i]) * 0.1;
+        }
+    }
+}
+
+void Renderer::WaitForFrame() {
+    // Blocks while maxFramesInFlight_ frames are still queued on the GPU
+    if (frameLatencyWaitable_ != NULL) {
+        WaitForSingleObjectEx(frameLatencyWaitable_, 1000, TRUE);
+    }
+    framePacer_.Wait();
+}
+
 bool Renderer::Render() {
+    WaitForFrame();
+    ApplyPendingResize();
+
+    if (pSoftwareRasterizer_ != NULL) {
+        return RenderSoftware();
+    }
+
     if (!UpdateScene())
         return false;
 
+    UpdateGpuTimings();
+    if (pGpuProfiler_ != NULL) {
+        pGpuProfiler_->BeginFrame();
+    }
+
+    // Same descriptors every frame, so the pool hands back the same textures until a resize
+    targetPool_.BeginFrame();
+    frameBackend_.BeginFrame(pDeviceContext_);
+    if (!BuildFrameGraph())
+        return false;
+
     pDeviceContext_->ClearState();
 
     D3D11_VIEWPORT viewport;
@@ -891,100 +1675,192 @@ bool Renderer::Render() {
     rect.bottom = height_;
     pDeviceContext_->RSSetScissorRects(1, &rect);
 
-    pDeviceContext_->OMSetRenderTargets(1, &pPostEffectRenderTargetView_, pDepthBufferDSV_);
-    static const FLOAT color[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
-    pDeviceContext_->ClearRenderTargetView(pPostEffectRenderTargetView_, color);
-    pDeviceContext_->ClearDepthStencilView(pDepthBufferDSV_, D3D11_CLEAR_DEPTH, 0.0f, 0);
+    if (!frameGraph_.Execute(frameBackend_))
+        return false;
+    if (postPasses_.empty()) {
+        stageCpuMs_[ProfileStagePostEffect] = 0.0;
+    }
 
-    pDeviceContext_->RSSetState(pRasterizerState_);
-    pDeviceContext_->OMSetDepthStencilState(pDepthState_[0], 0);
+    if (pGpuProfiler_ != NULL) {
+        pGpuProfiler_->EndFrame();
+    }
+    RecordBenchmarkFrame();
 
-    ID3D11ShaderResourceView* resources[] = { pTexture_[0], pTexture_[1] };
-    pDeviceContext_->PSSetShaderResources(0, 2, resources);
+    HRESULT result = pSwapChain_->Present(pacingMode_ == PacingMode::VSync ? 1 : 0, 0);
+    framePacer_.MarkPresent();
 
-    ID3D11SamplerState* samplers[] = { pSampler_ };
-    pDeviceContext_->PSSetSamplers(0, 1, samplers);
+    return SUCCEEDED(result);
+}
 
-    pDeviceContext_->IASetIndexBuffer(pIndexBuffer_[0], DXGI_FORMAT_R16_UINT, 0);
-    ID3D11Buffer* vertexBuffers[] = { pVertexBuffer_[0] };
-    UINT strides[] = { sizeof(Vertex) };
-    UINT offsets[] = { 0 };
-    pDeviceContext_->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
-    pDeviceContext_->IASetInputLayout(pInputLayout_[0]);
-    pDeviceContext_->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    pDeviceContext_->VSSetConstantBuffers(0, 1, &pGeomBufferInst_);
-    pDeviceContext_->VSSetConstantBuffers(1, 1, &pViewMatrixBuffer_[0]);
-    pDeviceContext_->VSSetConstantBuffers(2, 1, &pLightBuffer_);
-    pDeviceContext_->VSSetShader(pVertexShader_[0], nullptr, 0);
-    pDeviceContext_->PSSetShader(pPixelShader_[0], nullptr, 0);
-    pDeviceContext_->PSSetConstantBuffers(0, 1, &pGeomBufferInst_);
-    pDeviceContext_->PSSetConstantBuffers(1, 1, &pViewMatrixBuffer_[0]);
-    pDeviceContext_->PSSetConstantBuffers(2, 1, &pLightBuffer_);
-    pDeviceContext_->DrawIndexedInstanced(36, (UINT)cubeIndexies_.size(), 0, 0, 0);
+void Renderer::DrawSoftwareScene(SoftwareRasterizer& rasterizer) {
+    static_assert(sizeof(RasterVertex) == sizeof(Vertex), "RasterVertex must match Vertex");
+    static_assert(sizeof(RasterLight) == sizeof(Light), "RasterLight must match Light");
 
-    pDeviceContext_->OMSetDepthStencilState(pDepthState_[1], 0);
-    skybox_->draw(pDeviceContext_);
+    // The skybox is not part of the reference backend, the background stays at the clear color
+    static const float color[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    rasterizer.Clear(color, 0.0f);
+    rasterizer.SetViewProjection(ToRasterMatrix(viewProjectionMatrix_));
 
-    {
-        pDeviceContext_->IASetIndexBuffer(pIndexBuffer_[2], DXGI_FORMAT_R16_UINT, 0);
-        ID3D11Buffer* vertexBuffers[] = { pVertexBuffer_[2] };
-        UINT strides[] = { 12 };
-        UINT offsets[] = { 0 };
-        pDeviceContext_->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
-        pDeviceContext_->IASetInputLayout(pInputLayout_[2]);
+    XMFLOAT3 cameraPos = pCamera_->GetPosition();
+    RasterLighting lighting;
+    lighting.cameraPos = RasterFloat3(cameraPos.x, cameraPos.y, cameraPos.z);
+    lighting.ambientColor = RasterFloat3(0.9f, 0.9f, 0.9f);
+    lighting.lights = reinterpret_cast<const RasterLight*>(lights_.data());
+    lighting.lightCount = (int)lights_.size();
+    lighting.useNormalMap = useNormalMap_;
+    lighting.showNormals = showNormals_;
+    rasterizer.SetLighting(lighting);
+    rasterizer.SetTextures(&softwareColor_, &softwareNormal_);
+
+    RasterInstance instances[MAX_CUBE];
+    for (int i = 0; i < cubesCount_; i++) {
+        instances[i].worldMatrix = ToRasterMatrix(XMLoadFloat4x4(&worldMatrices_[i]));
+        const XMFLOAT4& shineSpeedIdNM = cubes_[i].shineSpeedIdNM;
+        instances[i].shineSpeedTexIdNM = RasterFloat4(shineSpeedIdNM.x, shineSpeedIdNM.y, shineSpeedIdNM.z, shineSpeedIdNM.w);
+    }
+    rasterizer.DrawIndexedInstanced(reinterpret_cast<const RasterVertex*>(CubeVertices), CubeIndices, 36,
+        instances, cubeIndexies_.data(), (int)cubeIndexies_.size());
+
+    const RasterFloat3* planeVertices = reinterpret_cast<const RasterFloat3*>(VerticesT);
+    int first = isFirst_ ? 0 : 1;
+    for (int plane : { first, 1 - first }) {
+        const XMFLOAT4& color = TransparentColors[plane];
+        rasterizer.DrawTransparent(planeVertices, PlaneIndices, 6, ToRasterMatrix(TransparentMatrixs[plane]),
+            RasterFloat4(color.x, color.y, color.z, color.w), true);
+    }
+    drawCount_ += 3;
 
-        pDeviceContext_->VSSetShader(pVertexShader_[2], nullptr, 0);
-        pDeviceContext_->PSSetShader(pPixelShader_[2], nullptr, 0);
-        pDeviceContext_->VSSetConstantBuffers(1, 1, &pViewMatrixBuffer_[0]);
+    postChain_.ApplyReference(reinterpret_cast<float*>(rasterizer.GetColorBuffer()), rasterizer.GetWidth(), rasterizer.GetHeight(),
+        rasterizer.GetStride());
+}
 
-        pDeviceContext_->OMSetBlendState(pBlendState_, nullptr, 0xFFFFFFFF);
+bool Renderer::RenderSoftware() {
+    if (!UpdateScene())
+        return false;
 
-        if (isFirst_) {
-            pDeviceContext_->VSSetConstantBuffers(0, 1, &pPlanesWorldMatrixBuffer_[0]);
-            pDeviceContext_->PSSetConstantBuffers(0, 1, &pPlanesWorldMatrixBuffer_[0]);
-            pDeviceContext_->DrawIndexed(6, 0, 0);
+    DrawSoftwareScene(*pSoftwareRasterizer_);
+    pSoftwareRasterizer_->ResolveBGRA8(softwarePixels_);
+    RecordBenchmarkFrame();
+
+    BITMAPINFO info = {};
+    info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    info.bmiHeader.biWidth = pSoftwareRasterizer_->GetWidth();
+    info.bmiHeader.biHeight = -pSoftwareRasterizer_->GetHeight();
+    info.bmiHeader.biPlanes = 1;
+    info.bmiHeader.biBitCount = 32;
+    info.bmiHeader.biCompression = BI_RGB;
+
+    HDC hdc = GetDC(hWnd_);
+    int lines = StretchDIBits(hdc, 0, 0, width_, height_, 0, 0, width_, height_,
+        softwarePixels_.data(), &info, DIB_RGB_COLORS, SRCCOPY);
+    ReleaseDC(hWnd_, hdc);
+    framePacer_.MarkPresent();
+
+    return lines != 0;
+}
 
-            pDeviceContext_->VSSetConstantBuffers(0, 1, &pPlanesWorldMatrixBuffer_[1]);
-            pDeviceContext_->PSSetConstantBuffers(0, 1, &pPlanesWorldMatrixBuffer_[1]);
-            pDeviceContext_->DrawIndexed(6, 0, 0);
-        }
-        else {
-            pDeviceContext_->VSSetConstantBuffers(0, 1, &pPlanesWorldMatrixBuffer_[1]);
-            pDeviceContext_->PSSetConstantBuffers(0, 1, &pPlanesWorldMatrixBuffer_[1]);
-            pDeviceContext_->DrawIndexed(6, 0, 0);
+bool Renderer::CaptureFrame(const char* fileName) {
+    if (pSoftwareRasterizer_ != NULL) {
+        return pSoftwareRasterizer_->SaveBMP(fileName);
+    }
 
-            pDeviceContext_->VSSetConstantBuffers(0, 1, &pPlanesWorldMatrixBuffer_[0]);
-            pDeviceContext_->PSSetConstantBuffers(0, 1, &pPlanesWorldMatrixBuffer_[0]);
-            pDeviceContext_->DrawIndexed(6, 0, 0);
-        }
+    SoftwareRasterizer rasterizer;
+    if (!rasterizer.Init(width_, height_)) {
+        return false;
     }
+    DrawSoftwareScene(rasterizer);
+    return rasterizer.SaveBMP(fileName);
+}
 
-    ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+bool Renderer::Capture(const std::string& fileName, int frames) {
+    if (!InitSoftware(NULL, NULL)) {
+        return false;
+    }
+    // The same frame count always gives the same image
+    if (fixedTimeStep_ <= 0.0f) {
+        fixedTimeStep_ = 1.0f / 60.0f;
+        simulationTimer_.Reset(fixedTimeStep_);
+    }
+    bool replaying = replayer_.IsOpen();
+    if (frames <= 0) {
+        frames = replaying ? INT_MAX : 60;
+    }
 
-    ID3D11RenderTargetView* views[] = { pRenderTargetView_ };
-    pDeviceContext_->OMSetRenderTargets(1, views, pDepthBufferDSV_);
+    bool result = true;
+    for (int i = 0; i < frames && result; i++) {
+        result = UpdateScene();
+        // The frame that finds the replay empty is still drawn, as in the window
+        if (replaying && !replayer_.IsOpen()) {
+            break;
+        }
+    }
+    if (result) {
+        DrawSoftwareScene(*pSoftwareRasterizer_);
+        result = pSoftwareRasterizer_->SaveBMP(fileName.c_str());
+    }
+    Cleanup();
+    return result;
+}
 
-    static const FLOAT backColor[4] = { 0.4f, 0.2f, 0.4f, 1.0f };
-    pDeviceContext_->ClearRenderTargetView(pRenderTargetView_, backColor);
-    pDeviceContext_->ClearDepthStencilView(pDepthBufferDSV_, D3D11_CLEAR_DEPTH, 0.0f, 0);
+bool Renderer::Resize(UINT width, UINT height) {
+    // Dragging the window border sends WM_SIZE for every step, only the last size is applied
+    pendingWidth_ = width;
+    pendingHeight_ = height;
+    resizePending_ = true;
+    QueryPerformanceCounter(&resizeRequest_);
+
+    if (!sizeApplied_) {
+        FlushResize();
+    }
+    return true;
+}
 
-    ProcessPostEffect(viewport);
+void Renderer::FlushResize() {
+    if (!resizePending_) {
+        return;
+    }
+    resizePending_ = false;
+    if (ApplyResize(pendingWidth_, pendingHeight_)) {
+        sizeApplied_ = true;
+    }
+}
 
-    HRESULT result = pSwapChain_->Present(0, 0);
+void Renderer::ApplyPendingResize() {
+    if (!resizePending_) {
+        return;
+    }
 
-    return SUCCEEDED(result);
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    double elapsedMs = (now.QuadPart - resizeRequest_.QuadPart) * 1000.0 / frequency.QuadPart;
+    if (elapsedMs >= ResizeDebounceMs) {
+        FlushResize();
+    }
 }
 
-bool Renderer::Resize(UINT width, UINT height) {
+bool Renderer::ApplyResize(UINT width, UINT height) {
+    width = max(width, 8);
+    height = max(height, 8);
+    if (sizeApplied_ && width == width_ && height == height_) {
+        return true;
+    }
+
+    if (pSoftwareRasterizer_ != NULL) {
+        width_ = width;
+        height_ = height;
+        return pSoftwareRasterizer_->Init(width_, height_);
+    }
+
     if (pSwapChain_ == NULL)
         return false;
 
     SAFE_RELEASE(pRenderTargetView_);
 
-    width_ = max(width, 8);
-    height_ = max(height, 8);
+    width_ = width;
+    height_ = height;
 
-    auto result = pSwapChain_->ResizeBuffers(2, width_, height_, DXGI_FORMAT_R8G8B8A8_UNORM, 0);
+    auto result = pSwapChain_->ResizeBuffers(2, width_, height_, DXGI_FORMAT_R8G8B8A8_UNORM, swapChainFlags_);
     if (!SUCCEEDED(result))
         return false;
 
@@ -998,33 +1874,7 @@ bool Renderer::Resize(UINT width, UINT height) {
     if (!SUCCEEDED(result))
         return false;
 
-    SAFE_RELEASE(pDepthBuffer_);
-    SAFE_RELEASE(pDepthBufferDSV_);
-    D3D11_TEXTURE2D_DESC desc = {};
-    desc.Format = DXGI_FORMAT_D32_FLOAT;
-    desc.ArraySize = 1;
-    desc.MipLevels = 1;
-    desc.Usage = D3D11_USAGE_DEFAULT;
-    desc.Height = height_;
-    desc.Width = width_;
-    desc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
-    desc.CPUAccessFlags = 0;
-    desc.MiscFlags = 0;
-    desc.SampleDesc.Count = 1;
-    desc.SampleDesc.Quality = 0;
-
-    result = pDevice_->CreateTexture2D(&desc, NULL, &pDepthBuffer_);
-    if (!SUCCEEDED(result))
-        return false;
-
-    result = pDevice_->CreateDepthStencilView(pDepthBuffer_, NULL, &pDepthBufferDSV_);
-    if (!SUCCEEDED(result))
-        return false;
-
-    ReleaseRenderTexture();
-    result = InitRenderTexture(width_, height_);
-    if (!SUCCEEDED(result))
-        return false;
+    // Depth and offscreen targets follow width_ through targetPool_, the old size is evicted after a few frames
 
     float n = 0.01f;
     float fov = XM_PI / 3;
@@ -1035,16 +1885,35 @@ bool Renderer::Resize(UINT width, UINT height) {
     return true;
 }
 
-void Renderer::ReleaseRenderTexture() {
-    SAFE_RELEASE(pRenderTargetTexture_);
-    SAFE_RELEASE(pPostEffectRenderTargetView_);
-    SAFE_RELEASE(pShaderResourceView_);
-}
-
 void Renderer::Cleanup() {
-    ImGui_ImplDX11_Shutdown();
-    ImGui_ImplWin32_Shutdown();
-    ImGui::DestroyContext();
+    recorder_.Close();
+
+    if (frameLatencyWaitable_ != NULL) {
+        CloseHandle(frameLatencyWaitable_);
+        frameLatencyWaitable_ = NULL;
+    }
+    SAFE_RELEASE(pSwapChain2_);
+
+    if (pGpuProfiler_) {
+        delete pGpuProfiler_;
+        pGpuProfiler_ = NULL;
+    }
+    // The loader thread still reads through the reader until the streamer is gone
+    if (pWorldStreamer_) {
+        delete pWorldStreamer_;
+        pWorldStreamer_ = NULL;
+    }
+    if (pWorldReader_) {
+        delete pWorldReader_;
+        pWorldReader_ = NULL;
+    }
+    querySource_.Release();
+
+    if (ImGui::GetCurrentContext() != NULL) {
+        ImGui_ImplDX11_Shutdown();
+        ImGui_ImplWin32_Shutdown();
+        ImGui::DestroyContext();
+    }
 
     if (pDeviceContext_ != NULL)
         pDeviceContext_->ClearState();
@@ -1054,10 +1923,9 @@ void Renderer::Cleanup() {
     SAFE_RELEASE(pSwapChain_);
     SAFE_RELEASE(pRasterizerState_);
     SAFE_RELEASE(pSampler_);
-    SAFE_RELEASE(pDepthBuffer_);
-    SAFE_RELEASE(pDepthBufferDSV_);
     SAFE_RELEASE(pBlendState_);
     SAFE_RELEASE(pLightBuffer_);
+    SAFE_RELEASE(pTextureRemapBuffer_);
     SAFE_RELEASE(pGeomBufferInst_);
 
     SAFE_RELEASE(pVertexBuffer_[0]);
@@ -1076,9 +1944,7 @@ void Renderer::Cleanup() {
     SAFE_RELEASE(pVertexShader_[1]);
     SAFE_RELEASE(pVertexShader_[2]);
 
-    SAFE_RELEASE(pPixelShader_[0]);
-    SAFE_RELEASE(pPixelShader_[1]);
-    SAFE_RELEASE(pPixelShader_[2]);
+    shaderPermutations_.Release();
 
     SAFE_RELEASE(pViewMatrixBuffer_[0]);
     SAFE_RELEASE(pViewMatrixBuffer_[1]);
@@ -1087,19 +1953,17 @@ void Renderer::Cleanup() {
     SAFE_RELEASE(pPlanesWorldMatrixBuffer_[0]);
     SAFE_RELEASE(pPlanesWorldMatrixBuffer_[1]);
 
-    SAFE_RELEASE(pTexture_[0]);
-    SAFE_RELEASE(pTexture_[1]);
-    SAFE_RELEASE(pTexture_[2]);
+    textureCache_.Clear();
 
     SAFE_RELEASE(pDepthState_[0]);
     SAFE_RELEASE(pDepthState_[1]);
 
-    SAFE_RELEASE(pPostEffectVertexShader_);
-    SAFE_RELEASE(pPostEffectPixelShader_);
-    SAFE_RELEASE(pPostEffectSamplerState_);
-    SAFE_RELEASE(pPostEffectConstantBuffer_);
-
-    ReleaseRenderTexture();
+    postProcess_.Release();
+    targetPool_.Clear();
+    commandContexts_.Release();
+    for (int i = 0; i < D3D11CommandContexts::MaxContexts; i++) {
+        SAFE_RELEASE(pDrawRangeBuffer_[i]);
+    }
 
     if (pCamera_) {
         delete pCamera_;
@@ -1117,6 +1981,10 @@ void Renderer::Cleanup() {
         delete skybox_;
         skybox_ = NULL;
     }
+    if (pSoftwareRasterizer_) {
+        delete pSoftwareRasterizer_;
+        pSoftwareRasterizer_ = NULL;
+    }
 
 #ifdef _DEBUG
     if (pDevice_ != NULL) {
@@ -12,6 +12,32 @@
 #include "SkyBox.h"
 #include "Constant.h"
 #include "Frustum.h"
+#include "SoftwareRasterizer.h"
+#include "InputRecorder.h"
+#include "CameraPath.h"
+#include "BenchmarkLog.h"
+#include "FixedStepTimer.h"
+#include "FramePacer.h"
+#include "QueryRing.h"
+#include "D3D11QuerySource.h"
+#include "PostEffectFormat.h"
+#include "PostProcessChain.h"
+#include "PostProcessRenderer.h"
+#include "RenderTargetPool.h"
+#include "D3D11RenderTarget.h"
+#include "FrameGraph.h"
+#include "D3D11FrameGraph.h"
+#include "ParallelCommandRecorder.h"
+#include "D3D11CommandContexts.h"
+#include "InstancePacking.h"
+#include "AnimationKernels.h"
+#include "TransformHierarchy.h"
+#include "SceneFile.h"
+#include "WorldPartition.h"
+#include "InstanceBvh.h"
+#include "D3D11TextureCache.h"
+#include "BlockCompression.h"
+#include "D3D11ShaderCompiler.h"
 
 struct Light {
     XMFLOAT4 pos;
@@ -21,10 +47,7 @@ struct Light {
 struct Cube {
     XMFLOAT4 pos;
     XMFLOAT4 shineSpeedIdNM;
-};
-
-struct PostEffectConstantBuffer {
-    XMINT4 params;
+    int node; // in Renderer::sceneHierarchy_
 };
 
 struct Vertex {
@@ -34,17 +57,15 @@ struct Vertex {
     XMFLOAT3 tangent;
 };
 
-struct GeomBuffer {
-    XMMATRIX worldMatrix;
-    XMMATRIX norm;
-    XMFLOAT4 shineSpeedTexIdNM;
-};
-
 struct SceneBuffer {
     XMMATRIX viewProjectionMatrix;
     XMINT4 indexBuffer[MAX_CUBE];
 };
 
+struct DrawRangeBuffer {
+    XMINT4 firstInstance;
+};
+
 struct LightBuffer {
     XMFLOAT4 cameraPos;
     XMINT4 lightParams;
@@ -75,6 +96,15 @@ struct TransparentWorldMatrixBuffer {
     XMFLOAT4 color;
 };
 
+enum ProfileStage {
+    ProfileStageOpaque,
+    ProfileStageSkybox,
+    ProfileStageTransparent,
+    ProfileStageImGui,
+    ProfileStagePostEffect,
+    ProfileStageCount
+};
+
 class Renderer {
 public:
     static constexpr UINT defaultWidth = 1280;
@@ -86,7 +116,32 @@ public:
 
     bool Init(HINSTANCE hInstance, HWND hWnd);
     bool Render();
+    // Deferred until the size has not changed for ResizeDebounceMs, the first one is applied at once
     bool Resize(UINT width, UINT height);
+    // Applies a deferred resize now, for WM_EXITSIZEMOVE
+    void FlushResize();
+    // Renders the current scene with the CPU reference backend into a BMP file
+    bool CaptureFrame(const char* fileName);
+    // Instead of Init: runs frames fixed steps with the reference backend and no window or input,
+    // then writes the last frame to a BMP file. A replay started before drives the camera, with
+    // frames 0 it runs to the end of the replay
+    bool Capture(const std::string& fileName, int frames);
+    // Input recording and replay, both run the simulation with a fixed time step.
+    // StartReplay must be called before Init so the cubes are generated from the recorded seed
+    bool StartRecording(const std::string& fileName);
+    bool StartReplay(const std::string& fileName);
+    // Frame count, time per frame and the final camera position, empty until a replay ends
+    const std::string& GetReplayResult() const { return replayResult_; };
+    // Takes cubes and lights from a scene file instead of the seed, must be called before Init
+    bool LoadScene(const std::string& fileName);
+    // Streams cells of a partitioned world around the camera, must be called before Init
+    bool LoadWorld(const std::string& directory);
+    // Selects the nearest cube under a client-area point, ignored while ImGui has the mouse
+    void Pick(int x, int y);
+    // Flies the camera along a named path and writes benchmark_<name>.csv when it ends
+    bool StartBenchmark(const std::string& pathFile, const std::string& pathName);
+    // fps is used in PacingMode::TargetFps only
+    void SetPacing(PacingMode mode, double fps);
 
     void Cleanup();
     ~Renderer();
@@ -94,45 +149,112 @@ public:
 private:
     Renderer();
 
+    bool InitSoftware(HINSTANCE hInstance, HWND hWnd);
+    void InitCubes();
+    // Fills the cube slots with the nearest instances of visible resident world cells
+    void StreamWorld();
     HRESULT InitScene();
-    void InputHandler();
+    void InputHandler(int steps);
+    void SimulateStep(float step);
+    void FinishReplay();
+    void RecordBenchmarkFrame();
+    void FinishBenchmark();
+    void UpdateUI();
+    void ApplyFrameLatency();
+    void BeginStage(ProfileStage stage);
+    void EndStage(ProfileStage stage);
+    void UpdateGpuTimings();
+    void WaitForFrame();
     bool UpdateScene();
-    void ProcessPostEffect(D3D11_VIEWPORT viewport);
-    HRESULT InitRenderTexture(int textureWidth, int textureHeight);
-    void ReleaseRenderTexture();
+    bool RenderSoftware();
+    void DrawSoftwareScene(SoftwareRasterizer& rasterizer);
+    bool BuildFrameGraph();
+    void BindTargets(int color, int depth);
+    void RenderOpaque();
+    void BindOpaqueState(ID3D11DeviceContext* pContext);
+    void DrawOpaqueRange(ID3D11DeviceContext* pContext, int context, const DrawRange& range);
+    // End of the run of cubes from first on that share a shader key, within range
+    size_t GetShaderRunEnd(size_t first, const DrawRange& range) const;
+    void RenderSkybox();
+    void RenderTransparent();
+    void RenderImGui();
+    void RenderPostPass(size_t index);
+    PostEffectNeeds GetPostEffectNeeds() const;
+    IntermediateFormat GetIntermediateFormat() const;
+    void ApplyPendingResize();
+    bool ApplyResize(UINT width, UINT height);
 
     ID3D11Device* pDevice_;
     ID3D11DeviceContext* pDeviceContext_;
     IDXGISwapChain* pSwapChain_;
+    IDXGISwapChain2* pSwapChain2_ = NULL;
+    HANDLE frameLatencyWaitable_ = NULL;
+    UINT swapChainFlags_ = 0;
     ID3D11RenderTargetView* pRenderTargetView_;
 
     ID3D11Buffer* pVertexBuffer_[3] = { NULL, NULL, NULL };
     ID3D11Buffer* pIndexBuffer_[3] = { NULL, NULL, NULL };
     ID3D11InputLayout* pInputLayout_[3] = { NULL, NULL, NULL };
     ID3D11VertexShader* pVertexShader_[3] = { NULL, NULL, NULL };
-    ID3D11PixelShader* pPixelShader_[3] = { NULL, NULL, NULL };
+
+    // Variants of the cube and plane pixel shaders, compiled when a frame first needs them
+    D3D11ShaderCompiler shaderCompiler_;
+    ShaderPermutations shaderPermutations_{ shaderCompiler_ };
+    int opaqueShader_ = -1;
+    int transparentShader_ = -1;
+    // Of each cube by index into cubes_, valid for visible ones
+    std::vector<ShaderKey> cubeShaderKeys_;
+    ShaderKey transparentKey_ = 0;
+    // Compiled by InitScene or it fails, drawn with when a frame's variant is missing
+    ShaderKey opaqueFallbackKey_ = 0;
+    ShaderKey transparentFallbackKey_ = 0;
 
     ID3D11Buffer* pGeomBufferInst_ = NULL;
     ID3D11Buffer* pPlanesWorldMatrixBuffer_[2] = { NULL, NULL };
     //ID3D11Buffer* pSkyboxWorldMatrixBuffer_ = NULL;
     ID3D11Buffer* pViewMatrixBuffer_[2] = { NULL, NULL };
     ID3D11Buffer* pLightBuffer_ = NULL;
+    ID3D11Buffer* pTextureRemapBuffer_ = NULL;
+    // One per recording context, a deferred context must not share a dynamic buffer with another
+    ID3D11Buffer* pDrawRangeBuffer_[D3D11CommandContexts::MaxContexts] = {};
     ID3D11RasterizerState* pRasterizerState_;
     ID3D11SamplerState* pSampler_;
 
-    ID3D11ShaderResourceView* pTexture_[3] = { NULL, NULL, NULL };
-    ID3D11Texture2D* pDepthBuffer_;
-    ID3D11DepthStencilView* pDepthBufferDSV_;
+    // Color array and normal map, mips are dropped or the texture is released when over budget
+    D3D11TextureLoader textureLoader_;
+    TextureCache textureCache_{ textureLoader_, 64ull << 20 };
+    int colorTexture_ = -1;
+    TexturePackLayout textureLayout_;
+    int normalTexture_ = -1;
+    DdsInfo normalInfo_ = {};
+    float textureBudgetMb_ = 64.0f;
     ID3D11DepthStencilState* pDepthState_[2] = { NULL, NULL };
     ID3D11BlendState* pBlendState_;
 
-    ID3D11VertexShader* pPostEffectVertexShader_ = NULL;
-    ID3D11PixelShader* pPostEffectPixelShader_ = NULL;
-    ID3D11SamplerState* pPostEffectSamplerState_ = NULL;
-    ID3D11Buffer* pPostEffectConstantBuffer_ = NULL;
-    ID3D11Texture2D* pRenderTargetTexture_ = NULL;
-    ID3D11RenderTargetView* pPostEffectRenderTargetView_ = NULL;
-    ID3D11ShaderResourceView* pShaderResourceView_ = NULL;
+    // Depth, the scene target and post-effect intermediates, evicted after 3 unused frames
+    D3D11RenderTargetAllocator targetAllocator_;
+    RenderTargetPool targetPool_{ targetAllocator_, 3 };
+    // Rebuilt every frame, transient targets of the graph come from targetPool_
+    FrameGraph frameGraph_;
+    D3D11FrameGraphBackend frameBackend_{ targetPool_ };
+    int sceneColor_ = -1;
+    int sceneDepth_ = -1;
+
+    // Opaque instances are split into ranges recorded on deferred contexts by the thread pool
+    D3D11CommandContexts commandContexts_;
+    ParallelCommandRecorder commandRecorder_{ ThreadPool::GetInstance() };
+    // Deferred contexts only pay off with several ranges this large, below two ranges the
+    // opaque pass draws on the immediate context
+    bool deferredRecording_ = true;
+    int drawsPerContext_ = 256;
+
+    PostProcessChain postChain_;
+    PostProcessRenderer postProcess_;
+    std::vector<PostPass> postPasses_;
+    // Input of post pass i is postResources_[i], its output is postResources_[i + 1]
+    std::vector<int> postResources_;
+    IntermediateFormat intermediateOverride_ = IntermediateFormat::Auto;
+    IntermediateFormat renderTextureFormat_ = IntermediateFormat::RGBA32F;
 
     Camera* pCamera_;
     Input* pInput_;
@@ -140,17 +262,88 @@ private:
 
     bool useNormalMap_ = true;
     bool showNormals_ = false;
-    bool withPostEffect_ = true;
     bool withCulling_ = true;
     std::vector<Light> lights_;
     std::vector<Cube> cubes_;
+    // Positions, speeds and angles of cubes_, laid out for AnimateInstances
+    InstanceAnimation cubeAnimation_;
+    // Scene root with a node per cube, the root is moved from the Instances window
+    TransformHierarchy sceneHierarchy_;
+    int sceneNode_ = -1;
+    XMFLOAT3 sceneOffset_ = XMFLOAT3(0.0f, 0.0f, 0.0f);
     std::vector<int> cubeIndexies_;
     int cubesCount_ = 2;
 
     SkyBox* skybox_;
 
+    // Fallback when no hardware adapter is available
+    SoftwareRasterizer* pSoftwareRasterizer_ = NULL;
+    std::vector<uint8_t> softwarePixels_;
+    // Decoded on the CPU from the same DDS files, empty textures sample as white
+    RasterTexture softwareColor_;
+    RasterTexture softwareNormal_;
+    HWND hWnd_ = NULL;
+
+    InputRecorder recorder_;
+    InputReplayer replayer_;
+    unsigned sceneSeed_ = 1;
+    // Mapped for the lifetime of the renderer when a scene was loaded
+    SceneFile sceneFile_;
+
+    // Cells are requested within WorldLoadRadius and culled by distance and frustum before
+    // their instances take the cube slots
+    static constexpr float WorldLoadRadius = 48.0f;
+    static constexpr uint64_t WorldMemoryBudget = 64ull << 20;
+    WorldIndex worldIndex_;
+    FileCellReader* pWorldReader_ = NULL;
+    CellStreamer* pWorldStreamer_ = NULL;
+    std::vector<uint32_t> visibleCells_;
+
+    // Rebuilt from worldMatrices_ on every click
+    InstanceBvh pickBvh_;
+    int selectedCube_ = -1;
+    float selectedDistance_ = 0.0f;
+    float fixedTimeStep_ = 0.0f;
+
+    FixedStepTimer simulationTimer_;
+    LARGE_INTEGER lastFrameTime_ = {};
+    LARGE_INTEGER replayStart_ = {};
+    std::string replayResult_;
+
+    CameraPath benchmarkPath_;
+    BenchmarkLog benchmarkLog_;
+    LARGE_INTEGER frameStart_ = {};
+    LARGE_INTEGER lastFrameStart_ = {};
+    UINT drawCount_ = 0;
+
+    SteadyClock clock_;
+    FramePacer framePacer_{ clock_ };
+    PacingMode pacingMode_ = PacingMode::Unlimited;
+    float targetFps_ = 60.0f;
+    int maxFramesInFlight_ = 2;
+
+    // GPU results arrive GpuQuerySlots - 1 frames late at most, older frames are skipped
+    static constexpr int GpuQuerySlots = 4;
+    D3D11QuerySource querySource_;
+    QueryRing* pGpuProfiler_ = NULL;
+    LARGE_INTEGER stageStart_[ProfileStageCount] = {};
+    double stageCpuMs_[ProfileStageCount] = {};
+    double stageGpuMs_[ProfileStageCount] = {};
+
+    // Uploaded per frame, the world matrices stay on the CPU for culling and the software path
+    PackedInstance geomBufferInst_[MAX_CUBE];
+    XMFLOAT4X4 worldMatrices_[MAX_CUBE];
+    XMMATRIX viewProjectionMatrix_;
+
     UINT width_;
     UINT height_;
+
+    static constexpr double ResizeDebounceMs = 100.0;
+    bool resizePending_ = false;
+    bool sizeApplied_ = false;
+    UINT pendingWidth_ = 0;
+    UINT pendingHeight_ = 0;
+    LARGE_INTEGER resizeRequest_ = {};
     //UINT numSphereTriangles_;
     //float radius_;
 
@@ -164,6 +357,10 @@ private:
         DirectX::XMMatrixTranslation(1.8f, 0.0f, 0.0f),
         DirectX::XMMatrixTranslation(2.2f, 0.0f, 0.0f)
     };
+    const XMFLOAT4 TransparentColors[2] = {
+        {1.0f, 0.0f, 0.0f, 0.0f},
+        {0.0f, 1.0f, 0.0f, 0.0f}
+    };
     bool isFirst_ = true;
 
     const XMFLOAT4 AABB[2] = {
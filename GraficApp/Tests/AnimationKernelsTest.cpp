@@ -0,0 +1,167 @@
+#include "AnimationKernels.h"
+#include "ImageKernels.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+// Checks SinCos against the C library and the batched animation kernel against the sin/cos,
+// two matrices and a general multiply per instance UpdateScene used to do; the scalar and
+// AVX2 paths must give bit-identical matrices. Times all of them and writes
+// path,instances,ms,minstances_per_s,max_error rows to animation_benchmark.csv.
+// Usage: AnimationKernelsTest [<instances>], 1000000 for the full benchmark
+namespace {
+    // How many instances a ParallelFor task animates in the benchmark
+    const size_t InstancesPerTask = 16384;
+    // Float matrices of positions up to 100, the polynomials are within a few ulps
+    const double MaxMatrixError = 1e-4;
+
+    // What UpdateScene did per cube: sin/cos, a rotation and a translation matrix, a general multiply
+    void AnimateReference(const InstanceAnimation& animation, float alpha, float* matrices) {
+        for (size_t i = 0; i < animation.GetCount(); i++) {
+            float angle = animation.prevAngle[i] + (animation.angle[i] - animation.prevAngle[i]) * alpha;
+            float s = sinf(angle), c = cosf(angle);
+            float rotation[16] = { c, 0.0f, -s, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, s, 0.0f, c, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+            float translation[16] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+                animation.x[i], animation.y[i], animation.z[i], 1.0f };
+            float* m = matrices + i * 16;
+            for (int row = 0; row < 4; row++) {
+                for (int column = 0; column < 4; column++) {
+                    float sum = 0.0f;
+                    for (int k = 0; k < 4; k++) {
+                        sum += rotation[row * 4 + k] * translation[k * 4 + column];
+                    }
+                    m[row * 4 + column] = sum;
+                }
+            }
+        }
+    }
+
+    bool CheckSinCos() {
+        const size_t count = 100003;
+        std::vector<float> angles(count), sines(count), cosines(count);
+        for (size_t i = 0; i < count; i++) {
+            angles[i] = -100.0f + 200.0f * (float)i / (float)(count - 1);
+        }
+
+        bool ok = true;
+        std::vector<float> firstSines, firstCosines;
+        for (int path = 0; path <= (int)ImageKernelPath::AVX2; path++) {
+            if (path == (int)ImageKernelPath::AVX2 && !IsAVX2Supported()) {
+                continue;
+            }
+            SetImageKernelPath((ImageKernelPath)path);
+            SinCos(angles.data(), sines.data(), cosines.data(), count);
+            double error = 0.0;
+            for (size_t i = 0; i < count; i++) {
+                double d = fabs(sines[i] - sin((double)angles[i])) + fabs(cosines[i] - cos((double)angles[i]));
+                error = d > error ? d : error;
+            }
+            bool same = firstSines.empty() || (firstSines == sines && firstCosines == cosines);
+            firstSines = sines;
+            firstCosines = cosines;
+            printf("sincos %s: max error %g, %s\n", path == 0 ? "scalar" : "avx2", error, same ? "same as scalar" : "differs from scalar");
+            ok = ok && error < 1e-5 && same;
+        }
+        return ok;
+    }
+
+    bool RunAnimationBenchmark(const std::string& fileName, size_t instanceCount) {
+        std::ofstream file(fileName, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        InstanceAnimation animation;
+        animation.Resize(instanceCount);
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+        std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+        for (size_t i = 0; i < instanceCount; i++) {
+            animation.x[i] = position(random);
+            animation.y[i] = position(random);
+            animation.z[i] = position(random);
+            animation.prevAngle[i] = angle(random);
+            animation.angle[i] = animation.prevAngle[i] + 0.01f;
+        }
+
+        std::vector<float> reference(instanceCount * 16), matrices(instanceCount * 16), scalar;
+        std::vector<PackedInstance> packed(instanceCount);
+        const float alpha = 0.5f;
+        const int iterations = 10;
+        bool ok = true;
+
+        auto measure = [&](const std::function<void()>& run) {
+            run();
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; i++) {
+                run();
+            }
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+        };
+        auto maxError = [&]() {
+            double error = 0.0;
+            for (size_t i = 0; i < matrices.size(); i++) {
+                double d = fabs((double)matrices[i] - reference[i]);
+                error = d > error ? d : error;
+            }
+            return error;
+        };
+        auto writeRow = [&](const char* path, double ms, double error) {
+            file << path << ',' << instanceCount << ',' << ms << ',' << instanceCount / (ms * 1000.0) << ',' << error << '\n';
+            printf("%s: %.3f ms, max error %g\n", path, ms, error);
+            ok = ok && error < MaxMatrixError;
+        };
+
+        file << "path,instances,ms,minstances_per_s,max_error\n";
+        writeRow("matrix_multiply", measure([&]() { AnimateReference(animation, alpha, reference.data()); }), 0.0);
+
+        ImageKernelPath previous = GetImageKernelPath();
+        for (int path = 0; path <= (int)ImageKernelPath::AVX2; path++) {
+            if (path == (int)ImageKernelPath::AVX2 && !IsAVX2Supported()) {
+                continue;
+            }
+            SetImageKernelPath((ImageKernelPath)path);
+            const char* name = path == (int)ImageKernelPath::AVX2 ? "batched_avx2" : "batched_scalar";
+            double ms = measure([&]() { AnimateInstances(animation, 0, instanceCount, alpha, matrices.data(), packed.data()); });
+            writeRow(name, ms, maxError());
+            if (scalar.empty()) {
+                scalar = matrices;
+            }
+            else if (memcmp(scalar.data(), matrices.data(), matrices.size() * sizeof(float)) != 0) {
+                printf("avx2 matrices differ from scalar\n");
+                ok = false;
+            }
+        }
+
+        size_t tasks = (instanceCount + InstancesPerTask - 1) / InstancesPerTask;
+        double ms = measure([&]() {
+            ThreadPool::GetInstance().ParallelFor(tasks, [&](size_t task) {
+                size_t first = task * InstancesPerTask;
+                size_t count = first + InstancesPerTask < instanceCount ? InstancesPerTask : instanceCount - first;
+                AnimateInstances(animation, first, count, alpha, matrices.data(), packed.data());
+            });
+        });
+        writeRow("batched_parallel", ms, maxError());
+        SetImageKernelPath(previous);
+
+        return file.good() && ok;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t instanceCount = argc > 1 ? (size_t)atoll(argv[1]) : 100003;
+    ImageKernelPath previous = GetImageKernelPath();
+    bool sinCosOk = CheckSinCos();
+    SetImageKernelPath(previous);
+    bool benchmarkOk = RunAnimationBenchmark("animation_benchmark.csv", instanceCount);
+    return sinCosOk && benchmarkOk ? 0 : 1;
+}
@@ -0,0 +1,401 @@
+#include "BlockCompression.h"
+#include "DdsHeader.h"
+#include "ImageKernels.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Checks hand-made blocks against values worked out from the format specs, scalar against
+// AVX2, solid colors and encode-decode PSNR, then times both directions on a square
+// image. Writes format,direction,path,mpix_per_s,psnr rows and the check results to
+// block_compression.csv.
+// Usage: BlockCompressionTest [<size>], 2048 for the full benchmark
+namespace {
+    // Interpolation weights and the 565 expansion as the specs give them
+    const uint8_t BC7Weights2[4] = { 0, 21, 43, 64 };
+    const uint8_t BC7Weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+    const uint8_t BC7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    void Expand565(uint32_t color, int rgb[3]) {
+        int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    // Writes BC7 test blocks field by field
+    class BlockBitWriter {
+    public:
+        void Write(uint32_t value, uint32_t count) {
+            for (uint32_t i = 0; i < count; i++, position_++) {
+                block_[position_ / 8] |= (uint8_t)(((value >> i) & 1) << (position_ % 8));
+            }
+        }
+
+        const uint8_t* GetBlock() const { return block_; };
+    private:
+        uint8_t block_[16] = {};
+        uint32_t position_ = 0;
+    };
+
+    // Pixel values worked out with the formulas of the format specs in floating point
+    int SpecLerp(int a, int b, int numerator, int denominator) {
+        return (int)lround((a * (double)(denominator - numerator) + b * (double)numerator) / denominator);
+    }
+
+    int SpecBC7(int a, int b, int weight) {
+        return ((64 - weight) * a + weight * b + 32) >> 6;
+    }
+
+    bool CheckPixels(const uint8_t* decoded, const uint8_t* expected) {
+        return memcmp(decoded, expected, 64) == 0;
+    }
+
+    bool CheckReferenceBlocks() {
+        bool ok = true;
+        uint8_t decoded[64], expected[64];
+
+        // BC1, red and blue with indices 0..3 along each row
+        const uint8_t bc1[8] = { 0x00, 0xF8, 0x1F, 0x00, 0xE4, 0xE4, 0xE4, 0xE4 };
+        const int bc1Colors[4][4] = { { 255, 0, 0, 255 }, { 0, 0, 255, 255 },
+            { SpecLerp(255, 0, 1, 3), 0, SpecLerp(0, 255, 1, 3), 255 }, { SpecLerp(255, 0, 2, 3), 0, SpecLerp(0, 255, 2, 3), 255 } };
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 4; c++) {
+                expected[i * 4 + c] = (uint8_t)bc1Colors[i & 3][c];
+            }
+        }
+        DecodeBlock(DdsFormatBC1, bc1, decoded);
+        ok = ok && CheckPixels(decoded, expected);
+
+        // The same block with the endpoints swapped is in three color mode, index 3 transparent
+        const uint8_t bc1Three[8] = { 0x1F, 0x00, 0x00, 0xF8, 0xE4, 0xE4, 0xE4, 0xE4 };
+        const int bc1ThreeColors[4][4] = { { 0, 0, 255, 255 }, { 255, 0, 0, 255 },
+            { SpecLerp(0, 255, 1, 2), 0, SpecLerp(255, 0, 1, 2), 255 }, { 0, 0, 0, 0 } };
+        for (int i = 0; i < 64; i++) {
+            expected[i] = (uint8_t)bc1ThreeColors[(i / 4) & 3][i & 3];
+        }
+        DecodeBlock(DdsFormatBC1, bc1Three, decoded);
+        ok = ok && CheckPixels(decoded, expected);
+
+        // BC4 in both modes, pixel i uses index i & 7
+        for (int mode = 0; mode < 2; mode++) {
+            int e0 = mode == 0 ? 200 : 50, e1 = mode == 0 ? 100 : 150;
+            uint8_t bc4[8] = { (uint8_t)e0, (uint8_t)e1 };
+            uint64_t indices = 0;
+            for (int i = 0; i < 16; i++) {
+                indices |= (uint64_t)(i & 7) << (3 * i);
+            }
+            for (int i = 0; i < 6; i++) {
+                bc4[2 + i] = (uint8_t)(indices >> (8 * i));
+            }
+            int palette[8] = { e0, e1 };
+            for (int i = 2; i < 8; i++) {
+                palette[i] = mode == 0 ? SpecLerp(e0, e1, i - 1, 7) : (i < 6 ? SpecLerp(e0, e1, i - 1, 5) : (i == 6 ? 0 : 255));
+            }
+            for (int i = 0; i < 16; i++) {
+                expected[i * 4] = (uint8_t)palette[i & 7];
+                expected[i * 4 + 1] = 0;
+                expected[i * 4 + 2] = 0;
+                expected[i * 4 + 3] = 255;
+            }
+            DecodeBlock(DdsFormatBC4, bc4, decoded);
+            ok = ok && CheckPixels(decoded, expected);
+
+            // BC5 carries the same block twice, the second one in green
+            uint8_t bc5[16];
+            memcpy(bc5, bc4, 8);
+            memcpy(bc5 + 8, bc4, 8);
+            for (int i = 0; i < 16; i++) {
+                expected[i * 4 + 1] = expected[i * 4];
+            }
+            DecodeBlock(DdsFormatBC5, bc5, decoded);
+            ok = ok && CheckPixels(decoded, expected);
+
+            // BC3 alpha is a BC4 block, its color block has four colors even with c0 < c1
+            uint8_t bc3[16];
+            memcpy(bc3, bc4, 8);
+            memcpy(bc3 + 8, bc1Three, 8);
+            const int bc3Colors[4][3] = { { 0, 0, 255 }, { 255, 0, 0 },
+                { SpecLerp(0, 255, 1, 3), 0, SpecLerp(255, 0, 1, 3) }, { SpecLerp(0, 255, 2, 3), 0, SpecLerp(255, 0, 2, 3) } };
+            for (int i = 0; i < 16; i++) {
+                for (int c = 0; c < 3; c++) {
+                    expected[i * 4 + c] = (uint8_t)bc3Colors[i & 3][c];
+                }
+                expected[i * 4 + 3] = (uint8_t)palette[i & 7];
+            }
+            DecodeBlock(DdsFormatBC3, bc3, decoded);
+            ok = ok && CheckPixels(decoded, expected);
+        }
+
+        // BC7 mode 6: one subset, 7 bit endpoints with a P-bit each, 4 bit indices
+        {
+            const int ends[2][4] = { { 10, 100, 30, 127 }, { 120, 5, 64, 0 } };
+            const int pBits[2] = { 1, 0 };
+            BlockBitWriter writer;
+            writer.Write(1 << 6, 7);
+            for (int c = 0; c < 4; c++) {
+                writer.Write(ends[0][c], 7);
+                writer.Write(ends[1][c], 7);
+            }
+            writer.Write(pBits[0], 1);
+            writer.Write(pBits[1], 1);
+            for (int i = 0; i < 16; i++) {
+                writer.Write(i == 0 ? 0 : (i * 7) & 15, i == 0 ? 3 : 4);
+            }
+            for (int i = 0; i < 16; i++) {
+                int weight = BC7Weights4[i == 0 ? 0 : (i * 7) & 15];
+                for (int c = 0; c < 4; c++) {
+                    expected[i * 4 + c] = (uint8_t)SpecBC7((ends[0][c] << 1) | pBits[0], (ends[1][c] << 1) | pBits[1], weight);
+                }
+            }
+            DecodeBlock(DdsFormatBC7, writer.GetBlock(), decoded);
+            ok = ok && CheckPixels(decoded, expected);
+        }
+
+        // BC7 mode 1, partition 0: the two right columns are the second subset, anchored at pixel 15
+        {
+            const int ends[2][2][3] = { { { 63, 0, 10 }, { 0, 63, 20 } }, { { 5, 5, 5 }, { 60, 40, 20 } } };
+            const int shared[2] = { 0, 1 };
+            BlockBitWriter writer;
+            writer.Write(1 << 1, 2);
+            writer.Write(0, 6);
+            for (int c = 0; c < 3; c++) {
+                for (int s = 0; s < 2; s++) {
+                    writer.Write(ends[s][0][c], 6);
+                    writer.Write(ends[s][1][c], 6);
+                }
+            }
+            writer.Write(shared[0], 1);
+            writer.Write(shared[1], 1);
+            for (int i = 0; i < 16; i++) {
+                int index = (i * 3) & 7;
+                bool anchor = i == 0 || i == 15;
+                index = anchor ? index & 3 : index;
+                writer.Write(index, anchor ? 2 : 3);
+            }
+            for (int i = 0; i < 16; i++) {
+                int subset = (i & 3) >= 2 ? 1 : 0;
+                int index = (i * 3) & 7;
+                index = i == 0 || i == 15 ? index & 3 : index;
+                for (int c = 0; c < 3; c++) {
+                    int a = (ends[subset][0][c] << 1) | shared[subset], b = (ends[subset][1][c] << 1) | shared[subset];
+                    a = (a << 1) | (a >> 6);
+                    b = (b << 1) | (b >> 6);
+                    expected[i * 4 + c] = (uint8_t)SpecBC7(a, b, BC7Weights3[index]);
+                }
+                expected[i * 4 + 3] = 255;
+            }
+            DecodeBlock(DdsFormatBC7, writer.GetBlock(), decoded);
+            ok = ok && CheckPixels(decoded, expected);
+        }
+
+        // BC7 mode 5 with rotation 1: the interpolated alpha ends up in red and red in alpha
+        {
+            const int ends[2][4] = { { 127, 0, 64, 0 }, { 0, 127, 64, 255 } };
+            BlockBitWriter writer;
+            writer.Write(1 << 5, 6);
+            writer.Write(1, 2);
+            for (int c = 0; c < 3; c++) {
+                writer.Write(ends[0][c], 7);
+                writer.Write(ends[1][c], 7);
+            }
+            writer.Write(ends[0][3], 8);
+            writer.Write(ends[1][3], 8);
+            for (int i = 0; i < 16; i++) {
+                writer.Write(i == 0 ? 1 : i & 3, i == 0 ? 1 : 2);
+            }
+            for (int i = 0; i < 16; i++) {
+                writer.Write(i == 0 ? 0 : 3 - (i & 3), i == 0 ? 1 : 2);
+            }
+            for (int i = 0; i < 16; i++) {
+                int colorIndex = i == 0 ? 1 : i & 3, alphaIndex = i == 0 ? 0 : 3 - (i & 3);
+                int channels[4];
+                for (int c = 0; c < 3; c++) {
+                    int a = (ends[0][c] << 1) | (ends[0][c] >> 6), b = (ends[1][c] << 1) | (ends[1][c] >> 6);
+                    channels[c] = SpecBC7(a, b, BC7Weights2[colorIndex]);
+                }
+                channels[3] = SpecBC7(ends[0][3], ends[1][3], BC7Weights2[alphaIndex]);
+                expected[i * 4] = (uint8_t)channels[3];
+                expected[i * 4 + 1] = (uint8_t)channels[1];
+                expected[i * 4 + 2] = (uint8_t)channels[2];
+                expected[i * 4 + 3] = (uint8_t)channels[0];
+            }
+            DecodeBlock(DdsFormatBC7, writer.GetBlock(), decoded);
+            ok = ok && CheckPixels(decoded, expected);
+        }
+
+        // The reserved mode decodes to zeros
+        const uint8_t reserved[16] = {};
+        memset(expected, 0, sizeof(expected));
+        DecodeBlock(DdsFormatBC7, reserved, decoded);
+        ok = ok && CheckPixels(decoded, expected);
+
+        return ok;
+    }
+
+    // Smooth gradients, a few hard edged discs and some noise, alpha from a radial ramp
+    void MakeTestImage(uint32_t width, uint32_t height, std::vector<uint8_t>& pixels) {
+        std::mt19937 random(7);
+        pixels.resize((size_t)width * height * 4);
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                float u = x / (float)width, v = y / (float)height;
+                float r = 128.0f + 100.0f * sinf(u * 9.0f + v * 3.0f);
+                float g = 128.0f + 100.0f * cosf(v * 7.0f - u * 2.0f);
+                float b = 255.0f * u * v;
+                float du = u - 0.5f, dv = v - 0.5f;
+                if (fmodf((du * du + dv * dv) * 40.0f, 1.0f) < 0.1f) {
+                    r = 255.0f - r;
+                    b = 40.0f;
+                }
+                float noise = (float)(random() % 9) - 4.0f;
+                uint8_t* p = pixels.data() + ((size_t)y * width + x) * 4;
+                p[0] = (uint8_t)std::fmin(std::fmax(r + noise, 0.0f), 255.0f);
+                p[1] = (uint8_t)std::fmin(std::fmax(g + noise, 0.0f), 255.0f);
+                p[2] = (uint8_t)std::fmin(std::fmax(b + noise, 0.0f), 255.0f);
+                p[3] = (uint8_t)std::fmin(255.0f * 2.0f * sqrtf(du * du + dv * dv), 255.0f);
+            }
+        }
+    }
+
+    // PSNR of the channels the format keeps, alpha included for BC3
+    double FormatPSNR(uint32_t format, const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+        int channels = format == DdsFormatBC5 ? 2 : (format == DdsFormatBC3 ? 4 : 3);
+        double sum = 0.0;
+        for (size_t i = 0; i < a.size(); i += 4) {
+            for (int c = 0; c < channels; c++) {
+                double d = (double)a[i + c] - b[i + c];
+                sum += d * d;
+            }
+        }
+        double mse = sum / (a.size() / 4 * channels);
+        return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+    }
+
+    bool RunBlockCompressionBenchmark(const std::string& fileName, uint32_t size) {
+        std::ofstream file(fileName, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        ImageKernelPath previous = GetImageKernelPath();
+
+        bool referenceOk = true;
+        for (ImageKernelPath path : { ImageKernelPath::Scalar, ImageKernelPath::AVX2 }) {
+            SetImageKernelPath(path);
+            referenceOk = CheckReferenceBlocks() && referenceOk;
+        }
+
+        // Solid blocks of colors on the 565 grid and single BC4 values come back exactly
+        bool solidOk = true;
+        std::mt19937 random(3);
+        for (int i = 0; i < 1000; i++) {
+            int rgb[3];
+            Expand565(random() & 0xFFFF, rgb);
+            uint8_t pixels[64], block[16], decoded[64];
+            for (int p = 0; p < 16; p++) {
+                pixels[p * 4] = (uint8_t)rgb[0];
+                pixels[p * 4 + 1] = (uint8_t)rgb[1];
+                pixels[p * 4 + 2] = (uint8_t)rgb[2];
+                pixels[p * 4 + 3] = 255;
+            }
+            for (uint32_t format : { (uint32_t)DdsFormatBC1, (uint32_t)DdsFormatBC3, (uint32_t)DdsFormatBC5 }) {
+                EncodeBlock(format, pixels, block);
+                DecodeBlock(format, block, decoded);
+                for (int p = 0; p < 64; p++) {
+                    int c = p & 3;
+                    int want = format == DdsFormatBC5 && c == 2 ? 0 : pixels[p];
+                    solidOk = solidOk && decoded[p] == want;
+                }
+            }
+        }
+
+        const uint32_t width = size, height = size;
+        const int iterations = 3;
+        std::vector<uint8_t> image;
+        MakeTestImage(width, height, image);
+        // BC1 would turn the transparent half black, it gets the opaque image
+        std::vector<uint8_t> opaque = image;
+        for (size_t i = 3; i < opaque.size(); i += 4) {
+            opaque[i] = 255;
+        }
+        std::vector<uint8_t> blocks[2], decoded[2];
+        bool pathsMatch = true, qualityOk = true;
+        file << "format,direction,path,mpix_per_s,psnr\n";
+
+        const struct {
+            uint32_t format;
+            const char* name;
+            double minPSNR;
+        } formats[] = {
+            { DdsFormatBC1, "BC1", 38.0 },
+            { DdsFormatBC3, "BC3", 38.0 },
+            { DdsFormatBC4, "BC4", 0.0 },
+            { DdsFormatBC5, "BC5", 42.0 },
+            { DdsFormatBC7, "BC7", 0.0 }
+        };
+        for (const auto& format : formats) {
+            size_t blockBytes = (size_t)((width + 3) / 4) * ((height + 3) / 4) * GetDdsBlockBytes(format.format);
+            bool encodable = IsBlockEncodeSupported(format.format);
+            const std::vector<uint8_t>& source = format.format == DdsFormatBC1 ? opaque : image;
+            for (int path = 0; path < 2; path++) {
+                SetImageKernelPath(path == 0 ? ImageKernelPath::Scalar : ImageKernelPath::AVX2);
+                const char* pathName = GetImageKernelPath() == ImageKernelPath::AVX2 ? "avx2" : "scalar";
+                blocks[path].assign(blockBytes, 0);
+                decoded[path].assign(image.size(), 0);
+
+                if (encodable) {
+                    auto start = std::chrono::steady_clock::now();
+                    for (int iteration = 0; iteration < iterations; iteration++) {
+                        EncodeImage(format.format, source.data(), width, height, blocks[path].data());
+                    }
+                    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    file << format.name << ",encode," << pathName << ',' << width * height * iterations / seconds / 1e6 << ",\n";
+                }
+                else {
+                    // Random blocks, for BC7 spread evenly over the eight modes
+                    std::mt19937 blockRandom(11);
+                    for (size_t i = 0; i < blockBytes; i++) {
+                        blocks[path][i] = (uint8_t)blockRandom();
+                    }
+                    for (size_t i = 0; format.format == DdsFormatBC7 && i < blockBytes; i += 16) {
+                        int mode = (int)((i / 16) % 8);
+                        blocks[path][i] = (uint8_t)((blocks[path][i] & (0xFF << (mode + 1))) | (1 << mode));
+                    }
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                for (int iteration = 0; iteration < iterations; iteration++) {
+                    DecodeImage(format.format, blocks[path].data(), width, height, decoded[path].data());
+                }
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                file << format.name << ",decode," << pathName << ',' << width * height * iterations / seconds / 1e6 << ',';
+                if (encodable) {
+                    double psnr = FormatPSNR(format.format, source, decoded[path]);
+                    qualityOk = qualityOk && psnr >= format.minPSNR;
+                    file << psnr;
+                }
+                file << '\n';
+            }
+            pathsMatch = pathsMatch && blocks[0] == blocks[1] && decoded[0] == decoded[1];
+        }
+        SetImageKernelPath(previous);
+
+        file << "checks,reference " << (referenceOk ? "ok" : "failed") << ",solid " << (solidOk ? "ok" : "failed")
+            << ",paths " << (pathsMatch ? "match" : "differ") << ",quality " << (qualityOk ? "ok" : "low") << '\n';
+        return file.good() && referenceOk && solidOk && pathsMatch && qualityOk;
+    }
+}
+
+int main(int argc, char** argv) {
+    uint32_t size = argc > 1 ? (uint32_t)atol(argv[1]) : 512;
+    bool ok = RunBlockCompressionBenchmark("block_compression.csv", size);
+    printf("block compression checks %s\n", ok ? "passed" : "failed");
+    return ok ? 0 : 1;
+}
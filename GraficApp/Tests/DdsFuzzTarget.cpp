@@ -0,0 +1,40 @@
+#include "DdsHeader.h"
+#include "DdsValidation.h"
+#include "BlockCompression.h"
+
+#include <cstdlib>
+#include <vector>
+
+// libFuzzer entry point for the DDS parser, built by Tests/CMakeLists.txt when the compiler
+// supports -fsanitize=fuzzer. The input is the whole file in an allocation of its exact size.
+// A file ValidateDdsFile accepts has to give back its shape through a header round trip and
+// decode its last mip, anything else aborts.
+// Usage: DdsFuzzTarget [<corpus dir>] [-max_total_time=<s>]
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    DdsInfo info;
+    bool headerOk = ParseDdsHeader(data, size, size, info);
+    if (!ValidateDdsFile(data, size, info)) {
+        return 0;
+    }
+    if (!headerOk) {
+        abort();
+    }
+
+    std::vector<uint8_t> header;
+    DdsInfo parsed;
+    if (!BuildDdsHeader(info, header) || !ParseDdsHeader(header.data(), header.size(), 0, parsed) ||
+        parsed.width != info.width || parsed.height != info.height || parsed.mipCount != info.mipCount ||
+        parsed.arraySize != info.arraySize || parsed.faces != info.faces || parsed.format != info.format) {
+        abort();
+    }
+
+    if (IsBlockDecodeSupported(info.format) || GetDdsPixelBytes(info.format) == 4) {
+        std::vector<uint8_t> pixels;
+        uint32_t width = 0, height = 0;
+        if (!DecodeDdsImage(data, size, info.arraySize * info.faces - 1, info.mipCount - 1, pixels, width, height) ||
+            width != GetDdsMipWidth(info, info.mipCount - 1)) {
+            abort();
+        }
+    }
+    return 0;
+}
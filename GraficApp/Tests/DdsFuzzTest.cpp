@@ -0,0 +1,155 @@
+#include "DdsValidation.h"
+#include "BlockCompression.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// Deterministic fuzzing of the DDS parser: mutates valid headers of every supported shape,
+// truncates and extends the files and feeds each mutant through ValidateDdsFile in an
+// allocation of its exact size. Accepted mutants have to survive a header round trip, reject
+// a one byte shorter file and decode their last mip. Writes seed,format,width,height,slices,
+// mutants,accepted,decoded rows to dds_fuzz.csv. DdsFuzzTarget covers the same code under
+// libFuzzer where clang is available.
+// Usage: DdsFuzzTest [<mutants per seed>], 16384 by default
+namespace {
+    // Values that sit on the edges of the checks in ParseDdsHeader
+    const uint32_t InterestingValues[] = {
+        0, 1, 3, 4, 6, 15, 16, 17, 20, 32, 124,
+        DdsMaxDimension, DdsMaxDimension + 1, DdsMaxArraySize, DdsMaxArraySize + 1,
+        0x30315844,          // "DX10"
+        0x31545844,          // "DXT1"
+        0x200 | 0xFC00,      // cube map with all faces
+        0x200 | 0x400,       // cube map with one face
+        0x200000,            // volume
+        0x20000 | 0x800000,  // mip count and depth flags
+        DdsFormatRGBA32Float, DdsFormatBC6HUf16, DdsFormatBC7Srgb, 113, 116,
+        0x7FFFFFFF, 0x80000000, 0xFFFFFFFE, 0xFFFFFFFF
+    };
+
+    void Mutate(std::vector<uint8_t>& data, std::mt19937& random) {
+        int operations = 1 + (int)(random() % 4);
+        for (int i = 0; i < operations; i++) {
+            size_t headerSize = data.size() < DdsMaxHeaderSize ? data.size() : DdsMaxHeaderSize;
+            uint32_t operation = random() % 8;
+            if (operation < 2 && headerSize > 0) {
+                data[random() % headerSize] ^= (uint8_t)(1u << (random() % 8));
+            }
+            else if (operation < 5 && headerSize >= 4) {
+                uint32_t value = InterestingValues[random() % (sizeof(InterestingValues) / sizeof(InterestingValues[0]))];
+                memcpy(&data[random() % (headerSize / 4) * 4], &value, 4);
+            }
+            else if (operation < 6 && headerSize > 0) {
+                data[random() % headerSize] = (uint8_t)random();
+            }
+            else if (operation < 7) {
+                data.resize(random() % (data.size() + 1));
+            }
+            else {
+                data.resize(data.size() + random() % 64, (uint8_t)random());
+            }
+        }
+    }
+
+    bool SameShape(const DdsInfo& a, const DdsInfo& b) {
+        return a.width == b.width && a.height == b.height && a.mipCount == b.mipCount && a.arraySize == b.arraySize &&
+            a.faces == b.faces && a.format == b.format;
+    }
+
+    bool RunDdsFuzzTest(const std::string& fileName, uint32_t mutantsPerSeed) {
+        std::ofstream file(fileName, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        // Legacy FourCC and RGB mask headers, DX10 ones, arrays and cube maps, sizes that are not
+        // multiples of 4 and partial mip chains
+        const DdsInfo shapes[] = {
+            { 64, 64, 7, 1, 1, DdsFormatBC1, 0 },
+            { 60, 36, 6, 1, 1, DdsFormatBC3, 0 },
+            { 64, 16, 5, 1, 1, DdsFormatBC5, 0 },
+            { 16, 16, 5, 3, 1, DdsFormatBC4, 0 },
+            { 16, 8, 3, 1, 1, DdsFormatBC2, 0 },
+            { 32, 32, 6, 4, 1, DdsFormatBC7Srgb, 0 },
+            { 16, 16, 5, 1, 6, DdsFormatBC1, 0 },
+            { 8, 8, 1, 2, 6, DdsFormatRGBA16Float, 0 },
+            { 33, 17, 6, 1, 1, DdsFormatRGBA8, 0 },
+            { 8, 8, 4, 1, 1, DdsFormatBGRA8Srgb, 0 },
+            { 8, 8, 1, 1, 1, DdsFormatRGBA32Float, 0 },
+            { 16, 16, 1, 1, 1, DdsFormatBC6HUf16, 0 }
+        };
+
+        bool seedsOk = true, roundTrips = true, truncationsRejected = true, decodes = true;
+        uint64_t totalMutants = 0, totalAccepted = 0;
+        double seconds = 0.0;
+        file << "seed,format,width,height,slices,mutants,accepted,decoded\n";
+        for (size_t seed = 0; seed < sizeof(shapes) / sizeof(shapes[0]); seed++) {
+            std::vector<uint8_t> original;
+            DdsInfo info;
+            seedsOk = seedsOk && BuildDdsHeader(shapes[seed], original);
+            original.resize(original.size() + (size_t)GetDdsTextureBytes(shapes[seed], 0));
+            std::mt19937 random((uint32_t)seed + 1);
+            std::generate(original.begin() + (original.size() - (size_t)GetDdsTextureBytes(shapes[seed], 0)), original.end(),
+                [&]() { return (uint8_t)random(); });
+            seedsOk = seedsOk && ValidateDdsFile(original.data(), original.size(), info) && SameShape(info, shapes[seed]);
+
+            // DecodeImage runs on ThreadPool, so the mutants are checked one after another
+            auto start = std::chrono::steady_clock::now();
+            uint32_t accepted = 0, decoded = 0;
+            std::vector<uint8_t> mutant, header, pixels;
+            for (uint32_t i = 0; i < mutantsPerSeed; i++) {
+                mutant = original;
+                Mutate(mutant, random);
+
+                // An allocation of the exact size, so that reading past the end is caught by ASan
+                size_t size = mutant.size();
+                std::unique_ptr<uint8_t[]> exact(new uint8_t[size > 0 ? size : 1]);
+                std::copy(mutant.begin(), mutant.end(), exact.get());
+                if (!ValidateDdsFile(exact.get(), size, info)) {
+                    continue;
+                }
+                accepted++;
+
+                DdsInfo parsed;
+                roundTrips = roundTrips && BuildDdsHeader(info, header) &&
+                    ParseDdsHeader(header.data(), header.size(), 0, parsed) && SameShape(parsed, info);
+                uint64_t end = info.dataOffset + GetDdsTextureBytes(info, 0);
+                truncationsRejected = truncationsRejected && !ValidateDdsFile(exact.get(), (size_t)end - 1, parsed);
+
+                if (IsBlockDecodeSupported(info.format) || GetDdsPixelBytes(info.format) == 4) {
+                    uint32_t width = 0, height = 0;
+                    bool ok = DecodeDdsImage(exact.get(), size, info.arraySize * info.faces - 1, info.mipCount - 1, pixels, width, height);
+                    decodes = decodes && ok && width == GetDdsMipWidth(info, info.mipCount - 1);
+                    decoded += ok ? 1 : 0;
+                }
+            }
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            totalMutants += mutantsPerSeed;
+            totalAccepted += accepted;
+
+            const DdsInfo& shape = shapes[seed];
+            file << seed << ',' << shape.format << ',' << shape.width << ',' << shape.height << ','
+                << shape.arraySize * shape.faces << ',' << mutantsPerSeed << ',' << accepted << ',' << decoded << '\n';
+        }
+
+        file << "checks,seeds " << (seedsOk ? "ok" : "failed") << ",round trips " << (roundTrips ? "ok" : "failed")
+            << ",truncations " << (truncationsRejected ? "rejected" : "accepted") << ",decodes " << (decodes ? "ok" : "failed")
+            << ',' << totalMutants << " mutants," << totalAccepted << " accepted," << (uint64_t)(totalMutants / seconds)
+            << " per s\n";
+        return file.good() && seedsOk && roundTrips && truncationsRejected && decodes;
+    }
+}
+
+int main(int argc, char** argv) {
+    uint32_t mutantsPerSeed = argc > 1 ? (uint32_t)atol(argv[1]) : 16384;
+    bool ok = RunDdsFuzzTest("dds_fuzz.csv", mutantsPerSeed);
+    printf("dds fuzz checks %s\n", ok ? "passed" : "failed");
+    return ok ? 0 : 1;
+}
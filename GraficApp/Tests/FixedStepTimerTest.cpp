@@ -0,0 +1,88 @@
+#include "AnimationKernels.h"
+#include "FixedStepTimer.h"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// Runs StepAnimation, the cube rotation of Renderer::SimulateStep, for ten seconds at several
+// render rates; at 3 rad/s the angle wraps at 2 pi four times. The state after each step must
+// be bit-identical whatever the rate, every step must keep the angle in [0, 2 pi] with
+// prevAngle one step behind it, and the interpolated angle must follow real time across the
+// wraps. Then checks the catch-up cap and the dropped backlog
+namespace {
+    const double Step = 1.0 / 60.0;
+    const double Duration = 10.0;
+    const float Speed = 3.0f;
+    const float TwoPi = 6.283185307f;
+
+    struct RateResult {
+        std::vector<float> angles; // after each step
+        int wraps = 0;
+        bool wrapOk = true;        // angle in range and prevAngle one step behind it
+        double maxLag = 0.0;       // between the interpolated angle and real time, in steps
+    };
+
+    RateResult Run(double rate) {
+        RateResult result;
+        FixedStepTimer timer(Step);
+        InstanceAnimation animation;
+        animation.Resize(1);
+        animation.speed[0] = Speed;
+        double time = 0.0;
+        for (int frame = 0; time < Duration; frame++) {
+            double elapsed = 1.0 / rate;
+            time += elapsed;
+            int steps = timer.Advance(elapsed);
+            for (int i = 0; i < steps; i++) {
+                float before = animation.angle[0];
+                StepAnimation(animation, (float)Step);
+                float angle = animation.angle[0], prevAngle = animation.prevAngle[0];
+                result.wraps += angle < before ? 1 : 0;
+                result.wrapOk = result.wrapOk && angle >= 0.0f && angle <= TwoPi &&
+                    fabs(angle - prevAngle - Speed * Step) < 1e-5;
+                result.angles.push_back(angle);
+            }
+            // Rendering is one step behind the accumulated time, blended by alpha; there is
+            // nothing to blend before the first step
+            if (timer.GetStepIndex() == 0) {
+                continue;
+            }
+            double alpha = timer.GetAlpha();
+            float angle = animation.angle[0], prevAngle = animation.prevAngle[0];
+            double shown = prevAngle + (angle - prevAngle) * alpha + (double)TwoPi * result.wraps;
+            double lag = (Speed * (time - Step) - shown) / (Speed * Step);
+            result.maxLag = fabs(lag) > result.maxLag ? fabs(lag) : result.maxLag;
+        }
+        return result;
+    }
+}
+
+int main() {
+    const double rates[] = { 30.0, 60.0, 144.0, 1000.0 };
+    RateResult reference = Run(rates[0]);
+    bool identical = true, smooth = true;
+    for (double rate : rates) {
+        RateResult result = Run(rate);
+        size_t common = result.angles.size() < reference.angles.size() ? result.angles.size() : reference.angles.size();
+        for (size_t i = 0; i < common; i++) {
+            identical = identical && result.angles[i] == reference.angles[i];
+        }
+        // The last step may be missing from rounding of the accumulated time
+        smooth = smooth && result.maxLag < 0.01 && result.angles.size() + 1 >= (size_t)(Duration / Step) &&
+            result.wraps == (int)(Speed * Duration / TwoPi) && result.wrapOk;
+        printf("%.0f Hz: %d steps, %d wraps, max lag %.3f steps\n", rate, (int)result.angles.size(), result.wraps,
+            result.maxLag);
+    }
+
+    FixedStepTimer timer(Step, 8);
+    int capped = timer.Advance(20 * Step);
+    bool backlogDropped = capped == 8 && timer.GetAlpha() == 0.0 && timer.GetStepIndex() == 8;
+    bool negativeIgnored = timer.Advance(-1.0) == 0 && timer.GetStepIndex() == 8;
+    timer.Reset(0.0);
+    bool resetOk = timer.GetStep() == 1.0 / 60.0 && timer.GetStepIndex() == 0 && timer.GetTime() == 0.0;
+
+    printf("identical %s, interpolation %s, cap %s, negative elapsed %s, reset %s\n", identical ? "ok" : "failed",
+        smooth ? "ok" : "failed", backlogDropped ? "ok" : "failed", negativeIgnored ? "ok" : "failed", resetOk ? "ok" : "failed");
+    return identical && smooth && backlogDropped && negativeIgnored && resetOk ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+#include "FrameGraph.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Compiles the graph Renderer::BuildFrameGraph builds and runs it on a fake backend: unused
+// passes are culled, post intermediates alias the scene target once it is dead, the unbinds
+// D3D11 needs are in place and no physical target is handed out while still held. Then times
+// Compile() on synthetic graphs of growing size and writes passes,transient,culled,physical,
+// compile_us rows to frame_graph_benchmark.csv.
+// Usage: FrameGraphTest [<iterations>], 1000 for stable timings
+namespace {
+    const RenderTargetDesc ColorDesc = { 1280, 720, 10, 40, 1 };
+    const RenderTargetDesc DepthDesc = { 1280, 720, 40, 64, 1 };
+
+    class FakeFrameGraphBackend : public IFrameGraphBackend {
+    public:
+        bool Acquire(int physical, const RenderTargetDesc&) override {
+            if ((int)held_.size() <= physical) {
+                held_.resize(physical + 1, false);
+            }
+            error_ = error_ || held_[physical];
+            held_[physical] = true;
+            return true;
+        };
+
+        void Release(int physical) override {
+            error_ = error_ || physical >= (int)held_.size() || !held_[physical];
+            held_[physical] = false;
+        };
+
+        void Barrier(const FrameGraphBarrier& barrier) override {
+            barriers_.push_back(barrier.type);
+        };
+
+        bool AllReleased() const {
+            for (bool held : held_) {
+                if (held) {
+                    return false;
+                }
+            }
+            return !error_;
+        };
+
+        size_t GetBarrierCount() const { return barriers_.size(); };
+    private:
+        std::vector<bool> held_;
+        std::vector<FrameGraphBarrierType> barriers_;
+        bool error_ = false;
+    };
+
+    bool HasBarrier(const FrameGraphCompiledPass& pass, FrameGraphBarrierType type) {
+        for (const FrameGraphBarrier& barrier : pass.barriers) {
+            if (barrier.type == type) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool CheckRendererGraph() {
+        FrameGraph graph;
+        std::vector<std::string> executed;
+        auto record = [&executed](const char* name) {
+            return [&executed, name]() { executed.push_back(name); };
+        };
+
+        int backBuffer = graph.ImportResource("BackBuffer");
+        int depth = graph.CreateResource("Depth", DepthDesc);
+        int color = graph.CreateResource("SceneColor", ColorDesc);
+        const char* scenePasses[] = { "Opaque", "Skybox", "Transparent" };
+        for (const char* name : scenePasses) {
+            int pass = graph.AddPass(name, record(name));
+            graph.Write(pass, color);
+            graph.Write(pass, depth);
+        }
+        int pass = graph.AddPass("ImGui", record("ImGui"));
+        graph.Write(pass, color);
+        // Nothing reads the debug target, the pass must not run
+        pass = graph.AddPass("Debug", record("Debug"));
+        graph.Read(pass, color);
+        graph.Write(pass, graph.CreateResource("DebugTarget", ColorDesc));
+
+        // Three post passes like the default chain
+        std::vector<int> post = { color };
+        for (int i = 0; i < 3; i++) {
+            post.push_back(i == 2 ? backBuffer : graph.CreateResource("PostIntermediate", ColorDesc));
+            pass = graph.AddPass("PostEffect", record("PostEffect"));
+            graph.Read(pass, post[i]);
+            graph.Write(pass, post[i + 1]);
+        }
+
+        if (!graph.Compile()) {
+            printf("renderer graph failed to compile\n");
+            return false;
+        }
+        const std::vector<FrameGraphCompiledPass>& compiled = graph.GetCompiledPasses();
+        bool cullOk = graph.GetCulledCount() == 1 && compiled.size() == 7;
+        // The second intermediate starts after the scene target's last read
+        bool aliasOk = graph.GetTransientCount() == 4 && graph.GetPhysicalCount() == 3 &&
+            graph.GetPhysical(post[2]) == graph.GetPhysical(color) && graph.GetPhysical(post[1]) != graph.GetPhysical(color) &&
+            graph.GetPhysical(backBuffer) == -1;
+        // The first post pass reads what ImGui drew into, the second one overwrites what the first read
+        bool barriersOk = cullOk && HasBarrier(compiled[4], FrameGraphBarrierType::UnbindRenderTargets) &&
+            HasBarrier(compiled[5], FrameGraphBarrierType::UnbindShaderResources) &&
+            HasBarrier(compiled[5], FrameGraphBarrierType::UnbindRenderTargets) && compiled[0].barriers.empty();
+
+        FakeFrameGraphBackend backend;
+        bool executeOk = graph.Execute(backend) && backend.AllReleased() && executed.size() == 7 &&
+            executed[3] == "ImGui" && executed[4] == "PostEffect";
+        printf("renderer graph: cull %s, alias %s, barriers %s, execute %s\n", cullOk ? "ok" : "failed",
+            aliasOk ? "ok" : "failed", barriersOk ? "ok" : "failed", executeOk ? "ok" : "failed");
+        return cullOk && aliasOk && barriersOk && executeOk;
+    }
+
+    // A live pass reading a target nothing wrote is a graph error
+    bool CheckReadBeforeWrite() {
+        FrameGraph graph;
+        int backBuffer = graph.ImportResource("BackBuffer");
+        int pass = graph.AddPass("Post", nullptr);
+        graph.Read(pass, graph.CreateResource("Never written", ColorDesc));
+        graph.Write(pass, backBuffer);
+        bool ok = !graph.Compile() && graph.GetCompiledPasses().empty();
+        printf("read before write %s\n", ok ? "rejected" : "accepted");
+        return ok;
+    }
+
+    bool RunFrameGraphBenchmark(const std::string& fileName, int iterations) {
+        std::ofstream file(fileName, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        const RenderTargetDesc descs[2] = {
+            { 1920, 1080, 10, 40, 1 },
+            { 960, 540, 10, 40, 1 }
+        };
+
+        FrameGraph graph;
+        file << "passes,transient,culled,physical,compile_us\n";
+        for (int passCount = 8; passCount <= 2048; passCount *= 4) {
+            double totalUs = 0.0;
+            for (int iteration = 0; iteration < iterations; iteration++) {
+                // Each pass reads the outputs of the two before it, every fourth one feeds nothing
+                graph.Reset();
+                int output = graph.ImportResource("BackBuffer");
+                std::vector<int> targets;
+                for (int i = 0; i < passCount; i++) {
+                    int pass = graph.AddPass("Pass", nullptr);
+                    if (i > 0) {
+                        graph.Read(pass, targets[i - 1]);
+                    }
+                    if (i > 1) {
+                        graph.Read(pass, targets[i - 2]);
+                    }
+                    targets.push_back(graph.CreateResource("Target", descs[i % 2]));
+                    graph.Write(pass, i + 1 == passCount ? output : targets.back());
+                    if (i % 4 == 3) {
+                        graph.Write(graph.AddPass("Unused", nullptr), graph.CreateResource("Unused", descs[0]));
+                    }
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                if (!graph.Compile()) {
+                    return false;
+                }
+                auto end = std::chrono::steady_clock::now();
+                totalUs += std::chrono::duration<double, std::micro>(end - start).count();
+            }
+
+            file << graph.GetPassCount() << ',' << graph.GetTransientCount() << ',' << graph.GetCulledCount() << ','
+                << graph.GetPhysicalCount() << ',' << totalUs / iterations << '\n';
+        }
+
+        return file.good();
+    }
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 20;
+    bool graphOk = CheckRendererGraph();
+    bool readOk = CheckReadBeforeWrite();
+    bool benchmarkOk = RunFrameGraphBenchmark("frame_graph_benchmark.csv", iterations);
+    printf("benchmark %s\n", benchmarkOk ? "written" : "failed");
+    return graphOk && readOk && benchmarkOk ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+#include "FramePacer.h"
+
+#include <cmath>
+#include <cstdio>
+
+// Drives FramePacer with a simulated clock: sleeps overshoot by a set amount and every clock
+// read while spinning costs a microsecond. Checks that Wait() holds the target period, that
+// only the spin threshold is spun, that a missed frame restarts the schedule instead of
+// bursting, and that GetStats() reports known intervals exactly
+namespace {
+    const double SpinStep = 1e-6;
+
+    class FakeClock : public IClock {
+    public:
+        explicit FakeClock(double overshoot) : overshoot_(overshoot) {};
+
+        // A read inside Wait() is one turn of the spin loop
+        double Now() override {
+            double now = time_;
+            time_ += SpinStep;
+            spun_ += SpinStep;
+            return now;
+        };
+
+        void SleepFor(double seconds) override {
+            time_ += seconds + overshoot_;
+            slept_ += seconds + overshoot_;
+        };
+
+        // Frame work between two waits
+        void Advance(double seconds) { time_ += seconds; };
+
+        void ResetCounters() {
+            slept_ = 0.0;
+            spun_ = 0.0;
+        };
+
+        double GetSlept() const { return slept_; };
+        double GetSpun() const { return spun_; };
+    private:
+        double overshoot_;
+        double time_ = 1.0;
+        double slept_ = 0.0;
+        double spun_ = 0.0;
+    };
+
+    bool Near(double a, double b, double tolerance) {
+        return fabs(a - b) <= tolerance;
+    }
+
+    // Frames with 3 ms of work at 100 fps, a frame is Wait() then MarkPresent()
+    bool CheckPeriod(double overshoot) {
+        const double period = 0.01, work = 0.003, threshold = 0.002;
+        FakeClock clock(overshoot);
+        FramePacer pacer(clock);
+        pacer.SetTargetFps(100.0);
+        pacer.SetSpinThreshold(threshold);
+
+        bool spinOk = true;
+        for (int frame = 0; frame < 200; frame++) {
+            clock.ResetCounters();
+            pacer.Wait();
+            // The sleep leaves the threshold minus its overshoot to spin, a few reads of slack
+            if (frame > 0) {
+                spinOk = spinOk && clock.GetSpun() <= threshold - overshoot + 10 * SpinStep &&
+                    clock.GetSlept() >= period - work - threshold - 10 * SpinStep;
+            }
+            pacer.MarkPresent();
+            clock.Advance(work);
+        }
+
+        FrameStats stats = pacer.GetStats();
+        bool periodOk = Near(stats.averageMs, 10.0, 0.01) && stats.deviationMs < 0.01 && stats.maxMs < 10.01;
+        printf("overshoot %.1f ms: average %.4f ms, deviation %.4f ms, period %s, spin %s\n", overshoot * 1000.0,
+            stats.averageMs, stats.deviationMs, periodOk ? "held" : "missed", spinOk ? "within threshold" : "too long");
+        return periodOk && spinOk;
+    }
+
+    // One 35 ms frame at 100 fps: the next frames are paced again, none comes early to catch up
+    bool CheckMissedFrame() {
+        FakeClock clock(0.0005);
+        FramePacer pacer(clock);
+        pacer.SetTargetFps(100.0);
+
+        double lastPresent = 0.0, shortest = 1.0;
+        for (int frame = 0; frame < 40; frame++) {
+            pacer.Wait();
+            double now = clock.Now();
+            if (frame > 21) {
+                shortest = now - lastPresent < shortest ? now - lastPresent : shortest;
+            }
+            lastPresent = now;
+            clock.Advance(frame == 20 ? 0.035 : 0.002);
+        }
+        bool ok = shortest > 0.0099;
+        printf("missed frame: shortest interval after it %.4f ms, %s\n", shortest * 1000.0, ok ? "no burst" : "burst");
+        return ok;
+    }
+
+    // Intervals of 10, 20, 30 and 40 ms with input sampled 5 ms before each present
+    bool CheckStats() {
+        FakeClock clock(0.0);
+        FramePacer pacer(clock);
+        FrameStats empty = pacer.GetStats();
+
+        pacer.MarkPresent();
+        const double intervals[] = { 0.010, 0.020, 0.030, 0.040 };
+        for (double interval : intervals) {
+            clock.Advance(interval - 0.005 - SpinStep);
+            pacer.MarkInput();
+            clock.Advance(0.005 - SpinStep);
+            pacer.MarkPresent();
+        }
+        FrameStats stats = pacer.GetStats();
+        bool ok = empty.frames == 0 && stats.frames == 4 && Near(stats.averageMs, 25.0, 1e-6) &&
+            Near(stats.deviationMs, sqrt(125.0), 1e-6) && Near(stats.minMs, 10.0, 1e-6) && Near(stats.maxMs, 40.0, 1e-6) &&
+            Near(stats.latencyMs, 5.0, 1e-6);
+
+        // Only the last HistorySize intervals count
+        for (int i = 0; i < FramePacer::HistorySize; i++) {
+            clock.Advance(0.002 - SpinStep);
+            pacer.MarkPresent();
+        }
+        FrameStats history = pacer.GetStats();
+        ok = ok && history.frames == FramePacer::HistorySize && Near(history.averageMs, 2.0, 1e-6) &&
+            Near(history.maxMs, 2.0, 1e-6);
+        printf("stats: average %.3f ms, deviation %.3f ms, min %.3f ms, max %.3f ms, latency %.3f ms, %s\n",
+            stats.averageMs, stats.deviationMs, stats.minMs, stats.maxMs, stats.latencyMs, ok ? "ok" : "failed");
+        return ok;
+    }
+}
+
+int main() {
+    bool ok = CheckPeriod(0.0);
+    ok = CheckPeriod(0.0015) && ok;
+    ok = CheckMissedFrame() && ok;
+    ok = CheckStats() && ok;
+    printf("%s\n", ok ? "all checks passed" : "some checks failed");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#include "ImageKernels.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Runs every ImageKernels kernel with both paths on a frame whose width is not a multiple of
+// the vector width and checks that the results are bit-identical, then times the kernels and
+// writes kernel,path,ms,mpixels_per_s rows to image_benchmark.csv. Images smaller than an SSIM
+// block must still tell a changed pixel apart.
+// Usage: ImageKernelsTest [<width> <height> [<iterations>]], 3840 2160 20 for a 4K run
+namespace {
+    struct Frame {
+        std::vector<float> hdr;
+        std::vector<uint8_t> a;
+        std::vector<uint8_t> b;
+        double psnr = 0.0;
+        double ssim = 0.0;
+    };
+
+    void FillInputs(Frame& frame, size_t pixelCount) {
+        frame.hdr.resize(pixelCount * 4);
+        frame.a.assign(pixelCount * 4, 0);
+        frame.b.resize(pixelCount * 4);
+        for (size_t i = 0; i < frame.hdr.size(); i++) {
+            // Out of range values check the saturation
+            frame.hdr[i] = (float)(i % 1021) / 900.0f - 0.05f;
+            frame.b[i] = (uint8_t)(i * 7 % 251);
+        }
+    }
+
+    Frame RunKernels(ImageKernelPath path, int width, int height) {
+        SetImageKernelPath(path);
+        Frame frame;
+        FillInputs(frame, (size_t)width * height);
+        ConvertRGBA32FToBGRA8(frame.hdr.data(), width, frame.a.data(), width, height);
+        frame.psnr = ComputePSNR(frame.a.data(), frame.b.data(), width, height);
+        frame.ssim = ComputeSSIM(frame.a.data(), frame.b.data(), width, height);
+        InvertRGBA32F(frame.hdr.data(), width, height, width);
+        InvertRGBA8(frame.b.data(), width, height, width);
+        return frame;
+    }
+
+    bool SameFrame(const Frame& x, const Frame& y) {
+        return memcmp(x.hdr.data(), y.hdr.data(), x.hdr.size() * sizeof(float)) == 0 && x.a == y.a && x.b == y.b &&
+            x.psnr == y.psnr && x.ssim == y.ssim;
+    }
+
+    // Images smaller than a block used to score 1 whatever their pixels
+    bool CheckSmallImageSSIM(int width, int height) {
+        std::vector<uint8_t> a((size_t)width * height * 4), b;
+        for (size_t i = 0; i < a.size(); i++) {
+            a[i] = (uint8_t)(i * 37 % 256);
+        }
+        b = a;
+        double same = ComputeSSIM(a.data(), b.data(), width, height);
+        b[(a.size() / 8) * 4 + 1] ^= 0x80;
+        double changed = ComputeSSIM(a.data(), b.data(), width, height);
+        bool ok = same == 1.0 && changed < 1.0;
+        printf("%dx%d ssim same %.5f, changed %.5f, %s\n", width, height, same, changed, ok ? "ok" : "failed");
+        return ok;
+    }
+
+    double TimeKernel(int iterations, const std::function<void()>& kernel) {
+        // The first run touches the memory and wakes the workers
+        kernel();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            kernel();
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+    }
+
+    bool RunImageBenchmark(const std::string& fileName, int width, int height, int iterations) {
+        std::ofstream file(fileName, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        size_t pixelCount = (size_t)width * height;
+        Frame frame;
+        FillInputs(frame, pixelCount);
+        std::vector<float>& hdr = frame.hdr;
+        std::vector<uint8_t>& a = frame.a;
+        std::vector<uint8_t>& b = frame.b;
+
+        struct Kernel {
+            const char* name;
+            std::function<void()> run;
+        };
+        const Kernel kernels[] = {
+            { "invert_rgba32f", [&]() { InvertRGBA32F(hdr.data(), width, height, width); } },
+            { "invert_rgba8", [&]() { InvertRGBA8(b.data(), width, height, width); } },
+            { "convert_bgra8", [&]() { ConvertRGBA32FToBGRA8(hdr.data(), width, a.data(), width, height); } },
+            { "psnr", [&]() { ComputePSNR(a.data(), b.data(), width, height); } },
+            { "ssim", [&]() { ComputeSSIM(a.data(), b.data(), width, height); } }
+        };
+
+        file << "kernel,path,ms,mpixels_per_s\n";
+        for (int path = 0; path < 2; path++) {
+            if (path == (int)ImageKernelPath::AVX2 && !IsAVX2Supported()) {
+                continue;
+            }
+            SetImageKernelPath((ImageKernelPath)path);
+            for (const Kernel& kernel : kernels) {
+                double ms = TimeKernel(iterations, kernel.run);
+                file << kernel.name << ',' << (path == 0 ? "scalar" : "avx2") << ',' << ms << ','
+                    << pixelCount / (ms * 1000.0) << '\n';
+            }
+        }
+        return file.good();
+    }
+}
+
+int main(int argc, char** argv) {
+    int width = argc > 2 ? atoi(argv[1]) : 1021;
+    int height = argc > 2 ? atoi(argv[2]) : 577;
+    int iterations = argc > 3 ? atoi(argv[3]) : 5;
+
+    ImageKernelPath previous = GetImageKernelPath();
+    bool identical = true;
+    if (IsAVX2Supported()) {
+        identical = SameFrame(RunKernels(ImageKernelPath::Scalar, width, height), RunKernels(ImageKernelPath::AVX2, width, height));
+        printf("scalar and avx2 paths %s\n", identical ? "identical" : "differ");
+    }
+    else {
+        printf("no avx2, only the scalar path is checked\n");
+    }
+
+    bool smallOk = CheckSmallImageSSIM(5, 3) && CheckSmallImageSSIM(1, 1) && CheckSmallImageSSIM(4, 100);
+
+    bool benchmarkOk = RunImageBenchmark("image_benchmark.csv", width, height, iterations);
+    SetImageKernelPath(previous);
+    printf("%dx%d benchmark %s\n", width, height, benchmarkOk ? "written" : "failed");
+    return identical && smallOk && benchmarkOk ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+#include "InstanceBvh.h"
+#include "InstancePacking.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Picks the corner of a cube with the box of the mesh the renderer draws, then builds a BVH
+// over random rotated and scaled cubes, times builds and picks, compares the hits with brute
+// force and with a BVH read back from a scene file; writes step,value rows to
+// picking_benchmark.csv.
+// Usage: InstanceBvhTest [<instances>], 1000000 for the full benchmark
+namespace {
+    // A ray through the corner of a unit scale cube in front of a bigger one has to stop at the
+    // front cube. CubeVertices in renderer.cpp span -1..1, a half size box misses the corner and
+    // selects the cube behind it
+    bool CheckCubeCorner() {
+        const float boxMin[3] = { -1.0f, -1.0f, -1.0f };
+        const float boxMax[3] = { 1.0f, 1.0f, 1.0f };
+        const InstanceTransform transforms[2] = {
+            { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 1.0f, 0.0f, 0, false },
+            { { 0.0f, 0.0f, 5.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 2.0f, 0.0f, 0, false }
+        };
+        float matrices[2 * 16], bounds[2 * 6];
+        for (int i = 0; i < 2; i++) {
+            BuildWorldMatrix(transforms[i], matrices + i * 16);
+        }
+        ComputeInstanceBounds(matrices, 2, boxMin, boxMax, bounds);
+        InstanceBvh bvh;
+        bvh.Build(bounds, 2);
+
+        const PickRay ray = { { 0.9f, 0.9f, -10.0f }, { 0.0f, 0.0f, 1.0f } };
+        PickHit hit;
+        bool ok = bvh.Pick(ray, matrices, boxMin, boxMax, hit) && hit.instance == 0 && fabsf(hit.distance - 9.0f) < 1e-4f;
+        printf("cube corner %s\n", ok ? "picked" : "missed");
+        return ok;
+    }
+
+    bool RunPickingBenchmark(const std::string& fileName, uint32_t instanceCount) {
+        std::ofstream file(fileName, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        // Unit cubes, randomly rotated and scaled, in a 1000 unit box
+        const float boxMin[3] = { -0.5f, -0.5f, -0.5f };
+        const float boxMax[3] = { 0.5f, 0.5f, 0.5f };
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> scale(0.5f, 4.0f);
+        std::vector<float> matrices((size_t)instanceCount * 16);
+        for (uint32_t i = 0; i < instanceCount; i++) {
+            InstanceTransform transform = {};
+            float q[4] = { unit(random), unit(random), unit(random), unit(random) };
+            float length = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]) + 1e-6f;
+            for (int k = 0; k < 3; k++) {
+                transform.position[k] = unit(random) * 500.0f;
+            }
+            for (int k = 0; k < 4; k++) {
+                transform.rotation[k] = q[k] / length;
+            }
+            transform.scale = scale(random);
+            BuildWorldMatrix(transform, &matrices[(size_t)i * 16]);
+        }
+
+        auto now = []() { return std::chrono::steady_clock::now(); };
+        auto ms = [](std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+            return std::chrono::duration<double, std::milli>(end - start).count();
+        };
+
+        auto start = now();
+        std::vector<float> bounds((size_t)instanceCount * 6);
+        ComputeInstanceBounds(matrices.data(), instanceCount, boxMin, boxMax, bounds.data());
+        auto boundsEnd = now();
+        InstanceBvh bvh;
+        bvh.Build(bounds.data(), instanceCount);
+        auto buildEnd = now();
+
+        // Rays from outside the box, most aimed at an instance so the traversal has to go deep
+        const int rayCount = 1000, bruteCount = 100;
+        std::vector<PickRay> rays(rayCount);
+        for (PickRay& ray : rays) {
+            float target[3];
+            uint32_t instance = random() % instanceCount;
+            for (int k = 0; k < 3; k++) {
+                ray.origin[k] = unit(random) * 800.0f;
+                target[k] = (random() % 4 != 0 ? matrices[(size_t)instance * 16 + 12 + k] : unit(random) * 500.0f) - ray.origin[k];
+            }
+            float length = sqrtf(target[0] * target[0] + target[1] * target[1] + target[2] * target[2]);
+            for (int k = 0; k < 3; k++) {
+                ray.direction[k] = target[k] / length;
+            }
+        }
+
+        std::vector<PickHit> hits(rayCount);
+        double totalUs = 0.0, maxUs = 0.0;
+        int hitCount = 0;
+        for (int i = 0; i < rayCount; i++) {
+            auto pickStart = now();
+            hitCount += bvh.Pick(rays[i], matrices.data(), boxMin, boxMax, hits[i]) ? 1 : 0;
+            double us = ms(pickStart, now()) * 1000.0;
+            totalUs += us;
+            maxUs = us > maxUs ? us : maxUs;
+        }
+
+        // Brute force agrees on the instance and the distance
+        auto same = [](const PickHit& a, const PickHit& b) {
+            return a.instance == b.instance && (a.instance == UINT32_MAX || fabsf(a.distance - b.distance) <= 1e-4f * (1.0f + a.distance));
+        };
+        int mismatches = 0;
+        double bruteUs = 0.0;
+        for (int i = 0; i < bruteCount; i++) {
+            PickHit reference;
+            auto bruteStart = now();
+            PickBruteForce(rays[i], matrices.data(), instanceCount, boxMin, boxMax, reference);
+            bruteUs += ms(bruteStart, now()) * 1000.0;
+            mismatches += same(hits[i], reference) ? 0 : 1;
+        }
+
+        // The same BVH stored in a scene file and read back
+        SceneData scene;
+        scene.x.assign(instanceCount, 0.0f);
+        scene.y.assign(instanceCount, 0.0f);
+        scene.z.assign(instanceCount, 0.0f);
+        scene.speed.assign(instanceCount, 0.0f);
+        scene.material.assign(instanceCount, 0);
+        scene.materials.push_back({ 5.0f, 0, 0, 0 });
+        scene.bvhNodes = bvh.GetNodes();
+        scene.bvhIndices = bvh.GetIndices();
+        std::vector<uint8_t> bytes;
+        SerializeSceneFile(scene, bytes);
+        std::vector<uint64_t> aligned((bytes.size() + 7) / 8);
+        memcpy(aligned.data(), bytes.data(), bytes.size());
+        SceneFile sceneFile;
+        int storedMismatches = 0;
+        if (!sceneFile.Attach(aligned.data(), bytes.size()) || !sceneFile.HasBvh()) {
+            storedMismatches = rayCount;
+        }
+        else {
+            InstanceBvh stored;
+            stored.Assign(sceneFile.GetBvhNodes(), sceneFile.GetHeader().bvhNodeCount, sceneFile.GetBvhIndices(), sceneFile.GetBvhIndexCount());
+            for (int i = 0; i < rayCount; i++) {
+                PickHit hit;
+                stored.Pick(rays[i], matrices.data(), boxMin, boxMax, hit);
+                storedMismatches += same(hits[i], hit) ? 0 : 1;
+            }
+        }
+
+        file << "step,value\n";
+        file << "instances," << instanceCount << '\n';
+        file << "bounds_ms," << ms(start, boundsEnd) << '\n';
+        file << "build_ms," << ms(boundsEnd, buildEnd) << '\n';
+        file << "binary_nodes," << bvh.GetNodes().size() << '\n';
+        file << "wide_nodes," << bvh.GetWideNodeCount() << '\n';
+        file << "pick_avg_us," << totalUs / rayCount << '\n';
+        file << "pick_max_us," << maxUs << '\n';
+        file << "hits," << hitCount << '/' << rayCount << '\n';
+        file << "brute_force_avg_us," << bruteUs / bruteCount << '\n';
+        file << "brute_force_mismatches," << mismatches << '/' << bruteCount << '\n';
+        file << "stored_bvh_mismatches," << storedMismatches << '/' << rayCount << '\n';
+
+        printf("%u instances: %d/%d hits, %.2f us per pick, brute force mismatches %d/%d, stored bvh mismatches %d/%d\n",
+            instanceCount, hitCount, rayCount, totalUs / rayCount, mismatches, bruteCount, storedMismatches, rayCount);
+        return file.good() && mismatches == 0 && storedMismatches == 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    uint32_t instanceCount = argc > 1 ? (uint32_t)atol(argv[1]) : 100000;
+    bool cornerOk = CheckCubeCorner();
+    bool benchmarkOk = RunPickingBenchmark("picking_benchmark.csv", instanceCount);
+    return cornerOk && benchmarkOk ? 0 : 1;
+}
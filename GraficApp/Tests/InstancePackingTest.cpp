@@ -0,0 +1,100 @@
+#include "InstancePacking.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+
+// Packs and unpacks random transforms and checks the worst errors against what snorm16 and
+// half precision allow, writes them to instance_packing.csv. Then checks the half conversion
+// at its edges: signed zero, infinity, NaN, the largest half and denormals.
+// Usage: InstancePackingTest [<instances>]
+namespace {
+    bool RunInstancePackingTest(const std::string& fileName, int count) {
+        std::ofstream file(fileName, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> positive(0.0f, 1.0f);
+
+        double maxPositionError = 0.0, maxRotationError = 0.0, maxShininessError = 0.0;
+        bool idsMatch = true;
+        for (int i = 0; i < count; i++) {
+            InstanceTransform transform;
+            for (int j = 0; j < 3; j++) {
+                transform.position[j] = unit(random) * 100.0f;
+            }
+            float length = 0.0f;
+            while (length < 1e-3f) {
+                for (int j = 0; j < 4; j++) {
+                    transform.rotation[j] = unit(random);
+                }
+                length = sqrtf(transform.rotation[0] * transform.rotation[0] + transform.rotation[1] * transform.rotation[1] +
+                    transform.rotation[2] * transform.rotation[2] + transform.rotation[3] * transform.rotation[3]);
+            }
+            for (int j = 0; j < 4; j++) {
+                transform.rotation[j] /= length;
+            }
+            transform.scale = 0.1f + positive(random) * 10.0f;
+            transform.shininess = 1.0f + positive(random) * 127.0f;
+            transform.textureIndex = (uint32_t)(random() % 2048);
+            transform.normalMap = (random() & 1) != 0;
+
+            InstanceTransform unpacked = UnpackInstance(PackInstance(transform));
+
+            float expected[16], actual[16];
+            BuildWorldMatrix(transform, expected);
+            BuildWorldMatrix(unpacked, actual);
+            for (int row = 0; row < 3; row++) {
+                for (int column = 0; column < 3; column++) {
+                    // Rotation error relative to the scale, in radians for small errors
+                    double error = fabs(expected[row * 4 + column] - actual[row * 4 + column]) / transform.scale;
+                    maxRotationError = error > maxRotationError ? error : maxRotationError;
+                }
+            }
+            for (int column = 0; column < 3; column++) {
+                double error = fabs(expected[12 + column] - actual[12 + column]);
+                maxPositionError = error > maxPositionError ? error : maxPositionError;
+            }
+            double shininessError = fabs(transform.shininess - unpacked.shininess) / transform.shininess;
+            maxShininessError = shininessError > maxShininessError ? shininessError : maxShininessError;
+            idsMatch = idsMatch && unpacked.textureIndex == transform.textureIndex && unpacked.normalMap == transform.normalMap;
+        }
+
+        // snorm16 steps are 1 / 32767, a half keeps 11 significant bits
+        bool passed = maxPositionError == 0.0 && maxRotationError < 2e-4 && maxShininessError < 1.0 / 2048.0 && idsMatch;
+        file << "instances,packed_bytes,unpacked_bytes,max_position_error,max_rotation_error,max_shininess_error,ids_match,passed\n";
+        file << count << ',' << sizeof(PackedInstance) << ',' << 144 << ',' << maxPositionError << ',' << maxRotationError << ','
+            << maxShininessError << ',' << (idsMatch ? 1 : 0) << ',' << (passed ? 1 : 0) << '\n';
+
+        return file.good() && passed;
+    }
+
+    bool CheckHalf(float value, float expected) {
+        float result = HalfToFloat(FloatToHalf(value));
+        bool ok = std::isnan(expected) ? std::isnan(result) : result == expected && std::signbit(result) == std::signbit(expected);
+        if (!ok) {
+            printf("half of %g is %g, expected %g\n", value, result, expected);
+        }
+        return ok;
+    }
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 100000;
+    bool packingOk = RunInstancePackingTest("instance_packing.csv", count);
+    printf("%d instances %s\n", count, packingOk ? "within precision" : "out of precision");
+
+    const float infinity = INFINITY;
+    bool halfOk = CheckHalf(0.0f, 0.0f) && CheckHalf(-0.0f, -0.0f) && CheckHalf(1.0f, 1.0f) && CheckHalf(-2.5f, -2.5f) &&
+        CheckHalf(65504.0f, 65504.0f) && CheckHalf(1e6f, infinity) && CheckHalf(-infinity, -infinity) &&
+        CheckHalf(NAN, NAN) && CheckHalf(ldexpf(1.0f, -24), ldexpf(1.0f, -24)) && CheckHalf(ldexpf(3.0f, -20), ldexpf(3.0f, -20)) &&
+        CheckHalf(1e-9f, 0.0f);
+    printf("half conversion %s\n", halfOk ? "ok" : "failed");
+    return packingOk && halfOk ? 0 : 1;
+}
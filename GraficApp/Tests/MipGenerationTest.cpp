@@ -0,0 +1,301 @@
+#include "MipGeneration.h"
+#include "BlockCompression.h"
+#include "DdsHeader.h"
+#include "ImageKernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+// Checks both filters against an area average reference, gamma correctness, normal lengths,
+// odd sizes, scalar against AVX2 and the written DDS, then times whole chains of a square
+// image. Writes filter,space,path,mpix_per_s,min_psnr rows and the check results to
+// mip_generation.csv.
+// Usage: MipGenerationTest [<size>], 2048 for the full benchmark
+namespace {
+    // sRGB transfer functions in double precision, bytes rounded to nearest
+    double DecodeSrgb(uint8_t value) {
+        double v = value / 255.0;
+        return v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4);
+    }
+
+    uint8_t EncodeSrgb(double value) {
+        value = value < 0.0 ? 0.0 : (value > 1.0 ? 1.0 : value);
+        double v = value <= 0.0031308 ? value * 12.92 : 1.055 * pow(value, 1.0 / 2.4) - 0.055;
+        return (uint8_t)(v * 255.0 + 0.5);
+    }
+
+    uint8_t EncodeUNorm(float value) {
+        value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+        return (uint8_t)(value * 255.0f + 0.5f);
+    }
+
+    // sRGB content with smooth gradients, stripes near the Nyquist limit and noise
+    void MakeColorImage(uint32_t width, uint32_t height, std::vector<uint8_t>& pixels) {
+        std::mt19937 random(5);
+        pixels.resize((size_t)width * height * 4);
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                float u = x / (float)width, v = y / (float)height;
+                float stripes = ((x / 2 + y / 3) & 1) ? 60.0f : -60.0f;
+                uint8_t* p = pixels.data() + ((size_t)y * width + x) * 4;
+                float values[4] = { 120.0f + 100.0f * sinf(u * 12.0f) + (v > 0.5f ? stripes : 0.0f), 255.0f * v,
+                    128.0f + (u < 0.5f ? stripes : 0.0f) + (float)(random() % 31) - 15.0f, 255.0f * u };
+                for (int c = 0; c < 4; c++) {
+                    p[c] = (uint8_t)std::min(std::max(values[c], 0.0f), 255.0f);
+                }
+            }
+        }
+    }
+
+    // Hemispherical bumps, the kind of detail whose averaged normals come out short
+    void MakeNormalImage(uint32_t width, uint32_t height, std::vector<uint8_t>& pixels) {
+        const float Cell = 6.0f;
+        pixels.resize((size_t)width * height * 4);
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                float dx = fmodf(x + 0.5f, Cell) / Cell * 2.0f - 1.0f, dy = fmodf(y + 0.5f, Cell) / Cell * 2.0f - 1.0f;
+                float r2 = dx * dx + dy * dy;
+                float n[3] = { 0.0f, 0.0f, 1.0f };
+                if (r2 < 0.9f) {
+                    n[0] = dx;
+                    n[1] = dy;
+                    n[2] = sqrtf(1.0f - r2);
+                }
+                uint8_t* p = pixels.data() + ((size_t)y * width + x) * 4;
+                for (int c = 0; c < 3; c++) {
+                    p[c] = EncodeUNorm(n[c] * 0.5f + 0.5f);
+                }
+                p[3] = 255;
+            }
+        }
+    }
+
+    // Exact area averages of a power of two image in linear light, encoded like the generator
+    void MakeReferenceMips(const std::vector<uint8_t>& pixels, uint32_t width, uint32_t height,
+        std::vector<std::vector<uint8_t>>& mips) {
+        std::vector<double> level((size_t)width * height * 4);
+        for (size_t i = 0; i < level.size(); i++) {
+            level[i] = (i & 3) == 3 ? pixels[i] / 255.0 : DecodeSrgb(pixels[i]);
+        }
+        mips.assign(1, pixels);
+        while (width > 1 || height > 1) {
+            uint32_t newWidth = width > 1 ? width / 2 : 1, newHeight = height > 1 ? height / 2 : 1;
+            std::vector<double> next((size_t)newWidth * newHeight * 4);
+            std::vector<uint8_t> bytes(next.size());
+            for (uint32_t y = 0; y < newHeight; y++) {
+                for (uint32_t x = 0; x < newWidth; x++) {
+                    for (int c = 0; c < 4; c++) {
+                        double sum = 0.0;
+                        for (uint32_t sy = 0; sy < height / newHeight; sy++) {
+                            for (uint32_t sx = 0; sx < width / newWidth; sx++) {
+                                sum += level[(((size_t)y * (height / newHeight) + sy) * width + x * (width / newWidth) + sx) * 4 + c];
+                            }
+                        }
+                        size_t i = ((size_t)y * newWidth + x) * 4 + c;
+                        next[i] = sum / ((height / newHeight) * (width / newWidth));
+                        bytes[i] = c == 3 ? EncodeUNorm((float)next[i]) : EncodeSrgb(next[i]);
+                    }
+                }
+            }
+            mips.push_back(bytes);
+            level.swap(next);
+            width = newWidth;
+            height = newHeight;
+        }
+    }
+
+    // Lowest PSNR of the levels below the top against the reference
+    double MinimumPSNR(const std::vector<std::vector<uint8_t>>& mips, const std::vector<std::vector<uint8_t>>& reference,
+        uint32_t width, uint32_t height) {
+        double minimum = std::numeric_limits<double>::infinity();
+        for (size_t mip = 1; mip < mips.size() && mip < reference.size(); mip++) {
+            int w = (int)std::max(width >> mip, 1u), h = (int)std::max(height >> mip, 1u);
+            minimum = std::min(minimum, ComputePSNR(mips[mip].data(), reference[mip].data(), w, h));
+        }
+        return minimum;
+    }
+
+    bool CheckGamma() {
+        // A 0/255 checkerboard averages to half the light, not to byte 128
+        uint8_t checker[16];
+        for (int i = 0; i < 4; i++) {
+            uint8_t value = (i == 0 || i == 3) ? 255 : 0;
+            checker[i * 4] = checker[i * 4 + 1] = checker[i * 4 + 2] = value;
+            checker[i * 4 + 3] = 255;
+        }
+        std::vector<std::vector<uint8_t>> mips;
+        MipSettings settings;
+        settings.filter = MipFilter::Box;
+        bool ok = GenerateMips(checker, 2, 2, settings, mips) && mips.size() == 2 && mips[1][0] == EncodeSrgb(0.5) &&
+            mips[1][0] == 188;
+        settings.srgb = false;
+        return ok && GenerateMips(checker, 2, 2, settings, mips) && mips[1][0] == 128;
+    }
+
+    // Odd sizes halve down to 1x1 and a flat image stays flat through both filters
+    bool CheckOddSizes() {
+        const uint32_t width = 300, height = 17;
+        std::vector<uint8_t> flat((size_t)width * height * 4);
+        for (size_t i = 0; i < flat.size(); i++) {
+            flat[i] = (uint8_t)(40 + 50 * (i & 3));
+        }
+        DdsInfo info = { width, height, 0, 1, 1, DdsFormatRGBA8, 0 };
+        bool ok = GetFullMipCount(width, height) == 9;
+        for (MipFilter filter : { MipFilter::Box, MipFilter::Kaiser }) {
+            MipSettings settings;
+            settings.filter = filter;
+            std::vector<std::vector<uint8_t>> mips;
+            ok = ok && GenerateMips(flat.data(), width, height, settings, mips) && mips.size() == 9;
+            for (uint32_t mip = 0; ok && mip < mips.size(); mip++) {
+                ok = mips[mip].size() == (size_t)GetDdsMipWidth(info, mip) * GetDdsMipHeight(info, mip) * 4;
+                for (size_t i = 0; ok && i < mips[mip].size(); i++) {
+                    ok = mips[mip][i] == flat[i & 3];
+                }
+            }
+        }
+        return ok;
+    }
+
+    // Renormalized levels keep unit normals, plain filtering lets them shrink
+    bool CheckNormals(double& plainLength) {
+        const uint32_t size = 256;
+        std::vector<uint8_t> pixels;
+        MakeNormalImage(size, size, pixels);
+        MipSettings settings;
+        settings.normalMap = true;
+        std::vector<std::vector<uint8_t>> mips, plain;
+        bool ok = GenerateMips(pixels.data(), size, size, settings, mips);
+        settings.normalMap = false;
+        settings.srgb = false;
+        ok = GenerateMips(pixels.data(), size, size, settings, plain) && ok;
+
+        double plainSum = 0.0;
+        size_t plainCount = 0;
+        for (size_t mip = 1; ok && mip < mips.size(); mip++) {
+            for (size_t i = 0; i < mips[mip].size(); i += 4) {
+                double length = 0.0, lengthPlain = 0.0;
+                for (int c = 0; c < 3; c++) {
+                    double n = mips[mip][i + c] / 127.5 - 1.0, p = plain[mip][i + c] / 127.5 - 1.0;
+                    length += n * n;
+                    lengthPlain += p * p;
+                }
+                // 8 bit channels are off by up to half a step each
+                ok = ok && fabs(sqrt(length) - 1.0) < 0.01;
+                plainSum += sqrt(lengthPlain);
+                plainCount++;
+            }
+        }
+        plainLength = plainCount > 0 ? plainSum / plainCount : 0.0;
+        return ok;
+    }
+
+    // The written file parses and gives back every level, BC3 to keep the alpha ramp
+    bool CheckDds() {
+        const uint32_t width = 256, height = 256;
+        std::vector<uint8_t> pixels;
+        MakeColorImage(width, height, pixels);
+        MipSettings settings;
+        std::vector<std::vector<uint8_t>> mips;
+        std::vector<uint8_t> file, decoded;
+        DdsInfo info;
+        bool ok = GenerateMips(pixels.data(), width, height, settings, mips) &&
+            BuildMipChainDds(mips, width, height, DdsFormatRGBA8, file) &&
+            ParseDdsHeader(file.data(), file.size(), file.size(), info) && info.mipCount == mips.size();
+        for (uint32_t mip = 0; ok && mip < info.mipCount; mip++) {
+            uint32_t w = 0, h = 0;
+            ok = DecodeDdsImage(file.data(), file.size(), 0, mip, decoded, w, h) && decoded == mips[mip];
+        }
+        ok = ok && BuildMipChainDds(mips, width, height, DdsFormatBC3, file) &&
+            ParseDdsHeader(file.data(), file.size(), file.size(), info) && info.mipCount == mips.size();
+        // The smallest levels are a single block of very different colors, only the top is measured
+        for (uint32_t mip = 0; ok && mip < info.mipCount; mip++) {
+            uint32_t w = 0, h = 0;
+            ok = DecodeDdsImage(file.data(), file.size(), 0, mip, decoded, w, h) &&
+                (mip > 0 || ComputePSNR(decoded.data(), mips[mip].data(), (int)w, (int)h) > 30.0);
+        }
+        return ok && !BuildMipChainDds(mips, width, height, DdsFormatBC7, file);
+    }
+
+    bool RunMipGenerationBenchmark(const std::string& fileName, uint32_t size) {
+        std::ofstream file(fileName, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        ImageKernelPath previous = GetImageKernelPath();
+
+        double plainLength = 0.0;
+        bool gammaOk = CheckGamma();
+        bool oddOk = CheckOddSizes();
+        bool normalsOk = CheckNormals(plainLength);
+
+        const int iterations = 2;
+        std::vector<uint8_t> color, normal;
+        MakeColorImage(size, size, color);
+        MakeNormalImage(size, size, normal);
+        std::vector<std::vector<uint8_t>> reference;
+        MakeReferenceMips(color, size, size, reference);
+        bool ddsOk = CheckDds();
+
+        file << "filter,space,path,mpix_per_s,min_psnr\n";
+        const struct {
+            MipFilter filter;
+            bool normalMap;
+            const char* filterName;
+            const char* space;
+            double minPSNR;
+        } runs[] = {
+            { MipFilter::Box, false, "box", "linear", 50.0 },
+            { MipFilter::Kaiser, false, "kaiser", "linear", 26.0 },
+            { MipFilter::Kaiser, true, "kaiser", "normal", 0.0 }
+        };
+        bool pathsMatch = true, qualityOk = true;
+        for (const auto& run : runs) {
+            std::vector<std::vector<uint8_t>> mips[2];
+            for (int path = 0; path < 2; path++) {
+                SetImageKernelPath(path == 0 ? ImageKernelPath::Scalar : ImageKernelPath::AVX2);
+                const char* pathName = GetImageKernelPath() == ImageKernelPath::AVX2 ? "avx2" : "scalar";
+                MipSettings settings;
+                settings.filter = run.filter;
+                settings.normalMap = run.normalMap;
+                const std::vector<uint8_t>& source = run.normalMap ? normal : color;
+
+                auto start = std::chrono::steady_clock::now();
+                for (int iteration = 0; iteration < iterations; iteration++) {
+                    GenerateMips(source.data(), size, size, settings, mips[path]);
+                }
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                file << run.filterName << ',' << run.space << ',' << pathName << ','
+                    << (double)size * size * iterations / seconds / 1e6 << ',';
+                if (!run.normalMap) {
+                    double psnr = MinimumPSNR(mips[path], reference, size, size);
+                    qualityOk = qualityOk && psnr >= run.minPSNR;
+                    file << psnr;
+                }
+                file << '\n';
+            }
+            pathsMatch = pathsMatch && mips[0] == mips[1];
+        }
+        SetImageKernelPath(previous);
+
+        file << "checks,gamma " << (gammaOk ? "ok" : "failed") << ",odd sizes " << (oddOk ? "ok" : "failed")
+            << ",normals " << (normalsOk ? "ok" : "failed") << " (plain filtering " << plainLength << "),dds "
+            << (ddsOk ? "ok" : "failed") << ",paths " << (pathsMatch ? "match" : "differ") << ",quality "
+            << (qualityOk ? "ok" : "low") << '\n';
+        return file.good() && gammaOk && oddOk && normalsOk && ddsOk && pathsMatch && qualityOk;
+    }
+}
+
+int main(int argc, char** argv) {
+    uint32_t size = argc > 1 ? (uint32_t)atol(argv[1]) : 512;
+    bool ok = RunMipGenerationBenchmark("mip_generation.csv", size);
+    printf("mip generation checks %s\n", ok ? "passed" : "failed");
+    return ok ? 0 : 1;
+}
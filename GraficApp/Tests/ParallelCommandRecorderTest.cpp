@@ -0,0 +1,138 @@
+#include "ParallelCommandRecorder.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Checks the partition of draw lists into ranges, then records synthetic draws with 1..N
+// threads: the draws must execute in order whatever the thread count, a failed context must
+// keep anything from executing. Writes threads,ranges,record_ms,speedup,ordered rows to
+// record_benchmark.csv.
+// Usage: ParallelCommandRecorderTest [<draws>], 20000 for stable timings
+namespace {
+    // Stands in for deferred contexts: recording burns some CPU per draw, executing appends
+    // the recorded draw ids to one list
+    class SyntheticContextSet : public ICommandContextSet {
+    public:
+        SyntheticContextSet(int contextCount, int failContext = -1) : lists_(contextCount), failContext_(failContext) {};
+
+        int GetContextCount() const override { return (int)lists_.size(); };
+
+        bool Record(int context, const DrawRange& range) override {
+            std::vector<size_t>& list = lists_[context];
+            list.clear();
+            for (size_t i = range.first; i < range.first + range.count; i++) {
+                uint32_t state = (uint32_t)i;
+                for (int j = 0; j < 2000; j++) {
+                    state = state * 1664525u + 1013904223u;
+                }
+                sink_ += state;
+                list.push_back(i);
+            }
+            return context != failContext_;
+        }
+
+        void Execute(int context) override {
+            executed_.insert(executed_.end(), lists_[context].begin(), lists_[context].end());
+        }
+
+        bool IsOrdered(size_t drawCount) const {
+            if (executed_.size() != drawCount) {
+                return false;
+            }
+            for (size_t i = 0; i < drawCount; i++) {
+                if (executed_[i] != i) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        size_t GetExecutedCount() const { return executed_.size(); };
+        void Reset() { executed_.clear(); };
+    private:
+        std::vector<std::vector<size_t>> lists_;
+        std::vector<size_t> executed_;
+        int failContext_;
+        std::atomic<uint32_t> sink_{ 0 };
+    };
+
+    // Ranges cover the list without gaps, respect minDraws and differ by one draw at most
+    bool CheckPartition(size_t drawCount, int contextCount, size_t minDraws, size_t expectedRanges) {
+        std::vector<DrawRange> ranges = ParallelCommandRecorder::Partition(drawCount, contextCount, minDraws);
+        bool ok = ranges.size() == expectedRanges;
+        size_t next = 0, smallest = drawCount, largest = 0;
+        for (const DrawRange& range : ranges) {
+            ok = ok && range.first == next && range.count > 0;
+            next = range.first + range.count;
+            smallest = range.count < smallest ? range.count : smallest;
+            largest = range.count > largest ? range.count : largest;
+        }
+        ok = ok && next == (ranges.empty() ? 0 : drawCount) && (ranges.empty() || largest - smallest <= 1);
+        ok = ok && (ranges.size() <= 1 || smallest >= minDraws);
+        if (!ok) {
+            printf("partition of %d draws into %d contexts, min %d: %d ranges, failed\n", (int)drawCount, contextCount,
+                (int)minDraws, (int)ranges.size());
+        }
+        return ok;
+    }
+
+    bool RunCommandRecordingBenchmark(const std::string& fileName, size_t drawCount) {
+        std::ofstream file(fileName, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        unsigned maxThreads = std::thread::hardware_concurrency();
+        maxThreads = maxThreads > 0 ? maxThreads : 1;
+
+        const int iterations = 10;
+        double baseMs = 0.0;
+        bool allOrdered = true;
+        file << "threads,ranges,record_ms,speedup,ordered\n";
+        for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+            ThreadPool pool(threads);
+            ParallelCommandRecorder recorder(pool);
+            SyntheticContextSet contexts((int)threads);
+
+            double totalMs = 0.0;
+            bool ordered = true;
+            for (int i = 0; i < iterations; i++) {
+                contexts.Reset();
+                recorder.Run(contexts, drawCount, 1);
+                totalMs += recorder.GetRecordMs();
+                ordered = ordered && contexts.IsOrdered(drawCount);
+            }
+            double ms = totalMs / iterations;
+            baseMs = threads == 1 ? ms : baseMs;
+            allOrdered = allOrdered && ordered;
+
+            file << threads << ',' << recorder.GetRangeCount() << ',' << ms << ',' << baseMs / ms << ',' << (ordered ? 1 : 0) << '\n';
+        }
+
+        return file.good() && allOrdered;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t drawCount = argc > 1 ? (size_t)atoi(argv[1]) : 2000;
+
+    bool partitionOk = CheckPartition(0, 4, 1, 0) && CheckPartition(10, 0, 1, 0) && CheckPartition(30, 4, 1, 4) &&
+        CheckPartition(30, 8, 16, 1) && CheckPartition(30, 8, 10, 3) && CheckPartition(7, 16, 1, 7) &&
+        CheckPartition(1000, 3, 64, 3);
+    printf("partition %s\n", partitionOk ? "ok" : "failed");
+
+    ThreadPool pool(4);
+    ParallelCommandRecorder recorder(pool);
+    SyntheticContextSet failing(4, 2);
+    bool failOk = !recorder.Run(failing, 100, 1) && failing.GetExecutedCount() == 0 && recorder.GetExecuteMs() == 0.0;
+    printf("failed context %s\n", failOk ? "executes nothing" : "still executed");
+
+    bool benchmarkOk = RunCommandRecordingBenchmark("record_benchmark.csv", drawCount);
+    printf("%d draws %s\n", (int)drawCount, benchmarkOk ? "executed in order" : "out of order");
+    return partitionOk && failOk && benchmarkOk ? 0 : 1;
+}
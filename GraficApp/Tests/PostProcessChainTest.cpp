@@ -0,0 +1,173 @@
+#include "PostProcessChain.h"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// Plans chains of every shape and checks that the fused passes give the same image as running
+// each stage on its own, that blur splits passes and per-pixel stages fuse up to MaxFusedOps,
+// and that shader keys ignore parameters. Chains that do not ask for an HDR intermediate
+// must give the same output from an input clamped like an 8-bit target
+namespace {
+    const int Width = 61;
+    const int Height = 37;
+    const int Stride = 64;
+
+    std::vector<float> MakeImage() {
+        std::mt19937 random(11);
+        std::uniform_real_distribution<float> value(0.0f, 2.0f);
+        std::vector<float> pixels((size_t)Stride * Height * 4);
+        for (float& pixel : pixels) {
+            pixel = value(random);
+        }
+        return pixels;
+    }
+
+    // Largest difference between the fused plan and the per-stage reference
+    float CompareWithReference(const PostProcessChain& chain) {
+        std::vector<float> reference = MakeImage(), fused = reference;
+        chain.ApplyReference(reference.data(), Width, Height, Stride);
+        PostProcessChain::ApplyPlan(chain.Plan(), fused.data(), Width, Height, Stride);
+        float maxError = 0.0f;
+        for (int y = 0; y < Height; y++) {
+            for (int x = 0; x < Width * 4; x++) {
+                size_t i = (size_t)y * Stride * 4 + x;
+                float error = fabsf(reference[i] - fused[i]);
+                maxError = error > maxError ? error : maxError;
+            }
+        }
+        return maxError;
+    }
+
+    struct ChainCase {
+        const char* name;
+        std::vector<PostEffectType> types;
+        std::vector<bool> enabled;
+        size_t passes;
+    };
+
+    // Largest difference of the chain's output clamped to [0, 1] like the back buffer, between
+    // the image as is and the image clamped like an RGBA8 intermediate
+    float CompareWithClampedInput(const PostProcessChain& chain) {
+        std::vector<float> full = MakeImage(), clamped = full;
+        for (float& pixel : clamped) {
+            pixel = std::fmin(std::fmax(pixel, 0.0f), 1.0f);
+        }
+        chain.ApplyReference(full.data(), Width, Height, Stride);
+        chain.ApplyReference(clamped.data(), Width, Height, Stride);
+        float error = 0.0f;
+        for (size_t i = 0; i < full.size(); i++) {
+            float a = std::fmin(std::fmax(full[i], 0.0f), 1.0f), b = std::fmin(std::fmax(clamped[i], 0.0f), 1.0f);
+            error = std::fmax(error, std::fabs(a - b));
+        }
+        return error;
+    }
+
+    struct FormatCase {
+        const char* name;
+        PostEffectType type;
+        bool enabled;
+        float params[3];
+        bool hdr;
+    };
+
+    bool CheckFormats() {
+        using T = PostEffectType;
+        const FormatCase cases[] = {
+            { "invert", T::Invert, true, { 0.0f, 0.0f, 0.0f }, false },
+            { "neutral grade", T::ColorGrade, true, { 1.0f, 1.0f, 0.0f }, false },
+            { "brighter grade", T::ColorGrade, true, { 1.2f, 1.0f, 0.1f }, false },
+            { "low contrast", T::ColorGrade, true, { 0.8f, 1.0f, 0.0f }, true },
+            { "desaturated", T::ColorGrade, true, { 1.0f, 0.5f, 0.0f }, true },
+            { "darker grade", T::ColorGrade, true, { 1.0f, 1.0f, -0.1f }, true },
+            { "no vignette", T::Vignette, true, { 0.0f, 0.0f, 0.0f }, false },
+            { "vignette", T::Vignette, true, { 1.0f, 0.0f, 0.0f }, true },
+            { "blur", T::Blur, true, { 1.0f, 0.0f, 0.0f }, true },
+            { "tone map", T::ToneMap, true, { 1.0f, 0.0f, 0.0f }, true },
+            { "disabled tone map", T::ToneMap, false, { 1.0f, 0.0f, 0.0f }, false }
+        };
+
+        bool ok = true;
+        for (const FormatCase& test : cases) {
+            PostProcessChain chain;
+            chain.AddStage(test.type, test.enabled, test.params[0], test.params[1], test.params[2]);
+            PostEffectNeeds needs = chain.GetNeeds();
+            IntermediateFormat format = SelectIntermediateFormat(needs);
+            bool formatOk = needs.active == test.enabled && needs.hdr == test.hdr &&
+                format == (test.hdr ? IntermediateFormat::R11G11B10F : IntermediateFormat::RGBA8);
+            // An 8-bit intermediate is only chosen where it cannot change the picture
+            bool clampOk = needs.hdr || CompareWithClampedInput(chain) <= 1e-5f;
+            printf("%s: %s, %s\n", test.name, GetFormatName(format), formatOk && clampOk ? "ok" : "failed");
+            ok = ok && formatOk && clampOk;
+        }
+
+        PostEffectNeeds alpha;
+        alpha.active = true;
+        alpha.alpha = true;
+        bool alphaOk = SelectIntermediateFormat(alpha) == IntermediateFormat::RGBA8;
+        alpha.hdr = true;
+        alphaOk = alphaOk && SelectIntermediateFormat(alpha) == IntermediateFormat::RGBA16F;
+        printf("alpha %s\n", alphaOk ? "ok" : "failed");
+        return ok && alphaOk;
+    }
+}
+
+int main() {
+    using T = PostEffectType;
+    const ChainCase cases[] = {
+        { "empty", {}, {}, 0 },
+        { "invert", { T::Invert }, { true }, 1 },
+        { "per-pixel fused", { T::ToneMap, T::ColorGrade, T::Vignette, T::Invert }, { true, true, true, true }, 1 },
+        { "disabled skipped", { T::ToneMap, T::Blur, T::Invert }, { true, false, true }, 1 },
+        { "blur alone", { T::Blur }, { true }, 2 },
+        { "blur in the middle", { T::ToneMap, T::Blur, T::Vignette, T::Invert }, { true, true, true, true }, 3 },
+        { "two blurs", { T::Blur, T::ColorGrade, T::Blur }, { true, true, true }, 4 },
+        { "all disabled", { T::ToneMap, T::Blur }, { false, false }, 0 }
+    };
+
+    bool ok = true;
+    for (const ChainCase& test : cases) {
+        PostProcessChain chain;
+        for (size_t i = 0; i < test.types.size(); i++) {
+            chain.AddStage(test.types[i], test.enabled[i], 1.3f, 0.8f, 0.05f);
+        }
+        size_t passes = chain.Plan().size();
+        float error = CompareWithReference(chain);
+        bool pass = passes == test.passes && error <= 1e-5f;
+        printf("%s: %d passes, max error %g, %s\n", test.name, (int)passes, error, pass ? "ok" : "failed");
+        ok = ok && pass;
+    }
+
+    // A long run of per-pixel stages is split when a pass is full
+    PostProcessChain longChain;
+    for (int i = 0; i < PostProcessChain::MaxFusedOps * 2 + 1; i++) {
+        longChain.AddStage(i % 2 == 0 ? T::ColorGrade : T::Invert, true, 1.1f, 0.9f, 0.01f);
+    }
+    std::vector<PostPass> longPlan = longChain.Plan();
+    bool opsBounded = true;
+    for (const PostPass& pass : longPlan) {
+        opsBounded = opsBounded && pass.ops.size() <= (size_t)PostProcessChain::MaxFusedOps;
+    }
+    float longError = CompareWithReference(longChain);
+    bool longOk = longPlan.size() >= 2 && opsBounded && longError <= 1e-5f;
+    printf("long chain: %d passes, max error %g, %s\n", (int)longPlan.size(), longError, longOk ? "ok" : "failed");
+
+    // Parameters live in the constant buffer, only the op sequence picks the shader
+    PostProcessChain a, b, c;
+    a.AddStage(T::ToneMap, true, 1.0f);
+    a.AddStage(T::Vignette, true, 0.5f);
+    b.AddStage(T::ToneMap, true, 2.0f);
+    b.AddStage(T::Vignette, true, 1.5f);
+    c.AddStage(T::Vignette, true, 0.5f);
+    c.AddStage(T::ToneMap, true, 1.0f);
+    std::string keyA = PostProcessChain::GetShaderKey(a.Plan()[0]);
+    bool keysOk = keyA == PostProcessChain::GetShaderKey(b.Plan()[0]) && keyA != PostProcessChain::GetShaderKey(c.Plan()[0]) &&
+        PostProcessChain::GenerateShader(a.Plan()[0]) == PostProcessChain::GenerateShader(b.Plan()[0]) &&
+        PostProcessChain::GenerateShader(a.Plan()[0]).find("main") != std::string::npos;
+    printf("shader keys %s\n", keysOk ? "ok" : "failed");
+
+    bool formatsOk = CheckFormats();
+
+    return ok && longOk && keysOk && formatsOk ? 0 : 1;
+}
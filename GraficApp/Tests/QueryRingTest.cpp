@@ -0,0 +1,117 @@
+#include "QueryRing.h"
+
+#include <cstdio>
+#include <vector>
+
+// Drives QueryRing with a fake GPU that finishes a frame a fixed number of frames after it
+// was issued: results must arrive that late with the stage times the fake reports, frames are
+// skipped instead of waited for once the lag outgrows the ring, and disjoint frames are dropped
+namespace {
+    const int StageCount = 3;
+    const int SlotCount = 4;
+    const uint64_t Frequency = 1000000;
+
+    class FakeQuerySource : public IQuerySource {
+    public:
+        FakeQuerySource(int lag, int disjointEvery) : lag_(lag), disjointEvery_(disjointEvery), issued_(SlotCount, 0) {};
+
+        void Begin(int slot) override {
+            issued_[slot] = frame_;
+        };
+        void Timestamp(int, int) override {};
+        void End(int) override {};
+
+        // Stage i takes (i + 1) * 100 ticks, 0.1 ms per stage index
+        QueryStatus Read(int slot, uint32_t timestampMask, uint64_t* timestamps, uint64_t& frequency) override {
+            if (frame_ < issued_[slot] + (uint64_t)lag_) {
+                return QueryStatus::NotReady;
+            }
+            if (disjointEvery_ > 0 && issued_[slot] % disjointEvery_ == 0) {
+                return QueryStatus::Disjoint;
+            }
+            uint64_t time = 5000;
+            for (int i = 0; i < StageCount * 2; i++) {
+                if (timestampMask & (1u << i)) {
+                    timestamps[i] = time;
+                }
+                time += i % 2 == 0 ? (i / 2 + 1) * 100 : 10;
+            }
+            frequency = Frequency;
+            return QueryStatus::Ready;
+        };
+
+        // The GPU moves on by one frame
+        void Advance() { frame_++; };
+    private:
+        int lag_;
+        int disjointEvery_;
+        uint64_t frame_ = 0;
+        std::vector<uint64_t> issued_;
+    };
+
+    struct RunResult {
+        uint64_t latency;
+        uint64_t dropped;
+        uint64_t disjoint;
+        bool timesOk;
+        bool hasResult;
+    };
+
+    // Same order as Renderer: collect, then record the frame's stages
+    RunResult Run(int lag, int disjointEvery, int frames) {
+        FakeQuerySource source(lag, disjointEvery);
+        QueryRing ring(source, StageCount, SlotCount);
+        bool timesOk = true;
+        for (int frame = 0; frame < frames; frame++) {
+            ring.Collect();
+            if (ring.HasResult()) {
+                for (int i = 0; i < StageCount; i++) {
+                    double expected = (i + 1) * 100 * 1000.0 / Frequency;
+                    double ms = ring.GetStageMs(i);
+                    timesOk = timesOk && ms > expected - 1e-9 && ms < expected + 1e-9;
+                }
+            }
+            ring.BeginFrame();
+            for (int i = 0; i < StageCount; i++) {
+                ring.BeginStage(i);
+                ring.EndStage(i);
+            }
+            ring.EndFrame();
+            source.Advance();
+        }
+        return { ring.GetLatency(), ring.GetDroppedFrames(), ring.GetDisjointFrames(), timesOk, ring.HasResult() };
+    }
+}
+
+int main() {
+    const int Frames = 240;
+    bool ok = true;
+    for (int lag = 0; lag <= 5; lag++) {
+        RunResult result = Run(lag, 0, Frames);
+        // A ring of SlotCount slots keeps up with a GPU up to SlotCount frames behind, then skips
+        bool expectedLatency = result.latency == (uint64_t)(lag > 1 ? lag : 1);
+        bool expectedDrops = lag <= SlotCount ? result.dropped == 0 : result.dropped > 0;
+        bool pass = result.hasResult && result.timesOk && expectedDrops && (lag > SlotCount || expectedLatency);
+        printf("lag %d: latency %d, dropped %d, times %s, %s\n", lag, (int)result.latency, (int)result.dropped,
+            result.timesOk ? "ok" : "wrong", pass ? "ok" : "failed");
+        ok = ok && pass;
+    }
+
+    RunResult disjoint = Run(2, 3, Frames);
+    bool disjointOk = disjoint.disjoint > 0 && disjoint.timesOk && disjoint.hasResult;
+    printf("disjoint every 3rd frame: %d dropped as disjoint, %s\n", (int)disjoint.disjoint, disjointOk ? "ok" : "failed");
+
+    // Stages outside the ring's range are ignored, not written past the timestamp mask
+    FakeQuerySource source(0, 0);
+    QueryRing ring(source, QueryRing::MaxStages + 4, 2);
+    ring.BeginFrame();
+    ring.BeginStage(-1);
+    ring.BeginStage(QueryRing::MaxStages);
+    ring.EndStage(QueryRing::MaxStages + 3);
+    ring.EndFrame();
+    ring.Collect();
+    bool rangeOk = ring.GetStageCount() == QueryRing::MaxStages && ring.HasResult() && ring.GetStageMs(0) == 0.0;
+    printf("stage range %s\n", rangeOk ? "ok" : "failed");
+
+    return ok && disjointOk && rangeOk ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+#include "RenderTargetPool.h"
+
+#include <cstdio>
+#include <set>
+
+// Drives RenderTargetPool with a fake allocator through the frames Renderer produces: the same
+// targets every frame, a post chain that releases its inputs, a resize and a failed creation.
+// The fake tracks live resources, nothing may leak or be destroyed twice
+namespace {
+    const uint32_t MaxAge = 3;
+    const uint32_t ColorFormat = 28; // DXGI_FORMAT_R8G8B8A8_UNORM
+    const uint32_t DepthFormat = 45; // DXGI_FORMAT_D24_UNORM_S8_UINT
+    const uint32_t RenderTarget = 0x28; // D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET
+    const uint32_t DepthStencil = 0x40;
+
+    class FakeRenderTargetAllocator : public IRenderTargetAllocator {
+    public:
+        // Zero sized targets fail like CreateTexture2D does
+        void* Create(const RenderTargetDesc& desc) override {
+            if (desc.width == 0 || desc.height == 0) {
+                return NULL;
+            }
+            void* resource = reinterpret_cast<void*>(++next_);
+            live_.insert(resource);
+            return resource;
+        };
+
+        void Destroy(void* resource) override {
+            doubleDestroy_ = doubleDestroy_ || live_.erase(resource) == 0;
+        };
+
+        size_t GetLive() const { return live_.size(); };
+        bool GetDoubleDestroy() const { return doubleDestroy_; };
+    private:
+        uintptr_t next_ = 0;
+        std::set<void*> live_;
+        bool doubleDestroy_ = false;
+    };
+
+    RenderTargetDesc Color(uint32_t width, uint32_t height) {
+        return { width, height, ColorFormat, RenderTarget, 1 };
+    }
+
+    RenderTargetDesc Depth(uint32_t width, uint32_t height) {
+        return { width, height, DepthFormat, DepthStencil, 1 };
+    }
+
+    // Depth, scene target and a three-pass post chain; each pass releases its input
+    void RenderFrame(RenderTargetPool& pool, uint32_t width, uint32_t height) {
+        pool.BeginFrame();
+        pool.Acquire(Depth(width, height));
+        int input = pool.Acquire(Color(width, height));
+        for (int pass = 0; pass < 3; pass++) {
+            pool.Release(input);
+            input = pool.Acquire(Color(width, height));
+        }
+    }
+
+    bool Check(const char* name, bool ok) {
+        printf("%s %s\n", name, ok ? "ok" : "failed");
+        return ok;
+    }
+}
+
+int main() {
+    FakeRenderTargetAllocator allocator;
+    bool ok = true;
+    {
+        RenderTargetPool pool(allocator, MaxAge);
+
+        // Released inputs alias, the chain needs depth plus one color target
+        RenderFrame(pool, 1280, 720);
+        RenderTargetPoolStats first = pool.GetStats();
+        ok &= Check("aliasing", first.entries == 2 && first.allocations == 2 && first.reuses == 3);
+
+        for (int frame = 0; frame < 100; frame++) {
+            RenderFrame(pool, 1280, 720);
+        }
+        RenderTargetPoolStats steady = pool.GetStats();
+        ok &= Check("steady frames", steady.allocations == 2 && steady.evictions == 0 && allocator.GetLive() == 2);
+
+        // A target still held is not handed out twice
+        pool.BeginFrame();
+        pool.Acquire(Depth(1280, 720));
+        int a = pool.Acquire(Color(1280, 720));
+        int b = pool.Acquire(Color(1280, 720));
+        ok &= Check("held target", a >= 0 && b >= 0 && a != b && pool.GetResource(a) != pool.GetResource(b) &&
+            pool.GetStats().inUse == 3 && pool.GetDesc(b) == Color(1280, 720));
+
+        // After a resize the old size lives for MaxAge frames, then its slots are reused
+        for (uint32_t frame = 0; frame < MaxAge; frame++) {
+            RenderFrame(pool, 1920, 1080);
+        }
+        bool oldKept = pool.GetStats().evictions == 0;
+        RenderFrame(pool, 1920, 1080);
+        RenderTargetPoolStats resized = pool.GetStats();
+        ok &= Check("resize eviction", oldKept && resized.evictions == 3 && resized.entries == 2 && allocator.GetLive() == 2);
+        RenderFrame(pool, 800, 600);
+        ok &= Check("empty slots reused", pool.GetStats().entries == 4 && allocator.GetLive() == 4);
+
+        // A minimized window asks for zero sized targets
+        pool.BeginFrame();
+        ok &= Check("failed creation", pool.Acquire(Color(0, 0)) == -1 && allocator.GetLive() == 4);
+        pool.Release(-1);
+        pool.Release(100);
+
+        pool.Clear();
+        ok &= Check("clear", pool.GetStats().entries == 0 && allocator.GetLive() == 0);
+        RenderFrame(pool, 640, 480);
+    }
+    ok &= Check("destructor", allocator.GetLive() == 0 && !allocator.GetDoubleDestroy());
+
+    printf("%s\n", ok ? "all checks passed" : "some checks failed");
+    return ok ? 0 : 1;
+}
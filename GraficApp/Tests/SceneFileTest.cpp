@@ -0,0 +1,161 @@
+#include "SceneFile.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+// Writes a random scene, opens it and checks every table reads back as written, times
+// writing, opening and a first pass over the positions, then checks that damaged copies are
+// rejected and the undamaged one still passes. Writes step,ms rows to scene_benchmark.csv.
+// Usage: SceneFileTest [<instances>], 1000000 for the full benchmark
+namespace {
+    bool RunSceneFileBenchmark(const std::string& fileName, uint32_t instanceCount) {
+        std::ofstream file(fileName, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        SceneData scene;
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+        for (uint32_t i = 0; i < instanceCount; i++) {
+            scene.x.push_back(position(random));
+            scene.y.push_back(position(random));
+            scene.z.push_back(position(random));
+            scene.speed.push_back((float)(random() % 5));
+            scene.material.push_back(random() % 8);
+        }
+        for (uint32_t i = 0; i < 8; i++) {
+            scene.materials.push_back({ 5.0f + i, i % 2, i % 2 == 0 ? 1u : 0u, 0 });
+            scene.lights.push_back({ { position(random), position(random), position(random), 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } });
+        }
+
+        auto measure = [](const std::function<bool()>& run, double& ms) {
+            auto start = std::chrono::steady_clock::now();
+            bool result = run();
+            ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            return result;
+        };
+
+        std::string sceneName = fileName + ".scene";
+        double writeMs = 0.0, openMs = 0.0, touchMs = 0.0;
+        if (!measure([&]() { return WriteSceneFile(sceneName, scene); }, writeMs)) {
+            return false;
+        }
+
+        SceneFile sceneFile;
+        // Later opens find the pages in the page cache, they are averaged separately
+        const int iterations = 10;
+        double firstOpenMs = 0.0;
+        for (int i = 0; i <= iterations; i++) {
+            double ms = 0.0;
+            if (!measure([&]() { return sceneFile.Open(sceneName); }, ms)) {
+                return false;
+            }
+            firstOpenMs = i == 0 ? ms : firstOpenMs;
+            openMs += i == 0 ? 0.0 : ms / iterations;
+        }
+
+        // Every table comes back as written
+        const SceneInstances& loaded = sceneFile.GetInstances();
+        bool roundTrip = loaded.count == instanceCount && sceneFile.GetHeader().lightCount == scene.lights.size() &&
+            sceneFile.GetHeader().materialCount == scene.materials.size();
+        for (uint32_t i = 0; i < instanceCount && roundTrip; i++) {
+            roundTrip = loaded.x[i] == scene.x[i] && loaded.y[i] == scene.y[i] && loaded.z[i] == scene.z[i] &&
+                loaded.speed[i] == scene.speed[i] && loaded.material[i] == scene.material[i];
+        }
+        for (size_t i = 0; i < scene.lights.size() && roundTrip; i++) {
+            roundTrip = memcmp(&sceneFile.GetLights()[i], &scene.lights[i], sizeof(SceneLight)) == 0 &&
+                memcmp(&sceneFile.GetMaterials()[i], &scene.materials[i], sizeof(SceneMaterial)) == 0;
+        }
+        printf("%u instances %s\n", instanceCount, roundTrip ? "read back" : "changed on the way");
+
+        float sum = 0.0f;
+        measure([&]() {
+            const SceneInstances& instances = sceneFile.GetInstances();
+            for (uint32_t i = 0; i < instances.count; i++) {
+                sum += instances.x[i] + instances.y[i] + instances.z[i];
+            }
+            return true;
+        }, touchMs);
+
+        file << "step,ms\n";
+        file << "write," << writeMs << '\n';
+        file << "first_open," << firstOpenMs << '\n';
+        file << "open," << openMs << '\n';
+        file << "first_pass," << touchMs << '\n';
+        file << "size_mb," << sceneFile.GetHeader().fileSize / (1024.0 * 1024.0) << '\n';
+        sceneFile.Close();
+
+        // Damaged copies, a uint64_t buffer keeps the copy aligned like a mapping
+        std::ifstream input(sceneName, std::ios::binary);
+        std::vector<uint8_t> original((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        input.close();
+        std::remove(sceneName.c_str());
+
+        const size_t sectionsOffset = sizeof(SceneFileHeader);
+        const size_t materialSection = sectionsOffset + 4 * sizeof(SceneFileSection);
+        struct Damage {
+            const char* name;
+            std::function<void(std::vector<uint8_t>&)> apply;
+        };
+        auto setU32 = [](std::vector<uint8_t>& data, size_t offset, uint32_t value) { memcpy(&data[offset], &value, 4); };
+        auto setU64 = [](std::vector<uint8_t>& data, size_t offset, uint64_t value) { memcpy(&data[offset], &value, 8); };
+        auto getU64 = [](const std::vector<uint8_t>& data, size_t offset) { uint64_t value; memcpy(&value, &data[offset], 8); return value; };
+        const Damage damages[] = {
+            { "truncated", [](std::vector<uint8_t>& data) { data.resize(data.size() / 2); } },
+            { "short_header", [](std::vector<uint8_t>& data) { data.resize(32); } },
+            { "bad_magic", [&](std::vector<uint8_t>& data) { setU32(data, 0, 0x12345678); } },
+            { "bad_version", [&](std::vector<uint8_t>& data) { setU32(data, 4, SceneFileHeader::Version + 1); } },
+            { "section_table_outside", [&](std::vector<uint8_t>& data) { setU64(data, 24, data.size() - 16); } },
+            { "section_outside", [&](std::vector<uint8_t>& data) { setU64(data, sectionsOffset + 8, data.size() + 64); } },
+            { "section_misaligned", [&](std::vector<uint8_t>& data) { setU64(data, sectionsOffset + 8, getU64(data, sectionsOffset + 8) + 4); } },
+            { "count_overflow", [&](std::vector<uint8_t>& data) { setU64(data, sectionsOffset + 16, UINT64_MAX / 2); } },
+            { "instance_count_mismatch", [&](std::vector<uint8_t>& data) { setU32(data, 32, instanceCount + 1); } },
+            { "missing_section", [&](std::vector<uint8_t>& data) { setU32(data, sectionsOffset, 1000); } },
+            { "duplicate_section", [&](std::vector<uint8_t>& data) { setU32(data, sectionsOffset + sizeof(SceneFileSection), SceneSectionPositionX); } },
+            { "bad_element_size", [&](std::vector<uint8_t>& data) { setU32(data, sectionsOffset + 4, 8); } },
+            { "material_out_of_range", [&](std::vector<uint8_t>& data) {
+                setU32(data, (size_t)getU64(data, materialSection + 8) + 4 * (instanceCount - 1), 8); } }
+        };
+
+        bool rejected = true;
+        std::vector<uint64_t> buffer;
+        for (const Damage& damage : damages) {
+            std::vector<uint8_t> data = original;
+            damage.apply(data);
+            buffer.assign((data.size() + 7) / 8, 0);
+            memcpy(buffer.data(), data.data(), data.size());
+            bool accepted = sceneFile.Attach(buffer.data(), data.size());
+            file << damage.name << ',' << (accepted ? "accepted" : "rejected") << '\n';
+            if (accepted) {
+                printf("%s file accepted\n", damage.name);
+            }
+            rejected = rejected && !accepted;
+        }
+
+        // The undamaged copy still has to pass
+        buffer.assign((original.size() + 7) / 8, 0);
+        memcpy(buffer.data(), original.data(), original.size());
+        bool valid = sceneFile.Attach(buffer.data(), original.size());
+        file << "undamaged," << (valid ? "accepted" : "rejected") << '\n';
+        sceneFile.Close();
+
+        // Keeps the first pass from being optimized out
+        file << "checksum," << sum << '\n';
+        printf("damaged files %s, undamaged file %s\n", rejected ? "rejected" : "accepted", valid ? "accepted" : "rejected");
+        return file.good() && roundTrip && rejected && valid;
+    }
+}
+
+int main(int argc, char** argv) {
+    uint32_t instanceCount = argc > 1 ? (uint32_t)atol(argv[1]) : 100000;
+    return RunSceneFileBenchmark("scene_benchmark.csv", instanceCount) ? 0 : 1;
+}
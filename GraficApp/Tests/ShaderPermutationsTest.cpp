@@ -0,0 +1,227 @@
+#include "ShaderPermutations.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Checks macro sets, key masking and hashing, that only requested variants are compiled and
+// only once, failure caching and lookups of thousands of variants with a fake compiler, then
+// times parallel compilation and Find. Writes shaders,variants,requested,compile_ms,threads,
+// max_parallel,lookups_per_s rows and the check results to shader_permutations.csv
+namespace {
+    // Key layout of MakeKey: shader index plus one from bit 16, features below
+    const uint32_t FeatureMask = (1u << ShaderFeatureCount) - 1;
+    const uint32_t ShaderShift = 16;
+
+    // Stands in for the shader compiler: a variant is its file name and macros, compiling it
+    // takes a while, files named "broken" fail
+    class FakeShaderCompiler : public IShaderCompiler {
+    public:
+        explicit FakeShaderCompiler(int compileMs) : compileMs_(compileMs) {};
+
+        void* Compile(const ShaderSource& source, const std::vector<const char*>& macros) override {
+            int running = ++running_;
+            int highest = maxRunning_;
+            while (running > highest && !maxRunning_.compare_exchange_weak(highest, running)) {
+            }
+            if (compileMs_ > 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(compileMs_));
+            }
+            --running_;
+            if (source.file == "broken") {
+                return nullptr;
+            }
+
+            std::string* pShader = new std::string(source.file);
+            for (const char* macro : macros) {
+                *pShader += std::string(" ") + macro;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            live_.insert(pShader);
+            return pShader;
+        }
+
+        void Destroy(void* shader) override {
+            std::string* pShader = (std::string*)shader;
+            std::lock_guard<std::mutex> lock(mutex_);
+            live_.erase(pShader);
+            delete pShader;
+        }
+
+        size_t GetLiveCount() const { return live_.size(); };
+        int GetMaxRunning() const { return maxRunning_; };
+    private:
+        int compileMs_;
+        std::atomic<int> running_{ 0 };
+        std::atomic<int> maxRunning_{ 0 };
+        std::mutex mutex_;
+        std::set<std::string*> live_;
+    };
+
+    // What FakeShaderCompiler makes of a variant
+    std::string DescribeVariant(const std::string& file, uint32_t features) {
+        std::vector<const char*> macros;
+        GetShaderMacros(features, macros);
+        std::string text = file;
+        for (const char* macro : macros) {
+            text += std::string(" ") + macro;
+        }
+        return text;
+    }
+
+    // The scene shaders as the renderer registers them
+    bool CheckSceneShaders() {
+        std::vector<const char*> macros;
+        GetShaderMacros(ShaderFeatureNormalMap | ShaderFeatureLights, macros);
+        bool ok = macros.size() == 2 && std::string(macros[0]) == "NORMAL_MAP" && std::string(macros[1]) == "USE_LIGHTS";
+        GetShaderMacros(0, macros);
+        ok = ok && macros.empty();
+
+        FakeShaderCompiler compiler(0);
+        ShaderPermutations permutations(compiler);
+        int opaque = permutations.AddShader({ "PS.hlsl", "main", "ps_5_0", ShaderFeatureNormalMap | ShaderFeatureShowNormals });
+        int transparent = permutations.AddShader({ "TPS.hlsl", "main", "ps_5_0", ShaderFeatureLights | ShaderFeatureShowNormals });
+        // A feature the file does not have gives the same variant
+        ShaderKey lit = permutations.MakeKey(transparent, ShaderFeatureLights);
+        ok = ok && permutations.MakeKey(transparent, ShaderFeatureLights | ShaderFeatureNormalMap) == lit;
+        ok = ok && permutations.MakeKey(opaque, ShaderFeatureLights) == permutations.MakeKey(opaque, 0);
+        ok = ok && permutations.MakeKey(opaque, 0) != permutations.MakeKey(transparent, 0);
+
+        // A frame with plain and normal mapped cubes and lit planes asks for three variants
+        ShaderKey plain = permutations.MakeKey(opaque, 0), mapped = permutations.MakeKey(opaque, ShaderFeatureNormalMap);
+        for (int i = 0; i < 100; i++) {
+            permutations.Request(i % 3 == 0 ? mapped : plain);
+        }
+        permutations.Request(lit);
+        ok = ok && permutations.GetPendingCount() == 3 && permutations.Find(plain) == nullptr;
+        ok = ok && permutations.Compile() && permutations.GetCompileCount() == 3;
+        ok = ok && *(std::string*)permutations.Find(mapped) == "PS.hlsl NORMAL_MAP" &&
+            *(std::string*)permutations.Find(plain) == "PS.hlsl" && *(std::string*)permutations.Find(lit) == "TPS.hlsl USE_LIGHTS";
+        ok = ok && permutations.Find(permutations.MakeKey(opaque, ShaderFeatureShowNormals)) == nullptr;
+
+        // Toggling show normals compiles only what is new
+        permutations.Request(permutations.MakeKey(opaque, ShaderFeatureShowNormals));
+        permutations.Request(plain);
+        ok = ok && permutations.Compile() && permutations.GetCompileCount() == 4 && permutations.Compile();
+
+        // A broken file fails once and stays failed without being compiled again
+        int broken = permutations.AddShader({ "broken", "main", "ps_5_0", ShaderFeatureLights });
+        permutations.Request(permutations.MakeKey(broken, 0));
+        ok = ok && !permutations.Compile() && permutations.Find(permutations.MakeKey(broken, 0)) == nullptr;
+        permutations.Request(permutations.MakeKey(broken, 0));
+        ok = ok && permutations.GetPendingCount() == 0 && permutations.GetCompileCount() == 5;
+
+        // Draws with a failed or never requested variant fall back to a compiled one
+        ok = ok && permutations.Find(permutations.MakeKey(broken, 0), plain) == permutations.Find(plain) &&
+            permutations.Find(permutations.MakeKey(transparent, 0), lit) == permutations.Find(lit) &&
+            permutations.Find(mapped, plain) == permutations.Find(mapped) && permutations.Find(plain) != nullptr;
+
+        permutations.Release();
+        return ok && compiler.GetLiveCount() == 0 && permutations.Find(plain) == nullptr;
+    }
+
+    bool RunShaderPermutationTest(const std::string& fileName) {
+        std::ofstream file(fileName, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        bool sceneOk = CheckSceneShaders();
+
+        // Keys of neighbouring variants land in different slots
+        std::set<uint32_t> buckets;
+        for (uint32_t shader = 1; shader <= 8; shader++) {
+            for (uint32_t features = 0; features <= FeatureMask; features++) {
+                buckets.insert(HashShaderKey((shader << ShaderShift) | features) & 127);
+            }
+        }
+        bool spread = buckets.size() >= 40;
+
+        bool found = true, onlyRequested = true, compiledOnce = true, released = true;
+        unsigned threads = ThreadPool::GetInstance().GetThreadCount();
+        file << "shaders,variants,requested,compile_ms,threads,max_parallel,lookups_per_s\n";
+        for (int shaderCount : { 2, 64, 2048 }) {
+            FakeShaderCompiler compiler(shaderCount <= 64 ? 2 : 0);
+            ShaderPermutations permutations(compiler);
+            for (int i = 0; i < shaderCount; i++) {
+                permutations.AddShader({ "shader" + std::to_string(i), "main", "ps_5_0", FeatureMask });
+            }
+
+            // Draws ask for a random quarter of the possible variants, many times over
+            std::mt19937 random(shaderCount);
+            std::vector<ShaderKey> requested, all;
+            for (int i = 0; i < shaderCount; i++) {
+                for (uint32_t features = 0; features <= FeatureMask; features++) {
+                    ShaderKey key = permutations.MakeKey(i, features);
+                    all.push_back(key);
+                    if (random() % 4 == 0 || (i == 0 && features == 0)) {
+                        requested.push_back(key);
+                    }
+                }
+            }
+            for (int i = 0; i < 20; i++) {
+                for (ShaderKey key : requested) {
+                    permutations.Request(key);
+                }
+            }
+            auto start = std::chrono::steady_clock::now();
+            bool compiled = permutations.Compile();
+            double compileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            compiledOnce = compiledOnce && compiled && permutations.GetCompileCount() == requested.size() &&
+                permutations.GetVariantCount() == requested.size();
+            permutations.Request(requested[0]);
+            compiledOnce = compiledOnce && permutations.GetPendingCount() == 0;
+
+            std::set<ShaderKey> wanted(requested.begin(), requested.end());
+            for (ShaderKey key : all) {
+                void* pShader = permutations.Find(key);
+                if (wanted.count(key) == 0) {
+                    onlyRequested = onlyRequested && pShader == nullptr;
+                    continue;
+                }
+                int shader = (int)(key >> ShaderShift) - 1;
+                found = found && pShader != nullptr &&
+                    *(std::string*)pShader == DescribeVariant("shader" + std::to_string(shader), key & FeatureMask);
+            }
+
+            // Lookups in draw order: mostly the same few keys with a random one now and then
+            const int lookups = 4000000;
+            std::vector<ShaderKey> order(4096);
+            for (ShaderKey& key : order) {
+                key = requested[random() % requested.size()];
+            }
+            size_t hits = 0;
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < lookups; i++) {
+                hits += permutations.Find(order[i & 4095]) != nullptr ? 1 : 0;
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            found = found && hits == (size_t)lookups;
+
+            permutations.Release();
+            released = released && compiler.GetLiveCount() == 0;
+
+            file << shaderCount << ',' << all.size() << ',' << requested.size() << ',' << compileMs << ',' << threads << ','
+                << compiler.GetMaxRunning() << ',' << (uint64_t)(lookups / seconds) << '\n';
+        }
+
+        file << "checks,scene shaders " << (sceneOk ? "ok" : "failed") << ",hash " << (spread ? "spread" : "clustered")
+            << ",lookups " << (found ? "ok" : "failed") << ",unrequested " << (onlyRequested ? "absent" : "compiled")
+            << ",compiles " << (compiledOnce ? "once" : "repeated") << ",release " << (released ? "ok" : "leaked") << '\n';
+        return file.good() && sceneOk && spread && found && onlyRequested && compiledOnce && released;
+    }
+}
+
+int main() {
+    bool ok = RunShaderPermutationTest("shader_permutations.csv");
+    printf("shader permutation checks %s\n", ok ? "passed" : "failed");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,260 @@
+#include "SoftwareRasterizer.h"
+#include "ImageCompare.h"
+
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Renders a fixed scene with every feature of the reference backend and compares it with
+// golden/cubes.bmp; --update writes the golden image instead. Also checks that LoadBMP
+// rejects headers with impossible sizes or more pixel data than the file holds
+namespace {
+    const int Width = 128;
+    const int Height = 96;
+    const double MinPsnr = 40.0;
+
+    // Same cube as renderer.cpp
+    const RasterVertex CubeVertices[] = {
+        { { -1.0f, -1.0f,  1.0f }, { 0, 1 }, { 0, -1, 0 }, { 1, 0, 0 } },
+        { {  1.0f, -1.0f,  1.0f }, { 1, 1 }, { 0, -1, 0 }, { 1, 0, 0 } },
+        { {  1.0f, -1.0f, -1.0f }, { 1, 0 }, { 0, -1, 0 }, { 1, 0, 0 } },
+        { { -1.0f, -1.0f, -1.0f }, { 0, 0 }, { 0, -1, 0 }, { 1, 0, 0 } },
+
+        { { -1.0f,  1.0f, -1.0f }, { 0, 1 }, { 0, 1, 0 }, { 1, 0, 0 } },
+        { {  1.0f,  1.0f, -1.0f }, { 1, 1 }, { 0, 1, 0 }, { 1, 0, 0 } },
+        { {  1.0f,  1.0f,  1.0f }, { 1, 0 }, { 0, 1, 0 }, { 1, 0, 0 } },
+        { { -1.0f,  1.0f,  1.0f }, { 0, 0 }, { 0, 1, 0 }, { 1, 0, 0 } },
+
+        { {  1.0f, -1.0f, -1.0f }, { 0, 1 }, { 1, 0, 0 }, { 0, 0, 1 } },
+        { {  1.0f, -1.0f,  1.0f }, { 1, 1 }, { 1, 0, 0 }, { 0, 0, 1 } },
+        { {  1.0f,  1.0f,  1.0f }, { 1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },
+        { {  1.0f,  1.0f, -1.0f }, { 0, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },
+
+        { { -1.0f, -1.0f,  1.0f }, { 0, 1 }, { -1, 0, 0 }, { 0, 0, -1 } },
+        { { -1.0f, -1.0f, -1.0f }, { 1, 1 }, { -1, 0, 0 }, { 0, 0, -1 } },
+        { { -1.0f,  1.0f, -1.0f }, { 1, 0 }, { -1, 0, 0 }, { 0, 0, -1 } },
+        { { -1.0f,  1.0f,  1.0f }, { 0, 0 }, { -1, 0, 0 }, { 0, 0, -1 } },
+
+        { {  1.0f, -1.0f,  1.0f }, { 0, 1 }, { 0, 0, 1 }, { -1, 0, 0 } },
+        { { -1.0f, -1.0f,  1.0f }, { 1, 1 }, { 0, 0, 1 }, { -1, 0, 0 } },
+        { { -1.0f,  1.0f,  1.0f }, { 1, 0 }, { 0, 0, 1 }, { -1, 0, 0 } },
+        { {  1.0f,  1.0f,  1.0f }, { 0, 0 }, { 0, 0, 1 }, { -1, 0, 0 } },
+
+        { { -1.0f, -1.0f, -1.0f }, { 0, 1 }, { 0, 0, -1 }, { 1, 0, 0 } },
+        { {  1.0f, -1.0f, -1.0f }, { 1, 1 }, { 0, 0, -1 }, { 1, 0, 0 } },
+        { {  1.0f,  1.0f, -1.0f }, { 1, 0 }, { 0, 0, -1 }, { 1, 0, 0 } },
+        { { -1.0f,  1.0f, -1.0f }, { 0, 0 }, { 0, 0, -1 }, { 1, 0, 0 } }
+    };
+    const uint16_t CubeIndices[] = {
+        0, 2, 1, 0, 3, 2,
+        4, 6, 5, 4, 7, 6,
+        8, 10, 9, 8, 11, 10,
+        12, 14, 13, 12, 15, 14,
+        16, 18, 17, 16, 19, 18,
+        20, 22, 21, 20, 23, 22
+    };
+
+    const RasterFloat3 PlaneVertices[] = {
+        { 0.0f, -1.0f, -1.0f }, { 0.0f, 1.0f, -1.0f }, { 0.0f, 1.0f, 1.0f }, { 0.0f, -1.0f, 1.0f }
+    };
+    const uint16_t PlaneIndices[] = { 0, 2, 1, 0, 3, 2 };
+
+    RasterMatrix Multiply(const RasterMatrix& a, const RasterMatrix& b) {
+        RasterMatrix result = {};
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                for (int k = 0; k < 4; k++) {
+                    result.m[i][j] += a.m[i][k] * b.m[k][j];
+                }
+            }
+        }
+        return result;
+    }
+
+    // Rotation about y, then about x, then the translation, like the renderer's cube transforms
+    RasterMatrix MakeWorld(float angleY, float angleX, float x, float y, float z, float scale) {
+        float cy = cosf(angleY), sy = sinf(angleY), cx = cosf(angleX), sx = sinf(angleX);
+        RasterMatrix rotateY = { { { cy * scale, 0, -sy * scale, 0 }, { 0, scale, 0, 0 }, { sy * scale, 0, cy * scale, 0 }, { 0, 0, 0, 1 } } };
+        RasterMatrix rotateX = { { { 1, 0, 0, 0 }, { 0, cx, sx, 0 }, { 0, -sx, cx, 0 }, { x, y, z, 1 } } };
+        return Multiply(rotateY, rotateX);
+    }
+
+    RasterFloat3 Normalize(RasterFloat3 v) {
+        float length = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+        return RasterFloat3(v.x / length, v.y / length, v.z / length);
+    }
+
+    // XMMatrixLookAtLH * XMMatrixPerspectiveFovLH with near and far swapped for reversed depth
+    RasterMatrix MakeViewProjection(const RasterFloat3& eye, const RasterFloat3& at) {
+        RasterFloat3 z = Normalize(RasterFloat3(at.x - eye.x, at.y - eye.y, at.z - eye.z));
+        RasterFloat3 x = Normalize(RasterFloat3(z.z, 0.0f, -z.x)); // up (0, 1, 0) cross z
+        RasterFloat3 y(z.y * x.z - z.z * x.y, z.z * x.x - z.x * x.z, z.x * x.y - z.y * x.x);
+        RasterMatrix view = { {
+            { x.x, y.x, z.x, 0 },
+            { x.y, y.y, z.y, 0 },
+            { x.z, y.z, z.z, 0 },
+            { -(x.x * eye.x + x.y * eye.y + x.z * eye.z), -(y.x * eye.x + y.y * eye.y + y.z * eye.z),
+                -(z.x * eye.x + z.y * eye.y + z.z * eye.z), 1 }
+        } };
+
+        const float nearZ = 100.0f, farZ = 0.01f, fovY = 3.14159265f / 3;
+        float h = 1.0f / tanf(fovY * 0.5f), w = h * Height / Width, q = farZ / (farZ - nearZ);
+        RasterMatrix projection = { { { w, 0, 0, 0 }, { 0, h, 0, 0 }, { 0, 0, q, 1 }, { 0, 0, -q * nearZ, 0 } } };
+        return Multiply(view, projection);
+    }
+
+    // Checker layers in two colors and a normal map of diagonal ridges
+    void MakeTextures(RasterTexture& color, RasterTexture& normal) {
+        color.width = color.height = 16;
+        color.layers = 2;
+        for (int layer = 0; layer < 2; layer++) {
+            for (int y = 0; y < 16; y++) {
+                for (int x = 0; x < 16; x++) {
+                    float on = ((x / 4 + y / 4) & 1) ? 1.0f : 0.35f;
+                    color.texels.push_back(layer == 0 ? RasterFloat4(on, 0.6f * on, 0.3f, 1.0f) : RasterFloat4(0.3f, 0.7f * on, on, 1.0f));
+                }
+            }
+        }
+
+        normal.width = normal.height = 16;
+        normal.layers = 1;
+        for (int y = 0; y < 16; y++) {
+            for (int x = 0; x < 16; x++) {
+                float slope = ((x + y) & 4) ? 0.4f : -0.4f;
+                RasterFloat3 n = Normalize(RasterFloat3(slope, slope, 1.0f));
+                normal.texels.push_back(RasterFloat4(n.x * 0.5f + 0.5f, n.y * 0.5f + 0.5f, n.z * 0.5f + 0.5f, 1.0f));
+            }
+        }
+    }
+
+    void RenderScene(SoftwareRasterizer& rasterizer, const RasterTexture& color, const RasterTexture& normal) {
+        static const float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        rasterizer.Clear(clearColor, 0.0f);
+        rasterizer.SetViewProjection(MakeViewProjection(RasterFloat3(-3.0f, 2.0f, -5.0f), RasterFloat3(0.0f, 0.0f, 0.0f)));
+
+        static const RasterLight lights[] = {
+            { { -2.0f, 3.0f, -2.5f, 0.0f }, { 9.0f, 8.5f, 8.0f, 0.0f } },
+            { { 2.5f, -0.5f, -2.5f, 0.0f }, { 2.0f, 3.0f, 6.0f, 0.0f } }
+        };
+        RasterLighting lighting;
+        lighting.cameraPos = RasterFloat3(-3.0f, 2.0f, -5.0f);
+        lighting.lights = lights;
+        lighting.lightCount = 2;
+        rasterizer.SetLighting(lighting);
+        rasterizer.SetTextures(&color, &normal);
+
+        // One cube crosses the near side of the frustum to exercise clipping
+        RasterInstance instances[5];
+        const float placement[5][6] = {
+            { 0.3f, 0.2f, 0.0f, 0.0f, 0.0f, 1.0f },
+            { 1.1f, -0.4f, 3.0f, 1.0f, 2.0f, 0.8f },
+            { -0.7f, 0.9f, -3.0f, -1.0f, 1.0f, 0.7f },
+            { 2.0f, 0.5f, 1.5f, 2.5f, -2.0f, 0.6f },
+            { 0.0f, 0.0f, -1.52f, 1.87f, -5.45f, 1.0f }
+        };
+        for (int i = 0; i < 5; i++) {
+            const float* p = placement[i];
+            instances[i].worldMatrix = MakeWorld(p[0], p[1], p[2], p[3], p[4], p[5]);
+            instances[i].shineSpeedTexIdNM = RasterFloat4(i == 1 ? 0.0f : 5.0f, 0.0f, (float)(i & 1), i % 3 == 0 ? 1.0f : 0.0f);
+        }
+        rasterizer.DrawIndexedInstanced(CubeVertices, CubeIndices, 36, instances, nullptr, 5);
+
+        RasterMatrix plane = MakeWorld(0.0f, 0.0f, 1.8f, 0.0f, 0.0f, 1.5f);
+        rasterizer.DrawTransparent(PlaneVertices, PlaneIndices, 6, plane, RasterFloat4(0.2f, 0.9f, 0.3f, 0.5f), true);
+    }
+
+    void WriteUInt32(uint8_t* data, uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            data[i] = (uint8_t)(value >> (i * 8));
+        }
+    }
+
+    // A 24 bit BMP with the given header size and dataSize bytes of pixels after it
+    bool LoadTestBMP(int32_t width, int32_t height, size_t dataSize) {
+        std::vector<uint8_t> file(54 + dataSize, 0);
+        file[0] = 'B';
+        file[1] = 'M';
+        WriteUInt32(&file[10], 54);
+        WriteUInt32(&file[18], (uint32_t)width);
+        WriteUInt32(&file[22], (uint32_t)height);
+        file[28] = 24;
+        FILE* out = fopen("header.bmp", "wb");
+        if (!out) {
+            return false;
+        }
+        fwrite(file.data(), 1, file.size(), out);
+        fclose(out);
+
+        std::vector<uint8_t> pixels;
+        int loadedWidth, loadedHeight;
+        bool loaded = LoadBMP("header.bmp", pixels, loadedWidth, loadedHeight);
+        remove("header.bmp");
+        return loaded;
+    }
+
+    bool CheckMalformedBMP() {
+        // 3x2 pixels, rows padded to 12 bytes
+        bool ok = LoadTestBMP(3, 2, 24) && LoadTestBMP(3, -2, 24);
+        ok = ok && !LoadTestBMP(3, 2, 23) && !LoadTestBMP(3, INT_MIN, 24);
+        ok = ok && !LoadTestBMP(BmpMaxDimension + 1, 1, 0) && !LoadTestBMP(1, -(BmpMaxDimension + 1), 0);
+        ok = ok && !LoadTestBMP(BmpMaxDimension, BmpMaxDimension, 1024);
+        printf("malformed headers %s\n", ok ? "rejected" : "accepted");
+        return ok;
+    }
+}
+
+int main(int argc, char** argv) {
+    bool update = argc > 1 && strcmp(argv[1], "--update") == 0;
+    if (!update && !CheckMalformedBMP()) {
+        return 1;
+    }
+    std::string golden = std::string(GOLDEN_DIR) + "/cubes.bmp";
+
+    RasterTexture color, normal;
+    MakeTextures(color, normal);
+    SoftwareRasterizer rasterizer;
+    if (!rasterizer.Init(Width, Height)) {
+        printf("init failed\n");
+        return 1;
+    }
+
+    // Tiles are shaded in parallel, the result must not depend on the order
+    RenderScene(rasterizer, color, normal);
+    std::vector<uint8_t> first, second;
+    rasterizer.ResolveBGRA8(first);
+    RenderScene(rasterizer, color, normal);
+    rasterizer.ResolveBGRA8(second);
+    if (first != second) {
+        printf("two renders of the same scene differ\n");
+        return 1;
+    }
+
+    size_t lit = 0;
+    for (size_t i = 0; i < first.size(); i += 4) {
+        lit += first[i] != 0 || first[i + 1] != 0 || first[i + 2] != 0 ? 1 : 0;
+    }
+    if (lit < first.size() / 4 / 8) {
+        printf("only %d pixels covered\n", (int)lit);
+        return 1;
+    }
+
+    if (!rasterizer.SaveBMP(update ? golden.c_str() : "cubes.bmp")) {
+        printf("failed to write the image\n");
+        return 1;
+    }
+    if (update) {
+        printf("updated %s\n", golden.c_str());
+        return 0;
+    }
+
+    ImageCompareResult result;
+    if (!CompareImages(golden, "cubes.bmp", result)) {
+        printf("failed to compare cubes.bmp with %s\n", golden.c_str());
+        return 1;
+    }
+    printf("%dx%d, %d pixels covered, psnr %.2f ssim %.5f\n", result.width, result.height, (int)lit, result.psnr, result.ssim);
+    return result.psnr >= MinPsnr ? 0 : 1;
+}
@@ -0,0 +1,332 @@
+#include "TextureCache.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Drives the cache with a fake loader through working sets that fit, overflow and shrink,
+// and parses damaged DDS headers; checks accounting, demotion before eviction, LRU order
+// and promotion. Writes per-frame rows and the check results to texture_cache.csv.
+// Then checks mip selection against hand-computed sizes and streams a scene as the camera
+// approaches and backs away: tails first, per-frame byte limit, order by need, stopping at
+// the wanted mip and giving surplus detail back under pressure, into texture_streaming.csv
+namespace {
+    // Hands out fake resources that remember their texture and size, so the test can sum
+    // what is really alive and see the order of evictions
+    class FakeTextureLoader : public ITextureLoader {
+    public:
+        struct Resource {
+            int texture;
+            uint64_t bytes;
+        };
+
+        explicit FakeTextureLoader(const std::vector<DdsInfo>& infos) : infos_(infos) {};
+
+        void* Load(int texture, uint32_t firstMip) override {
+            Resource* resource = new Resource{ texture, GetDdsTextureBytes(infos_[texture], firstMip) };
+            liveBytes_ += resource->bytes;
+            loadedBytes_ += resource->bytes;
+            loaded_.push_back(texture);
+            return resource;
+        }
+
+        void Destroy(void* resource) override {
+            Resource* fake = static_cast<Resource*>(resource);
+            liveBytes_ -= fake->bytes;
+            destroyed_.push_back(fake->texture);
+            delete fake;
+        }
+
+        uint64_t GetLiveBytes() const { return liveBytes_; };
+        // What a real loader reads from the files: only the mips of the level it creates
+        uint64_t GetLoadedBytes() const { return loadedBytes_; };
+        std::vector<int>& GetDestroyed() { return destroyed_; };
+        std::vector<int>& GetLoaded() { return loaded_; };
+    private:
+        const std::vector<DdsInfo>& infos_;
+        uint64_t liveBytes_ = 0;
+        uint64_t loadedBytes_ = 0;
+        std::vector<int> destroyed_;
+        std::vector<int> loaded_;
+    };
+
+    bool RunTextureCacheTest(const std::string& fileName) {
+        std::ofstream file(fileName, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        // 32 BC1 and BC3 textures from 256 to 2048 pixels, described by real headers
+        std::vector<DdsInfo> infos;
+        std::mt19937 random(1);
+        bool headersOk = true;
+        for (int i = 0; i < 32; i++) {
+            uint32_t size = 256u << (random() % 4);
+            DdsInfo info = { size, size, 0, 1, 1, i % 2 == 0 ? (uint32_t)DdsFormatBC1 : (uint32_t)DdsFormatBC3, 0 };
+            for (uint32_t s = size; s > 0; s >>= 1) {
+                info.mipCount++;
+            }
+            std::vector<uint8_t> header;
+            DdsInfo parsed;
+            headersOk = headersOk && BuildDdsHeader(info, header) && ParseDdsHeader(header.data(), header.size(), 0, parsed);
+            infos.push_back(parsed);
+        }
+
+        // Damaged headers have to be rejected
+        std::vector<uint8_t> header;
+        BuildDdsHeader(infos[0], header);
+        const struct {
+            size_t offset;
+            uint32_t value;
+        } damages[] = {
+            { 0, 0 },                 // magic
+            { 4, 100 },               // header size
+            { 4 + 8, 0 },             // height
+            { 4 + 12, 1u << 20 },     // width
+            { 4 + 24, 40 },           // mip count
+            { 4 + 72, 0 },            // pixel format size
+            { 4 + 80, 0x31545844 + 1 } // unknown FourCC
+        };
+        int rejected = 0;
+        for (const auto& damage : damages) {
+            std::vector<uint8_t> damaged = header;
+            memcpy(&damaged[damage.offset], &damage.value, 4);
+            DdsInfo parsed;
+            rejected += ParseDdsHeader(damaged.data(), damaged.size(), 0, parsed) ? 0 : 1;
+        }
+        DdsInfo parsed;
+        bool truncatedRejected = !ParseDdsHeader(header.data(), header.size(), infos[0].dataOffset + GetDdsTextureBytes(infos[0], 0) - 1, parsed);
+
+        uint64_t fullBytes = 0;
+        for (const DdsInfo& info : infos) {
+            fullBytes += GetDdsTextureBytes(info, 0);
+        }
+
+        FakeTextureLoader loader(infos);
+        bool accounting = true, withinBudget = true, demotedFirst = true, lruOrder = true, promoted = true, visibleResident = true;
+        bool settled = true;
+        {
+            // Half of everything at full detail
+            TextureCache cache(loader, fullBytes / 2);
+            for (const DdsInfo& info : infos) {
+                cache.Register(info);
+            }
+            file << "frame,visible,resident,resident_mb,budget_mb,demotions,evictions\n";
+            std::vector<uint64_t> lastUsed(infos.size(), 0);
+            for (int frame = 0; frame < 300; frame++) {
+                cache.BeginFrame();
+
+                // A window sliding over the textures: 8 visible at first, then 24, then 4
+                int count = frame < 100 ? 8 : (frame < 200 ? 24 : 4);
+                int first = frame / 10;
+                uint64_t evictionsBefore = cache.GetStats().evictions;
+                uint64_t loadsBefore = cache.GetStats().loads;
+                std::vector<int>& destroyed = loader.GetDestroyed();
+                destroyed.clear();
+                for (int i = 0; i < count; i++) {
+                    int texture = (first + i) % (int)infos.size();
+                    visibleResident = visibleResident && cache.Request(texture) != nullptr;
+                    lastUsed[texture] = cache.GetFrame();
+                }
+
+                TextureCacheStats stats = cache.GetStats();
+                accounting = accounting && stats.residentBytes == loader.GetLiveBytes();
+                withinBudget = withinBudget && stats.residentBytes <= cache.GetBudget();
+                // No eviction while some other texture could still drop a mip
+                if (stats.evictions > evictionsBefore && stats.demotions == 0) {
+                    demotedFirst = false;
+                }
+                // An evicted texture was not used more recently than any texture still resident and not in use
+                if (stats.evictions > evictionsBefore) {
+                    for (int victim : destroyed) {
+                        if (cache.GetResource(victim) != nullptr) {
+                            continue;
+                        }
+                        for (int other = 0; other < (int)infos.size(); other++) {
+                            if (cache.GetResource(other) != nullptr && lastUsed[other] + 1 < cache.GetFrame() &&
+                                lastUsed[other] < lastUsed[victim]) {
+                                lruOrder = false;
+                            }
+                        }
+                    }
+                }
+                // A few frames after the window moved nothing is reloaded any more
+                if (frame % 10 >= 3 && stats.loads != loadsBefore) {
+                    settled = false;
+                }
+                if (frame % 10 == 0) {
+                    file << frame << ',' << count << ',' << stats.resident << ',' << stats.residentBytes / (1024.0 * 1024.0) << ','
+                        << cache.GetBudget() / (1024.0 * 1024.0) << ',' << stats.demotions << ',' << stats.evictions << '\n';
+                }
+
+                // Once the working set is small again the visible textures are back at full detail
+                if (frame == 299) {
+                    for (int i = 0; i < count; i++) {
+                        promoted = promoted && cache.GetFirstMip((first + i) % (int)infos.size()) == 0;
+                    }
+                }
+            }
+            // A smaller budget applies at the next frame
+            cache.SetBudget(fullBytes / 16);
+            cache.BeginFrame();
+            withinBudget = withinBudget && cache.GetStats().residentBytes <= cache.GetBudget();
+            accounting = accounting && cache.GetStats().residentBytes == loader.GetLiveBytes();
+        }
+        accounting = accounting && loader.GetLiveBytes() == 0;
+
+        bool passed = headersOk && rejected == (int)(sizeof(damages) / sizeof(damages[0])) && truncatedRejected &&
+            accounting && withinBudget && demotedFirst && lruOrder && promoted && visibleResident && settled;
+        file << "checks,headers " << (headersOk ? "ok" : "failed") << ",damaged_rejected " << rejected + (truncatedRejected ? 1 : 0)
+            << ",accounting " << (accounting ? "ok" : "failed") << ",budget " << (withinBudget ? "ok" : "exceeded")
+            << ",demotion_first " << (demotedFirst ? "ok" : "failed") << ",lru " << (lruOrder ? "ok" : "failed")
+            << ",promotion " << (promoted ? "ok" : "failed") << ",visible_resident " << (visibleResident ? "ok" : "failed")
+            << ",settled " << (settled ? "ok" : "failed") << '\n';
+        return file.good() && passed;
+    }
+
+    bool RunTextureStreamingTest(const std::string& fileName) {
+        std::ofstream file(fileName, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        const float Pi = 3.14159265f;
+
+        // A 512 texture over 256 pixels needs mip 1; over 300 pixels mip 1 would be blurry
+        bool selectionOk = SelectRequiredMip(512, 512.0f, 10) == 0 && SelectRequiredMip(512, 256.0f, 10) == 1 &&
+            SelectRequiredMip(512, 300.0f, 10) == 0 && SelectRequiredMip(512, 64.0f, 10) == 3 &&
+            SelectRequiredMip(512, 0.5f, 10) == 9 && SelectRequiredMip(512, 0.0f, 10) == 9 &&
+            SelectRequiredMip(512, 2000.0f, 10) == 0 && SelectRequiredMip(512, 256.0f, 10, 1.0f) == 2;
+        // Something 2 units across at 2 / (2 tan 30) fills a 60 degree view
+        selectionOk = selectionOk && fabsf(GetProjectedSize(2.0f, 1.7320508f, Pi / 3.0f, 1080.0f) - 1080.0f) < 0.5f;
+
+        // 24 BC1 textures of 1024, the first 16 on a row of cubes the camera flies towards
+        std::vector<DdsInfo> infos;
+        for (int i = 0; i < 24; i++) {
+            DdsInfo info = { 1024, 1024, 11, 1, 1, DdsFormatBC1, 0 };
+            infos.push_back(info);
+        }
+        FakeTextureLoader loader(infos);
+        const uint64_t StreamBytes = 512 << 10;
+        bool tailsFirst = true, withinLimit = true, notPastWanted = true, neediestFirst = true, converged = true;
+        bool surplusReturned = true, accounting = true, withinBudget = true;
+        {
+            TextureCache cache(loader, 1ull << 30);
+            cache.SetStreaming(StreamBytes);
+            for (const DdsInfo& info : infos) {
+                cache.Register(info);
+            }
+            file << "frame,camera_distance,pending,resident_mb,streamed_kb\n";
+            std::vector<uint32_t> wanted(infos.size(), 0);
+            auto runFrame = [&](int frame, float cameraDistance, int firstTexture, int count) {
+                cache.BeginFrame();
+                uint64_t loadedBefore = loader.GetLoadedBytes();
+                for (int i = firstTexture; i < firstTexture + count; i++) {
+                    // Cubes 2 units across, one every 4 units behind the first
+                    float distance = cameraDistance + 4.0f * (i % 16);
+                    wanted[i] = SelectRequiredMip(1024, GetProjectedSize(2.0f, distance, Pi / 3.0f, 1080.0f), 11);
+                    bool resident = cache.GetResource(i) != nullptr;
+                    cache.Request(i, wanted[i]);
+                    // A texture seen for the first time comes in at its tail alone
+                    if (!resident) {
+                        tailsFirst = tailsFirst && cache.GetFirstMip(i) == 4;
+                    }
+                }
+                tailsFirst = tailsFirst && (frame > 0 || loader.GetLoadedBytes() - loadedBefore ==
+                    (uint64_t)count * GetDdsTextureBytes(infos[0], 4));
+
+                // The furthest behind goes first
+                std::vector<uint32_t> before(infos.size());
+                uint32_t largestGap = 0;
+                for (int i = firstTexture; i < firstTexture + count; i++) {
+                    before[i] = cache.GetFirstMip(i);
+                    uint32_t target = wanted[i] < 4 ? wanted[i] : 4;
+                    largestGap = before[i] > target && before[i] - target > largestGap ? before[i] - target : largestGap;
+                }
+                loader.GetLoaded().clear();
+                uint64_t streamed = cache.Stream();
+                std::vector<int>& loaded = loader.GetLoaded();
+                if (!loaded.empty()) {
+                    uint32_t target = wanted[loaded[0]] < 4 ? wanted[loaded[0]] : 4;
+                    neediestFirst = neediestFirst && before[loaded[0]] - target == largestGap;
+                }
+                withinLimit = withinLimit && (streamed <= StreamBytes || loaded.size() == 1);
+                for (int i = firstTexture; i < firstTexture + count; i++) {
+                    if (cache.GetFirstMip(i) < before[i]) {
+                        notPastWanted = notPastWanted && cache.GetFirstMip(i) >= wanted[i];
+                    }
+                }
+
+                TextureCacheStats stats = cache.GetStats();
+                accounting = accounting && stats.residentBytes == loader.GetLiveBytes();
+                withinBudget = withinBudget && stats.residentBytes <= cache.GetBudget();
+                if (frame % 5 == 0) {
+                    file << frame << ',' << cameraDistance << ',' << stats.pending << ',' << stats.residentBytes / (1024.0 * 1024.0)
+                        << ',' << streamed / 1024.0 << '\n';
+                }
+            };
+
+            // Approach from far away, then hold still until streaming catches up
+            int frame = 0;
+            for (; frame < 100; frame++) {
+                runFrame(frame, 200.0f - 1.98f * frame, 0, 16);
+            }
+            for (; frame < 140; frame++) {
+                runFrame(frame, 2.0f, 0, 16);
+            }
+            for (int i = 0; i < 16; i++) {
+                converged = converged && cache.GetFirstMip(i) == (wanted[i] < 4 ? wanted[i] : 4);
+            }
+            converged = converged && cache.GetStats().pending == 0;
+
+            // Backing away leaves the row over-detailed; with a budget too small for that and
+            // 8 new cubes up close, the row gives its surplus back and nothing is evicted
+            uint64_t evictionsBefore = cache.GetStats().evictions;
+            uint64_t budget = 8 * GetDdsTextureBytes(infos[0], 0);
+            for (int i = 0; i < 16; i++) {
+                uint32_t mip = SelectRequiredMip(1024, GetProjectedSize(2.0f, 30.0f + 4.0f * i, Pi / 3.0f, 1080.0f), 11);
+                budget += GetDdsTextureBytes(infos[0], mip < 4 ? mip : 4);
+            }
+            cache.SetBudget(budget);
+            for (; frame < 220; frame++) {
+                cache.BeginFrame();
+                for (int i = 0; i < 16; i++) {
+                    wanted[i] = SelectRequiredMip(1024, GetProjectedSize(2.0f, 30.0f + 4.0f * i, Pi / 3.0f, 1080.0f), 11);
+                    cache.Request(i, wanted[i]);
+                }
+                for (int i = 16; i < 24; i++) {
+                    wanted[i] = 0;
+                    cache.Request(i, 0);
+                }
+                cache.Stream();
+                accounting = accounting && cache.GetStats().residentBytes == loader.GetLiveBytes();
+                withinBudget = withinBudget && cache.GetStats().residentBytes <= cache.GetBudget();
+            }
+            for (int i = 0; i < 24; i++) {
+                surplusReturned = surplusReturned && cache.GetFirstMip(i) == (wanted[i] < 4 ? wanted[i] : 4);
+            }
+            surplusReturned = surplusReturned && cache.GetStats().evictions == evictionsBefore;
+        }
+        accounting = accounting && loader.GetLiveBytes() == 0;
+
+        bool passed = selectionOk && tailsFirst && withinLimit && notPastWanted && neediestFirst && converged &&
+            surplusReturned && accounting && withinBudget;
+        file << "checks,selection " << (selectionOk ? "ok" : "failed") << ",tails_first " << (tailsFirst ? "ok" : "failed")
+            << ",frame_limit " << (withinLimit ? "ok" : "exceeded") << ",wanted_mip " << (notPastWanted ? "ok" : "failed")
+            << ",neediest_first " << (neediestFirst ? "ok" : "failed") << ",converged " << (converged ? "ok" : "failed")
+            << ",surplus " << (surplusReturned ? "ok" : "failed") << ",accounting " << (accounting ? "ok" : "failed")
+            << ",budget " << (withinBudget ? "ok" : "exceeded") << '\n';
+        return file.good() && passed;
+    }
+}
+
+int main() {
+    bool cacheOk = RunTextureCacheTest("texture_cache.csv");
+    printf("texture cache checks %s\n", cacheOk ? "passed" : "failed");
+    bool streamingOk = RunTextureStreamingTest("texture_streaming.csv");
+    printf("texture streaming checks %s\n", streamingOk ? "passed" : "failed");
+    return cacheOk && streamingOk ? 0 : 1;
+}
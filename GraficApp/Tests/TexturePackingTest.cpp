@@ -0,0 +1,140 @@
+#include "TexturePacking.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Packs sets of random sized textures, checks that the rects with their gutter lie inside
+// the page and apart, that the remap matches the rects and that the copied blocks and the
+// gutter came from the right source. Writes textures,page,slices,mips,efficiency,pack_ms,
+// blit_ms rows and the check results to texture_packing.csv
+namespace {
+    // Page sized textures take a slice of their own
+    bool IsFullSlice(const TexturePackLayout& layout, const TexturePackRect& rect) {
+        return rect.width == layout.page.width && rect.height == layout.page.height;
+    }
+
+    uint32_t GetFullMipCount(uint32_t width, uint32_t height) {
+        uint32_t count = 1;
+        for (uint32_t size = std::max(width, height); size > 1; size >>= 1) {
+            count++;
+        }
+        return count;
+    }
+
+    bool RunTexturePackingBenchmark(const std::string& fileName) {
+        std::ofstream file(fileName, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        const int iterations = 10;
+        const uint32_t unitBytes = GetDdsBlockBytes(DdsFormatBC1);
+        bool placementOk = true, blocksOk = true, remapOk = true;
+        file << "textures,page,slices,mips,efficiency,pack_ms,blit_ms\n";
+        for (int count = 16; count <= 256; count *= 4) {
+            // BC1 textures from 64 to 1024 pixels in steps of 16, every 16th one of the page size
+            std::mt19937 random(count);
+            std::vector<DdsInfo> sources;
+            for (int i = 0; i < count; i++) {
+                uint32_t width = i % 16 == 0 ? 2048 : 16 * (4 + random() % 61);
+                uint32_t height = i % 16 == 0 ? 2048 : 16 * (4 + random() % 61);
+                sources.push_back({ width, height, GetFullMipCount(width, height), 1, 1, DdsFormatBC1, 0 });
+            }
+            TexturePackSettings settings = { 2048, 2048, 4 };
+
+            TexturePackLayout layout;
+            double packMs = 0.0;
+            for (int iteration = 0; iteration < iterations; iteration++) {
+                auto start = std::chrono::steady_clock::now();
+                placementOk = PackTextures(sources, settings, layout) && placementOk;
+                auto end = std::chrono::steady_clock::now();
+                packMs += std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+            }
+
+            // Rects with their gutter lie inside the page, on the grid and apart from each other
+            uint32_t align = layout.gutter;
+            for (size_t i = 0; i < sources.size(); i++) {
+                const TexturePackRect& a = layout.rects[i];
+                if (IsFullSlice(layout, a)) {
+                    placementOk = placementOk && i % 16 == 0 && a.slice < layout.fullSlices && a.x == 0 && a.y == 0;
+                    continue;
+                }
+                placementOk = placementOk && a.slice >= layout.fullSlices && a.slice < layout.page.arraySize &&
+                    a.x % align == 0 && a.y % align == 0 && a.x >= align && a.y >= align &&
+                    a.x + a.width + align <= layout.page.width && a.y + a.height + align <= layout.page.height;
+                for (size_t j = i + 1; j < sources.size(); j++) {
+                    const TexturePackRect& b = layout.rects[j];
+                    if (b.slice == a.slice && a.x - align < b.x + b.width + align && b.x - align < a.x + a.width + align &&
+                        a.y - align < b.y + b.height + align && b.y - align < a.y + a.height + align) {
+                        placementOk = false;
+                    }
+                }
+                const TextureRemap& remap = layout.remap[i];
+                remapOk = remapOk && remap.slice == a.slice &&
+                    remap.scaleOffset[2] * layout.page.width == a.x && remap.scaleOffset[3] * layout.page.height == a.y &&
+                    (remap.scaleOffset[0] + remap.scaleOffset[2]) * layout.page.width == a.x + a.width;
+            }
+
+            // Sources filled with blocks that tell where they came from
+            std::vector<std::vector<uint8_t>> data(sources.size());
+            for (size_t i = 0; i < sources.size(); i++) {
+                data[i].resize((size_t)GetDdsTextureBytes(sources[i], 0));
+                for (size_t b = 0; b < data[i].size(); b++) {
+                    data[i][b] = (uint8_t)(i * 131 + (b / unitBytes) * 7 + b);
+                }
+            }
+            std::vector<uint8_t> pages((size_t)GetDdsTextureBytes(layout.page, 0));
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < sources.size(); i++) {
+                for (uint32_t mip = 0; mip < layout.page.mipCount; mip++) {
+                    BlitPackedTexture(layout, (int)i, sources[i], mip, data[i].data() + GetDdsMipOffset(sources[i], 0, mip),
+                        pages.data() + GetDdsMipOffset(layout.page, layout.rects[i].slice, mip));
+                }
+            }
+            auto end = std::chrono::steady_clock::now();
+            double blitMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+            // Corner blocks at every mip, and the gutter left of the first one repeats it
+            for (size_t i = 0; i < sources.size(); i++) {
+                const TexturePackRect& rect = layout.rects[i];
+                for (uint32_t mip = 0; mip < layout.page.mipCount; mip++) {
+                    uint32_t blocksX = (GetDdsMipWidth(sources[i], mip) + 3) / 4;
+                    uint32_t blocksY = (GetDdsMipHeight(sources[i], mip) + 3) / 4;
+                    const uint8_t* source = data[i].data() + GetDdsMipOffset(sources[i], 0, mip);
+                    const uint8_t* slice = pages.data() + GetDdsMipOffset(layout.page, rect.slice, mip);
+                    uint32_t x0 = (rect.x >> mip) / 4, y0 = (rect.y >> mip) / 4;
+                    size_t sourcePitch = GetDdsRowPitch(sources[i], mip);
+                    size_t slicePitch = GetDdsRowPitch(layout.page, mip);
+                    for (uint32_t y : { 0u, blocksY - 1 }) {
+                        for (uint32_t x : { 0u, blocksX - 1 }) {
+                            blocksOk = blocksOk && memcmp(source + y * sourcePitch + x * unitBytes,
+                                slice + (y0 + y) * slicePitch + (x0 + x) * unitBytes, unitBytes) == 0;
+                        }
+                    }
+                    if (!IsFullSlice(layout, rect)) {
+                        blocksOk = blocksOk && memcmp(source, slice + (y0 - 1) * slicePitch + (x0 - 1) * unitBytes, unitBytes) == 0;
+                    }
+                }
+            }
+
+            file << count << ',' << layout.page.width << ',' << layout.page.arraySize << ',' << layout.page.mipCount << ','
+                << GetTexturePackEfficiency(layout) << ',' << packMs << ',' << blitMs << '\n';
+        }
+
+        file << "checks,placement " << (placementOk ? "ok" : "failed") << ",remap " << (remapOk ? "ok" : "failed")
+            << ",blocks " << (blocksOk ? "ok" : "failed") << '\n';
+        return file.good() && placementOk && remapOk && blocksOk;
+    }
+}
+
+int main() {
+    bool ok = RunTexturePackingBenchmark("texture_packing.csv");
+    printf("texture packing checks %s\n", ok ? "passed" : "failed");
+    return ok ? 0 : 1;
+}
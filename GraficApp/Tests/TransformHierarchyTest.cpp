@@ -0,0 +1,200 @@
+#include "TransformHierarchy.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+// Checks parenting rules on a small tree, then builds deep (chains of 1000) and wide (1024
+// children per node) trees: the depth-ordered update must give the same world matrices as
+// one pass in insertion order, serial and in parallel, and a partial update must only
+// recompute the dirty subtrees. Times full and partial updates and writes
+// tree,layout,dirty,threads,ms,mnodes_per_s rows to hierarchy_benchmark.csv.
+// Usage: TransformHierarchyTest [<nodes>], 1000000 for the full benchmark
+namespace {
+    const float Identity[16] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+    // A rotation about Y and a translation, enough to keep the multiplies honest
+    void MakeLocal(std::mt19937& random, float local[16]) {
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        float angle = unit(random) * 3.14159265f;
+        float s = sinf(angle), c = cosf(angle);
+        const float matrix[16] = { c, 0.0f, -s, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, s, 0.0f, c, 0.0f, unit(random), unit(random), unit(random), 1.0f };
+        memcpy(local, matrix, sizeof(matrix));
+    }
+
+    // Parents of a tree in depth-first insertion order, the order a scene loader creates them
+    std::vector<int> MakeTree(bool deep, size_t nodeCount) {
+        std::vector<int> parents;
+        parents.reserve(nodeCount);
+        if (deep) {
+            const size_t chainLength = 1000;
+            for (size_t i = 0; i < nodeCount; i++) {
+                parents.push_back(i % chainLength == 0 ? -1 : (int)i - 1);
+            }
+            return parents;
+        }
+
+        // Depth-first: each node gets up to Branching children before the next sibling
+        const size_t branching = 1024;
+        std::vector<std::pair<int, size_t>> stack; // node, children left
+        parents.push_back(-1);
+        stack.push_back({ 0, branching });
+        while (parents.size() < nodeCount && !stack.empty()) {
+            if (stack.back().second == 0) {
+                stack.pop_back();
+                continue;
+            }
+            stack.back().second--;
+            int node = (int)parents.size();
+            parents.push_back(stack.back().first);
+            if (stack.size() < 2) {
+                stack.push_back({ node, branching });
+            }
+        }
+        return parents;
+    }
+
+    // A root, a child added before a second root and a grandchild; moving the root moves its
+    // subtree only
+    bool CheckSmallTree() {
+        TransformHierarchy hierarchy;
+        float offset[16];
+        memcpy(offset, Identity, sizeof(offset));
+        offset[12] = 1.0f;
+        int root = hierarchy.AddNode(-1, offset);
+        int child = hierarchy.AddNode(root, offset);
+        int otherRoot = hierarchy.AddNode(-1, Identity);
+        int grandchild = hierarchy.AddNode(child, offset);
+        bool invalidRejected = hierarchy.AddNode(7, Identity) == -1 && hierarchy.AddNode(-2, Identity) == -1;
+        hierarchy.Update();
+        bool ok = invalidRejected && hierarchy.GetNodeCount() == 4 && hierarchy.GetLevelCount() == 3 &&
+            hierarchy.GetParent(grandchild) == child && hierarchy.GetWorld(grandchild)[12] == 3.0f;
+
+        offset[12] = 5.0f;
+        hierarchy.SetLocal(root, offset);
+        hierarchy.Update();
+        ok = ok && hierarchy.GetUpdatedCount() == 3 && hierarchy.GetWorld(grandchild)[12] == 7.0f &&
+            hierarchy.GetWorld(otherRoot)[12] == 0.0f;
+        printf("small tree %s\n", ok ? "ok" : "failed");
+        return ok;
+    }
+
+    bool RunHierarchyBenchmark(const std::string& fileName, size_t nodeCount) {
+        std::ofstream file(fileName, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        const int iterations = 10;
+        auto measure = [&](const std::function<void()>& prepare, const std::function<void()>& run) {
+            double totalMs = 0.0;
+            for (int i = 0; i < iterations; i++) {
+                prepare();
+                auto start = std::chrono::steady_clock::now();
+                run();
+                totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+            return totalMs / iterations;
+        };
+
+        bool partialOk = true;
+        ThreadPool serialPool(1);
+        unsigned threads = ThreadPool::GetInstance().GetThreadCount();
+        file << "tree,layout,dirty,threads,ms,mnodes_per_s\n";
+        for (int deep = 0; deep < 2; deep++) {
+            const char* tree = deep ? "deep" : "wide";
+            std::vector<int> parents = MakeTree(deep != 0, nodeCount);
+            size_t count = parents.size();
+
+            std::mt19937 random(1);
+            std::vector<float> locals(count * 16);
+            for (size_t i = 0; i < count; i++) {
+                MakeLocal(random, &locals[i * 16]);
+            }
+
+            // Baseline: one pass in insertion order, a child can be far from its parent in memory
+            std::vector<float> world(count * 16);
+            double ms = measure([]() {}, [&]() {
+                for (size_t i = 0; i < count; i++) {
+                    if (parents[i] >= 0) {
+                        MultiplyAffine(&locals[i * 16], &world[(size_t)parents[i] * 16], &world[i * 16]);
+                    }
+                    else {
+                        memcpy(&world[i * 16], &locals[i * 16], 16 * sizeof(float));
+                    }
+                }
+            });
+            file << tree << ",insertion_order,all,1," << ms << ',' << count / (ms * 1000.0) << '\n';
+
+            TransformHierarchy serial(serialPool);
+            TransformHierarchy parallel;
+            for (size_t i = 0; i < count; i++) {
+                serial.AddNode(parents[i], &locals[i * 16]);
+                parallel.AddNode(parents[i], &locals[i * 16]);
+            }
+            serial.Update();
+            parallel.Update();
+
+            bool matches = true;
+            for (size_t i = 0; i < count && matches; i++) {
+                matches = memcmp(serial.GetWorld((int)i), &world[i * 16], 16 * sizeof(float)) == 0;
+            }
+            if (!matches) {
+                printf("%s tree differs from the insertion order pass\n", tree);
+                return false;
+            }
+
+            // Every node dirty, then 1% of the nodes touched, the rest is only visited
+            std::vector<int> touched;
+            for (size_t i = 0; i < count / 100; i++) {
+                touched.push_back((int)(random() % count));
+            }
+            auto dirtyAll = [&](TransformHierarchy& hierarchy) {
+                for (size_t i = 0; i < count; i++) {
+                    hierarchy.SetLocal((int)i, &locals[i * 16]);
+                }
+            };
+            auto dirtySome = [&](TransformHierarchy& hierarchy) {
+                for (int node : touched) {
+                    hierarchy.SetLocal(node, hierarchy.GetLocal(node));
+                }
+            };
+
+            TransformHierarchy* hierarchies[2] = { &serial, &parallel };
+            for (int p = 0; p < 2; p++) {
+                TransformHierarchy& hierarchy = *hierarchies[p];
+                unsigned threadCount = p == 0 ? 1 : threads;
+                ms = measure([&]() { dirtyAll(hierarchy); }, [&]() { hierarchy.Update(); });
+                file << tree << ",depth_order,all," << threadCount << ',' << ms << ',' << count / (ms * 1000.0) << '\n';
+                ms = measure([&]() { dirtySome(hierarchy); }, [&]() { hierarchy.Update(); });
+                file << tree << ",depth_order,1%," << threadCount << ',' << ms << ',' << count / (ms * 1000.0) << '\n';
+                partialOk = partialOk && hierarchy.GetUpdatedCount() > 0 && hierarchy.GetUpdatedCount() < count;
+            }
+            for (size_t i = 0; i < count && matches; i++) {
+                matches = memcmp(serial.GetWorld((int)i), parallel.GetWorld((int)i), 16 * sizeof(float)) == 0 &&
+                    memcmp(serial.GetWorld((int)i), &world[i * 16], 16 * sizeof(float)) == 0;
+            }
+            printf("%s tree: %d nodes in %d levels, %s, partial update %s\n", tree, (int)count, (int)serial.GetLevelCount(),
+                matches ? "serial and parallel match" : "serial and parallel differ", partialOk ? "ok" : "failed");
+            if (!matches || !partialOk) {
+                return false;
+            }
+        }
+
+        return file.good();
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t nodeCount = argc > 1 ? (size_t)atoll(argv[1]) : 100000;
+    bool smallOk = CheckSmallTree();
+    bool benchmarkOk = RunHierarchyBenchmark("hierarchy_benchmark.csv", nodeCount);
+    return smallOk && benchmarkOk ? 0 : 1;
+}
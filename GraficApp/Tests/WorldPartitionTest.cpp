@@ -0,0 +1,170 @@
+#include "WorldPartition.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Streams a synthetic world from disk through a reader that adds latency and limits
+// bandwidth while a camera flies across it; checks the budget, nearest-first loading,
+// eviction and rejection of a damaged cell, writes per-frame rows to world_streaming.csv.
+// The cells are written to and removed from the working directory
+namespace {
+    // Latency per request plus a bandwidth limit, records the order cells were read in and
+    // damages one cell on the way
+    class SlowCellReader : public ICellReader {
+    public:
+        SlowCellReader(const WorldIndex& index, double latencyMs, double bytesPerMs, size_t damagedCell) :
+            reader_(index), latencyMs_(latencyMs), bytesPerMs_(bytesPerMs), damagedCell_(damagedCell) {};
+
+        bool Read(size_t cell, std::vector<uint64_t>& data, size_t& size) override {
+            bool ok = reader_.Read(cell, data, size);
+            double ms = latencyMs_ + size / bytesPerMs_;
+            std::this_thread::sleep_for(std::chrono::microseconds((long long)(ms * 1000.0)));
+            if (ok && cell == damagedCell_) {
+                data[0] ^= 0xFF;
+            }
+            order_.push_back((uint32_t)cell);
+            return ok;
+        }
+
+        // Read by the test only after the streamer is gone
+        const std::vector<uint32_t>& GetOrder() const { return order_; };
+    private:
+        FileCellReader reader_;
+        double latencyMs_;
+        double bytesPerMs_;
+        size_t damagedCell_;
+        std::vector<uint32_t> order_;
+    };
+
+    bool RunWorldStreamingTest(const std::string& fileName, const std::string& directory) {
+        std::ofstream file(fileName, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        // 32 x 32 cells of 16 units with 400 instances each
+        const int gridSize = 32;
+        const float cellSize = 16.0f;
+        const int instancesPerCell = 400;
+        SceneData scene;
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> offset(0.0f, cellSize);
+        std::uniform_real_distribution<float> height(-8.0f, 8.0f);
+        for (int x = 0; x < gridSize; x++) {
+            for (int z = 0; z < gridSize; z++) {
+                for (int i = 0; i < instancesPerCell; i++) {
+                    scene.x.push_back(x * cellSize + offset(random));
+                    scene.y.push_back(height(random));
+                    scene.z.push_back(z * cellSize + offset(random));
+                    scene.speed.push_back((float)(random() % 5));
+                    scene.material.push_back(0);
+                }
+            }
+        }
+        scene.materials.push_back({ 5.0f, 0, 1, 0 });
+
+        std::vector<uint8_t> bytes;
+        SerializeSceneFile(scene, bytes);
+        std::vector<uint64_t> aligned((bytes.size() + 7) / 8);
+        memcpy(aligned.data(), bytes.data(), bytes.size());
+        SceneFile sceneFile;
+        WorldIndex index;
+        if (!sceneFile.Attach(aligned.data(), bytes.size()) || !BuildWorld(sceneFile, cellSize, directory) || !index.Load(directory)) {
+            return false;
+        }
+        const std::vector<WorldCell>& cells = index.GetCells();
+
+        // The camera flies along the diagonal and stops at the far corner. The damaged cell is
+        // next to the path, the budget holds 16 of the ~20 cells the radius touches.
+        const float loadRadius = 40.0f;
+        const float unloadScale = 1.25f;
+        const float start[3] = { 8.0f, 0.0f, 8.0f };
+        const float end[3] = { gridSize * cellSize - 8.0f, 0.0f, gridSize * cellSize - 8.0f };
+        const int flightFrames = 400, settleFrames = 300;
+        size_t damagedCell = 0;
+        for (size_t i = 0; i < cells.size(); i++) {
+            damagedCell = cells[i].x == 10 && cells[i].z == 11 ? i : damagedCell;
+        }
+        uint64_t budget = 16 * cells[0].size;
+
+        SlowCellReader reader(index, 2.0, 100.0 * 1024.0, damagedCell);
+        bool budgetKept = true, nearestFirst = true, settled = true;
+        uint64_t missingNear = 0;
+        CellStreamerStats stats = {};
+        {
+            CellStreamer streamer(index, reader, budget, 4);
+            std::vector<uint32_t> visible;
+            float camera[3] = {};
+            file << "frame,resident_cells,resident_mb,loading_cells,visible_cells,missing_near\n";
+            for (int frame = 0; frame < flightFrames + settleFrames; frame++) {
+                float t = frame < flightFrames ? (float)frame / flightFrames : 1.0f;
+                for (int axis = 0; axis < 3; axis++) {
+                    camera[axis] = start[axis] + (end[axis] - start[axis]) * t;
+                }
+                streamer.Update(camera, loadRadius, unloadScale);
+                streamer.CollectVisible(camera, loadRadius, nullptr, visible);
+
+                stats = streamer.GetStats();
+                budgetKept = budgetKept && stats.residentBytes + stats.loadingBytes <= budget;
+
+                // Cells close to the camera that are still missing, the streamer is behind
+                uint32_t missing = 0;
+                for (uint32_t i = 0; i < (uint32_t)cells.size(); i++) {
+                    float dx = (cells[i].x + 0.5f) * cellSize - camera[0], dz = (cells[i].z + 0.5f) * cellSize - camera[2];
+                    if (i != damagedCell && dx * dx + dz * dz < cellSize * cellSize && streamer.GetCell(i) == nullptr) {
+                        missing++;
+                    }
+                }
+                missingNear += missing;
+                if (frame % 10 == 0) {
+                    file << frame << ',' << stats.residentCells << ',' << stats.residentBytes / (1024.0 * 1024.0) << ','
+                        << stats.loadingCells << ',' << visible.size() << ',' << missing << '\n';
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+
+            // At rest everything near is resident and nothing beyond the unload radius is
+            for (uint32_t i = 0; i < (uint32_t)cells.size(); i++) {
+                float dx = (cells[i].x + 0.5f) * cellSize - camera[0], dz = (cells[i].z + 0.5f) * cellSize - camera[2];
+                float centerDistance = sqrtf(dx * dx + dz * dz);
+                bool resident = streamer.GetCell(i) != nullptr;
+                if ((centerDistance < loadRadius * 0.5f && i != damagedCell && !resident) ||
+                    (resident && centerDistance > loadRadius * unloadScale + cellSize)) {
+                    settled = false;
+                }
+            }
+            settled = settled && streamer.GetCell(damagedCell) == nullptr;
+        }
+
+        // The first read is the cell under the camera
+        const std::vector<uint32_t>& order = reader.GetOrder();
+        nearestFirst = !order.empty() && cells[order[0]].x == 0 && cells[order[0]].z == 0;
+
+        bool passed = budgetKept && nearestFirst && settled && stats.failed == 1 && stats.evictions > 0;
+        file << "summary,loads " << stats.loads << ",evictions " << stats.evictions << ",cancelled " << stats.cancelled
+            << ",failed " << stats.failed << ",missing_near_frames " << missingNear << '\n';
+        file << "checks,budget " << (budgetKept ? "ok" : "exceeded") << ",nearest_first " << (nearestFirst ? "ok" : "failed")
+            << ",settled " << (settled ? "ok" : "failed") << '\n';
+
+        for (size_t i = 0; i < cells.size(); i++) {
+            std::remove(index.GetCellFileName(i).c_str());
+        }
+        std::remove((directory + "/world.index").c_str());
+
+        printf("loads %d, evictions %d, failed %d, budget %s, nearest first %s, settled %s\n", (int)stats.loads,
+            (int)stats.evictions, (int)stats.failed, budgetKept ? "ok" : "exceeded", nearestFirst ? "ok" : "failed",
+            settled ? "ok" : "failed");
+        return file.good() && passed;
+    }
+}
+
+int main() {
+    return RunWorldStreamingTest("world_streaming.csv", ".") ? 0 : 1;
+}